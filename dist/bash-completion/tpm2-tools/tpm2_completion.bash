@@ -3294,6 +3294,33 @@ _tpm2_policycommandcode()
     } &&
     complete -F _tpm2_policycommandcode tpm2_policycommandcode
 # ex: filetype=sh
+# bash completion for tpm2_policycompile                   -*- shell-script -*-
+_tpm2_policycompile()
+    {
+        local hash_methods=(sha1 sha256 sha384 sha512)
+
+        local cur prev words cword split
+        _init_completion -s || return
+        case $prev in
+            -h | --help)
+                COMPREPLY=( $(compgen -W "man no-man" -- "$cur") )
+                return;;
+            -T | --tcti)
+                COMPREPLY=( $(compgen -W "tabrmd mssim device none" -- "$cur") )
+                return;;
+            -g | --policy-algorithm)
+                COMPREPLY=($(compgen -W "${hash_methods[*]}" -- "$cur"))
+                return;;
+        esac
+
+        COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
+        -Z --enable-erata -T --tcti --offline \
+        -g --policy-algorithm " \
+        -- "$cur"))
+        _filedir
+    } &&
+    complete -F _tpm2_policycompile tpm2_policycompile
+# ex: filetype=sh
 # bash completion for tpm2_policycountertimer                   -*- shell-script -*-
 _tpm2_policycountertimer()
     {
@@ -9,6 +9,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <tss2/tss2_mu.h>
 
@@ -520,6 +526,129 @@ bool files_get_file_size_path(const char *path, unsigned long *file_size) {
     return result;
 }
 
+#define FILES_MAP_CHUNK 65536
+
+static bool files_map_read_fd(int fd, const char *path,
+        files_mapping *mapping) {
+
+    size_t cap = 0;
+    size_t len = 0;
+    UINT8 *buf = NULL;
+
+    for (;;) {
+        if (len == cap) {
+            cap += FILES_MAP_CHUNK;
+            UINT8 *tmp = realloc(buf, cap);
+            if (!tmp) {
+                LOG_ERR("oom");
+                free(buf);
+                return false;
+            }
+            buf = tmp;
+        }
+
+        ssize_t rc = read(fd, &buf[len], cap - len);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERR("Could not read file \"%s\" error: %s", path,
+                    strerror(errno));
+            free(buf);
+            return false;
+        }
+        if (rc == 0) {
+            break;
+        }
+        len += rc;
+    }
+
+    mapping->data = buf;
+    mapping->size = len;
+    mapping->is_mmap = false;
+
+    return true;
+}
+
+bool files_mapping_is_truncated(const files_mapping *mapping) {
+
+    if (!mapping || !mapping->is_mmap) {
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(mapping->fd, &sb)) {
+        LOG_ERR("Could not stat mapped file, error: %s", strerror(errno));
+        return true;
+    }
+
+    return (size_t) sb.st_size < mapping->size;
+}
+
+bool files_map_path(const char *path, files_mapping *mapping) {
+
+    BAIL_ON_NULL("path", path);
+    BAIL_ON_NULL("mapping", mapping);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG_ERR("Could not open file \"%s\" error: %s", path,
+                strerror(errno));
+        return false;
+    }
+
+    /*
+     * securityfs and other pseudo files report a size of 0 and can't be
+     * mapped, so only map regular files with content and read anything else.
+     */
+    bool result;
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        void *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            LOG_INFO("Could not mmap file \"%s\", reading it: %s", path,
+                    strerror(errno));
+        } else {
+            /*
+             * a file shrinking before it was mapped is read as it is now,
+             * the descriptor is kept to check the size again after use
+             */
+            struct stat now;
+            if (fstat(fd, &now) == 0 && now.st_size >= sb.st_size) {
+                mapping->data = data;
+                mapping->size = sb.st_size;
+                mapping->is_mmap = true;
+                mapping->fd = fd;
+                return true;
+            }
+            munmap(data, sb.st_size);
+        }
+    }
+
+    result = files_map_read_fd(fd, path, mapping);
+    close(fd);
+
+    return result;
+}
+
+void files_unmap_path(files_mapping *mapping) {
+
+    if (!mapping || !mapping->data) {
+        return;
+    }
+
+    if (mapping->is_mmap) {
+        munmap(mapping->data, mapping->size);
+        close(mapping->fd);
+    } else {
+        free(mapping->data);
+    }
+
+    mapping->data = NULL;
+    mapping->size = 0;
+    mapping->is_mmap = false;
+}
+
 #define BE_CONVERT(value, size) \
     do { \
         if (!tpm2_util_is_big_endian()) { \
@@ -571,6 +700,85 @@ bool files_write_bytes(FILE *out, uint8_t bytes[], size_t len) {
     return writex(out, bytes, len);
 }
 
+bool files_write_blob(FILE *out, const void *data, UINT32 len) {
+
+    bool result = files_write_32(out, len);
+    if (!result || !len) {
+        return result;
+    }
+
+    return files_write_bytes(out, (UINT8 *) data, len);
+}
+
+bool files_read_blob(FILE *in, UINT32 max, UINT8 **data, UINT32 *len) {
+
+    bool result = files_read_32(in, len);
+    if (!result) {
+        return false;
+    }
+
+    if (*len > max) {
+        LOG_ERR("Message of %"PRIu32" bytes exceeds limit of %"PRIu32,
+                *len, max);
+        return false;
+    }
+
+    /* always NUL terminate so strings can be used in place */
+    *data = malloc(*len + 1);
+    if (!*data) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    result = *len ? files_read_bytes(in, *data, *len) : true;
+    if (!result) {
+        free(*data);
+        *data = NULL;
+        return false;
+    }
+
+    (*data)[*len] = '\0';
+
+    return true;
+}
+
+bool files_unix_addr(const char *path, struct sockaddr_un *addr) {
+
+    BAIL_ON_NULL("path", path);
+    BAIL_ON_NULL("addr", addr);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        LOG_ERR("Socket path \"%s\" is too long", path);
+        return false;
+    }
+
+    strcpy(addr->sun_path, path);
+
+    return true;
+}
+
+bool files_unix_peer_is_self(int fd) {
+
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)) {
+        LOG_ERR("Could not get the peer credentials, error: %s",
+                strerror(errno));
+        return false;
+    }
+
+    if (cred.uid != geteuid()) {
+        LOG_ERR("Rejecting connection from uid %u, serving uid %u only",
+                (unsigned) cred.uid, (unsigned) geteuid());
+        return false;
+    }
+
+    return true;
+}
+
 bool files_write_header(FILE *out, UINT32 version) {
 
     BAIL_ON_NULL("FILE", out);
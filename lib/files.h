@@ -6,6 +6,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <sys/un.h>
+
 #include <tss2/tss2_esys.h>
 
 #include "tool_rc.h"
@@ -479,6 +481,50 @@ bool files_get_file_size_path(const char *path, unsigned long *file_size);
  */
 bool files_get_file_size(FILE *fp, unsigned long *file_size, const char *path);
 
+typedef struct files_mapping files_mapping;
+struct files_mapping {
+    UINT8 *data;
+    size_t size;
+    bool is_mmap;
+    /* the mapped file, only valid when is_mmap is set */
+    int fd;
+};
+
+/**
+ * Loads a whole file read only into memory. Regular files are mapped with
+ * mmap(2) so no copy of the data is made. Files that can't be sized or
+ * mapped, like the securityfs event log, are read in chunks instead. Check
+ * files_mapping_is_truncated() once done with the data. No SIGBUS handler
+ * is installed: a file truncated by whole pages while it is mapped still
+ * raises SIGBUS on an access to those pages and terminates the process.
+ * @param path
+ *  The path of the file to load.
+ * @param mapping
+ *  The loaded data and its size, valid only on a true return. Release it
+ *  with files_unmap_path().
+ * @return
+ *  True on success, False otherwise.
+ */
+bool files_map_path(const char *path, files_mapping *mapping);
+
+/**
+ * Tells whether a mapped file was truncated by another process since it was
+ * mapped, by comparing its current size with the mapped size. The data past
+ * the new end of the file reads as zeros then and must not be trusted.
+ * @param mapping
+ *  A mapping returned by files_map_path().
+ * @return
+ *  True if the file was truncated, False otherwise.
+ */
+bool files_mapping_is_truncated(const files_mapping *mapping);
+
+/**
+ * Releases a mapping returned by files_map_path().
+ * @param mapping
+ *  The mapping to release, it is reset to empty.
+ */
+void files_unmap_path(files_mapping *mapping);
+
 /**
  * Writes a TPM2.0 header to a file.
  * @param f
@@ -571,6 +617,58 @@ bool files_read_64(FILE *out, UINT64 *data);
  */
 bool files_read_bytes(FILE *out, UINT8 data[], size_t size);
 
+/**
+ * Writes a blob prefixed with its 32 bit big endian length, as used by the
+ * socket protocols of the tools.
+ * @param out
+ *  The file to write to.
+ * @param data
+ *  The data to write, may be NULL when len is 0.
+ * @param len
+ *  The length of the data.
+ * @return
+ *  True on success, False otherwise.
+ */
+bool files_write_blob(FILE *out, const void *data, UINT32 len);
+
+/**
+ * Reads a blob written by files_write_blob().
+ * @param in
+ *  The file to read from.
+ * @param max
+ *  The largest length accepted.
+ * @param data
+ *  The blob, NULL terminated so strings can be used in place. Only valid
+ *  on a True return, the caller frees it.
+ * @param len
+ *  The length of the blob without the NULL terminator.
+ * @return
+ *  True on success, False otherwise.
+ */
+bool files_read_blob(FILE *in, UINT32 max, UINT8 **data, UINT32 *len);
+
+/**
+ * Fills in the address of a Unix socket, as used by the socket protocols of
+ * the tools.
+ * @param path
+ *  The path of the socket.
+ * @param addr
+ *  The address to fill in.
+ * @return
+ *  True on success, False if the path doesn't fit.
+ */
+bool files_unix_addr(const char *path, struct sockaddr_un *addr);
+
+/**
+ * Tells whether the peer of a connected Unix socket runs as the effective
+ * uid of this process, so services only serve their own user.
+ * @param fd
+ *  The connected socket.
+ * @return
+ *  True if the peer is the same user, False otherwise.
+ */
+bool files_unix_peer_is_self(int fd);
+
 /**
  * Converts a TPM2B_ATTEST to a TPMS_ATTEST using libmu.
  * @param quoted
@@ -39,6 +39,15 @@ void _log(log_level level, const char *file, unsigned lineno, const char *fmt,
     if (level > current_log_level)
         return;
 
+    /*
+     * stdout is buffered, write out what the tool printed so far so that
+     * errors and warnings show up after it and nothing is lost if the tool
+     * bails out.
+     */
+    if (level <= log_level_warning) {
+        fflush(stdout);
+    }
+
     va_list argptr;
     va_start(argptr, fmt);
 
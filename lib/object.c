@@ -6,6 +6,7 @@
 #include "object.h"
 #include "tool_rc.h"
 #include "tpm2_auth_util.h"
+#include "tpm2_tr_cache.h"
 
 #define NULL_OBJECT "null"
 #define NULL_OBJECT_LEN (sizeof(NULL_OBJECT) - 1)
@@ -55,6 +56,10 @@ static tool_rc tpm2_util_object_load2(ESYS_CONTEXT *ctx, const char *objectstr,
     if (result) {
         outobject->handle = handle;
         outobject->path = NULL;
+        if (handle >> TPM2_HR_SHIFT == TPM2_HT_PERSISTENT) {
+            return tpm2_tr_cache_from_tpm_public(ctx, handle,
+                    &outobject->tr_handle);
+        }
         return tpm2_util_sys_handle_to_esys_handle(ctx, outobject->handle,
                 &outobject->tr_handle);
     }
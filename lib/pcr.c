@@ -9,6 +9,7 @@
 #include "log.h"
 #include "pcr.h"
 #include "tpm2.h"
+#include "tpm2_capability_cache.h"
 #include "tpm2_systemdeps.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
@@ -366,17 +367,14 @@ bool pcr_parse_selections(const char *arg, TPML_PCR_SELECTION *pcr_select) {
 tool_rc pcr_get_banks(ESYS_CONTEXT *esys_context,
         TPMS_CAPABILITY_DATA *capability_data, tpm2_algorithm *algs) {
 
-    TPMI_YES_NO more_data;
-    TPMS_CAPABILITY_DATA *capdata_ret;
-
-    tool_rc rc = tpm2_get_capability(esys_context, ESYS_TR_NONE, ESYS_TR_NONE,
-            ESYS_TR_NONE, TPM2_CAP_PCRS, no_argument, required_argument,
-            &more_data, &capdata_ret);
+    const TPML_PCR_SELECTION *pcrs;
+    tool_rc rc = tpm2_capability_cache_get_pcrs(esys_context, &pcrs);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    *capability_data = *capdata_ret;
+    capability_data->capability = TPM2_CAP_PCRS;
+    capability_data->data.assignedPCR = *pcrs;
 
     unsigned i;
 
@@ -386,7 +384,6 @@ tool_rc pcr_get_banks(ESYS_CONTEXT *esys_context,
         LOG_ERR("Current implementation does not support more than %zu banks, "
                 "got %" PRIu32 " banks supported by TPM",
                 sizeof(algs->alg), capability_data->data.assignedPCR.count);
-        free(capdata_ret);
         return tool_rc_general_error;
     }
 
@@ -395,7 +392,6 @@ tool_rc pcr_get_banks(ESYS_CONTEXT *esys_context,
     }
     algs->count = capability_data->data.assignedPCR.count;
 
-    free(capdata_ret);
     return tool_rc_success;
 }
 
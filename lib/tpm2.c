@@ -202,6 +202,30 @@ tpm2_nvread_skip_esapi_call:
     return rc;
 }
 
+tool_rc tpm2_nv_read_tr(ESYS_CONTEXT *esys_context,
+    tpm2_loaded_object *auth_hierarchy_obj, ESYS_TR nv_index, UINT16 size,
+    UINT16 offset, TPM2B_MAX_NV_BUFFER **data) {
+
+    ESYS_TR auth_hierarchy_obj_session_handle = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+            auth_hierarchy_obj->tr_handle, auth_hierarchy_obj->session,
+            &auth_hierarchy_obj_session_handle);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to get shandle");
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_NV_Read(esys_context, auth_hierarchy_obj->tr_handle,
+        nv_index, auth_hierarchy_obj_session_handle, ESYS_TR_NONE,
+        ESYS_TR_NONE, size, offset, data);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_NV_Read, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_context_save(ESYS_CONTEXT *esys_context, ESYS_TR save_handle,
         TPMS_CONTEXT **context) {
 
@@ -2283,6 +2307,48 @@ tpm2_encryptdecrypt_skip_esapi_call:
     return rc;
 }
 
+tool_rc tpm2_encryptdecrypt_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data) {
+
+    ESYS_TR shandle1 = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+    encryption_key_obj->tr_handle, encryption_key_obj->session, &shandle1);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to get shandle");
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_EncryptDecrypt2_Async(esys_context,
+            encryption_key_obj->tr_handle, shandle1, ESYS_TR_NONE, ESYS_TR_NONE,
+            input_data, decrypt, mode, iv_in);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Esys_EncryptDecrypt2_Async, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_encryptdecrypt_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_MAX_BUFFER **output_data, TPM2B_IV **iv_out) {
+
+    TSS2_RC rval = Esys_EncryptDecrypt2_Finish(esys_context, output_data,
+            iv_out);
+    if (tpm2_error_get(rval) == TPM2_RC_COMMAND_CODE) {
+        /* Let the caller fall back to EncryptDecrypt */
+        return tool_rc_unsupported;
+    }
+
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Esys_EncryptDecrypt2_Finish, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_hierarchycontrol(ESYS_CONTEXT *esys_context,
         tpm2_loaded_object *auth_hierarchy, TPMI_RH_ENABLES enable,
         TPMI_YES_NO state, TPM2B_DIGEST *cp_hash) {
@@ -4082,6 +4148,26 @@ tool_rc tpm2_pcr_event(ESYS_CONTEXT *ectx,
     return tool_rc_success;
 }
 
+tool_rc tpm2_pcr_extend(ESYS_CONTEXT *ectx, ESYS_TR pcr,
+        tpm2_session *session, const TPML_DIGEST_VALUES *digests) {
+
+    ESYS_TR shandle1 = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(ectx, pcr, session,
+            &shandle1);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_PCR_Extend(ectx, pcr, shandle1, ESYS_TR_NONE,
+            ESYS_TR_NONE, digests);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_PCR_Extend, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_getrandom(ESYS_CONTEXT *ectx, UINT16 count,
         TPM2B_DIGEST **random, TPM2B_DIGEST *cp_hash, TPM2B_DIGEST *rp_hash,
         ESYS_TR session_handle_1, ESYS_TR session_handle_2,
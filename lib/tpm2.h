@@ -35,6 +35,14 @@ tool_rc tpm2_nv_read(ESYS_CONTEXT *esys_context,
     tpm2_loaded_object *auth_hierarchy_obj, TPM2_HANDLE nv_index, UINT16 size,
     UINT16 offset, TPM2B_MAX_NV_BUFFER **data, TPM2B_DIGEST *cp_hash);
 
+/*
+ * Like tpm2_nv_read() for an index already loaded as an ESYS_TR, so reading
+ * an index in several chunks doesn't look it up again for each of them.
+ */
+tool_rc tpm2_nv_read_tr(ESYS_CONTEXT *esys_context,
+    tpm2_loaded_object *auth_hierarchy_obj, ESYS_TR nv_index, UINT16 size,
+    UINT16 offset, TPM2B_MAX_NV_BUFFER **data);
+
 tool_rc tpm2_context_save(ESYS_CONTEXT *esys_context, ESYS_TR save_handle,
         TPMS_CONTEXT **context);
 
@@ -271,6 +279,24 @@ tool_rc tpm2_encryptdecrypt(ESYS_CONTEXT *esys_context,
         const TPM2B_MAX_BUFFER *input_data, TPM2B_MAX_BUFFER **output_data,
         TPM2B_IV **iv_out, TPM2B_DIGEST *cp_hash);
 
+/*
+ * Submits EncryptDecrypt2 without waiting for the TPM, so the caller can do
+ * other work until it collects the result with tpm2_encryptdecrypt_finish().
+ * Only one command can be outstanding on an ESYS context at a time.
+ */
+tool_rc tpm2_encryptdecrypt_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data);
+
+/*
+ * Returns tool_rc_unsupported without logging an error when the TPM does not
+ * implement EncryptDecrypt2, the caller can then fall back to
+ * tpm2_encryptdecrypt().
+ */
+tool_rc tpm2_encryptdecrypt_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_MAX_BUFFER **output_data, TPM2B_IV **iv_out);
+
 tool_rc tpm2_hierarchycontrol(ESYS_CONTEXT *esys_context,
         tpm2_loaded_object *auth_hierarchy, TPMI_RH_ENABLES enable,
         TPMI_YES_NO state, TPM2B_DIGEST *cp_hash);
@@ -394,6 +420,9 @@ tool_rc tpm2_loadexternal(ESYS_CONTEXT *ectx, const TPM2B_SENSITIVE *private,
 tool_rc tpm2_pcr_event(ESYS_CONTEXT *ectx, ESYS_TR pcr, tpm2_session *session,
         const TPM2B_EVENT *event_data, TPML_DIGEST_VALUES **digests);
 
+tool_rc tpm2_pcr_extend(ESYS_CONTEXT *ectx, ESYS_TR pcr, tpm2_session *session,
+        const TPML_DIGEST_VALUES *digests);
+
 tool_rc tpm2_getrandom(ESYS_CONTEXT *ectx, UINT16 count,
         TPM2B_DIGEST **random, TPM2B_DIGEST *cp_hash, TPM2B_DIGEST *rp_hash,
         ESYS_TR session_handle_1, ESYS_TR session_handle_2,
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,14 +19,6 @@ struct alg_pair {
     const char *name;
     TPM2_ALG_ID id;
     tpm2_alg_util_flags flags;
-    tpm2_alg_util_flags _flags;
-};
-
-typedef enum alg_iter_res alg_iter_res;
-enum alg_iter_res {
-    stop,
-    go,
-    found
 };
 
 typedef enum alg_parser_rc alg_parser_rc;
@@ -35,86 +28,113 @@ enum alg_parser_rc {
     alg_parser_rc_done
 };
 
-typedef alg_iter_res (*alg_iter)(TPM2_ALG_ID id, const char *name,
-        tpm2_alg_util_flags flags, void *userdata);
-
-static void tpm2_alg_util_for_each_alg(alg_iter iterator, void *userdata) {
-
-    static const alg_pair algs[] = {
-
-        // Assymetric
-        { .name = "rsa", .id = TPM2_ALG_RSA, .flags = tpm2_alg_util_flags_asymmetric|tpm2_alg_util_flags_base },
-        { .name = "ecc", .id = TPM2_ALG_ECC, .flags = tpm2_alg_util_flags_asymmetric|tpm2_alg_util_flags_base },
-
-        // Symmetric
-        { .name = "tdes", .id = TPM2_ALG_TDES, .flags = tpm2_alg_util_flags_symmetric },
-        { .name = "aes", .id = TPM2_ALG_AES, .flags = tpm2_alg_util_flags_symmetric },
-        { .name = "camellia", .id = TPM2_ALG_CAMELLIA, .flags = tpm2_alg_util_flags_symmetric },
-
-        // Hash
-        { .name = "sha1", .id = TPM2_ALG_SHA1, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha256", .id = TPM2_ALG_SHA256, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha384", .id = TPM2_ALG_SHA384, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha512", .id = TPM2_ALG_SHA512, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sm3_256", .id = TPM2_ALG_SM3_256, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha3_256", .id = TPM2_ALG_SHA3_256, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha3_384", .id = TPM2_ALG_SHA3_384, .flags = tpm2_alg_util_flags_hash },
-        { .name = "sha3_512", .id = TPM2_ALG_SHA3_512, .flags = tpm2_alg_util_flags_hash },
-
-        // Keyed hash
-        { .name = "hmac", .id = TPM2_ALG_HMAC, tpm2_alg_util_flags_keyedhash | tpm2_alg_util_flags_sig },
-        { .name = "xor", .id = TPM2_ALG_XOR, tpm2_alg_util_flags_keyedhash },
-        { .name = "cmac", .id = TPM2_ALG_CMAC, .flags = tpm2_alg_util_flags_sig },
-
-        // Mask Generation Functions
-        { .name = "mgf1", .id = TPM2_ALG_MGF1, .flags = tpm2_alg_util_flags_mgf },
-
-        // Signature Schemes
-        { .name = "rsassa", .id = TPM2_ALG_RSASSA, .flags = tpm2_alg_util_flags_sig },
-        { .name = "rsapss", .id = TPM2_ALG_RSAPSS, .flags = tpm2_alg_util_flags_sig },
-        { .name = "ecdsa", .id = TPM2_ALG_ECDSA, .flags = tpm2_alg_util_flags_sig },
-        { .name = "ecdaa", .id = TPM2_ALG_ECDAA, .flags = tpm2_alg_util_flags_sig },
-        { .name = "ecschnorr", .id = TPM2_ALG_ECSCHNORR, .flags = tpm2_alg_util_flags_sig },
-
-        // Assyemtric Encryption Scheme
-        { .name = "oaep", .id = TPM2_ALG_OAEP, .flags = tpm2_alg_util_flags_enc_scheme | tpm2_alg_util_flags_rsa_scheme },
-        { .name = "rsaes", .id = TPM2_ALG_RSAES, .flags = tpm2_alg_util_flags_enc_scheme | tpm2_alg_util_flags_rsa_scheme },
-        { .name = "ecdh", .id = TPM2_ALG_ECDH, .flags = tpm2_alg_util_flags_enc_scheme },
-
-
-        // XXX are these sigs?
-        { .name = "sm2", .id = TPM2_ALG_SM2, .flags = tpm2_alg_util_flags_sig },
-        { .name = "sm4", .id = TPM2_ALG_SM4, .flags = tpm2_alg_util_flags_sig },
-
-        // Key derivation functions
-        { .name = "kdf1_sp800_56a", .id = TPM2_ALG_KDF1_SP800_56A, .flags = tpm2_alg_util_flags_kdf },
-        { .name = "kdf2", .id = TPM2_ALG_KDF2, .flags = tpm2_alg_util_flags_kdf },
-        { .name = "kdf1_sp800_108", .id = TPM2_ALG_KDF1_SP800_108, .flags = tpm2_alg_util_flags_kdf },
-        { .name = "ecmqv", .id = TPM2_ALG_ECMQV, .flags = tpm2_alg_util_flags_kdf },
-
-        // Modes
-        { .name = "ctr", .id = TPM2_ALG_CTR, .flags = tpm2_alg_util_flags_mode },
-        { .name = "ofb", .id = TPM2_ALG_OFB, .flags = tpm2_alg_util_flags_mode },
-        { .name = "cbc", .id = TPM2_ALG_CBC, .flags = tpm2_alg_util_flags_mode },
-        { .name = "cfb", .id = TPM2_ALG_CFB, .flags = tpm2_alg_util_flags_mode },
-        { .name = "ecb", .id = TPM2_ALG_ECB, .flags = tpm2_alg_util_flags_mode },
-
-        { .name = "symcipher", .id = TPM2_ALG_SYMCIPHER, .flags = tpm2_alg_util_flags_base },
-        { .name = "keyedhash", .id = TPM2_ALG_KEYEDHASH, .flags = tpm2_alg_util_flags_base },
-
-        // Misc
-        { .name = "null", .id = TPM2_ALG_NULL, .flags = tpm2_alg_util_flags_misc | tpm2_alg_util_flags_rsa_scheme },
-    };
-
-    size_t i;
-    for (i = 0; i < ARRAY_LEN(algs); i++) {
-        const alg_pair *alg = &algs[i];
-        alg_iter_res result = iterator(alg->id, alg->name, alg->flags,
-                userdata);
-        if (result != go) {
-            return;
-        }
-    }
+static const alg_pair algs[] = {
+
+    // Assymetric
+    { .name = "rsa", .id = TPM2_ALG_RSA, .flags = tpm2_alg_util_flags_asymmetric|tpm2_alg_util_flags_base },
+    { .name = "ecc", .id = TPM2_ALG_ECC, .flags = tpm2_alg_util_flags_asymmetric|tpm2_alg_util_flags_base },
+
+    // Symmetric
+    { .name = "tdes", .id = TPM2_ALG_TDES, .flags = tpm2_alg_util_flags_symmetric },
+    { .name = "aes", .id = TPM2_ALG_AES, .flags = tpm2_alg_util_flags_symmetric },
+    { .name = "camellia", .id = TPM2_ALG_CAMELLIA, .flags = tpm2_alg_util_flags_symmetric },
+
+    // Hash
+    { .name = "sha1", .id = TPM2_ALG_SHA1, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha256", .id = TPM2_ALG_SHA256, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha384", .id = TPM2_ALG_SHA384, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha512", .id = TPM2_ALG_SHA512, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sm3_256", .id = TPM2_ALG_SM3_256, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha3_256", .id = TPM2_ALG_SHA3_256, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha3_384", .id = TPM2_ALG_SHA3_384, .flags = tpm2_alg_util_flags_hash },
+    { .name = "sha3_512", .id = TPM2_ALG_SHA3_512, .flags = tpm2_alg_util_flags_hash },
+
+    // Keyed hash
+    { .name = "hmac", .id = TPM2_ALG_HMAC, tpm2_alg_util_flags_keyedhash | tpm2_alg_util_flags_sig },
+    { .name = "xor", .id = TPM2_ALG_XOR, tpm2_alg_util_flags_keyedhash },
+    { .name = "cmac", .id = TPM2_ALG_CMAC, .flags = tpm2_alg_util_flags_sig },
+
+    // Mask Generation Functions
+    { .name = "mgf1", .id = TPM2_ALG_MGF1, .flags = tpm2_alg_util_flags_mgf },
+
+    // Signature Schemes
+    { .name = "rsassa", .id = TPM2_ALG_RSASSA, .flags = tpm2_alg_util_flags_sig },
+    { .name = "rsapss", .id = TPM2_ALG_RSAPSS, .flags = tpm2_alg_util_flags_sig },
+    { .name = "ecdsa", .id = TPM2_ALG_ECDSA, .flags = tpm2_alg_util_flags_sig },
+    { .name = "ecdaa", .id = TPM2_ALG_ECDAA, .flags = tpm2_alg_util_flags_sig },
+    { .name = "ecschnorr", .id = TPM2_ALG_ECSCHNORR, .flags = tpm2_alg_util_flags_sig },
+
+    // Assyemtric Encryption Scheme
+    { .name = "oaep", .id = TPM2_ALG_OAEP, .flags = tpm2_alg_util_flags_enc_scheme | tpm2_alg_util_flags_rsa_scheme },
+    { .name = "rsaes", .id = TPM2_ALG_RSAES, .flags = tpm2_alg_util_flags_enc_scheme | tpm2_alg_util_flags_rsa_scheme },
+    { .name = "ecdh", .id = TPM2_ALG_ECDH, .flags = tpm2_alg_util_flags_enc_scheme },
+
+
+    // XXX are these sigs?
+    { .name = "sm2", .id = TPM2_ALG_SM2, .flags = tpm2_alg_util_flags_sig },
+    { .name = "sm4", .id = TPM2_ALG_SM4, .flags = tpm2_alg_util_flags_sig },
+
+    // Key derivation functions
+    { .name = "kdf1_sp800_56a", .id = TPM2_ALG_KDF1_SP800_56A, .flags = tpm2_alg_util_flags_kdf },
+    { .name = "kdf2", .id = TPM2_ALG_KDF2, .flags = tpm2_alg_util_flags_kdf },
+    { .name = "kdf1_sp800_108", .id = TPM2_ALG_KDF1_SP800_108, .flags = tpm2_alg_util_flags_kdf },
+    { .name = "ecmqv", .id = TPM2_ALG_ECMQV, .flags = tpm2_alg_util_flags_kdf },
+
+    // Modes
+    { .name = "ctr", .id = TPM2_ALG_CTR, .flags = tpm2_alg_util_flags_mode },
+    { .name = "ofb", .id = TPM2_ALG_OFB, .flags = tpm2_alg_util_flags_mode },
+    { .name = "cbc", .id = TPM2_ALG_CBC, .flags = tpm2_alg_util_flags_mode },
+    { .name = "cfb", .id = TPM2_ALG_CFB, .flags = tpm2_alg_util_flags_mode },
+    { .name = "ecb", .id = TPM2_ALG_ECB, .flags = tpm2_alg_util_flags_mode },
+
+    { .name = "symcipher", .id = TPM2_ALG_SYMCIPHER, .flags = tpm2_alg_util_flags_base },
+    { .name = "keyedhash", .id = TPM2_ALG_KEYEDHASH, .flags = tpm2_alg_util_flags_base },
+
+    // Misc
+    { .name = "null", .id = TPM2_ALG_NULL, .flags = tpm2_alg_util_flags_misc | tpm2_alg_util_flags_rsa_scheme },
+};
+
+/* the algorithms sorted by name and by id, see build_indexes() */
+static const void *algs_by_name[ARRAY_LEN(algs)];
+static const void *algs_by_id[ARRAY_LEN(algs)];
+
+static int alg_name_cmp(const void *key, const void *entry) {
+
+    return strcmp(((const alg_pair *) key)->name,
+            ((const alg_pair *) entry)->name);
+}
+
+static int alg_id_cmp(const void *key, const void *entry) {
+
+    TPM2_ALG_ID a = ((const alg_pair *) key)->id;
+    TPM2_ALG_ID b = ((const alg_pair *) entry)->id;
+
+    return a < b ? -1 : a > b;
+}
+
+static void indexes_build(void) {
+
+    tpm2_util_index_build(algs, ARRAY_LEN(algs), sizeof(algs[0]),
+            algs_by_name, alg_name_cmp);
+    tpm2_util_index_build(algs, ARRAY_LEN(algs), sizeof(algs[0]),
+            algs_by_id, alg_id_cmp);
+}
+
+/* the lookups run on worker threads too, so the indexes are built once */
+static void build_indexes(void) {
+
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, indexes_build);
+}
+
+static const alg_pair *find_by_id(TPM2_ALG_ID id) {
+
+    build_indexes();
+
+    alg_pair key = { .id = id };
+
+    return tpm2_util_index_find(&key, algs_by_id, ARRAY_LEN(algs_by_id),
+            alg_id_cmp);
 }
 
 static alg_parser_rc handle_sym_common(const char *ext, TPMT_SYM_DEF_OBJECT *s) {
@@ -595,62 +615,33 @@ bool tpm2_alg_util_handle_ext_alg(const char *alg_spec, TPM2B_PUBLIC *public) {
     return false;
 }
 
-static alg_iter_res find_match(TPM2_ALG_ID id, const char *name,
-        tpm2_alg_util_flags flags, void *userdata) {
-
-    alg_pair *search_data = (alg_pair *) userdata;
+TPM2_ALG_ID tpm2_alg_util_strtoalg(const char *name, tpm2_alg_util_flags flags) {
 
-    /*
-     * if name, then search on name, else
-     * search by id.
-     */
-    if (search_data->name && !strcmp(search_data->name, name)) {
-        alg_iter_res res = search_data->flags & flags ? found : stop;
-        if (res == found) {
-            search_data->id = id;
-            search_data->_flags = flags;
-        }
-        return res;
-    } else if (search_data->id == id) {
-        alg_iter_res res = search_data->flags & flags ? found : stop;
-        if (res == found) {
-            search_data->name = name;
-            search_data->_flags = flags;
-        }
-        return res;
+    if (!name) {
+        return TPM2_ALG_ERROR;
     }
 
-    return go;
-}
-
-TPM2_ALG_ID tpm2_alg_util_strtoalg(const char *name, tpm2_alg_util_flags flags) {
+    build_indexes();
 
-    alg_pair userdata = { .name = name, .id = TPM2_ALG_ERROR, .flags = flags };
+    alg_pair key = { .name = name };
+    const alg_pair *alg = tpm2_util_index_find(&key, algs_by_name,
+            ARRAY_LEN(algs_by_name), alg_name_cmp);
 
-    if (name) {
-        tpm2_alg_util_for_each_alg(find_match, &userdata);
-    }
-
-    return userdata.id;
+    return alg && (alg->flags & flags) ? alg->id : TPM2_ALG_ERROR;
 }
 
 const char *tpm2_alg_util_algtostr(TPM2_ALG_ID id, tpm2_alg_util_flags flags) {
 
-    alg_pair userdata = { .name = NULL, .id = id, .flags = flags };
+    const alg_pair *alg = find_by_id(id);
 
-    tpm2_alg_util_for_each_alg(find_match, &userdata);
-
-    return userdata.name;
+    return alg && (alg->flags & flags) ? alg->name : NULL;
 }
 
 tpm2_alg_util_flags tpm2_alg_util_algtoflags(TPM2_ALG_ID id) {
 
-    alg_pair userdata = { .name = NULL, .id = id, .flags =
-            tpm2_alg_util_flags_any, ._flags = tpm2_alg_util_flags_none };
-
-    tpm2_alg_util_for_each_alg(find_match, &userdata);
+    const alg_pair *alg = find_by_id(id);
 
-    return userdata._flags;
+    return alg ? alg->flags : tpm2_alg_util_flags_none;
 }
 
 TPM2_ALG_ID tpm2_alg_util_from_optarg(const char *optarg,
@@ -681,6 +672,12 @@ UINT16 tpm2_alg_util_get_hash_size(TPMI_ALG_HASH id) {
         return TPM2_SHA512_DIGEST_SIZE;
     case TPM2_ALG_SM3_256:
         return TPM2_SM3_256_DIGEST_SIZE;
+    case TPM2_ALG_SHA3_256:
+        return TPM2_SHA3_256_DIGEST_SIZE;
+    case TPM2_ALG_SHA3_384:
+        return TPM2_SHA3_384_DIGEST_SIZE;
+    case TPM2_ALG_SHA3_512:
+        return TPM2_SHA3_512_DIGEST_SIZE;
         /* no default */
     }
 
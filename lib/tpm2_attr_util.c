@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -381,6 +382,72 @@ static dispatch_table obj_attr_table[] = {         // Bit Index
         dispatch_reserved(31),                     // 31
 };
 
+/* the attribute tables sorted by name, see build_indexes() */
+static const void *nv_attr_index[ARRAY_LEN(nv_attr_table)];
+static const void *obj_attr_index[ARRAY_LEN(obj_attr_table)];
+
+static int dispatch_name_cmp(const void *key, const void *entry) {
+
+    return strcmp(((const dispatch_table *) key)->name,
+            ((const dispatch_table *) entry)->name);
+}
+
+static void indexes_build(void) {
+
+    tpm2_util_index_build(nv_attr_table, ARRAY_LEN(nv_attr_table),
+            sizeof(nv_attr_table[0]), nv_attr_index, dispatch_name_cmp);
+    tpm2_util_index_build(obj_attr_table, ARRAY_LEN(obj_attr_table),
+            sizeof(obj_attr_table[0]), obj_attr_index, dispatch_name_cmp);
+}
+
+static void build_indexes(void) {
+
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, indexes_build);
+}
+
+/*
+ * A token matches the entries it is a prefix of, up to the "=" of its
+ * argument if it has one, and the first of them in bit order handles it.
+ * Those entries are next to each other in the index.
+ */
+static dispatch_table *find_dispatch(char *token, const void **index,
+        size_t size) {
+
+    char *sep = strchr(token, '=');
+    if (sep) {
+        *sep = '\0';
+    }
+
+    dispatch_table key = { .name = token };
+    size_t len = strlen(token);
+    dispatch_table *match = NULL;
+
+    size_t i;
+    for (i = tpm2_util_index_lower_bound(&key, index, size, dispatch_name_cmp);
+            i < size; i++) {
+        dispatch_table *d = (dispatch_table *) index[i];
+        if (strncmp(d->name, token, len)) {
+            break;
+        }
+
+        /* reserved, or without an argument for a token with one */
+        if (!d->callback || (sep && d->width == 1)) {
+            continue;
+        }
+
+        if (!match || d < match) {
+            match = d;
+        }
+    }
+
+    if (sep) {
+        *sep = '=';
+    }
+
+    return match;
+}
+
 static bool token_match(const char *name, const char *token, bool has_arg,
         char **sep) {
 
@@ -441,7 +508,7 @@ static dispatch_error handle_dispatch(dispatch_table *d, char *token,
 }
 
 static bool common_strtoattr(char *attribute_list, void *attrs,
-        dispatch_table *table, size_t size) {
+        const void **index, size_t size) {
 
     char *token;
     char *save;
@@ -456,27 +523,21 @@ static bool common_strtoattr(char *attribute_list, void *attrs,
         return false;
     }
 
+    build_indexes();
+
     while ((token = strtok_r(attribute_list, "|", &save))) {
         attribute_list = NULL;
 
-        bool did_dispatch = false;
-
-        size_t i;
-        for (i = 0; i < size; i++) {
-            dispatch_table *d = &table[i];
-
+        dispatch_table *d = find_dispatch(token, index, size);
+        if (d) {
             dispatch_error err = handle_dispatch(d, token, attrs);
-            if (err == dispatch_ok) {
-                did_dispatch = true;
-                break;
-            } else if (err == dispatch_err) {
+            if (err == dispatch_err) {
                 return false;
             }
-            /* dispatch_no_match --> keep looking */
         }
 
         /* did we dispatch?, If not log error and return */
-        if (!did_dispatch) {
+        if (!d) {
             char *tmp = strchr(token, '=');
             if (tmp) {
                 *tmp = '\0';
@@ -492,15 +553,15 @@ static bool common_strtoattr(char *attribute_list, void *attrs,
 bool tpm2_attr_util_nv_strtoattr(char *attribute_list, TPMA_NV *nvattrs) {
 
     memset(nvattrs, 0, sizeof(*nvattrs));
-    return common_strtoattr(attribute_list, nvattrs, nv_attr_table,
-            ARRAY_LEN(nv_attr_table));
+    return common_strtoattr(attribute_list, nvattrs, nv_attr_index,
+            ARRAY_LEN(nv_attr_index));
 }
 
 bool tpm2_attr_util_obj_strtoattr(char *attribute_list, TPMA_OBJECT *objattrs) {
 
     memset(objattrs, 0, sizeof(*objattrs));
-    return common_strtoattr(attribute_list, objattrs, obj_attr_table,
-            ARRAY_LEN(obj_attr_table));
+    return common_strtoattr(attribute_list, objattrs, obj_attr_index,
+            ARRAY_LEN(obj_attr_index));
 }
 
 static UINT8 find_first_set(UINT32 bits) {
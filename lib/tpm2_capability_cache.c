@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tpm2.h"
+#include "tpm2_capability.h"
+#include "tpm2_capability_cache.h"
+
+static struct {
+    ESYS_CONTEXT *ectx;
+    bool has_properties;
+    bool has_banks;
+    TPML_TAGGED_TPM_PROPERTY properties;
+    TPML_PCR_SELECTION pcrs;
+} cache;
+
+/* another ESAPI context may be another TPM */
+static void cache_select(ESYS_CONTEXT *ectx) {
+
+    if (cache.ectx != ectx) {
+        memset(&cache, 0, sizeof(cache));
+        cache.ectx = ectx;
+    }
+}
+
+static tool_rc load_properties(ESYS_CONTEXT *ectx) {
+
+    cache_select(ectx);
+    if (cache.has_properties) {
+        return tool_rc_success;
+    }
+
+    TPMS_CAPABILITY_DATA *cap_data = NULL;
+    tool_rc rc = tpm2_capability_get(ectx, TPM2_CAP_TPM_PROPERTIES,
+            TPM2_PT_FIXED, TPM2_MAX_TPM_PROPERTIES, &cap_data);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    /* the query runs on into the variable properties, which aren't cached */
+    TPML_TAGGED_TPM_PROPERTY *properties = &cap_data->data.tpmProperties;
+    UINT32 i;
+    for (i = 0; i < properties->count; i++) {
+        if (properties->tpmProperty[i].property < TPM2_PT_FIXED
+                || properties->tpmProperty[i].property >= TPM2_PT_VAR) {
+            continue;
+        }
+        cache.properties.tpmProperty[cache.properties.count++] =
+                properties->tpmProperty[i];
+    }
+    free(cap_data);
+
+    cache.has_properties = true;
+
+    return tool_rc_success;
+}
+
+static bool find_property(TPM2_PT property, UINT32 *value) {
+
+    UINT32 i;
+    for (i = 0; i < cache.properties.count; i++) {
+        if (cache.properties.tpmProperty[i].property == property) {
+            *value = cache.properties.tpmProperty[i].value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static tool_rc load_banks(ESYS_CONTEXT *ectx) {
+
+    cache_select(ectx);
+    if (cache.has_banks) {
+        return tool_rc_success;
+    }
+
+    TPMS_CAPABILITY_DATA *cap_data = NULL;
+    tool_rc rc = tpm2_capability_get(ectx, TPM2_CAP_PCRS, 0,
+            TPM2_NUM_PCR_BANKS, &cap_data);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+    cache.pcrs = cap_data->data.assignedPCR;
+    free(cap_data);
+
+    cache.has_banks = true;
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_capability_cache_get_properties(ESYS_CONTEXT *ectx,
+        const TPML_TAGGED_TPM_PROPERTY **properties) {
+
+    tool_rc rc = load_properties(ectx);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    *properties = &cache.properties;
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_capability_cache_get_property(ESYS_CONTEXT *ectx,
+        TPM2_PT property, UINT32 *value, bool *found) {
+
+    tool_rc rc = load_properties(ectx);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    *found = find_property(property, value);
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_capability_cache_get_pcrs(ESYS_CONTEXT *ectx,
+        const TPML_PCR_SELECTION **pcrs) {
+
+    tool_rc rc = load_banks(ectx);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    *pcrs = &cache.pcrs;
+
+    return tool_rc_success;
+}
+
+void tpm2_capability_cache_clear(void) {
+
+    memset(&cache, 0, sizeof(cache));
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_CAPABILITY_CACHE_H_
+#define LIB_TPM2_CAPABILITY_CACHE_H_
+
+#include <stdbool.h>
+
+#include <tss2/tss2_esys.h>
+
+#include "tool_rc.h"
+
+/*
+ * A cache of the fixed TPM properties and the PCR banks, so the library
+ * routines and tools needing them share one GetCapability query each per
+ * ESAPI context instead of issuing their own.
+ *
+ * Nothing is kept across processes: a PCR allocation changes the banks on the
+ * next TPM reset, which a cache outliving the command couldn't notice.
+ */
+
+/**
+ * Gets the fixed TPM properties, TPM2_PT_FIXED up to TPM2_PT_VAR, in the
+ * order the TPM returned them.
+ * @param ectx
+ *  The ESAPI context.
+ * @param properties
+ *  The cached properties, valid until the cache is cleared.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_capability_cache_get_properties(ESYS_CONTEXT *ectx,
+        const TPML_TAGGED_TPM_PROPERTY **properties);
+
+/**
+ * Looks up a fixed TPM property.
+ * @param ectx
+ *  The ESAPI context.
+ * @param property
+ *  The property, in the TPM2_PT_FIXED group.
+ * @param value
+ *  The value of the property when found.
+ * @param found
+ *  Set to whether the TPM reported the property.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_capability_cache_get_property(ESYS_CONTEXT *ectx,
+        TPM2_PT property, UINT32 *value, bool *found);
+
+/**
+ * Gets the PCR banks, as returned for TPM2_CAP_PCRS.
+ * @param ectx
+ *  The ESAPI context.
+ * @param pcrs
+ *  The cached banks, valid until the cache is cleared.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_capability_cache_get_pcrs(ESYS_CONTEXT *ectx,
+        const TPML_PCR_SELECTION **pcrs);
+
+/**
+ * Empties the cache, for commands changing the capabilities it holds.
+ */
+void tpm2_capability_cache_clear(void);
+
+#endif /* LIB_TPM2_CAPABILITY_CACHE_H_ */
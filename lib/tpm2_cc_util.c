@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <pthread.h>
 #include <string.h>
 
 #include "log.h"
@@ -132,6 +133,38 @@ static const cc_map _g_map[] = {
     ADDCC(TPM2_CC_Vendor_TCG_Test),
 };
 
+/* the map sorted by name and by command code, see build_indexes() */
+static const void *_g_by_str[ARRAY_LEN(_g_map)];
+static const void *_g_by_cc[ARRAY_LEN(_g_map)];
+
+static int cc_str_cmp(const void *key, const void *entry) {
+
+    return strcmp(((const cc_map *) key)->str, ((const cc_map *) entry)->str);
+}
+
+static int cc_cmp(const void *key, const void *entry) {
+
+    TPM2_CC a = ((const cc_map *) key)->cc;
+    TPM2_CC b = ((const cc_map *) entry)->cc;
+
+    return a < b ? -1 : a > b;
+}
+
+static void indexes_build(void) {
+
+    tpm2_util_index_build(_g_map, ARRAY_LEN(_g_map), sizeof(_g_map[0]),
+            _g_by_str, cc_str_cmp);
+    tpm2_util_index_build(_g_map, ARRAY_LEN(_g_map), sizeof(_g_map[0]),
+            _g_by_cc, cc_cmp);
+}
+
+/* tools look up command codes on worker threads as well */
+static void build_indexes(void) {
+
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, indexes_build);
+}
+
 bool tpm2_cc_util_from_str(const char *str, TPM2_CC *cc) {
 
     if (!str || !cc) {
@@ -143,13 +176,14 @@ bool tpm2_cc_util_from_str(const char *str, TPM2_CC *cc) {
         return true;
     }
 
-    size_t i;
-    for (i = 0; i < ARRAY_LEN(_g_map); i++) {
-        const cc_map *m = &_g_map[i];
-        if (!strcmp(str, m->str)) {
-            *cc = m->cc;
-            return true;
-        }
+    build_indexes();
+
+    cc_map key = { .str = str };
+    const cc_map *m = tpm2_util_index_find(&key, _g_by_str,
+            ARRAY_LEN(_g_by_str), cc_str_cmp);
+    if (m) {
+        *cc = m->cc;
+        return true;
     }
 
     LOG_ERR("Could not convert command-code to number, got: \"%s\"", str);
@@ -159,12 +193,13 @@ bool tpm2_cc_util_from_str(const char *str, TPM2_CC *cc) {
 
 const char *tpm2_cc_util_to_str(TPM2_CC cc) {
 
-    size_t i;
-    for (i = 0; i < ARRAY_LEN(_g_map); i++) {
-        const cc_map *m = &_g_map[i];
-        if (m->cc == cc) {
-            return m->str;
-        }
+    build_indexes();
+
+    cc_map key = { .cc = cc };
+    const cc_map *m = tpm2_util_index_find(&key, _g_by_cc,
+            ARRAY_LEN(_g_by_cc), cc_cmp);
+    if (m) {
+        return m->str;
     }
 
     /* we intentionally don't decode hex here so we don't have to keep
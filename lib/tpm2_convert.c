@@ -10,6 +10,9 @@
 #include <openssl/err.h>
 #include <openssl/evp.h>
 #include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <tss2/tss2_mu.h>
 
 #include "files.h"
 #include "log.h"
@@ -420,22 +423,41 @@ bool tpm2_convert_sig_load(const char *path, tpm2_convert_sig_fmt format,
 bool tpm2_convert_sig_load_plain(const char *path,
         TPM2B_MAX_BUFFER *signature, TPMI_ALG_HASH *halg) {
 
+    TPM2B_MAX_BUFFER raw = { .size = sizeof(raw.buffer) };
+    bool ret = files_load_bytes_from_path(path, raw.buffer, &raw.size);
+    if (!ret) {
+        return false;
+    }
+
+    return tpm2_convert_sig_plain_from_buffer(raw.buffer, raw.size,
+            signature, halg);
+}
+
+bool tpm2_convert_sig_plain_from_buffer(const UINT8 *data, size_t len,
+        TPM2B_MAX_BUFFER *signature, TPMI_ALG_HASH *halg) {
+
     /*
      * TSS signature need be read and converted to plain
      *
      * So load it up into the TPMT Structure
      */
     TPMT_SIGNATURE tmp = { 0 };
-    bool ret = files_load_signature_silent(path, &tmp);
-    if (!ret) {
+    size_t offset = 0;
+    TSS2_RC rc = Tss2_MU_TPMT_SIGNATURE_Unmarshal(data, len, &offset, &tmp);
+    if (rc != TSS2_RC_SUCCESS) {
         /* plain signatures are just used as is */
 
         *halg = TPM2_ALG_NULL;
 
-        signature->size = sizeof(signature->buffer);
-        return files_load_bytes_from_path(path,
-                signature->buffer,
-                &signature->size);
+        if (len > sizeof(signature->buffer)) {
+            LOG_ERR("Signature size bigger than buffer, got: %zu expected"
+                    " less than %zu", len, sizeof(signature->buffer));
+            return false;
+        }
+
+        signature->size = len;
+        memcpy(signature->buffer, data, len);
+        return true;
     }
 
     *halg = tmp.signature.any.hashAlg;
@@ -628,6 +650,11 @@ convert_to_pem:
 
 try_pem:
     p = PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL);
+    if (!p && BIO_reset(bio) == 0) {
+        /* not PEM either, try a DER encoded SubjectPublicKeyInfo */
+        ERR_clear_error();
+        p = d2i_PUBKEY_bio(bio, NULL);
+    }
     if (!p) {
         LOG_ERR("Failed to convert public key from file '%s': %s", path,
                 ERR_error_string(ERR_get_error(), NULL));
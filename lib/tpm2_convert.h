@@ -115,6 +115,24 @@ bool tpm2_convert_sig_load(const char *path, tpm2_convert_sig_fmt format,
 bool tpm2_convert_sig_load_plain(const char *path,
         TPM2B_MAX_BUFFER *signature, TPMI_ALG_HASH *halg);
 
+/**
+ * Like tpm2_convert_sig_load_plain(), but for a signature that is already
+ * in memory.
+ * @param data
+ *  The signature, either a marshaled TPMT_SIGNATURE or a plain signature.
+ * @param len
+ *  The length of the data.
+ * @param signature
+ *  The plain signature bytes.
+ * @param halg:
+ *  If the signature scheme is *tss* also provide the hash algorithm, else
+ *  set it to TPM2_ALG_NULL.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_convert_sig_plain_from_buffer(const UINT8 *data, size_t len,
+        TPM2B_MAX_BUFFER *signature, TPMI_ALG_HASH *halg);
+
 bool tpm2_public_load_pkey(const char *path, EVP_PKEY **pkey);
 
 /**
@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+
+#include "log.h"
+#include "tpm2_drbg.h"
+
+#define DRBG_KEY_LEN 32
+#define DRBG_BLOCK_LEN 16
+
+/* SP 800-90A table 3, the maximum number of requests between reseeds */
+#define DRBG_RESEED_INTERVAL (1ULL << 48)
+
+struct tpm2_drbg {
+    uint8_t key[DRBG_KEY_LEN];
+    uint8_t v[DRBG_BLOCK_LEN];
+    uint64_t reseed_counter;
+    EVP_CIPHER_CTX *cipher;
+};
+
+/*
+ * Adds to V as a 128 bit big endian counter.
+ */
+static void drbg_v_add(tpm2_drbg *drbg, uint64_t n) {
+
+    int i;
+    for (i = DRBG_BLOCK_LEN - 1; i >= 0 && n; i--) {
+        n += drbg->v[i];
+        drbg->v[i] = n & 0xff;
+        n >>= 8;
+    }
+}
+
+/*
+ * Outputs the encryptions of V + 1, V + 2 ... as many as needed for len
+ * bytes and leaves V at the last counter value used. That is AES-256-CTR
+ * from V + 1 on zeros, the counter of CTR mode being the whole block as the
+ * DRBG expects.
+ */
+static bool drbg_keystream(tpm2_drbg *drbg, uint8_t *out, size_t len) {
+
+    drbg_v_add(drbg, 1);
+
+    int rc = EVP_EncryptInit_ex(drbg->cipher, EVP_aes_256_ctr(), NULL,
+            drbg->key, drbg->v);
+    if (!rc) {
+        LOG_ERR("Could not initialize the DRBG cipher: %s",
+                ERR_error_string(ERR_get_error(), NULL));
+        return false;
+    }
+
+    memset(out, 0, len);
+
+    int outlen = 0;
+    rc = EVP_EncryptUpdate(drbg->cipher, out, &outlen, out, len);
+    if (!rc || (size_t) outlen != len) {
+        LOG_ERR("Could not run the DRBG cipher: %s",
+                ERR_error_string(ERR_get_error(), NULL));
+        return false;
+    }
+
+    drbg_v_add(drbg, (len + DRBG_BLOCK_LEN - 1) / DRBG_BLOCK_LEN - 1);
+
+    return true;
+}
+
+/*
+ * The CTR_DRBG_Update function, provided_data is TPM2_DRBG_SEED_LEN bytes
+ * or NULL for zeros.
+ */
+static bool drbg_update(tpm2_drbg *drbg, const uint8_t *provided_data) {
+
+    uint8_t temp[TPM2_DRBG_SEED_LEN];
+    bool result = drbg_keystream(drbg, temp, sizeof(temp));
+    if (!result) {
+        goto out;
+    }
+
+    if (provided_data) {
+        size_t i;
+        for (i = 0; i < sizeof(temp); i++) {
+            temp[i] ^= provided_data[i];
+        }
+    }
+
+    memcpy(drbg->key, temp, DRBG_KEY_LEN);
+    memcpy(drbg->v, &temp[DRBG_KEY_LEN], DRBG_BLOCK_LEN);
+
+out:
+    OPENSSL_cleanse(temp, sizeof(temp));
+
+    return result;
+}
+
+tpm2_drbg *tpm2_drbg_new(const uint8_t seed[TPM2_DRBG_SEED_LEN]) {
+
+    tpm2_drbg *drbg = calloc(1, sizeof(*drbg));
+    if (!drbg) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    drbg->cipher = EVP_CIPHER_CTX_new();
+    if (!drbg->cipher) {
+        LOG_ERR("oom");
+        free(drbg);
+        return NULL;
+    }
+
+    /* key and V start as zeros */
+    if (!tpm2_drbg_reseed(drbg, seed)) {
+        tpm2_drbg_free(drbg);
+        return NULL;
+    }
+
+    return drbg;
+}
+
+bool tpm2_drbg_reseed(tpm2_drbg *drbg, const uint8_t seed[TPM2_DRBG_SEED_LEN]) {
+
+    if (!drbg_update(drbg, seed)) {
+        return false;
+    }
+
+    drbg->reseed_counter = 1;
+
+    return true;
+}
+
+bool tpm2_drbg_generate(tpm2_drbg *drbg, uint8_t *out, size_t len) {
+
+    if (len > TPM2_DRBG_MAX_REQUEST) {
+        LOG_ERR("DRBG requests are limited to %u bytes, got: %zu",
+                TPM2_DRBG_MAX_REQUEST, len);
+        return false;
+    }
+
+    if (drbg->reseed_counter > DRBG_RESEED_INTERVAL) {
+        LOG_ERR("The DRBG must be reseeded");
+        return false;
+    }
+
+    if (len && !drbg_keystream(drbg, out, len)) {
+        return false;
+    }
+
+    if (!drbg_update(drbg, NULL)) {
+        return false;
+    }
+
+    drbg->reseed_counter++;
+
+    return true;
+}
+
+void tpm2_drbg_free(tpm2_drbg *drbg) {
+
+    if (!drbg) {
+        return;
+    }
+
+    EVP_CIPHER_CTX_free(drbg->cipher);
+    OPENSSL_cleanse(drbg, sizeof(*drbg));
+    free(drbg);
+}
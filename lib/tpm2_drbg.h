@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_DRBG_H_
+#define LIB_TPM2_DRBG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A host side CTR_DRBG, as specified in NIST SP 800-90A, with AES-256 and no
+ * derivation function. Its whole state comes from the seeds given, which are
+ * expected to be full entropy, for instance bytes from the TPM RNG, and
+ * nothing from the host is mixed in.
+ */
+typedef struct tpm2_drbg tpm2_drbg;
+
+/* The seed length of the DRBG, the AES-256 key length plus the block length */
+#define TPM2_DRBG_SEED_LEN 48
+
+/* The largest request a single tpm2_drbg_generate() call serves */
+#define TPM2_DRBG_MAX_REQUEST 65536
+
+/**
+ * Instantiates a DRBG.
+ * @param seed
+ *  The entropy input, TPM2_DRBG_SEED_LEN bytes.
+ * @return
+ *  The DRBG or NULL on error.
+ */
+tpm2_drbg *tpm2_drbg_new(const uint8_t seed[TPM2_DRBG_SEED_LEN]);
+
+/**
+ * Reseeds a DRBG.
+ * @param drbg
+ *  The DRBG to reseed.
+ * @param seed
+ *  The entropy input, TPM2_DRBG_SEED_LEN bytes.
+ * @return
+ *  true on success.
+ */
+bool tpm2_drbg_reseed(tpm2_drbg *drbg, const uint8_t seed[TPM2_DRBG_SEED_LEN]);
+
+/**
+ * Generates random bytes.
+ * @param drbg
+ *  The DRBG to generate from.
+ * @param out
+ *  The buffer for the bytes.
+ * @param len
+ *  The number of bytes, at most TPM2_DRBG_MAX_REQUEST.
+ * @return
+ *  true on success, false on error or when the DRBG must be reseeded.
+ */
+bool tpm2_drbg_generate(tpm2_drbg *drbg, uint8_t *out, size_t len);
+
+/**
+ * Clears and frees a DRBG.
+ */
+void tpm2_drbg_free(tpm2_drbg *drbg);
+
+#endif /* LIB_TPM2_DRBG_H_ */
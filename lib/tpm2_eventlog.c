@@ -1,9 +1,14 @@
+#include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <tss2/tss2_tpm2_types.h>
 
+#include "files.h"
 #include "log.h"
 #include "efi_event.h"
 #include "tpm2_alg_util.h"
@@ -23,6 +28,131 @@ bool digest2_accumulator_callback(TCG_DIGEST2 const *digest, size_t size,
 
     return true;
 }
+static tpm2_eventlog_bank *eventlog_bank_add(tpm2_eventlog_context *ctx,
+        TPMI_ALG_HASH alg, UINT16 size) {
+
+    if (size == 0 || size > sizeof(ctx->banks[0].pcrs[0])) {
+        return NULL;
+    }
+
+    if (ctx->bank_count >= ARRAY_LEN(ctx->banks)) {
+        LOG_ERR("Too many PCR banks, at most %zu are supported",
+                ARRAY_LEN(ctx->banks));
+        return NULL;
+    }
+
+    /* keep the table sorted by algorithm */
+    size_t i = ctx->bank_count;
+    while (i > 0 && ctx->banks[i - 1].alg > alg) {
+        ctx->banks[i] = ctx->banks[i - 1];
+        i--;
+    }
+    ctx->bank_count++;
+
+    tpm2_eventlog_bank *bank = &ctx->banks[i];
+    memset(bank, 0, sizeof(*bank));
+    bank->alg = alg;
+    bank->size = size;
+
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(alg);
+    if (md && (size_t)EVP_MD_size(md) == size) {
+        bank->md = md;
+    } else {
+        LOG_WARN("PCR bank 0x%x is not supported by the host, it is not "
+                "replayed", alg);
+    }
+
+    return bank;
+}
+
+tpm2_eventlog_bank *eventlog_bank_get(tpm2_eventlog_context *ctx,
+        TPMI_ALG_HASH alg) {
+
+    size_t i;
+    for (i = 0; i < ctx->bank_count; i++) {
+        if (ctx->banks[i].alg == alg) {
+            return &ctx->banks[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * The digest size for the algorithm, as declared by the log or as known to
+ * the tools for logs that don't declare their banks.
+ */
+static UINT16 eventlog_digest_size(tpm2_eventlog_context *ctx,
+        TPMI_ALG_HASH alg) {
+
+    tpm2_eventlog_bank *bank = ctx ? eventlog_bank_get(ctx, alg) : NULL;
+
+    return bank ? bank->size : tpm2_alg_util_get_hash_size(alg);
+}
+
+/* extend operation is pcr = HASH(pcr + digest) */
+static bool eventlog_bank_extend(tpm2_eventlog_bank *bank, unsigned pcr_index,
+        const BYTE *digest) {
+
+    if (!bank->md) {
+        return true;
+    }
+
+    if (!bank->md_ctx) {
+        bank->md_ctx = EVP_MD_CTX_new();
+        if (!bank->md_ctx) {
+            LOG_ERR("oom");
+            return false;
+        }
+    }
+
+    uint8_t *pcr = bank->pcrs[pcr_index];
+    if (!EVP_DigestInit_ex(bank->md_ctx, bank->md, NULL)
+        || !EVP_DigestUpdate(bank->md_ctx, pcr, bank->size)
+        || !EVP_DigestUpdate(bank->md_ctx, digest, bank->size)
+        || !EVP_DigestFinal_ex(bank->md_ctx, pcr, NULL)) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+    bank->used |= (UINT32_C(1) << pcr_index);
+
+    return true;
+}
+
+static bool eventlog_banks_from_specid(tpm2_eventlog_context *ctx,
+        TCG_EVENT const *event) {
+
+    TCG_SPECID_EVENT const *specid = (TCG_SPECID_EVENT const *)event->event;
+
+    UINT32 i;
+    for (i = 0; i < specid->numberOfAlgorithms; i++) {
+        TCG_SPECID_ALG const *alg = &specid->digestSizes[i];
+        if (eventlog_bank_get(ctx, alg->algorithmId)) {
+            continue;
+        }
+        if (!eventlog_bank_add(ctx, alg->algorithmId, alg->digestSize)) {
+            LOG_ERR("Invalid SpecID algorithm 0x%x with digest size %u",
+                    alg->algorithmId, alg->digestSize);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void eventlog_context_cleanup(tpm2_eventlog_context *ctx) {
+
+    size_t i;
+    for (i = 0; i < ctx->bank_count; i++) {
+        EVP_MD_CTX_free(ctx->banks[i].md_ctx);
+        ctx->banks[i].md_ctx = NULL;
+    }
+
+    free(ctx->pending);
+    ctx->pending = NULL;
+    ctx->pending_size = 0;
+}
+
 /*
  * Invoke callback function for each TCG_DIGEST2 structure in the provided
  * TCG_EVENT_HEADER2. The callback function is only invoked if this function
@@ -54,33 +184,20 @@ bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index, TCG_DIGEST2
         }
 
         const TPMI_ALG_HASH alg = digest->AlgorithmId;
-        const size_t alg_size = tpm2_alg_util_get_hash_size(alg);
+        const size_t alg_size = eventlog_digest_size(ctx, alg);
         if (size < sizeof(*digest) + alg_size) {
             LOG_ERR("insufficient size for digest buffer");
             return false;
         }
 
-        uint8_t *pcr = NULL;
-        if (alg == TPM2_ALG_SHA1) {
-            pcr = ctx->sha1_pcrs[pcr_index];
-            ctx->sha1_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA256) {
-            pcr = ctx->sha256_pcrs[pcr_index];
-            ctx->sha256_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA384) {
-            pcr = ctx->sha384_pcrs[pcr_index];
-            ctx->sha384_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA512) {
-            pcr = ctx->sha512_pcrs[pcr_index];
-            ctx->sha512_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SM3_256) {
-            pcr = ctx->sm3_256_pcrs[pcr_index];
-            ctx->sm3_256_used |= (1 << pcr_index);
-        } else {
-            LOG_WARN("PCR%d algorithm %d unsupported", pcr_index, alg);
+        tpm2_eventlog_bank *bank = eventlog_bank_get(ctx, alg);
+        if (!bank) {
+            bank = eventlog_bank_add(ctx, alg, alg_size);
         }
 
-        if (pcr && !tpm2_openssl_pcr_extend(alg, pcr, digest->Digest, alg_size)) {
+        if (!bank) {
+            LOG_WARN("PCR%d algorithm %d unsupported", pcr_index, alg);
+        } else if (!eventlog_bank_extend(bank, pcr_index, digest->Digest)) {
             LOG_ERR("PCR%d extend failed", pcr_index);
             return false;
         }
@@ -161,11 +278,42 @@ bool parse_event2body(TCG_EVENT2 const *event, UINT32 type) {
     return true;
 }
 /*
- * parse event structure, including header, digests and event buffer ensuring
- * it all fits within the provided buffer (buf_size).
+ * Walk the digests of an event to find their size, without replaying them.
  */
-bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
-                  size_t *event_size, size_t *digests_size) {
+static bool event2_digests_size(tpm2_eventlog_context *ctx,
+        TCG_EVENT_HEADER2 const *eventhdr, size_t size, size_t *digests_size) {
+
+    if (eventhdr->PCRIndex > (TPM2_MAX_PCRS - 1)) {
+        LOG_ERR("PCR Index %d is out of bounds for max available PCRS %d",
+        eventhdr->PCRIndex, TPM2_MAX_PCRS);
+        return false;
+    }
+
+    TCG_DIGEST2 const *digest = eventhdr->Digests;
+    UINT32 i;
+    for (i = 0; i < eventhdr->DigestCount; ++i) {
+        if (size < sizeof(*digest)) {
+            LOG_ERR("insufficient size for digest header");
+            return false;
+        }
+
+        const size_t alg_size = eventlog_digest_size(ctx, digest->AlgorithmId);
+        if (size < sizeof(*digest) + alg_size) {
+            LOG_ERR("insufficient size for digest buffer");
+            return false;
+        }
+
+        *digests_size += sizeof(*digest) + alg_size;
+        size -= sizeof(*digest) + alg_size;
+        digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
+    }
+
+    return true;
+}
+
+static bool parse_event2_ctx(tpm2_eventlog_context *ctx,
+        TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
+        size_t *event_size, size_t *digests_size) {
 
     bool ret;
 
@@ -175,13 +323,8 @@ bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
     }
     *event_size = sizeof(*eventhdr);
 
-    tpm2_eventlog_context ctx = {
-        .data = digests_size,
-        .digest2_cb = digest2_accumulator_callback,
-    };
-    ret = foreach_digest2(&ctx, eventhdr->PCRIndex,
-                          eventhdr->Digests, eventhdr->DigestCount,
-                          buf_size - sizeof(*eventhdr));
+    ret = event2_digests_size(ctx, eventhdr, buf_size - sizeof(*eventhdr),
+            digests_size);
     if (ret != true) {
         return false;
     }
@@ -203,11 +346,20 @@ bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
     return true;
 }
 
+/*
+ * parse event structure, including header, digests and event buffer ensuring
+ * it all fits within the provided buffer (buf_size).
+ */
+bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
+                  size_t *event_size, size_t *digests_size) {
+
+    return parse_event2_ctx(NULL, eventhdr, buf_size, event_size,
+            digests_size);
+}
+
 bool parse_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *event, size_t size,
                       size_t *event_size) {
 
-    uint8_t *pcr = NULL;
-
     /* enough size for the 1.2 event structure */
     if (size < sizeof(*event)) {
         LOG_ERR("insufficient size for SpecID event header");
@@ -215,10 +367,19 @@ bool parse_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *event, si
     }
     *event_size = sizeof(*event);
 
-    pcr = ctx->sha1_pcrs[ event->pcrIndex];
-    if (pcr) {
-        tpm2_openssl_pcr_extend(TPM2_ALG_SHA1, pcr, &event->digest[0], 20);
-        ctx->sha1_used |= (1 << event->pcrIndex);
+    if (event->pcrIndex > (TPM2_MAX_PCRS - 1)) {
+        LOG_ERR("PCR Index %d is out of bounds for max available PCRS %d",
+        event->pcrIndex, TPM2_MAX_PCRS);
+        return false;
+    }
+
+    tpm2_eventlog_bank *bank = eventlog_bank_get(ctx, TPM2_ALG_SHA1);
+    if (!bank) {
+        bank = eventlog_bank_add(ctx, TPM2_ALG_SHA1, TPM2_SHA1_DIGEST_SIZE);
+    }
+    if (bank && !eventlog_bank_extend(bank, event->pcrIndex, event->digest)) {
+        LOG_ERR("PCR%d extend failed", event->pcrIndex);
+        return false;
     }
 
     /* buffer size must be sufficient to hold event and event data */
@@ -231,6 +392,41 @@ bool parse_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *event, si
     return true;
 }
 
+static bool handle_sha1_log_event(tpm2_eventlog_context *ctx,
+        TCG_EVENT const *eventhdr, size_t size, size_t *event_size) {
+
+    bool ret = parse_sha1_log_event(ctx, eventhdr, size, event_size);
+    if (!ret) {
+        return ret;
+    }
+
+    TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)&eventhdr->eventDataSize);
+
+    /* event header callback */
+    if (ctx->log_eventhdr_cb != NULL) {
+        ret = ctx->log_eventhdr_cb(eventhdr, *event_size, ctx->data);
+        if (ret != true) {
+            return false;
+        }
+    }
+
+    ret = parse_event2body(event, eventhdr->eventType);
+    if (ret != true) {
+        return ret;
+    }
+
+    /* event data callback */
+    if (ctx->event2_cb != NULL) {
+        ret = ctx->event2_cb(event, eventhdr->eventType, ctx->data,
+                             ctx->eventlog_version);
+        if (ret != true) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool foreach_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *eventhdr_start, size_t size) {
 
     if (eventhdr_start == NULL) {
@@ -251,34 +447,11 @@ bool foreach_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *eventhd
          eventhdr = (TCG_EVENT*)((uintptr_t)eventhdr + event_size),
          size -= event_size) {
 
-        ret = parse_sha1_log_event(ctx, eventhdr, size, &event_size);
+        ret = handle_sha1_log_event(ctx, eventhdr, size, &event_size);
         if (!ret) {
             return ret;
         }
-
-        TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)&eventhdr->eventDataSize);
-
-        /* event header callback */
-        if (ctx->log_eventhdr_cb != NULL) {
-            ret = ctx->log_eventhdr_cb(eventhdr, event_size, ctx->data);
-            if (ret != true) {
-                return false;
-            }
-        }
-
-        ret = parse_event2body(event, eventhdr->eventType);
-        if (ret != true) {
-            return ret;
-        }
-
-        /* event data callback */
-        if (ctx->event2_cb != NULL) {
-            ret = ctx->event2_cb(event, eventhdr->eventType, ctx->data,
-                                 ctx->eventlog_version);
-            if (ret != true) {
-                return false;
-            }
-        }
+        ctx->events++;
     }
 
     return true;
@@ -286,11 +459,14 @@ bool foreach_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *eventhd
 
 /*
  * For event types where digest can be verified from their event payload,
- * perform verification to ensure event payload was not tempered
+ * perform verification to ensure event payload was not tempered. Returns NULL
+ * when the digests are fine, otherwise the reason to complete "Event N" with.
+ * Nothing is logged here, so it can run on the verifier threads.
  */
-bool verify_digests(size_t eventnum, TCG_EVENT_HEADER2 const *eventhdr, TCG_EVENT2 *event) {
+static const char *verify_digests_reason(TCG_EVENT_HEADER2 const *eventhdr,
+        TCG_EVENT2 const *event) {
 
-size_t i;
+    size_t i;
 
     TCG_DIGEST2 const *digest = eventhdr->Digests;
     UINT32 digest_count = eventhdr->DigestCount;
@@ -305,17 +481,15 @@ size_t i;
             TPMI_ALG_HASH alg = digest->AlgorithmId;
             TPM2B_DIGEST calc_digest;
 
-            bool result = tpm2_openssl_hash_compute_data(alg, event->Event,
-            event->EventSize, &calc_digest);
+            bool result = tpm2_openssl_hash_compute_data(alg,
+            (BYTE *)event->Event, event->EventSize, &calc_digest);
             if (!result) {
-                LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
-                return false;
+                return ": Cannot calculate hash value from data";
             }
 
             size_t alg_size = tpm2_alg_util_get_hash_size(alg);
             if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
-                LOG_WARN("Event %zu's digest does not match its payload", eventnum - 1);
-                return false;
+                return "'s digest does not match its payload";
             }
 
             digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
@@ -327,19 +501,18 @@ size_t i;
         /* PCR9: used to measure loaded kernel and initramfs images which cannot
            be verified from eventlog alone */
         if (eventhdr->PCRIndex == 9) {
-            return true;
+            return NULL;
         }
 
         /* PCR14: used to measure MokList, MokListX, and MokSBState which cannot
            be verified from eventlog alone */
         if (eventhdr->PCRIndex == 14) {
-            return true;
+            return NULL;
         }
 
         /* PCR8: used to measure grub and kernel command line */
         if (eventhdr->PCRIndex != 8) {
-            LOG_WARN("Event %zu is unexpectedly not extending either PCR 8, 9, or 14", eventnum - 1);
-            return false;
+            return " is unexpectedly not extending either PCR 8, 9, or 14";
         }
 
         /* Digest is applied on the string between "^[a-zA-Z_]+:? " and EOL,
@@ -353,33 +526,29 @@ size_t i;
             }
 
             if (j + 1 >= event->EventSize || event->Event[event->EventSize - 1] != '\0') {
-                LOG_WARN("Event %zu's event data is in unexpected format", eventnum - 1);
-                return false;
+                return "'s event data is in unexpected format";
             }
 
             TPM2B_DIGEST calc_digest;
             TPMI_ALG_HASH alg = digest->AlgorithmId;
             /* First try to calculate the hash excluding the trailing \0 */
             bool result = tpm2_openssl_hash_compute_data(alg,
-            event->Event + (j + 1), event->EventSize - (j + 2), &calc_digest);
+            (BYTE *)event->Event + (j + 1), event->EventSize - (j + 2), &calc_digest);
             if (!result) {
-                LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
-                return false;
+                return ": Cannot calculate hash value from data";
             }
 
             size_t alg_size = tpm2_alg_util_get_hash_size(alg);
             if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
                 /* Next try to calculate the hash including the trailing \0 */
                 bool result = tpm2_openssl_hash_compute_data(alg,
-                event->Event + (j + 1), event->EventSize - (j + 1), &calc_digest);
+                (BYTE *)event->Event + (j + 1), event->EventSize - (j + 1), &calc_digest);
                 if (!result) {
-                    LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
-                    return false;
+                    return ": Cannot calculate hash value from data";
                 }
 
                 if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
-                    LOG_WARN("Event %zu's digest does not match its payload", eventnum - 1);
-                    return false;
+                    return "'s digest does not match its payload";
                 }
             }
             digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
@@ -387,6 +556,246 @@ size_t i;
         break;
     }
 
+    return NULL;
+}
+
+/*
+ * A mismatch is only reported, inline or on the verifier threads, it never
+ * fails the parse.
+ */
+static void verify_digests_report(size_t eventnum, const char *reason) {
+
+    LOG_WARN("Event %zu%s", eventnum - 1, reason);
+}
+
+bool verify_digests(size_t eventnum, TCG_EVENT_HEADER2 const *eventhdr, TCG_EVENT2 *event) {
+
+    const char *reason = verify_digests_reason(eventhdr, event);
+    if (reason) {
+        verify_digests_report(eventnum, reason);
+        return false;
+    }
+
+    return true;
+}
+
+#define EVENTLOG_VERIFIER_QUEUE 256
+
+typedef struct eventlog_verifier_job eventlog_verifier_job;
+struct eventlog_verifier_job {
+    size_t eventnum;
+    TCG_EVENT_HEADER2 const *eventhdr;
+    TCG_EVENT2 const *event;
+    const char *reason;
+    bool done;
+};
+
+struct tpm2_eventlog_verifier {
+    pthread_t *threads;
+    unsigned count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stop;
+    /*
+     * A ring of jobs, [head, next) are taken by the threads and [next, tail)
+     * are waiting for one. Jobs are reported from head, in event order.
+     */
+    size_t head;
+    size_t next;
+    size_t tail;
+    eventlog_verifier_job jobs[EVENTLOG_VERIFIER_QUEUE];
+};
+
+static void *eventlog_verifier_thread(void *arg) {
+
+    tpm2_eventlog_verifier *v = arg;
+
+    pthread_mutex_lock(&v->lock);
+    for (;;) {
+        while (!v->stop && v->next == v->tail) {
+            pthread_cond_wait(&v->cond, &v->lock);
+        }
+        if (v->next == v->tail) {
+            break;
+        }
+
+        eventlog_verifier_job *job = &v->jobs[v->next++ % EVENTLOG_VERIFIER_QUEUE];
+        pthread_mutex_unlock(&v->lock);
+
+        const char *reason = verify_digests_reason(job->eventhdr, job->event);
+
+        pthread_mutex_lock(&v->lock);
+        job->reason = reason;
+        job->done = true;
+        pthread_cond_broadcast(&v->cond);
+    }
+    pthread_mutex_unlock(&v->lock);
+
+    return NULL;
+}
+
+/* called with the lock held */
+static void eventlog_verifier_report(tpm2_eventlog_verifier *v) {
+
+    eventlog_verifier_job *job = &v->jobs[v->head % EVENTLOG_VERIFIER_QUEUE];
+    while (!job->done) {
+        pthread_cond_wait(&v->cond, &v->lock);
+    }
+
+    if (job->reason) {
+        verify_digests_report(job->eventnum, job->reason);
+    }
+    v->head++;
+}
+
+static void eventlog_verifier_submit(tpm2_eventlog_verifier *v,
+        size_t eventnum, TCG_EVENT_HEADER2 const *eventhdr,
+        TCG_EVENT2 const *event) {
+
+    pthread_mutex_lock(&v->lock);
+
+    while (v->tail - v->head == EVENTLOG_VERIFIER_QUEUE) {
+        eventlog_verifier_report(v);
+    }
+
+    v->jobs[v->tail++ % EVENTLOG_VERIFIER_QUEUE] = (eventlog_verifier_job) {
+        .eventnum = eventnum,
+        .eventhdr = eventhdr,
+        .event = event,
+    };
+
+    pthread_cond_broadcast(&v->cond);
+    pthread_mutex_unlock(&v->lock);
+}
+
+void eventlog_verifier_wait(tpm2_eventlog_verifier *verifier) {
+
+    if (!verifier) {
+        return;
+    }
+
+    pthread_mutex_lock(&verifier->lock);
+
+    while (verifier->head != verifier->tail) {
+        eventlog_verifier_report(verifier);
+    }
+
+    pthread_mutex_unlock(&verifier->lock);
+}
+
+static void eventlog_verifier_stop(tpm2_eventlog_verifier *v) {
+
+    pthread_mutex_lock(&v->lock);
+    v->stop = true;
+    pthread_cond_broadcast(&v->cond);
+    pthread_mutex_unlock(&v->lock);
+
+    unsigned i;
+    for (i = 0; i < v->count; i++) {
+        pthread_join(v->threads[i], NULL);
+    }
+    v->count = 0;
+}
+
+tpm2_eventlog_verifier *eventlog_verifier_new(unsigned jobs) {
+
+    if (!jobs) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+
+    tpm2_eventlog_verifier *v = calloc(1, sizeof(*v));
+    if (!v) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    v->threads = calloc(jobs, sizeof(*v->threads));
+    if (!v->threads) {
+        LOG_ERR("oom");
+        free(v);
+        return NULL;
+    }
+
+    pthread_mutex_init(&v->lock, NULL);
+    pthread_cond_init(&v->cond, NULL);
+
+    for (v->count = 0; v->count < jobs; v->count++) {
+        int rc = pthread_create(&v->threads[v->count], NULL,
+                eventlog_verifier_thread, v);
+        if (rc) {
+            LOG_ERR("Could not start verifier thread: %s", strerror(rc));
+            eventlog_verifier_free(v);
+            return NULL;
+        }
+    }
+
+    return v;
+}
+
+void eventlog_verifier_free(tpm2_eventlog_verifier *verifier) {
+
+    if (!verifier) {
+        return;
+    }
+
+    eventlog_verifier_stop(verifier);
+
+    pthread_cond_destroy(&verifier->cond);
+    pthread_mutex_destroy(&verifier->lock);
+    free(verifier->threads);
+    free(verifier);
+}
+
+static bool handle_event2(tpm2_eventlog_context *ctx,
+        TCG_EVENT_HEADER2 const *eventhdr, size_t size, size_t *event_size) {
+
+    size_t digests_size = 0;
+
+    bool ret = parse_event2_ctx(ctx, eventhdr, size, event_size, &digests_size);
+    if (!ret) {
+        return ret;
+    }
+
+    TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)eventhdr->Digests + digests_size);
+
+    /* event header callback */
+    if (ctx->event2hdr_cb != NULL) {
+        ret = ctx->event2hdr_cb(eventhdr, *event_size, ctx->data);
+        if (ret != true) {
+            return false;
+        }
+    }
+
+    /* digest callback foreach digest */
+    ret = foreach_digest2(ctx, eventhdr->PCRIndex, eventhdr->Digests, eventhdr->DigestCount, digests_size);
+    if (ret != true) {
+        return false;
+    }
+
+    ret = parse_event2body(event, eventhdr->EventType);
+    if (ret != true) {
+        return ret;
+    }
+
+    /* digest verification, the verifier only changes where it runs */
+    if (ctx->data != 0) {
+        if (ctx->verifier) {
+            eventlog_verifier_submit(ctx->verifier, ctx->events + 1, eventhdr,
+                    event);
+        } else {
+            verify_digests(ctx->events + 1, eventhdr, event);
+        }
+    }
+
+    /* event data callback */
+    if (ctx->event2_cb != NULL) {
+        ret = ctx->event2_cb(event, eventhdr->EventType, ctx->data, ctx->eventlog_version);
+        if (ret != true) {
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -409,46 +818,11 @@ bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhd
          eventhdr = (TCG_EVENT_HEADER2*)((uintptr_t)eventhdr + event_size),
          size -= event_size) {
 
-        size_t digests_size = 0;
-
-        ret = parse_event2(eventhdr, size, &event_size, &digests_size);
+        ret = handle_event2(ctx, eventhdr, size, &event_size);
         if (!ret) {
             return ret;
         }
-
-        TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)eventhdr->Digests + digests_size);
-
-        /* event header callback */
-        if (ctx->event2hdr_cb != NULL) {
-            ret = ctx->event2hdr_cb(eventhdr, event_size, ctx->data);
-            if (ret != true) {
-                return false;
-            }
-        }
-
-        /* digest callback foreach digest */
-        ret = foreach_digest2(ctx, eventhdr->PCRIndex, eventhdr->Digests, eventhdr->DigestCount, digests_size);
-        if (ret != true) {
-            return false;
-        }
-
-        ret = parse_event2body(event, eventhdr->EventType);
-        if (ret != true) {
-            return ret;
-        }
-
-        /* digest verification */
-        if (ctx->data != 0) {
-            verify_digests(*(size_t*)ctx->data, eventhdr, event);
-        }
-
-        /* event data callback */
-        if (ctx->event2_cb != NULL) {
-            ret = ctx->event2_cb(event, eventhdr->EventType, ctx->data, ctx->eventlog_version);
-            if (ret != true) {
-                return false;
-            }
-        }
+        ctx->events++;
     }
 
     return true;
@@ -551,6 +925,11 @@ bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t siz
             return false;
         }
 
+        ret = eventlog_banks_from_specid(ctx, event);
+        if (!ret) {
+            return false;
+        }
+
         size -= (uintptr_t)next - (uintptr_t)eventlog;
 
         if (ctx->specid_cb) {
@@ -559,10 +938,375 @@ bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t siz
                 return false;
             }
         }
+        ctx->events++;
+
+        ret = foreach_event2(ctx, next, size);
+        eventlog_verifier_wait(ctx->verifier);
 
-        return foreach_event2(ctx, next, size);
+        return ret;
     }
 
     /* No specid event found. sha1 log format will be parsed. */
     return foreach_sha1_log_event(ctx, event, size);
 }
+
+/*
+ * Returns the size of the event at the start of buf, or 0 if buf doesn't hold
+ * all of it yet. Only the sizes are looked at, the content is validated when
+ * the complete event is parsed.
+ */
+static size_t eventlog_next_event_size(tpm2_eventlog_context *ctx,
+        BYTE const *buf, size_t size) {
+
+    tpm2_eventlog_format format = ctx->format;
+
+    if (format != EVENTLOG_FORMAT_CRYPTO_AGILE) {
+        TCG_EVENT const *event = (TCG_EVENT const *)buf;
+        if (size < sizeof(*event)) {
+            return 0;
+        }
+
+        size_t need = sizeof(*event) + event->eventDataSize;
+        if (format == EVENTLOG_FORMAT_UNKNOWN &&
+            event->eventType == EV_NO_ACTION) {
+            /* the SpecID event, sized like specid_event() does */
+            TCG_SPECID_EVENT const *specid =
+                (TCG_SPECID_EVENT const *)event->event;
+            need = sizeof(*event) + sizeof(*specid);
+            if (size < need) {
+                return 0;
+            }
+            need += sizeof(specid->digestSizes[0]) *
+                    specid->numberOfAlgorithms + sizeof(TCG_VENDOR_INFO);
+            if (size < need) {
+                return 0;
+            }
+            TCG_VENDOR_INFO const *vendor =
+                (TCG_VENDOR_INFO const *)(buf + need - sizeof(*vendor));
+            need += vendor->vendorInfoSize;
+        }
+
+        return size < need ? 0 : need;
+    }
+
+    TCG_EVENT_HEADER2 const *eventhdr = (TCG_EVENT_HEADER2 const *)buf;
+    size_t need = sizeof(*eventhdr);
+    if (size < need) {
+        return 0;
+    }
+
+    UINT32 i;
+    for (i = 0; i < eventhdr->DigestCount; i++) {
+        TCG_DIGEST2 const *digest = (TCG_DIGEST2 const *)(buf + need);
+        if (size < need + sizeof(*digest)) {
+            return 0;
+        }
+        need += sizeof(*digest) +
+                eventlog_digest_size(ctx, digest->AlgorithmId);
+    }
+
+    TCG_EVENT2 const *event = (TCG_EVENT2 const *)(buf + need);
+    if (size < need + sizeof(*event)) {
+        return 0;
+    }
+    need += sizeof(*event) + event->EventSize;
+
+    return size < need ? 0 : need;
+}
+
+static bool parse_eventlog_event(tpm2_eventlog_context *ctx, BYTE const *buf,
+        size_t size) {
+
+    size_t event_size = 0;
+    bool ret;
+
+    switch (ctx->format) {
+    case EVENTLOG_FORMAT_UNKNOWN: {
+        TCG_EVENT const *event = (TCG_EVENT const *)buf;
+        if (event->eventType != EV_NO_ACTION) {
+            /* No specid event found. sha1 log format will be parsed. */
+            ctx->format = EVENTLOG_FORMAT_SHA1;
+            return parse_eventlog_event(ctx, buf, size);
+        }
+
+        TCG_EVENT_HEADER2 *next;
+        ret = specid_event(event, size, &next);
+        if (!ret) {
+            return false;
+        }
+        event_size = (uintptr_t)next - (uintptr_t)buf;
+
+        ret = eventlog_banks_from_specid(ctx, event);
+        if (!ret) {
+            return false;
+        }
+
+        if (ctx->specid_cb) {
+            ret = ctx->specid_cb(event, ctx->data);
+            if (!ret) {
+                return false;
+            }
+        }
+        ctx->format = EVENTLOG_FORMAT_CRYPTO_AGILE;
+    } break;
+    case EVENTLOG_FORMAT_SHA1:
+        ret = handle_sha1_log_event(ctx, (TCG_EVENT const *)buf, size,
+                &event_size);
+        if (!ret) {
+            return false;
+        }
+        break;
+    case EVENTLOG_FORMAT_CRYPTO_AGILE:
+        ret = handle_event2(ctx, (TCG_EVENT_HEADER2 const *)buf, size,
+                &event_size);
+        if (!ret) {
+            return false;
+        }
+        break;
+    default:
+        LOG_ERR("unknown eventlog format %d", ctx->format);
+        return false;
+    }
+
+    if (event_size != size) {
+        LOG_ERR("corrupted log, event %" PRIu64 " is %zu bytes, expected %zu",
+                ctx->events, event_size, size);
+        return false;
+    }
+
+    return true;
+}
+
+static void eventlog_pending_free(tpm2_eventlog_context *ctx) {
+
+    free(ctx->pending);
+    ctx->pending = NULL;
+    ctx->pending_size = 0;
+}
+
+bool parse_eventlog_chunk(tpm2_eventlog_context *ctx, BYTE const *chunk,
+                          size_t size) {
+
+    if (!ctx || (!chunk && size)) {
+        LOG_ERR("invalid parameter");
+        return false;
+    }
+
+    /*
+     * Events are parsed in place from the chunk, only an incomplete event
+     * split across chunks is copied.
+     */
+    BYTE const *buf = chunk;
+    size_t len = size;
+    if (ctx->pending_size) {
+        BYTE *tmp = realloc(ctx->pending, ctx->pending_size + size);
+        if (!tmp) {
+            LOG_ERR("oom");
+            eventlog_pending_free(ctx);
+            return false;
+        }
+        if (size) {
+            memcpy(&tmp[ctx->pending_size], chunk, size);
+        }
+        ctx->pending = tmp;
+        ctx->pending_size += size;
+        buf = ctx->pending;
+        len = ctx->pending_size;
+    }
+
+    size_t done = 0;
+    while (done < len) {
+        size_t event_size = eventlog_next_event_size(ctx, &buf[done],
+                len - done);
+        if (!event_size) {
+            break;
+        }
+
+        bool ret = parse_eventlog_event(ctx, &buf[done], event_size);
+        if (!ret) {
+            eventlog_verifier_wait(ctx->verifier);
+            eventlog_pending_free(ctx);
+            return false;
+        }
+
+        done += event_size;
+        ctx->offset += event_size;
+        ctx->events++;
+    }
+
+    /* the events are about to be moved or released */
+    eventlog_verifier_wait(ctx->verifier);
+
+    size_t left = len - done;
+    if (!left) {
+        eventlog_pending_free(ctx);
+    } else if (buf == ctx->pending) {
+        memmove(ctx->pending, &ctx->pending[done], left);
+        ctx->pending_size = left;
+    } else {
+        ctx->pending = malloc(left);
+        if (!ctx->pending) {
+            LOG_ERR("oom");
+            return false;
+        }
+        memcpy(ctx->pending, &buf[done], left);
+        ctx->pending_size = left;
+    }
+
+    return true;
+}
+
+bool parse_eventlog_finish(tpm2_eventlog_context *ctx) {
+
+    bool ret = true;
+    if (ctx->pending_size) {
+        LOG_ERR("corrupted log, it ends within event %" PRIu64 " (%zu bytes)",
+                ctx->events, ctx->pending_size);
+        ret = false;
+    }
+
+    eventlog_pending_free(ctx);
+
+    return ret;
+}
+
+#define EVENTLOG_STATE_VERSION 3
+
+/* the state is tied to the log by a digest of the part it covers */
+static bool eventlog_state_digest(BYTE const *eventlog, uint64_t offset,
+        BYTE digest[TPM2_SHA256_DIGEST_SIZE]) {
+
+    bool ret = EVP_Digest(eventlog, offset, digest, NULL, EVP_sha256(), NULL);
+    if (!ret) {
+        LOG_ERR("Could not hash the eventlog");
+    }
+
+    return ret;
+}
+
+bool eventlog_state_save(tpm2_eventlog_context *ctx, BYTE const *eventlog,
+        const char *path) {
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+    bool ret = eventlog_state_digest(eventlog, ctx->offset, digest);
+    if (!ret) {
+        return false;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        LOG_ERR("Could not open file \"%s\" error: %s", path, strerror(errno));
+        return false;
+    }
+
+    ret = files_write_header(f, EVENTLOG_STATE_VERSION)
+            && files_write_32(f, ctx->format)
+            && files_write_64(f, ctx->offset)
+            && files_write_64(f, ctx->events)
+            && files_write_bytes(f, digest, sizeof(digest))
+            && files_write_32(f, ctx->bank_count);
+
+    size_t i;
+    for (i = 0; ret && i < ctx->bank_count; i++) {
+        tpm2_eventlog_bank *bank = &ctx->banks[i];
+        ret = files_write_16(f, bank->alg)
+            && files_write_16(f, bank->size)
+            && files_write_32(f, bank->used);
+
+        unsigned pcr;
+        for (pcr = 0; ret && pcr < TPM2_MAX_PCRS; pcr++) {
+            ret = files_write_bytes(f, bank->pcrs[pcr], bank->size);
+        }
+    }
+
+    if (fclose(f) || !ret) {
+        LOG_ERR("Could not write eventlog state to \"%s\"", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool eventlog_state_load(tpm2_eventlog_context *ctx, BYTE const *eventlog,
+        size_t size, const char *path, bool *is_stale) {
+
+    *is_stale = false;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        LOG_ERR("Could not open file \"%s\" error: %s", path, strerror(errno));
+        return false;
+    }
+
+    UINT32 version = 0;
+    UINT32 format = 0;
+    UINT64 offset = 0;
+    UINT64 events = 0;
+    BYTE saved[TPM2_SHA256_DIGEST_SIZE];
+    UINT32 bank_count = 0;
+    bool ret = files_read_header(f, &version);
+    if (ret && version != EVENTLOG_STATE_VERSION) {
+        LOG_ERR("Unsupported eventlog state version %" PRIu32, version);
+        ret = false;
+    }
+
+    ret = ret && files_read_32(f, &format)
+              && files_read_64(f, &offset)
+              && files_read_64(f, &events)
+              && files_read_bytes(f, saved, sizeof(saved))
+              && files_read_32(f, &bank_count);
+
+    /* a log that was reset or rewritten is left to a full parse */
+    if (ret) {
+        BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+        *is_stale = offset > size;
+        if (!*is_stale) {
+            ret = eventlog_state_digest(eventlog, offset, digest);
+            *is_stale = ret && memcmp(saved, digest, sizeof(digest));
+        }
+        if (*is_stale) {
+            fclose(f);
+            return true;
+        }
+        ctx->offset = offset;
+        ctx->events = events;
+    }
+
+    UINT32 i;
+    for (i = 0; ret && i < bank_count; i++) {
+        UINT16 alg = 0;
+        UINT16 size = 0;
+        UINT32 used = 0;
+        ret = files_read_16(f, &alg)
+            && files_read_16(f, &size)
+            && files_read_32(f, &used);
+        if (!ret) {
+            break;
+        }
+
+        tpm2_eventlog_bank *bank = eventlog_bank_get(ctx, alg);
+        if (!bank) {
+            bank = eventlog_bank_add(ctx, alg, size);
+        }
+        if (!bank || bank->size != size) {
+            ret = false;
+            break;
+        }
+        bank->used = used;
+
+        unsigned pcr;
+        for (pcr = 0; ret && pcr < TPM2_MAX_PCRS; pcr++) {
+            ret = files_read_bytes(f, bank->pcrs[pcr], size);
+        }
+    }
+
+    fclose(f);
+
+    if (!ret || format > EVENTLOG_FORMAT_CRYPTO_AGILE) {
+        LOG_ERR("Could not read eventlog state from \"%s\"", path);
+        return false;
+    }
+    ctx->format = format;
+
+    return true;
+}
@@ -5,6 +5,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include <openssl/evp.h>
 #include <tss2/tss2_tpm2_types.h>
 
 #include "efi_event.h"
@@ -19,6 +20,26 @@ typedef bool (*SPECID_CALLBACK)(TCG_EVENT const *event, void *data);
 typedef bool (*LOG_EVENT_CALLBACK)(TCG_EVENT const *event_hdr, size_t size,
                                    void *data);
 
+typedef struct tpm2_eventlog_verifier tpm2_eventlog_verifier;
+
+typedef enum {
+    EVENTLOG_FORMAT_UNKNOWN = 0,
+    EVENTLOG_FORMAT_SHA1 = 1,
+    EVENTLOG_FORMAT_CRYPTO_AGILE = 2,
+} tpm2_eventlog_format;
+
+/*
+ * The replayed PCRs of one bank. The digest size comes from the SpecID event
+ * when the log has one. Banks the host can't hash have no md and are skipped.
+ */
+typedef struct {
+    TPMI_ALG_HASH alg;
+    UINT16 size;
+    uint32_t used;
+    const EVP_MD *md;
+    EVP_MD_CTX *md_ctx;
+    uint8_t pcrs[TPM2_MAX_PCRS][sizeof(TPMU_HA)];
+} tpm2_eventlog_bank;
 
 typedef struct {
     void *data;
@@ -27,22 +48,37 @@ typedef struct {
     EVENT2_CALLBACK event2hdr_cb;
     DIGEST2_CALLBACK digest2_cb;
     EVENT2DATA_CALLBACK event2_cb;
-    uint32_t sha1_used;
-    uint32_t sha256_used;
-    uint32_t sha384_used;
-    uint32_t sha512_used;
-    uint32_t sm3_256_used;
-    uint8_t sha1_pcrs[TPM2_MAX_PCRS][TPM2_SHA1_DIGEST_SIZE];
-    uint8_t sha256_pcrs[TPM2_MAX_PCRS][TPM2_SHA256_DIGEST_SIZE];
-    uint8_t sha384_pcrs[TPM2_MAX_PCRS][TPM2_SHA384_DIGEST_SIZE];
-    uint8_t sha512_pcrs[TPM2_MAX_PCRS][TPM2_SHA512_DIGEST_SIZE];
-    uint8_t sm3_256_pcrs[TPM2_MAX_PCRS][TPM2_SM3_256_DIGEST_SIZE];
+    /* sorted by algorithm */
+    size_t bank_count;
+    tpm2_eventlog_bank banks[TPM2_NUM_PCR_BANKS];
     uint32_t eventlog_version;
+    /* resumable parsing state, see parse_eventlog_chunk() */
+    tpm2_eventlog_format format;
+    uint64_t offset;
+    uint64_t events;
+    BYTE *pending;
+    size_t pending_size;
+    /*
+     * when set, the payload digests otherwise verified inline are verified
+     * on its threads instead
+     */
+    tpm2_eventlog_verifier *verifier;
 } tpm2_eventlog_context;
 
 bool digest2_accumulator_callback(TCG_DIGEST2 const *digest, size_t size,
                                   void *data);
 
+/*
+ * Returns the bank for the algorithm, or NULL if the log doesn't have one.
+ */
+tpm2_eventlog_bank *eventlog_bank_get(tpm2_eventlog_context *ctx,
+                                      TPMI_ALG_HASH alg);
+/*
+ * Releases the resources held by the context, it can't be used to parse
+ * further afterwards.
+ */
+void eventlog_context_cleanup(tpm2_eventlog_context *ctx);
+
 bool parse_event2body(TCG_EVENT2 const *event, UINT32 type);
 bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index,
                      TCG_DIGEST2 const *event_hdr, size_t count, size_t size);
@@ -52,4 +88,43 @@ bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhd
 bool specid_event(TCG_EVENT const *event, size_t size, TCG_EVENT_HEADER2 **next);
 bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t size);
 
+/*
+ * Feed the next chunk of an event log to the parser. Chunks may split events
+ * at any byte, the incomplete tail is kept until the next call. Every complete
+ * event is parsed, replayed into the PCR banks and counted in ctx->offset and
+ * ctx->events, so parsing can continue from a saved context.
+ */
+bool parse_eventlog_chunk(tpm2_eventlog_context *ctx, BYTE const *chunk,
+                          size_t size);
+/*
+ * Ends parsing with parse_eventlog_chunk(), failing if the log ended in the
+ * middle of an event.
+ */
+bool parse_eventlog_finish(tpm2_eventlog_context *ctx);
+
+/*
+ * Save and load the parser state and the replayed PCR banks, so a later run
+ * only needs to parse the events appended to the log since. The state keeps
+ * a digest of the part of the log it covers, when that part of the log
+ * changed, for example after a reboot, the state is reported as stale and
+ * the context is left untouched.
+ */
+bool eventlog_state_save(tpm2_eventlog_context *ctx, BYTE const *eventlog,
+        const char *path);
+bool eventlog_state_load(tpm2_eventlog_context *ctx, BYTE const *eventlog,
+        size_t size, const char *path, bool *is_stale);
+
+/*
+ * A pool of threads verifying the event payload digests, while the events are
+ * still parsed and replayed in order. Mismatches are reported in event order,
+ * like inline verification they are warnings that don't fail the parse.
+ * A jobs count of 0 uses one thread per online CPU.
+ */
+tpm2_eventlog_verifier *eventlog_verifier_new(unsigned jobs);
+void eventlog_verifier_free(tpm2_eventlog_verifier *verifier);
+/*
+ * Waits for all submitted events to be verified and reported.
+ */
+void eventlog_verifier_wait(tpm2_eventlog_verifier *verifier);
+
 #endif
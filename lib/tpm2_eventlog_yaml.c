@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <uchar.h>
+#include <unistd.h>
 
 #include <tss2/tss2_tpm2_types.h>
 
@@ -15,6 +16,7 @@
 #include "tpm2_eventlog_yaml.h"
 #include "tpm2_tool.h"
 #include "tpm2_tool_output.h"
+#include "tpm2_util.h"
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -90,12 +92,13 @@ char const *eventtype_to_string (UINT32 event_type) {
 }
 void bytes_to_str(uint8_t const *buf, size_t size, char *dest, size_t dest_size) {
 
-    size_t i, j;
-
-    for(i = 0, j = 0; i < size && j < dest_size - 2; ++i, j+=2) {
-        sprintf(&dest[j], "%02x", buf[i]);
+    if (!dest_size) {
+        return;
     }
-    dest[j] = '\0';
+
+    /* truncate to what fits, leaving room for the NULL terminator */
+    size_t max = (dest_size - 1) / 2;
+    tpm2_util_hex_encode(buf, size < max ? size : max, dest);
 }
 void yaml_event2hdr(TCG_EVENT_HEADER2 const *eventhdr, size_t size) {
 
@@ -854,63 +857,32 @@ static void yaml_eventlog_pcrs(tpm2_eventlog_context *ctx) {
 
     tpm2_tool_output("pcrs:\n");
 
-    if (ctx->sha1_used != 0) {
-        tpm2_tool_output("  sha1:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha1_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha1_pcrs[i], sizeof(ctx->sha1_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
+    size_t i;
+    for (i = 0; i < ctx->bank_count; i++) {
+        tpm2_eventlog_bank *bank = &ctx->banks[i];
+        if (bank->used == 0) {
+            continue;
         }
-    }
 
-    if (ctx->sha256_used != 0) {
-        tpm2_tool_output("  sha256:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha256_used & (1 << i)) == 0)
+        tpm2_tool_output("  %s:\n",
+                tpm2_alg_util_algtostr(bank->alg, tpm2_alg_util_flags_hash));
+        for(unsigned pcr = 0 ; pcr < TPM2_MAX_PCRS ; pcr++) {
+            if ((bank->used & (UINT32_C(1) << pcr)) == 0)
                 continue;
-            bytes_to_str(ctx->sha256_pcrs[i], sizeof(ctx->sha256_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
-
-    if (ctx->sha384_used != 0) {
-        tpm2_tool_output("  sha384:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha384_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha384_pcrs[i], sizeof(ctx->sha384_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
+            bytes_to_str(bank->pcrs[pcr], bank->size, hexstr, sizeof(hexstr));
+            tpm2_tool_output("    %-2d : 0x%s\n", pcr, hexstr);
         }
     }
+}
 
-    if (ctx->sha512_used != 0) {
-        tpm2_tool_output("  sha512:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha512_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha512_pcrs[i], sizeof(ctx->sha512_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
+bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version) {
 
-    if (ctx->sm3_256_used != 0) {
-        tpm2_tool_output("  sm3_256:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sm3_256_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sm3_256_pcrs[i], sizeof(ctx->sm3_256_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
+    return yaml_eventlog_resume(eventlog, size, eventlog_version, NULL, NULL);
 }
 
-bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version) {
+bool yaml_eventlog_resume(UINT8 const *eventlog, size_t size,
+                          uint32_t eventlog_version, const char *state_path,
+                          tpm2_eventlog_verifier *verifier) {
 
     if (eventlog_version < MIN_EVLOG_YAML_VERSION || 
         eventlog_version > MAX_EVLOG_YAML_VERSION) {
@@ -927,16 +899,47 @@ bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version
         .digest2_cb = yaml_digest2_callback,
         .event2_cb = yaml_event2data_callback,
         .eventlog_version = eventlog_version,
+        .verifier = verifier,
     };
 
+    bool rc = true;
+    bool resume = state_path && access(state_path, F_OK) == 0;
+    if (resume) {
+        bool is_stale = false;
+        rc = eventlog_state_load(&ctx, eventlog, size, state_path, &is_stale);
+        if (!rc) {
+            goto out;
+        }
+        if (is_stale) {
+            LOG_WARN("The eventlog doesn't match the resume state, it was "
+                    "likely reset by a reboot, parsing it from the start");
+        }
+        count = ctx.events;
+    }
+
     tpm2_tool_output("---\n");
     tpm2_tool_output("version: %u\n", eventlog_version);
     tpm2_tool_output("events:\n");
-    bool rc = parse_eventlog(&ctx, eventlog, size);
+    if (state_path) {
+        /* only the events appended since the saved state are parsed */
+        rc = eventlog && parse_eventlog_chunk(&ctx, &eventlog[ctx.offset],
+                size - ctx.offset);
+        rc = parse_eventlog_finish(&ctx) && rc;
+    } else {
+        rc = parse_eventlog(&ctx, eventlog, size);
+    }
     if (!rc) {
-        return rc;
+        goto out;
     }
 
     yaml_eventlog_pcrs(&ctx);
-    return true;
+
+    if (state_path) {
+        rc = eventlog_state_save(&ctx, eventlog, state_path);
+    }
+
+out:
+    eventlog_context_cleanup(&ctx);
+
+    return rc;
 }
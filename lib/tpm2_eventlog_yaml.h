@@ -23,5 +23,14 @@ bool yaml_event2data_callback(TCG_EVENT2 const *event, UINT32 type, void *data,
                               uint32_t eventlog_version);
 
 bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version);
+/*
+ * Like yaml_eventlog(), but when the state file exists only the events after
+ * the saved offset are parsed and the PCRs are replayed from the saved banks.
+ * The state file is (re)written on success. Both the state path and the
+ * verifier are optional.
+ */
+bool yaml_eventlog_resume(UINT8 const *eventlog, size_t size,
+                          uint32_t eventlog_version, const char *state_path,
+                          tpm2_eventlog_verifier *verifier);
 
 #endif
@@ -0,0 +1,536 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "pcr.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_golden.h"
+#include "tpm2_openssl.h"
+#include "tpm2_util.h"
+
+#define GOLDEN_INITIAL_CAPACITY 64
+
+/*
+ * The combinations allowed for one selection, each the concatenation of its
+ * values in selection order, which is what a quote hashes into its
+ * pcrDigest. The index is an open addressing table of combination numbers
+ * plus one, free slots are zero.
+ */
+typedef struct golden_set golden_set;
+struct golden_set {
+    TPML_PCR_SELECTION pcr_select;
+    size_t value_size;
+    size_t count;
+    size_t capacity;
+    BYTE *values;
+    size_t *index;
+};
+
+/*
+ * The composite digests of the combinations of one selection, for one hash
+ * algorithm, in an open addressing table. Digests come out of a hash
+ * function, so their first bytes are used as the table hash. Free slots have
+ * a zero size.
+ */
+typedef struct golden_table golden_table;
+struct golden_table {
+    size_t capacity;
+    TPM2B_DIGEST *digests;
+};
+
+/* the tables of all the selections for one quote hash algorithm */
+typedef struct golden_compiled golden_compiled;
+struct golden_compiled {
+    TPMI_ALG_HASH halg;
+    golden_table *tables;
+    golden_compiled *next;
+};
+
+struct tpm2_golden {
+    size_t count;
+    size_t set_count;
+    golden_set *sets;
+    /*
+     * Quotes are hashed with the hash algorithm of their signing scheme, the
+     * tables for it are compiled on first use and kept until freed.
+     */
+    pthread_mutex_t lock;
+    golden_compiled *compiled;
+};
+
+static bool is_pcr_selected(const TPMS_PCR_SELECTION *selection,
+        unsigned pcr_id) {
+
+    return pcr_id / 8 < selection->sizeofSelect
+            && (selection->pcrSelect[pcr_id / 8] & (1 << (pcr_id % 8)));
+}
+
+/*
+ * Selections are equal when they select the same PCRs of the same banks in
+ * the same order, whatever the size of their bitmaps.
+ */
+static bool selection_equal(const TPML_PCR_SELECTION *a,
+        const TPML_PCR_SELECTION *b) {
+
+    if (a->count != b->count) {
+        return false;
+    }
+
+    UINT32 i;
+    for (i = 0; i < a->count; i++) {
+        const TPMS_PCR_SELECTION *sa = &a->pcrSelections[i];
+        const TPMS_PCR_SELECTION *sb = &b->pcrSelections[i];
+        if (sa->hash != sb->hash) {
+            return false;
+        }
+
+        unsigned pcr_id;
+        for (pcr_id = 0; pcr_id < sizeof(sa->pcrSelect) * 8; pcr_id++) {
+            if (is_pcr_selected(sa, pcr_id) != is_pcr_selected(sb, pcr_id)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/* FNV-1a, PCR values often repeat across combinations so all bytes count */
+static size_t golden_value_hash(const BYTE *value, size_t size) {
+
+    size_t hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash = (hash ^ value[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static size_t *golden_set_slot(const golden_set *set, const BYTE *value) {
+
+    size_t mask = set->capacity - 1;
+    size_t i = golden_value_hash(value, set->value_size) & mask;
+    while (set->index[i] && memcmp(&set->values[(set->index[i] - 1)
+            * set->value_size], value, set->value_size)) {
+        i = (i + 1) & mask;
+    }
+
+    return &set->index[i];
+}
+
+/*
+ * Makes room for one more combination, growing the index at a load factor
+ * of 1/2.
+ */
+static bool golden_set_reserve(golden_set *set) {
+
+    if ((set->count + 1) * 2 <= set->capacity) {
+        return true;
+    }
+
+    size_t capacity = set->capacity ? set->capacity * 2 :
+            GOLDEN_INITIAL_CAPACITY;
+    size_t *index = calloc(capacity, sizeof(*index));
+    BYTE *values = realloc(set->values, capacity / 2 * set->value_size);
+    if (!index || !values) {
+        LOG_ERR("oom");
+        free(index);
+        if (values) {
+            set->values = values;
+        }
+        return false;
+    }
+
+    golden_set grown = *set;
+    grown.capacity = capacity;
+    grown.values = values;
+    grown.index = index;
+
+    size_t i;
+    for (i = 0; i < set->count; i++) {
+        *golden_set_slot(&grown, &values[i * set->value_size]) = i + 1;
+    }
+
+    free(set->index);
+    *set = grown;
+
+    return true;
+}
+
+static TPM2B_DIGEST *golden_table_slot(const golden_table *table,
+        const TPM2B_DIGEST *digest) {
+
+    size_t hash = 0;
+    memcpy(&hash, digest->buffer,
+            digest->size < sizeof(hash) ? digest->size : sizeof(hash));
+
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    while (table->digests[i].size
+            && (table->digests[i].size != digest->size
+                    || memcmp(table->digests[i].buffer, digest->buffer,
+                            digest->size))) {
+        i = (i + 1) & mask;
+    }
+
+    return &table->digests[i];
+}
+
+static golden_set *golden_find_set(const tpm2_golden *golden,
+        const TPML_PCR_SELECTION *pcr_select) {
+
+    size_t i;
+    for (i = 0; i < golden->set_count; i++) {
+        if (selection_equal(&golden->sets[i].pcr_select, pcr_select)) {
+            return &golden->sets[i];
+        }
+    }
+
+    return NULL;
+}
+
+static golden_set *golden_add_set(tpm2_golden *golden, const char *selection,
+        unsigned line) {
+
+    TPML_PCR_SELECTION pcr_select;
+    if (!pcr_parse_selections(selection, &pcr_select)) {
+        LOG_ERR("Line %u: invalid PCR selection \"%s\"", line, selection);
+        return NULL;
+    }
+
+    size_t value_size = 0;
+    UINT32 i;
+    for (i = 0; i < pcr_select.count; i++) {
+        const TPMS_PCR_SELECTION *bank = &pcr_select.pcrSelections[i];
+        UINT16 size = tpm2_alg_util_get_hash_size(bank->hash);
+        if (!size) {
+            LOG_ERR("Line %u: unsupported PCR bank in \"%s\"", line,
+                    selection);
+            return NULL;
+        }
+
+        unsigned pcr_id;
+        for (pcr_id = 0; pcr_id < bank->sizeofSelect * 8u; pcr_id++) {
+            value_size += is_pcr_selected(bank, pcr_id) ? size : 0;
+        }
+    }
+
+    if (!value_size) {
+        LOG_ERR("Line %u: no PCR selected in \"%s\"", line, selection);
+        return NULL;
+    }
+
+    golden_set *set = golden_find_set(golden, &pcr_select);
+    if (set) {
+        return set;
+    }
+
+    set = realloc(golden->sets, (golden->set_count + 1) * sizeof(*set));
+    if (!set) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    golden->sets = set;
+    set = &golden->sets[golden->set_count++];
+    memset(set, 0, sizeof(*set));
+    set->pcr_select = pcr_select;
+    set->value_size = value_size;
+
+    return set;
+}
+
+/*
+ * Parses one combination of values in selection order and adds it to the
+ * set, unless it is listed already.
+ */
+static bool golden_add_values(tpm2_golden *golden, golden_set *set,
+        char *values, unsigned line) {
+
+    if (!golden_set_reserve(set)) {
+        return false;
+    }
+
+    /* parsed in place, in the free room after the last combination */
+    BYTE *value = &set->values[set->count * set->value_size];
+    size_t offset = 0;
+
+    char *saveptr = NULL;
+    char *token = strtok_r(values, " \t", &saveptr);
+
+    UINT32 i;
+    for (i = 0; i < set->pcr_select.count; i++) {
+        const TPMS_PCR_SELECTION *selection = &set->pcr_select.pcrSelections[i];
+        UINT16 size = tpm2_alg_util_get_hash_size(selection->hash);
+
+        unsigned pcr_id;
+        for (pcr_id = 0; pcr_id < selection->sizeofSelect * 8u; pcr_id++) {
+            if (!is_pcr_selected(selection, pcr_id)) {
+                continue;
+            }
+
+            if (!token) {
+                LOG_ERR("Line %u: missing the value of %s PCR %u", line,
+                        tpm2_alg_util_algtostr(selection->hash,
+                                tpm2_alg_util_flags_hash), pcr_id);
+                return false;
+            }
+
+            if (strlen(token) != size * 2u || !tpm2_util_hex_decode(token,
+                    size * 2u, &value[offset])) {
+                LOG_ERR("Line %u: invalid value \"%s\" for %s PCR %u", line,
+                        token, tpm2_alg_util_algtostr(selection->hash,
+                                tpm2_alg_util_flags_hash), pcr_id);
+                return false;
+            }
+            offset += size;
+
+            token = strtok_r(NULL, " \t", &saveptr);
+        }
+    }
+
+    if (token) {
+        LOG_ERR("Line %u: more values than selected PCRs", line);
+        return false;
+    }
+
+    size_t *slot = golden_set_slot(set, value);
+    if (!*slot) {
+        *slot = ++set->count;
+        golden->count++;
+    }
+
+    return true;
+}
+
+static bool golden_parse(tpm2_golden *golden, FILE *f) {
+
+    golden_set *set = NULL;
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned line_no = 0;
+    bool result = true;
+
+    while (result && getline(&line, &line_size, f) >= 0) {
+        line_no++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *start = line + strspn(line, " \t\r\n");
+        size_t len = strlen(start);
+        while (len && strchr(" \t\r\n", start[len - 1])) {
+            start[--len] = '\0';
+        }
+
+        if (!len) {
+            continue;
+        }
+
+        if (strchr(start, ':')) {
+            set = golden_add_set(golden, start, line_no);
+            result = set != NULL;
+        } else if (!set) {
+            LOG_ERR("Line %u: PCR values before any PCR selection", line_no);
+            result = false;
+        } else {
+            result = golden_add_values(golden, set, start, line_no);
+        }
+    }
+
+    if (result && ferror(f)) {
+        LOG_ERR("Could not read golden PCR policy, error: %s",
+                strerror(errno));
+        result = false;
+    }
+
+    free(line);
+
+    return result;
+}
+
+tpm2_golden *tpm2_golden_load(const char *path) {
+
+    tpm2_golden *golden = calloc(1, sizeof(*golden));
+    if (!golden) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+    pthread_mutex_init(&golden->lock, NULL);
+
+    bool is_stdin = !strcmp(path, "-");
+    FILE *f = is_stdin ? stdin : fopen(path, "r");
+    if (!f) {
+        LOG_ERR("Could not open golden PCR policy \"%s\", error: %s", path,
+                strerror(errno));
+        goto error;
+    }
+
+    bool result = golden_parse(golden, f);
+    if (!is_stdin) {
+        fclose(f);
+    }
+
+    if (!result) {
+        LOG_ERR("Could not compile golden PCR policy \"%s\"", path);
+        goto error;
+    }
+
+    return golden;
+
+error:
+    tpm2_golden_free(golden);
+
+    return NULL;
+}
+
+static void golden_compiled_free(golden_compiled *compiled, size_t count) {
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(compiled->tables[i].digests);
+    }
+
+    free(compiled->tables);
+    free(compiled);
+}
+
+static golden_compiled *golden_compile(const tpm2_golden *golden,
+        TPMI_ALG_HASH halg) {
+
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(halg);
+    if (!md) {
+        LOG_ERR("Unsupported hash algorithm for golden PCR values");
+        return NULL;
+    }
+
+    golden_compiled *compiled = calloc(1, sizeof(*compiled));
+    if (!compiled) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+    compiled->halg = halg;
+
+    compiled->tables = calloc(golden->set_count, sizeof(*compiled->tables));
+    if (golden->set_count && !compiled->tables) {
+        LOG_ERR("oom");
+        free(compiled);
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < golden->set_count; i++) {
+        const golden_set *set = &golden->sets[i];
+        golden_table *table = &compiled->tables[i];
+
+        /* the combinations are distinct, so are their digests */
+        table->capacity = GOLDEN_INITIAL_CAPACITY;
+        while (table->capacity < set->count * 2) {
+            table->capacity *= 2;
+        }
+
+        table->digests = calloc(table->capacity, sizeof(*table->digests));
+        if (!table->digests) {
+            LOG_ERR("oom");
+            golden_compiled_free(compiled, i);
+            return NULL;
+        }
+
+        size_t j;
+        for (j = 0; j < set->count; j++) {
+            TPM2B_DIGEST digest = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+            unsigned size = 0;
+            if (!EVP_Digest(&set->values[j * set->value_size],
+                    set->value_size, digest.buffer, &size, md, NULL)) {
+                LOG_ERR("Could not hash the golden PCR values");
+                golden_compiled_free(compiled, i + 1);
+                return NULL;
+            }
+            digest.size = size;
+            *golden_table_slot(table, &digest) = digest;
+        }
+    }
+
+    return compiled;
+}
+
+/* the tables for the algorithm, compiled by the first caller needing them */
+static const golden_compiled *golden_get_compiled(tpm2_golden *golden,
+        TPMI_ALG_HASH halg) {
+
+    pthread_mutex_lock(&golden->lock);
+
+    golden_compiled *compiled = golden->compiled;
+    while (compiled && compiled->halg != halg) {
+        compiled = compiled->next;
+    }
+
+    if (!compiled) {
+        compiled = golden_compile(golden, halg);
+        if (compiled) {
+            compiled->next = golden->compiled;
+            golden->compiled = compiled;
+        }
+    }
+
+    pthread_mutex_unlock(&golden->lock);
+
+    return compiled;
+}
+
+bool tpm2_golden_contains(tpm2_golden *golden, TPMI_ALG_HASH halg,
+        const TPML_PCR_SELECTION *pcr_select, const TPM2B_DIGEST *digest) {
+
+    if (!digest->size) {
+        return false;
+    }
+
+    golden_set *set = golden_find_set(golden, pcr_select);
+    if (!set || !set->count) {
+        return false;
+    }
+
+    const golden_compiled *compiled = golden_get_compiled(golden, halg);
+    if (!compiled) {
+        return false;
+    }
+
+    return golden_table_slot(&compiled->tables[set - golden->sets],
+            digest)->size != 0;
+}
+
+size_t tpm2_golden_count(const tpm2_golden *golden) {
+
+    return golden->count;
+}
+
+void tpm2_golden_free(tpm2_golden *golden) {
+
+    if (!golden) {
+        return;
+    }
+
+    while (golden->compiled) {
+        golden_compiled *next = golden->compiled->next;
+        golden_compiled_free(golden->compiled, golden->set_count);
+        golden->compiled = next;
+    }
+
+    size_t i;
+    for (i = 0; i < golden->set_count; i++) {
+        free(golden->sets[i].values);
+        free(golden->sets[i].index);
+    }
+
+    pthread_mutex_destroy(&golden->lock);
+    free(golden->sets);
+    free(golden);
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_GOLDEN_H_
+#define LIB_TPM2_GOLDEN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * The allowed, or golden, PCR values of a quote. A policy lists PCR
+ * selections, each followed by the allowed combinations of values for it,
+ * one per line:
+ *
+ *   # firmware 1.2
+ *   sha256:0,2,7
+ *   <PCR 0 hex> <PCR 2 hex> <PCR 7 hex>
+ *   <PCR 0 hex> <PCR 2 hex> <PCR 7 hex>
+ *
+ * Values are given in the order of the selection, bank by bank and by
+ * increasing PCR index. Lines with a ':' start a selection, text after a '#'
+ * is ignored and a selection may appear more than once.
+ *
+ * The combinations are compiled into a hash set of their composite digests,
+ * as they appear in the pcrDigest of a quote, so checking a quote doesn't
+ * depend on the number of combinations. A quote hashes them with the hash
+ * algorithm of its signature, a set is compiled for each one on first use.
+ */
+typedef struct tpm2_golden tpm2_golden;
+
+/**
+ * Loads a golden PCR policy.
+ * @param path
+ *  The policy file, "-" reads it from stdin.
+ * @return
+ *  The policy or NULL on error.
+ */
+tpm2_golden *tpm2_golden_load(const char *path);
+
+/**
+ * Checks a quoted PCR digest against a policy, it is safe to call from many
+ * threads at once.
+ * @param golden
+ *  The policy.
+ * @param halg
+ *  The hash algorithm of the quote.
+ * @param pcr_select
+ *  The PCR selection of the quote.
+ * @param digest
+ *  The pcrDigest of the quote.
+ * @return
+ *  true if the digest is one of the allowed combinations for the selection.
+ */
+bool tpm2_golden_contains(tpm2_golden *golden, TPMI_ALG_HASH halg,
+        const TPML_PCR_SELECTION *pcr_select, const TPM2B_DIGEST *digest);
+
+/**
+ * Returns the number of distinct allowed combinations of a policy.
+ */
+size_t tpm2_golden_count(const tpm2_golden *golden);
+
+void tpm2_golden_free(tpm2_golden *golden);
+
+#endif /* LIB_TPM2_GOLDEN_H_ */
@@ -1,21 +1,224 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "files.h"
 #include "log.h"
 #include "tpm2.h"
 #include "tpm2_hash.h"
 
+/*
+ * Large files are hashed with a reader thread that keeps a ring of chunks
+ * filled ahead of the TPM submission loop, so disk reads overlap with the
+ * sequence update round trips instead of alternating with them.
+ */
+#define HASH_PIPELINE_DEPTH 8
+
+typedef struct hash_pipeline hash_pipeline;
+struct hash_pipeline {
+    FILE *input;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    TPM2B_MAX_BUFFER chunks[HASH_PIPELINE_DEPTH];
+    /* next slot for the reader to fill */
+    size_t head;
+    /* next slot for the TPM loop to consume */
+    size_t tail;
+    size_t count;
+    bool eof;
+    bool error;
+    bool cancel;
+};
+
+static void *hash_pipeline_reader(void *arg) {
+
+    hash_pipeline *p = (hash_pipeline *) arg;
+
+    /*
+     * A read from a fifo or stdin may block forever when the TPM loop gives
+     * up, so the reader is cancelled then. Cancellation is only enabled
+     * around the read, never while the lock is held, and stdio releases the
+     * FILE lock when a read is cancelled.
+     */
+    int state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+
+    while (true) {
+        pthread_mutex_lock(&p->lock);
+        while (p->count == HASH_PIPELINE_DEPTH && !p->cancel) {
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        bool cancel = p->cancel;
+        size_t head = p->head;
+        pthread_mutex_unlock(&p->lock);
+
+        if (cancel) {
+            break;
+        }
+
+        /* the slot at head is not visible to the consumer until published */
+        TPM2B_MAX_BUFFER *chunk = &p->chunks[head];
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+        chunk->size = fread(chunk->buffer, 1,
+                BUFFER_SIZE(TPM2B_MAX_BUFFER, buffer), p->input);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        bool error = ferror(p->input);
+        bool eof = !error && chunk->size < BUFFER_SIZE(TPM2B_MAX_BUFFER, buffer);
+
+        pthread_mutex_lock(&p->lock);
+        if (chunk->size && !error) {
+            p->head = (head + 1) % HASH_PIPELINE_DEPTH;
+            p->count++;
+        }
+        p->eof = eof;
+        p->error = error;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+
+        if (eof || error) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Waits for the next chunk. Returns false on a read error, otherwise true
+ * with done set once the input is exhausted.
+ */
+static bool hash_pipeline_next(hash_pipeline *p, TPM2B_MAX_BUFFER *chunk,
+        bool *done) {
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->count && !p->eof && !p->error) {
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+
+    bool result = !p->error;
+    *done = !p->count;
+    if (result && !*done) {
+        *chunk = p->chunks[p->tail];
+        p->tail = (p->tail + 1) % HASH_PIPELINE_DEPTH;
+        p->count--;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (!result) {
+        LOG_ERR("Error reading from input file");
+    }
+
+    return result;
+}
+
+static double hash_elapsed(const struct timespec *start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec)
+            + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static tool_rc tpm2_hash_file_sequence(ESYS_CONTEXT *ectx,
+        TPMI_ALG_HASH halg, TPMI_RH_HIERARCHY hierarchy, FILE *infilep,
+        TPM2B_DIGEST **result, TPMT_TK_HASHCHECK **validation) {
+
+    TPM2B_AUTH null_auth = TPM2B_EMPTY_INIT;
+    TPMI_DH_OBJECT sequence_handle;
+
+    tool_rc rc = tpm2_hash_sequence_start(ectx, &null_auth, halg,
+            &sequence_handle);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    hash_pipeline p = {
+        .input = infilep,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t reader;
+    int err = pthread_create(&reader, NULL, hash_pipeline_reader, &p);
+    if (err) {
+        LOG_ERR("Could not start the reader thread, error: %s", strerror(err));
+        tpm2_flush_context(ectx, sequence_handle);
+        return tool_rc_general_error;
+    }
+
+    /*
+     * Hold one chunk back, so the last chunk of the input, which may be
+     * short or even absent for an empty fifo, goes into the complete call.
+     */
+    TPM2B_MAX_BUFFER pending = TPM2B_EMPTY_INIT;
+    TPM2B_MAX_BUFFER next;
+    unsigned long long total = 0;
+    bool done = false;
+    while (true) {
+        bool res = hash_pipeline_next(&p, &next, &done);
+        if (!res) {
+            rc = tool_rc_general_error;
+            goto out;
+        }
+
+        if (done) {
+            break;
+        }
+
+        if (pending.size) {
+            rc = tpm2_sequence_update(ectx, sequence_handle, &pending);
+            if (rc != tool_rc_success) {
+                goto out;
+            }
+            total += pending.size;
+        }
+
+        pending = next;
+    }
+
+    rc = tpm2_sequence_complete(ectx, sequence_handle, &pending, hierarchy,
+            result, validation);
+    if (rc == tool_rc_success) {
+        total += pending.size;
+        double secs = hash_elapsed(&start);
+        LOG_INFO("Hashed %llu bytes in %.3f seconds, %.1f KiB/s", total, secs,
+                secs > 0 ? total / 1024.0 / secs : 0.0);
+    }
+
+out:
+    pthread_mutex_lock(&p.lock);
+    bool is_reading = !p.eof && !p.error;
+    p.cancel = true;
+    pthread_cond_broadcast(&p.cond);
+    pthread_mutex_unlock(&p.lock);
+    if (is_reading) {
+        pthread_cancel(reader);
+    }
+    pthread_join(reader, NULL);
+
+    /* the TPM only flushes the sequence when it completes successfully */
+    if (rc != tool_rc_success) {
+        tpm2_flush_context(ectx, sequence_handle);
+    }
+
+    return rc;
+}
+
 static tool_rc tpm2_hash_common(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
         TPMI_RH_HIERARCHY hierarchy, FILE *infilep, BYTE *inbuffer,
         UINT16 inbuffer_len, TPM2B_DIGEST **result,
         TPMT_TK_HASHCHECK **validation) {
-    bool use_left = true, done;
+    bool use_left = true;
     unsigned long left = inbuffer_len;
-    size_t bytes_read;
     TPM2B_AUTH null_auth = TPM2B_EMPTY_INIT;
     TPMI_DH_OBJECT sequence_handle;
     TPM2B_MAX_BUFFER buffer;
@@ -42,71 +245,46 @@ static tool_rc tpm2_hash_common(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
         return tpm2_hash(ectx, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE,
                 &buffer, halg, hierarchy, result, validation);
     }
+
     /*
      * length is either unknown because the FILE * is a fifo, or it's too
-     * big to do in a single hash call. Based on the size figure out the
-     * chunks to loop over, if possible. This way we can call Complete with
-     * data.
+     * big to do in a single hash call. Files, sized or not, are streamed
+     * through the sequence by the reader pipeline.
+     */
+    if (!!infilep) {
+        return tpm2_hash_file_sequence(ectx, halg, hierarchy, infilep, result,
+                validation);
+    }
+
+    /*
+     * Based on the size figure out the chunks to loop over. This way we
+     * can call Complete with data.
      */
     tool_rc rc = tpm2_hash_sequence_start(ectx, &null_auth, halg, &sequence_handle);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    /* If we know the file size, we decrement the amount read and terminate
-     * the loop when 1 block is left, else we go till feof.
+    /* We decrement the amount read and terminate the loop when 1 block is
+     * left.
      */
-    done = false;
-    while (!done) {
-        /*  if we're using infilep, read the file. Otherwise, directly
-         copy into our local buffer. */
+    while (left > TPM2_MAX_DIGEST_BUFFER) {
         buffer.size = BUFFER_SIZE(typeof(buffer), buffer);
-        if (!!infilep) {
-            bytes_read = fread(buffer.buffer, 1, buffer.size, infilep);
-            if (ferror(infilep)) {
-                LOG_ERR("Error reading from input file");
-                return tool_rc_general_error;
-            } else {
-                buffer.size = bytes_read;
-            }
-        } else {
-            memcpy(buffer.buffer, inbuffer, buffer.size);
-            inbuffer = inbuffer + buffer.size;
-        }
+        memcpy(buffer.buffer, inbuffer, buffer.size);
+        inbuffer = inbuffer + buffer.size;
 
         rc = tpm2_sequence_update(ectx, sequence_handle, &buffer);
         if (rc != tool_rc_success) {
             return rc;
         }
 
-        if (use_left) {
-            left -= buffer.size;
-            if (left <= TPM2_MAX_DIGEST_BUFFER) {
-                done = true;
-                continue;
-            }
-        } else if (!!infilep && feof(infilep)) {
-            done = true;
-        }
-    } /* end file read/hash update loop */
-
-    /*  if there is data left, get the last bit of data from the file or
-     buffer or set the size to zero */
-    if (use_left) {
-        buffer.size = left;
-        if (!!infilep) {
-            bool res = files_read_bytes(infilep, buffer.buffer, buffer.size);
-            if (!res) {
-                LOG_ERR("Error reading from input file.");
-                return tool_rc_general_error;
-            }
-        } else {
-            memcpy(buffer.buffer, inbuffer, buffer.size);
-        }
-    } else {
-        buffer.size = 0;
+        left -= buffer.size;
     }
 
+    /*  get the last bit of data from the buffer */
+    buffer.size = left;
+    memcpy(buffer.buffer, inbuffer, buffer.size);
+
     return tpm2_sequence_complete(ectx, sequence_handle,
             &buffer, hierarchy, result, validation);
 }
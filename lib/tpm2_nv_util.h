@@ -9,6 +9,7 @@
 #include "log.h"
 #include "tpm2.h"
 #include "tpm2_capability.h"
+#include "tpm2_capability_cache.h"
 #include "tpm2_session.h"
 #include "tpm2_auth_util.h"
 #include "tpm2_hierarchy.h"
@@ -50,8 +51,8 @@ static inline tool_rc tpm2_util_nv_read_public(ESYS_CONTEXT *context,
 }
 
 /**
- * Retrieves the maximum transmission size for an NV buffer by
- * querying the capabilities for TPM2_PT_NV_BUFFER_MAX.
+ * Retrieves the maximum transmission size for an NV buffer from the
+ * TPM2_PT_NV_BUFFER_MAX fixed property, read through the capability cache.
  * @param context
  *  The Enhanced System API (ESAPI) context
  * @param size
@@ -62,25 +63,19 @@ static inline tool_rc tpm2_util_nv_read_public(ESYS_CONTEXT *context,
 static inline tool_rc tpm2_util_nv_max_buffer_size(ESYS_CONTEXT *ectx,
         UINT32 *size) {
 
-    /* Get the maximum read block size */
-    TPMS_CAPABILITY_DATA *cap_data;
-    TPMI_YES_NO more_data;
-    tool_rc rc = tpm2_getcap(ectx, TPM2_CAP_TPM_PROPERTIES,
-            TPM2_PT_NV_BUFFER_MAX, 1, &more_data, &cap_data);
+    bool found = false;
+    tool_rc rc = tpm2_capability_cache_get_property(ectx,
+            TPM2_PT_NV_BUFFER_MAX, size, &found);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    if ( cap_data->data.tpmProperties.tpmProperty[0].property == TPM2_PT_NV_BUFFER_MAX ) {
-        *size = cap_data->data.tpmProperties.tpmProperty[0].value;
-    } else {
+    if (!found) {
         /* TPM2_PT_NV_BUFFER_MAX is not part of the module spec <= 0.98*/
         *size = NV_DEFAULT_BUFFER_SIZE;
     }
 
-    free(cap_data);
-
-    return rc;
+    return tool_rc_success;
 }
 
 /**
@@ -113,8 +108,16 @@ static inline tool_rc tpm2_util_nv_read(ESYS_CONTEXT *ectx,
 
     *data_buffer = NULL;
 
+    /* the index is looked up once and used for every chunk */
+    ESYS_TR nv_object;
+    tool_rc rc = tpm2_from_tpm_public(ectx, nv_index, ESYS_TR_NONE,
+            ESYS_TR_NONE, ESYS_TR_NONE, &nv_object);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
     TPM2B_NV_PUBLIC *nv_public = NULL;
-    tool_rc rc = tpm2_util_nv_read_public(ectx, nv_index, &nv_public);
+    rc = tpm2_nv_readpublic(ectx, nv_object, &nv_public, NULL);
     if (rc != tool_rc_success) {
         goto out;
     }
@@ -143,7 +146,13 @@ static inline tool_rc tpm2_util_nv_read(ESYS_CONTEXT *ectx,
     }
 
     if (cp_hash) {
-        goto tpm2_util_nv_read_collect_cp_hash;
+        TPM2B_MAX_NV_BUFFER *nv_data;
+        rc = tpm2_nv_read(ectx, auth_hierarchy_obj, nv_index, size, offset,
+            &nv_data, cp_hash);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Failed cpHash for NVRAM read at index 0x%X", nv_index);
+        }
+        goto out;
     }
 
     UINT32 max_data_size;
@@ -158,17 +167,6 @@ static inline tool_rc tpm2_util_nv_read(ESYS_CONTEXT *ectx,
         max_data_size = NV_DEFAULT_BUFFER_SIZE;
     }
 
-tpm2_util_nv_read_collect_cp_hash:
-    if (cp_hash) {
-        TPM2B_MAX_NV_BUFFER *nv_data;
-        rc = tpm2_nv_read(ectx, auth_hierarchy_obj, nv_index, size, offset,
-            &nv_data, cp_hash);
-        if (rc != tool_rc_success) {
-            LOG_ERR("Failed cpHash for NVRAM read at index 0x%X", nv_index);
-        }
-        goto out;
-    }
-
     *data_buffer = malloc(data_size);
     if (!*data_buffer) {
         LOG_ERR("oom");
@@ -184,13 +182,21 @@ tpm2_util_nv_read_collect_cp_hash:
 
         TPM2B_MAX_NV_BUFFER *nv_data;
 
-        rc = tpm2_nv_read(ectx, auth_hierarchy_obj, nv_index, bytes_to_read,
-            offset, &nv_data, cp_hash);
+        rc = tpm2_nv_read_tr(ectx, auth_hierarchy_obj, nv_object,
+            bytes_to_read, offset, &nv_data);
         if (rc != tool_rc_success) {
             LOG_ERR("Failed to read NVRAM area at index 0x%X", nv_index);
             goto out;
         }
 
+        if (!nv_data->size || nv_data->size > bytes_to_read) {
+            LOG_ERR("Unexpected read size %u at index 0x%X, requested %u",
+                    nv_data->size, nv_index, bytes_to_read);
+            free(nv_data);
+            rc = tool_rc_general_error;
+            goto out;
+        }
+
         size -= nv_data->size;
         offset += nv_data->size;
 
@@ -205,6 +211,13 @@ tpm2_util_nv_read_collect_cp_hash:
     }
 
 out:
+    if (nv_object != ESYS_TR_NONE) {
+        tool_rc tmp_rc = tpm2_close(ectx, &nv_object);
+        if (rc == tool_rc_success) {
+            rc = tmp_rc;
+        }
+    }
+
     if (rc != tool_rc_success && *data_buffer != NULL) {
         free(*data_buffer);
         *data_buffer = NULL;
@@ -240,4 +253,69 @@ static inline bool on_arg_nv_index(int argc, char **argv,
     return true;
 }
 
+/**
+ * Parses a list of NV indices given as arguments, or "all".
+ * @param argc
+ *  The number of arguments.
+ * @param argv
+ *  The arguments.
+ * @param indices
+ *  The indices, left empty for "all".
+ * @param all
+ *  Set when "all" was given.
+ * @return
+ *  true on success, false on error.
+ */
+static inline bool on_arg_nv_indices(int argc, char **argv,
+        TPML_HANDLE *indices, bool *all) {
+
+    indices->count = 0;
+    *all = argc == 1 && !strcmp(argv[0], "all");
+    if (*all) {
+        return true;
+    }
+
+    if ((size_t) argc > ARRAY_LEN(indices->handle)) {
+        LOG_ERR("Too many NV indices, got %d, expected at most %zu", argc,
+                ARRAY_LEN(indices->handle));
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < argc; i++) {
+        TPMI_RH_NV_INDEX *nv_index = &indices->handle[indices->count++];
+        if (!on_arg_nv_index(1, &argv[i], nv_index)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Lists the defined NV indices.
+ * @param ectx
+ *  The ESAPI context.
+ * @param indices
+ *  The list to fill.
+ * @return
+ *  tool_rc indicating status.
+ */
+static inline tool_rc tpm2_util_nv_list(ESYS_CONTEXT *ectx,
+        TPML_HANDLE *indices) {
+
+    TPMS_CAPABILITY_DATA *capability_data = NULL;
+    tool_rc rc = tpm2_capability_get(ectx, TPM2_CAP_HANDLES,
+            TPM2_HT_NV_INDEX << 24, ARRAY_LEN(indices->handle),
+            &capability_data);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    *indices = capability_data->data.handles;
+    free(capability_data);
+
+    return tool_rc_success;
+}
+
 #endif /* LIB_TPM2_NV_UTIL_H_ */
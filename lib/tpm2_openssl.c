@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -70,6 +71,18 @@ const EVP_MD *tpm2_openssl_halg_from_tpmhalg(TPMI_ALG_HASH algorithm) {
         return EVP_sha384();
     case TPM2_ALG_SHA512:
         return EVP_sha512();
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    case TPM2_ALG_SHA3_256:
+        return EVP_sha3_256();
+    case TPM2_ALG_SHA3_384:
+        return EVP_sha3_384();
+    case TPM2_ALG_SHA3_512:
+        return EVP_sha3_512();
+#ifndef OPENSSL_NO_SM3
+    case TPM2_ALG_SM3_256:
+        return EVP_sm3();
+#endif
+#endif
     default:
         return NULL;
     }
@@ -184,6 +197,79 @@ out:
     return result;
 }
 
+bool tpm2_openssl_hash_file(FILE *input, TPML_DIGEST_VALUES *digests) {
+
+    bool result = false;
+    EVP_MD_CTX *mdctx[ARRAY_LEN(digests->digests)] = { 0 };
+    const EVP_MD *md[ARRAY_LEN(digests->digests)];
+    UINT32 i;
+
+    if (digests->count > ARRAY_LEN(digests->digests)) {
+        LOG_ERR("Too many digests, got: %"PRIu32, digests->count);
+        return false;
+    }
+
+    for (i = 0; i < digests->count; i++) {
+        md[i] = tpm2_openssl_halg_from_tpmhalg(digests->digests[i].hashAlg);
+        if (!md[i]) {
+            LOG_ERR("Hash algorithm 0x%x is not supported on the host",
+                    digests->digests[i].hashAlg);
+            goto out;
+        }
+
+        mdctx[i] = EVP_MD_CTX_create();
+        if (!mdctx[i]) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            goto out;
+        }
+
+        int rc = EVP_DigestInit_ex(mdctx[i], md[i], NULL);
+        if (!rc) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            goto out;
+        }
+    }
+
+    /* one pass over the input feeds every bank */
+    BYTE buffer[16384];
+    while (!feof(input)) {
+        size_t bytes_read = fread(buffer, 1, sizeof(buffer), input);
+        if (ferror(input)) {
+            LOG_ERR("Error reading from input file");
+            goto out;
+        }
+
+        for (i = 0; i < digests->count; i++) {
+            int rc = EVP_DigestUpdate(mdctx[i], buffer, bytes_read);
+            if (!rc) {
+                LOG_ERR("%s", tpm2_openssl_get_err());
+                goto out;
+            }
+        }
+    }
+
+    for (i = 0; i < digests->count; i++) {
+        unsigned size = EVP_MD_size(md[i]);
+        int rc = EVP_DigestFinal_ex(mdctx[i],
+                (BYTE *) &digests->digests[i].digest, &size);
+        if (!rc) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            goto out;
+        }
+    }
+
+    result = true;
+
+out:
+    for (i = 0; i < ARRAY_LEN(mdctx); i++) {
+        if (mdctx[i]) {
+            EVP_MD_CTX_destroy(mdctx[i]);
+        }
+    }
+
+    return result;
+}
+
 bool tpm2_openssl_pcr_extend(TPMI_ALG_HASH halg, BYTE *pcr,
         const BYTE *data, UINT16 length) {
 
@@ -3,6 +3,8 @@
 #ifndef LIB_TPM2_OPENSSL_H_
 #define LIB_TPM2_OPENSSL_H_
 
+#include <stdio.h>
+
 #include <tss2/tss2_sys.h>
 
 #include <openssl/ec.h>
@@ -109,6 +111,19 @@ void tpm2_openssl_hmac_free(HMAC_CTX *ctx);
 bool tpm2_openssl_hash_compute_data(TPMI_ALG_HASH halg, BYTE *buffer,
         UINT16 length, TPM2B_DIGEST *digest);
 
+/**
+ * Hash the remaining contents of a FILE on the host, computing every
+ * requested digest in a single pass over the data.
+ * @param input
+ *  The FILE to hash, which may be a fifo.
+ * @param digests
+ *  The hash algorithms to use, as specified by the hashAlg fields. On
+ *  success, the digest fields are filled in.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_openssl_hash_file(FILE *input, TPML_DIGEST_VALUES *digests);
+
 /**
  * Hash a list of PCR digests.
  * @param halg
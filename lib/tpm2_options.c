@@ -233,6 +233,13 @@ void tpm2_print_usage(const char *command, struct tpm2_options *tool_opts) {
     }
 }
 
+/*
+ * Keys of the long only common options, outside of the char range so they
+ * can't clash with the short options or long only keys of a tool.
+ */
+#define TPM2_OPTIONS_KEY_UNBUFFERED 0x100
+#define TPM2_OPTIONS_KEY_OFFLINE 0x101
+
 tpm2_option_code tpm2_handle_options(int argc, char **argv,
         tpm2_options *tool_opts, tpm2_option_flags *flags,
         TSS2_TCTI_CONTEXT **tcti) {
@@ -255,6 +262,8 @@ tpm2_option_code tpm2_handle_options(int argc, char **argv,
         { "quiet",         no_argument,       NULL, 'Q' },
         { "version",       no_argument,       NULL, 'v' },
         { "enable-errata", no_argument,       NULL, 'Z' },
+        { "unbuffered",    no_argument,       NULL, TPM2_OPTIONS_KEY_UNBUFFERED },
+        { "offline",       no_argument,       NULL, TPM2_OPTIONS_KEY_OFFLINE },
     };
 
     const char *tcti_conf_option = NULL;
@@ -344,6 +353,16 @@ tpm2_option_code tpm2_handle_options(int argc, char **argv,
         case 'Z':
             flags->enable_errata = 1;
             break;
+        case TPM2_OPTIONS_KEY_UNBUFFERED:
+            flags->unbuffered = 1;
+            break;
+        case TPM2_OPTIONS_KEY_OFFLINE:
+            if (!(opts->flags & TPM2_OPTIONS_OPTIONAL_SAPI)) {
+                LOG_ERR("%s: tool doesn't support running offline", argv[0]);
+                goto out;
+            }
+            flags->offline = 1;
+            break;
         case '?':
             goto out;
         default:
@@ -379,9 +398,31 @@ tpm2_option_code tpm2_handle_options(int argc, char **argv,
     /* Only init a TCTI if the tool needs it and if the -h/--help option isn't present */
     if (!show_help) {
 
+        /* --offline is the same as --tcti=none */
+        if (flags->offline) {
+            if (tcti_conf_option && strcmp(tcti_conf_option, "none")) {
+                LOG_ERR("%s: specify either a TCTI or --offline", argv[0]);
+                goto out;
+            }
+            goto none;
+        }
+
         /* tool doesn't request a sapi, don't initialize one */
         if (!tool_opts || !(tool_opts->flags & TPM2_OPTIONS_NO_SAPI)) {
 
+            /*
+             * The caller owns an already initialized TCTI, ie batch mode,
+             * so the TCTI can't be changed per tool invocation.
+             */
+            if (!tcti) {
+                if (tcti_conf_option) {
+                    LOG_ERR("%s: the TCTI option can't be changed per command",
+                            argv[0]);
+                    goto out;
+                }
+                goto errata;
+            }
+
             if (tcti_conf_option == NULL)
                 tcti_conf_option = tpm2_util_getenv(TPM2TOOLS_ENV_TCTI);
             else if (!strcmp(tcti_conf_option, "none")) {
@@ -401,6 +442,7 @@ tpm2_option_code tpm2_handle_options(int argc, char **argv,
              * no loader requested ie --tcti=none is an error if tool
              * doesn't indicate an optional SAPI
              */
+errata:
             if (!flags->enable_errata) {
                 flags->enable_errata = !!tpm2_util_getenv(
                         TPM2TOOLS_ENV_ENABLE_ERRATA);
@@ -21,6 +21,8 @@ union tpm2_option_flags {
         uint8_t verbose :1;
         uint8_t quiet :1;
         uint8_t enable_errata :1;
+        uint8_t unbuffered :1;
+        uint8_t offline :1;
     };
     uint8_t all;
 };
@@ -63,6 +65,10 @@ typedef bool (*tpm2_arg_handler)(int argc, char **argv);
  *
  * TPM2_OPTIONS_NO_SAPI:
  *  Skip SAPI initialization. Removes the "-T" common option.
+ *
+ * TPM2_OPTIONS_OPTIONAL_SAPI:
+ *  The tool can run without a TPM, selected with "-T none" or "--offline",
+ *  in which case it gets a NULL ESAPI context.
  */
 #define TPM2_OPTIONS_NO_SAPI 0x1
 #define TPM2_OPTIONS_OPTIONAL_SAPI 0x2
@@ -144,7 +150,9 @@ enum tpm2_option_code {
  * @param flags
  *  The tpm2_option_flags to set during parsing.
  * @param tcti
- *  The tcti initialized from the tcti options.
+ *  The tcti initialized from the tcti options. May be NULL when the
+ *  caller already owns an initialized TCTI, in which case no TCTI is
+ *  loaded and the tcti option is rejected.
  * @return
  *  A tpm option code indicating if an error, further processing
  *  or an immediate exit is desired.
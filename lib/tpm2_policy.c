@@ -10,9 +10,56 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_openssl.h"
 #include "tpm2_policy.h"
+#include "tpm2_policy_offline.h"
 #include "tpm2_tool.h"
 #include "tpm2_util.h"
 
+/*
+ * Extends the policy digest of an offline session with a policy command
+ * whose arguments are hashed in as they are.
+ */
+static tool_rc offline_extend(tpm2_session *session, TPM2_CC command_code,
+        const void *args, size_t args_len) {
+
+    bool result = tpm2_policy_offline_extend(tpm2_session_get_authhash(session),
+            tpm2_session_get_offline_digest(session), command_code, args,
+            args_len);
+
+    return result ? tool_rc_success : tool_rc_general_error;
+}
+
+/*
+ * Offline, the name of an entity is only known without asking the TPM for
+ * hierarchies and other permanent handles, where it is the handle itself.
+ */
+static tool_rc offline_entity_name(ESYS_CONTEXT *ectx,
+        tpm2_loaded_object *obj, TPM2B_NAME *name) {
+
+    if (ectx) {
+        TPM2B_NAME *tpm_name = NULL;
+        tool_rc rc = tpm2_tr_get_name(ectx, obj->tr_handle, &tpm_name);
+        if (rc != tool_rc_success) {
+            return rc;
+        }
+        *name = *tpm_name;
+        Esys_Free(tpm_name);
+        return tool_rc_success;
+    }
+
+    if (obj->path || (obj->handle >> TPM2_HR_SHIFT) != TPM2_HT_PERMANENT) {
+        LOG_ERR("The name of the authorizing entity is not known without a "
+                "TPM, only hierarchies and permanent handles can be used "
+                "offline");
+        return tool_rc_option_error;
+    }
+
+    UINT32 handle = tpm2_util_hton_32(obj->handle);
+    memcpy(name->name, &handle, sizeof(handle));
+    name->size = sizeof(handle);
+
+    return tool_rc_success;
+}
+
 static bool evaluate_populate_pcr_digests(TPML_PCR_SELECTION *pcr_selections,
         const char *raw_pcrs_file, TPML_DIGEST *pcr_values) {
 
@@ -79,6 +126,23 @@ static bool evaluate_populate_pcr_digests(TPML_PCR_SELECTION *pcr_selections,
     return true;
 }
 
+static tool_rc policy_pcr(ESYS_CONTEXT *ectx, tpm2_session *session,
+        TPM2B_DIGEST *pcr_digest, TPML_PCR_SELECTION *pcr_selections) {
+
+    if (tpm2_session_is_offline(session)) {
+        bool result = tpm2_policy_offline_pcr(
+                tpm2_session_get_authhash(session),
+                tpm2_session_get_offline_digest(session), pcr_selections,
+                pcr_digest);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
+    ESYS_TR handle = tpm2_session_get_handle(session);
+
+    return tpm2_policy_pcr(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
+            ESYS_TR_NONE, pcr_digest, pcr_selections);
+}
+
 tool_rc tpm2_policy_build_pcr(ESYS_CONTEXT *ectx, tpm2_session *policy_session,
         const char *raw_pcrs_file, TPML_PCR_SELECTION *pcr_selections,
         TPM2B_DIGEST *raw_pcr_digest) {
@@ -93,7 +157,6 @@ tool_rc tpm2_policy_build_pcr(ESYS_CONTEXT *ectx, tpm2_session *policy_session,
 
     TPM2B_DIGEST pcr_digest = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
     TPMI_ALG_HASH auth_hash = tpm2_session_get_authhash(policy_session);
-    ESYS_TR handle = tpm2_session_get_handle(policy_session);
 
     /*
      * If digest of all PCRs is directly given, handle it here.
@@ -105,8 +168,14 @@ tool_rc tpm2_policy_build_pcr(ESYS_CONTEXT *ectx, tpm2_session *policy_session,
     }
     // Call the PolicyPCR command
     if (raw_pcr_digest) {
-        return tpm2_policy_pcr(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
-            ESYS_TR_NONE, raw_pcr_digest, pcr_selections);
+        return policy_pcr(ectx, policy_session, raw_pcr_digest,
+                pcr_selections);
+    }
+
+    if (!raw_pcrs_file && !ectx) {
+        LOG_ERR("The PCR values must be given with a file or a digest "
+                "without a TPM");
+        return tool_rc_option_error;
     }
 
 
@@ -167,8 +236,7 @@ tool_rc tpm2_policy_build_pcr(ESYS_CONTEXT *ectx, tpm2_session *policy_session,
     }
 
     // Call the PolicyPCR command
-    return tpm2_policy_pcr(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
-            ESYS_TR_NONE, &pcr_digest, pcr_selections);
+    return policy_pcr(ectx, policy_session, &pcr_digest, pcr_selections);
 }
 
 tool_rc tpm2_policy_build_policyauthorize(ESYS_CONTEXT *ectx,
@@ -233,6 +301,14 @@ tool_rc tpm2_policy_build_policyauthorize(ESYS_CONTEXT *ectx,
         }
     }
 
+    if (tpm2_session_is_offline(policy_session)) {
+        result = tpm2_policy_offline_authorize(
+                tpm2_session_get_authhash(policy_session),
+                tpm2_session_get_offline_digest(policy_session),
+                &policy_qualifier, &key_sign);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
     ESYS_TR sess_handle = tpm2_session_get_handle(policy_session);
     return tpm2_policy_authorize(ectx, sess_handle, ESYS_TR_NONE, ESYS_TR_NONE,
             ESYS_TR_NONE, &approved_policy, &policy_qualifier, &key_sign,
@@ -242,6 +318,13 @@ tool_rc tpm2_policy_build_policyauthorize(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policyor(ESYS_CONTEXT *ectx,
         tpm2_session *policy_session, TPML_DIGEST *policy_list) {
 
+    if (tpm2_session_is_offline(policy_session)) {
+        bool result = tpm2_policy_offline_or(
+                tpm2_session_get_authhash(policy_session),
+                tpm2_session_get_offline_digest(policy_session), policy_list);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
     ESYS_TR sess_handle = tpm2_session_get_handle(policy_session);
     return tpm2_policy_or(ectx, sess_handle, ESYS_TR_NONE, ESYS_TR_NONE,
             ESYS_TR_NONE, policy_list);
@@ -250,6 +333,11 @@ tool_rc tpm2_policy_build_policyor(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policypassword(ESYS_CONTEXT *ectx,
         tpm2_session *session) {
 
+    /* PolicyPassword leaves the same digest as PolicyAuthValue */
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyAuthValue, NULL, 0);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_password(ectx, policy_session_handle, ESYS_TR_NONE,
@@ -259,6 +347,11 @@ tool_rc tpm2_policy_build_policypassword(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policynamehash(ESYS_CONTEXT *ectx,
     tpm2_session *session, const TPM2B_DIGEST *name_hash) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyNameHash, name_hash->buffer,
+                name_hash->size);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_namehash(ectx, policy_session_handle, name_hash);
@@ -267,6 +360,11 @@ tool_rc tpm2_policy_build_policynamehash(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policytemplate(ESYS_CONTEXT *ectx,
     tpm2_session *session, const TPM2B_DIGEST *template_hash) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyTemplate, template_hash->buffer,
+                template_hash->size);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_template(ectx, policy_session_handle, template_hash);
@@ -275,6 +373,11 @@ tool_rc tpm2_policy_build_policytemplate(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policycphash(ESYS_CONTEXT *ectx,
     tpm2_session *session, const TPM2B_DIGEST *cphash) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyCpHash, cphash->buffer,
+                cphash->size);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_cphash(ectx, policy_session_handle, cphash);
@@ -283,12 +386,61 @@ tool_rc tpm2_policy_build_policycphash(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policyauthvalue(ESYS_CONTEXT *ectx,
         tpm2_session *session) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyAuthValue, NULL, 0);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_authvalue(ectx, policy_session_handle, ESYS_TR_NONE,
             ESYS_TR_NONE, ESYS_TR_NONE);
 }
 
+/*
+ * PolicySecret and PolicySigned of an offline session. A trial session
+ * produces neither a ticket nor a timeout, so empty ones are returned.
+ */
+static tool_rc offline_policy_authority(ESYS_CONTEXT *ectx,
+        tpm2_session *policy_session, TPM2_CC command_code,
+        tpm2_loaded_object *auth_entity_obj, TPMT_TK_AUTH **policy_ticket,
+        TPM2B_TIMEOUT **timeout, bool is_nonce_tpm,
+        const TPM2B_NONCE *policy_qualifier, const TPM2B_DIGEST *cp_hash) {
+
+    if (is_nonce_tpm || cp_hash) {
+        LOG_ERR("The nonceTPM and cpHash are not available without a TPM");
+        return tool_rc_option_error;
+    }
+
+    TPM2B_NAME name = { .size = 0 };
+    tool_rc rc = offline_entity_name(ectx, auth_entity_obj, &name);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    bool result = tpm2_policy_offline_update(
+            tpm2_session_get_authhash(policy_session),
+            tpm2_session_get_offline_digest(policy_session), command_code,
+            &name, policy_qualifier);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    if (policy_ticket) {
+        *policy_ticket = calloc(1, sizeof(**policy_ticket));
+    }
+
+    if (timeout) {
+        *timeout = calloc(1, sizeof(**timeout));
+    }
+
+    if ((policy_ticket && !*policy_ticket) || (timeout && !*timeout)) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_policy_build_policysecret(ESYS_CONTEXT *ectx,
         tpm2_session *policy_session, tpm2_loaded_object *auth_entity_obj,
         INT32 expiration, TPMT_TK_AUTH **policy_ticket,
@@ -309,6 +461,12 @@ tool_rc tpm2_policy_build_policysecret(ESYS_CONTEXT *ectx,
         }
     }
 
+    if (tpm2_session_is_offline(policy_session)) {
+        return offline_policy_authority(ectx, policy_session,
+                TPM2_CC_PolicySecret, auth_entity_obj, policy_ticket, timeout,
+                is_nonce_tpm, &policy_qualifier, cp_hash);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(policy_session);
 
     TPM2B_NONCE *nonce_tpm = NULL;
@@ -379,6 +537,16 @@ tool_rc tpm2_policy_build_policyticket(ESYS_CONTEXT *ectx,
         return tool_rc_general_error;
     }
 
+    if (tpm2_session_is_offline(policy_session)) {
+        TPM2_CC command_code = ticket.tag == TPM2_ST_AUTH_SECRET ?
+                TPM2_CC_PolicySecret : TPM2_CC_PolicySigned;
+        result = tpm2_policy_offline_update(
+                tpm2_session_get_authhash(policy_session),
+                tpm2_session_get_offline_digest(policy_session), command_code,
+                &auth_name, &policyref);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(policy_session);
 
     return tpm2_policy_ticket(ectx, policy_session_handle, &policy_timeout,
@@ -424,11 +592,21 @@ tool_rc tpm2_policy_build_policysigned(ESYS_CONTEXT *ectx,
         }
     }
 
+    if (tpm2_session_is_offline(policy_session) && !raw_data_path) {
+        return offline_policy_authority(ectx, policy_session,
+                TPM2_CC_PolicySigned, auth_entity_obj, policy_ticket, timeout,
+                is_nonce_tpm, &policy_qualifier, NULL);
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(policy_session);
 
     TPM2B_NONCE *nonce_tpm = NULL;
     tool_rc rc = tool_rc_success;
     if (is_nonce_tpm) {
+        if (tpm2_session_is_offline(policy_session)) {
+            LOG_ERR("The nonceTPM is not available without a TPM");
+            return tool_rc_option_error;
+        }
         rc = tpm2_sess_get_noncetpm(ectx, policy_session_handle, &nonce_tpm);
         if (rc != tool_rc_success) {
             goto tpm2_policy_build_policysigned_out;
@@ -492,6 +670,16 @@ tpm2_policy_build_policysigned_out:
 tool_rc tpm2_policy_get_digest(ESYS_CONTEXT *ectx, tpm2_session *session,
         TPM2B_DIGEST **policy_digest) {
 
+    if (tpm2_session_is_offline(session)) {
+        *policy_digest = malloc(sizeof(**policy_digest));
+        if (!*policy_digest) {
+            LOG_ERR("oom");
+            return tool_rc_general_error;
+        }
+        **policy_digest = *tpm2_session_get_offline_digest(session);
+        return tool_rc_success;
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_getdigest(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
@@ -501,6 +689,12 @@ tool_rc tpm2_policy_get_digest(ESYS_CONTEXT *ectx, tpm2_session *session,
 tool_rc tpm2_policy_build_policycommandcode(ESYS_CONTEXT *ectx,
         tpm2_session *session, uint32_t command_code) {
 
+    if (tpm2_session_is_offline(session)) {
+        UINT32 code = tpm2_util_hton_32(command_code);
+        return offline_extend(session, TPM2_CC_PolicyCommandCode, &code,
+                sizeof(code));
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_command_code(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
@@ -510,6 +704,11 @@ tool_rc tpm2_policy_build_policycommandcode(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policynvwritten(ESYS_CONTEXT *ectx,
         tpm2_session *session, TPMI_YES_NO written_set) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyNvWritten, &written_set,
+                sizeof(written_set));
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_nv_written(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
@@ -519,6 +718,11 @@ tool_rc tpm2_policy_build_policynvwritten(ESYS_CONTEXT *ectx,
 tool_rc tpm2_policy_build_policylocality(ESYS_CONTEXT *ectx,
         tpm2_session *session, TPMA_LOCALITY locality) {
 
+    if (tpm2_session_is_offline(session)) {
+        return offline_extend(session, TPM2_CC_PolicyLocality, &locality,
+                sizeof(locality));
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_locality(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
@@ -553,6 +757,14 @@ tool_rc tpm2_policy_build_policyduplicationselect(ESYS_CONTEXT *ectx,
         return tool_rc_general_error;
     }
 
+    if (tpm2_session_is_offline(session)) {
+        result = tpm2_policy_offline_duplication_select(
+                tpm2_session_get_authhash(session),
+                tpm2_session_get_offline_digest(session), &obj_name,
+                &new_parent_name, is_include_obj);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(session);
 
     return tpm2_policy_duplication_select(ectx, handle, ESYS_TR_NONE,
@@ -560,6 +772,24 @@ tool_rc tpm2_policy_build_policyduplicationselect(ESYS_CONTEXT *ectx,
             is_include_obj);
 }
 
+tool_rc tpm2_policy_build_policycountertimer(ESYS_CONTEXT *ectx,
+        tpm2_session *session, const TPM2B_OPERAND *operand_b, UINT16 offset,
+        TPM2_EO operation) {
+
+    if (tpm2_session_is_offline(session)) {
+        bool result = tpm2_policy_offline_operand(
+                tpm2_session_get_authhash(session),
+                tpm2_session_get_offline_digest(session), operand_b, offset,
+                operation, NULL);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
+    ESYS_TR handle = tpm2_session_get_handle(session);
+
+    return tpm2_policy_countertimer(ectx, handle, operand_b, offset,
+            operation);
+}
+
 static bool tpm2_policy_populate_digest_list(char *buf,
         TPML_DIGEST *policy_list, TPMI_ALG_HASH hash) {
 
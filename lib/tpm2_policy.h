@@ -10,6 +10,12 @@
 #include "object.h"
 #include "tpm2_session.h"
 
+/*
+ * The tpm2_policy_build_*() routines extend the policy digest of sessions
+ * started with tpm2_session_open_offline() on the host, in which case ectx may
+ * be NULL as long as everything the policy needs is given as input.
+ */
+
 /**
  * Build a PCR policy via PolicyPCR.
  * @param context
@@ -299,6 +305,27 @@ tool_rc tpm2_policy_build_policyduplicationselect(ESYS_CONTEXT *ectx,
         tpm2_session *session, const char *obj_name_path,
         const char *new_parent_name_path, TPMI_YES_NO is_include_obj);
 
+/**
+ * Policy to restrict authorization to a comparison with the TPM clock and
+ * timer values
+ *
+ * @param ectx
+ *   The Enhanced system api (ESAPI_) context.
+ * @param session
+ *   The policy session into which the policy digest is extended into
+ * @param operand_b
+ *   The value to compare the TPMS_TIME_INFO data with
+ * @param offset
+ *   The offset of the compared data in TPMS_TIME_INFO
+ * @param operation
+ *   The comparison to perform
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_policy_build_policycountertimer(ESYS_CONTEXT *ectx,
+        tpm2_session *session, const TPM2B_OPERAND *operand_b, UINT16 offset,
+        TPM2_EO operation);
+
 /**
  * Policy tools need to:
  *  - get the policy digest
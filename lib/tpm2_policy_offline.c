@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <string.h>
+
+#include <openssl/evp.h>
+#include <tss2/tss2_mu.h>
+
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_openssl.h"
+#include "tpm2_policy_offline.h"
+#include "tpm2_util.h"
+
+typedef struct hash_part hash_part;
+struct hash_part {
+    const BYTE *data;
+    size_t len;
+};
+
+/*
+ * Hashes the concatenation of parts into digest. The parts may point into
+ * digest, as the result is only written once all of them are consumed.
+ */
+static bool hash_parts(TPMI_ALG_HASH halg, const hash_part *parts,
+        size_t count, TPM2B_DIGEST *digest) {
+
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(halg);
+    if (!md) {
+        LOG_ERR("Unsupported policy digest algorithm: 0x%x", halg);
+        return false;
+    }
+
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_create();
+    if (!mdctx) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+
+    bool result = false;
+    int rc = EVP_DigestInit_ex(mdctx, md, NULL);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        goto out;
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        if (!parts[i].len) {
+            continue;
+        }
+        rc = EVP_DigestUpdate(mdctx, parts[i].data, parts[i].len);
+        if (!rc) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            goto out;
+        }
+    }
+
+    unsigned size = EVP_MD_size(md);
+    rc = EVP_DigestFinal_ex(mdctx, digest->buffer, &size);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        goto out;
+    }
+
+    digest->size = size;
+
+    result = true;
+
+out:
+    EVP_MD_CTX_destroy(mdctx);
+    return result;
+}
+
+/*
+ * The digest being extended must be one of the session, anything else
+ * is the result of mixing up sessions and digests of different algorithms.
+ */
+static bool check_digest(TPMI_ALG_HASH halg, const TPM2B_DIGEST *digest) {
+
+    UINT16 size = tpm2_alg_util_get_hash_size(halg);
+    if (!size) {
+        LOG_ERR("Unsupported policy digest algorithm: 0x%x", halg);
+        return false;
+    }
+
+    if (digest->size != size) {
+        LOG_ERR("Policy digest size %u does not match the session hash "
+                "algorithm, expected %u", digest->size, size);
+        return false;
+    }
+
+    return true;
+}
+
+bool tpm2_policy_offline_reset(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest) {
+
+    UINT16 size = tpm2_alg_util_get_hash_size(halg);
+    if (!size) {
+        LOG_ERR("Unsupported policy digest algorithm: 0x%x", halg);
+        return false;
+    }
+
+    memset(digest->buffer, 0, sizeof(digest->buffer));
+    digest->size = size;
+
+    return true;
+}
+
+bool tpm2_policy_offline_extend(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        TPM2_CC command_code, const BYTE *args, size_t args_len) {
+
+    bool result = check_digest(halg, digest);
+    if (!result) {
+        return false;
+    }
+
+    UINT32 cc = tpm2_util_hton_32(command_code);
+
+    hash_part parts[] = {
+        { digest->buffer, digest->size },
+        { (BYTE *) &cc, sizeof(cc) },
+        { args, args_len },
+    };
+
+    return hash_parts(halg, parts, ARRAY_LEN(parts), digest);
+}
+
+bool tpm2_policy_offline_update(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        TPM2_CC command_code, const TPM2B_NAME *name,
+        const TPM2B_NONCE *policy_ref) {
+
+    bool result = tpm2_policy_offline_extend(halg, digest, command_code,
+            name->name, name->size);
+    if (!result) {
+        return false;
+    }
+
+    /* the policyRef is hashed in even when empty */
+    hash_part parts[] = {
+        { digest->buffer, digest->size },
+        { policy_ref->buffer, policy_ref->size },
+    };
+
+    return hash_parts(halg, parts, ARRAY_LEN(parts), digest);
+}
+
+bool tpm2_policy_offline_pcr(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPML_PCR_SELECTION *pcrs, const TPM2B_DIGEST *pcr_digest) {
+
+    BYTE args[sizeof(*pcrs) + sizeof(pcr_digest->buffer)];
+    size_t offset = 0;
+
+    TSS2_RC rval = Tss2_MU_TPML_PCR_SELECTION_Marshal(pcrs, args,
+            sizeof(args), &offset);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPML_PCR_SELECTION_Marshal, rval);
+        return false;
+    }
+
+    memcpy(&args[offset], pcr_digest->buffer, pcr_digest->size);
+    offset += pcr_digest->size;
+
+    return tpm2_policy_offline_extend(halg, digest, TPM2_CC_PolicyPCR, args,
+            offset);
+}
+
+bool tpm2_policy_offline_or(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPML_DIGEST *policy_list) {
+
+    if (policy_list->count < 2 || policy_list->count > 8) {
+        LOG_ERR("PolicyOR takes 2 to 8 policy digests, got %u",
+                policy_list->count);
+        return false;
+    }
+
+    BYTE args[sizeof(policy_list->digests)];
+    size_t offset = 0;
+
+    UINT32 i;
+    for (i = 0; i < policy_list->count; i++) {
+        const TPM2B_DIGEST *d = &policy_list->digests[i];
+        bool result = check_digest(halg, d);
+        if (!result) {
+            return false;
+        }
+        memcpy(&args[offset], d->buffer, d->size);
+        offset += d->size;
+    }
+
+    bool result = tpm2_policy_offline_reset(halg, digest);
+    if (!result) {
+        return false;
+    }
+
+    return tpm2_policy_offline_extend(halg, digest, TPM2_CC_PolicyOR, args,
+            offset);
+}
+
+bool tpm2_policy_offline_authorize(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_NONCE *policy_ref, const TPM2B_NAME *key_sign) {
+
+    bool result = tpm2_policy_offline_reset(halg, digest);
+    if (!result) {
+        return false;
+    }
+
+    return tpm2_policy_offline_update(halg, digest, TPM2_CC_PolicyAuthorize,
+            key_sign, policy_ref);
+}
+
+bool tpm2_policy_offline_operand(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_OPERAND *operand_b, UINT16 offset, TPM2_EO operation,
+        const TPM2B_NAME *nv_name) {
+
+    UINT16 be_offset = tpm2_util_hton_16(offset);
+    UINT16 be_operation = tpm2_util_hton_16(operation);
+
+    hash_part parts[] = {
+        { operand_b->buffer, operand_b->size },
+        { (BYTE *) &be_offset, sizeof(be_offset) },
+        { (BYTE *) &be_operation, sizeof(be_operation) },
+    };
+
+    TPM2B_DIGEST args = { .size = 0 };
+    bool result = hash_parts(halg, parts, ARRAY_LEN(parts), &args);
+    if (!result) {
+        return false;
+    }
+
+    if (!nv_name) {
+        return tpm2_policy_offline_extend(halg, digest,
+                TPM2_CC_PolicyCounterTimer, args.buffer, args.size);
+    }
+
+    BYTE nv_args[sizeof(args.buffer) + sizeof(nv_name->name)];
+    memcpy(nv_args, args.buffer, args.size);
+    memcpy(&nv_args[args.size], nv_name->name, nv_name->size);
+
+    return tpm2_policy_offline_extend(halg, digest, TPM2_CC_PolicyNV, nv_args,
+            args.size + nv_name->size);
+}
+
+bool tpm2_policy_offline_authorize_nv(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_NAME *nv_name) {
+
+    bool result = tpm2_policy_offline_reset(halg, digest);
+    if (!result) {
+        return false;
+    }
+
+    return tpm2_policy_offline_extend(halg, digest, TPM2_CC_PolicyAuthorizeNV,
+            nv_name->name, nv_name->size);
+}
+
+bool tpm2_policy_offline_duplication_select(TPMI_ALG_HASH halg,
+        TPM2B_DIGEST *digest, const TPM2B_NAME *obj_name,
+        const TPM2B_NAME *new_parent_name, TPMI_YES_NO is_include_obj) {
+
+    BYTE args[2 * sizeof(obj_name->name) + sizeof(is_include_obj)];
+    size_t offset = 0;
+
+    if (is_include_obj) {
+        memcpy(args, obj_name->name, obj_name->size);
+        offset += obj_name->size;
+    }
+
+    memcpy(&args[offset], new_parent_name->name, new_parent_name->size);
+    offset += new_parent_name->size;
+
+    args[offset++] = is_include_obj;
+
+    return tpm2_policy_offline_extend(halg, digest,
+            TPM2_CC_PolicyDuplicationSelect, args, offset);
+}
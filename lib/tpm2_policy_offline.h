@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_POLICY_OFFLINE_H_
+#define LIB_TPM2_POLICY_OFFLINE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * Host side implementations of the policyDigest updates a TPM performs for
+ * the policy commands of a trial session, as described in the TPM 2.0
+ * Part 3 Commands specification. Every routine updates digest in place and
+ * computes the same value the TPM would.
+ */
+
+/**
+ * Resets a policy digest to its initial value, all zeros of the size of halg,
+ * as done by StartAuthSession and PolicyRestart.
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to reset.
+ * @return
+ *  true on success, false on an unknown hash algorithm.
+ */
+bool tpm2_policy_offline_reset(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest);
+
+/**
+ * Extends a policy digest with:
+ *   policyDigest_new := H(policyDigest_old || commandCode || args)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to extend.
+ * @param command_code
+ *  The command code of the policy command.
+ * @param args
+ *  The marshaled arguments of the update, may be NULL if args_len is 0.
+ * @param args_len
+ *  The length of args.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_extend(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        TPM2_CC command_code, const BYTE *args, size_t args_len);
+
+/**
+ * Updates a policy digest the way the PolicyUpdate() function of the
+ * specification does for PolicySigned, PolicySecret, PolicyTicket and
+ * PolicyAuthorize:
+ *   policyDigest_new := H(policyDigest_old || commandCode || name)
+ *   policyDigest_new := H(policyDigest_new || policyRef)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to update.
+ * @param command_code
+ *  The command code of the policy command.
+ * @param name
+ *  The name of the authorizing entity.
+ * @param policy_ref
+ *  The policy qualifier, may be empty.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_update(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        TPM2_CC command_code, const TPM2B_NAME *name,
+        const TPM2B_NONCE *policy_ref);
+
+/**
+ * PolicyPCR:
+ *   policyDigest_new := H(policyDigest_old || TPM_CC_PolicyPCR || pcrs ||
+ *                         pcrDigest)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to extend.
+ * @param pcrs
+ *  The PCR selection.
+ * @param pcr_digest
+ *  The digest of the selected PCR values.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_pcr(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPML_PCR_SELECTION *pcrs, const TPM2B_DIGEST *pcr_digest);
+
+/**
+ * PolicyOR, which restarts from a zero digest:
+ *   policyDigest_new := H(0...0 || TPM_CC_PolicyOR || digests)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to replace.
+ * @param policy_list
+ *  The branch digests, 2 to 8 of them.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_or(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPML_DIGEST *policy_list);
+
+/**
+ * PolicyAuthorize, which resets the digest before the PolicyUpdate() with
+ * the name of the key that signs the approved policies.
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to replace.
+ * @param policy_ref
+ *  The policy qualifier, may be empty.
+ * @param key_sign
+ *  The name of the verifying key.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_authorize(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_NONCE *policy_ref, const TPM2B_NAME *key_sign);
+
+/**
+ * PolicyCounterTimer and, when nv_name is given, PolicyNV:
+ *   args := H(operandB || offset || operation)
+ *   policyDigest_new := H(policyDigest_old || commandCode || args [|| nvName])
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to extend.
+ * @param operand_b
+ *  The value to compare with.
+ * @param offset
+ *  The offset of the compared data.
+ * @param operation
+ *  The comparison operation.
+ * @param nv_name
+ *  The name of the NV index for PolicyNV, NULL for PolicyCounterTimer.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_operand(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_OPERAND *operand_b, UINT16 offset, TPM2_EO operation,
+        const TPM2B_NAME *nv_name);
+
+/**
+ * PolicyAuthorizeNV, which resets the digest before the update:
+ *   policyDigest_new := H(0...0 || TPM_CC_PolicyAuthorizeNV || nvName)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to replace.
+ * @param nv_name
+ *  The name of the NV index holding the approved policy.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_authorize_nv(TPMI_ALG_HASH halg, TPM2B_DIGEST *digest,
+        const TPM2B_NAME *nv_name);
+
+/**
+ * PolicyDuplicationSelect:
+ *   policyDigest_new := H(policyDigest_old || TPM_CC_PolicyDuplicationSelect
+ *                         [|| objectName] || newParentName || includeObject)
+ * @param halg
+ *  The policy session hash algorithm.
+ * @param digest
+ *  The policy digest to extend.
+ * @param obj_name
+ *  The name of the object to duplicate, only used if is_include_obj is set.
+ * @param new_parent_name
+ *  The name of the new parent.
+ * @param is_include_obj
+ *  Whether the object name is part of the digest.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_policy_offline_duplication_select(TPMI_ALG_HASH halg,
+        TPM2B_DIGEST *digest, const TPM2B_NAME *obj_name,
+        const TPM2B_NAME *new_parent_name, TPMI_YES_NO is_include_obj);
+
+#endif /* LIB_TPM2_POLICY_OFFLINE_H_ */
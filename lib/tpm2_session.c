@@ -9,7 +9,11 @@
 #include "files.h"
 #include "log.h"
 #include "tpm2.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_openssl.h"
+#include "tpm2_policy_offline.h"
 #include "tpm2_session.h"
+#include "tpm2_session_pool.h"
 
 struct tpm2_session_data {
     ESYS_TR key;
@@ -35,7 +39,15 @@ struct tpm2_session {
         char *path;
         ESYS_CONTEXT *ectx;
         bool is_final;
+        /* set when the session goes back to the session pool on close */
+        TPM2B_DIGEST pool_key;
     } internal;
+
+    /* trial sessions whose policy digest is computed on the host */
+    struct {
+        bool is_offline;
+        TPM2B_DIGEST policy_digest;
+    } offline;
 };
 
 tpm2_session_data *tpm2_session_data_new(TPM2_SE type) {
@@ -110,6 +122,14 @@ const TPM2B_AUTH *tpm2_session_get_auth_value(tpm2_session *session) {
     return &session->input->auth_data;
 }
 
+bool tpm2_session_is_offline(tpm2_session *session) {
+    return session->offline.is_offline;
+}
+
+TPM2B_DIGEST *tpm2_session_get_offline_digest(tpm2_session *session) {
+    return &session->offline.policy_digest;
+}
+
 //
 // This is a wrapper function around the StartAuthSession command.
 // It performs the command, calculates the session key, and updates a
@@ -144,6 +164,105 @@ static tool_rc start_auth_session(tpm2_session *session) {
     return tool_rc_success;
 }
 
+/*
+ * Only plain HMAC sessions are pooled, they authorize any entity with the
+ * auth value given per command. Policy sessions build up state, bound
+ * sessions depend on the auth value of the bind entity and a caller given
+ * nonce or session file asks for a session of its own.
+ */
+static bool pool_session(tpm2_session *session) {
+
+    tpm2_session_data *d = session->input;
+
+    if (!tpm2_session_pool_is_enabled() || d->session_type != TPM2_SE_HMAC
+            || d->bind != ESYS_TR_NONE || d->nonce_caller.size
+            || session->internal.path) {
+        return false;
+    }
+
+    /*
+     * The key covers everything StartAuthSession is given, the salt key by
+     * its name as ESYS_TR values mean nothing across processes.
+     */
+    BYTE buffer[sizeof(TPM2B_NAME) + 16];
+    size_t offset = 0;
+
+    if (d->key != ESYS_TR_NONE) {
+        TPM2B_NAME *name = NULL;
+        tool_rc rc = tpm2_tr_get_name(session->internal.ectx, d->key, &name);
+        if (rc != tool_rc_success) {
+            return false;
+        }
+        memcpy(buffer, name->name, name->size);
+        offset = name->size;
+        Esys_Free(name);
+    }
+
+    UINT16 params[] = {
+        d->auth_hash,
+        d->symmetric.algorithm,
+        d->symmetric.keyBits.sym,
+        d->symmetric.mode.sym,
+        d->attrs,
+    };
+    memcpy(&buffer[offset], params, sizeof(params));
+    offset += sizeof(params);
+
+    bool result = tpm2_openssl_hash_compute_data(TPM2_ALG_SHA256, buffer,
+            offset, &session->internal.pool_key);
+    if (!result) {
+        session->internal.pool_key.size = 0;
+    }
+
+    return result;
+}
+
+static tool_rc take_pooled_session(tpm2_session *session) {
+
+    ESYS_CONTEXT *ectx = session->internal.ectx;
+    ESYS_TR *handle = &session->output.session_handle;
+
+    bool result = tpm2_session_pool_take(ectx, &session->internal.pool_key,
+            handle);
+    if (!result) {
+        return start_auth_session(session);
+    }
+
+    /* the previous user may have changed them */
+    TPMA_SESSION attrs = session->input->attrs ?
+            session->input->attrs : TPMA_SESSION_CONTINUESESSION;
+    tool_rc rc = tpm2_sess_set_attributes(ectx, *handle, attrs, 0xff);
+    if (rc != tool_rc_success) {
+        tool_rc tmp_rc = tpm2_flush_context(ectx, *handle);
+        UNUSED(tmp_rc);
+        return start_auth_session(session);
+    }
+
+    return tool_rc_success;
+}
+
+/*
+ * Returns a session to the pool, unless it's done, which happens when the
+ * last command cleared continueSession.
+ */
+static bool put_pooled_session(tpm2_session *session) {
+
+    if (!session->internal.pool_key.size) {
+        return false;
+    }
+
+    ESYS_CONTEXT *ectx = session->internal.ectx;
+    ESYS_TR handle = session->output.session_handle;
+
+    TPMA_SESSION attrs = 0;
+    tool_rc rc = tpm2_sess_get_attributes(ectx, handle, &attrs);
+    if (rc != tool_rc_success || !(attrs & TPMA_SESSION_CONTINUESESSION)) {
+        return false;
+    }
+
+    return tpm2_session_pool_put(ectx, &session->internal.pool_key, handle);
+}
+
 static void tpm2_session_free(tpm2_session **session) {
 
     tpm2_session *s = *session;
@@ -186,7 +305,8 @@ tool_rc tpm2_session_open(ESYS_CONTEXT *context, tpm2_session_data *data,
         return tool_rc_success;
     }
 
-    tool_rc rc = start_auth_session(s);
+    tool_rc rc = pool_session(s) ? take_pooled_session(s) :
+            start_auth_session(s);
     if (rc != tool_rc_success) {
         tpm2_session_free(&s);
         return rc;
@@ -197,12 +317,46 @@ tool_rc tpm2_session_open(ESYS_CONTEXT *context, tpm2_session_data *data,
     return tool_rc_success;
 }
 
+tool_rc tpm2_session_open_offline(tpm2_session_data *data,
+        tpm2_session **session) {
+
+    if (data->session_type != TPM2_SE_TRIAL) {
+        LOG_ERR("Only trial sessions can be used without a TPM");
+        free(data);
+        return tool_rc_option_error;
+    }
+
+    tool_rc rc = tpm2_session_open(NULL, data, session);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    tpm2_session *s = *session;
+    s->output.session_handle = ESYS_TR_NONE;
+    s->offline.is_offline = true;
+
+    bool result = tpm2_policy_offline_reset(data->auth_hash,
+            &s->offline.policy_digest);
+    if (!result) {
+        tpm2_session_free(session);
+        return tool_rc_general_error;
+    }
+
+    return tool_rc_success;
+}
+
 /* SESSION_VERSION 1 was used prior to the switch to ESAPI. As the types of
  * several of the tpm2_session_data object members have changed the version is
  * bumped.
  */
 #define SESSION_VERSION 2
 
+/*
+ * Offline trial sessions have no TPM context, the file holds the policy
+ * digest computed so far instead.
+ */
+#define SESSION_VERSION_OFFLINE 3
+
 /*
  * Checks that two types are equal in size.
  *
@@ -220,6 +374,40 @@ COMPILE_ASSERT_SIZE(ESYS_TR, UINT32);
 COMPILE_ASSERT_SIZE(TPMI_ALG_HASH, UINT16);
 COMPILE_ASSERT_SIZE(TPM2_SE, UINT8);
 
+static tool_rc restore_offline(FILE *f, TPM2_SE type, TPMI_ALG_HASH auth_hash,
+        tpm2_session **session) {
+
+    TPM2B_DIGEST digest = { .size = 0 };
+    bool result = files_read_16(f, &digest.size);
+    if (!result || digest.size != tpm2_alg_util_get_hash_size(auth_hash)) {
+        LOG_ERR("Could not read session policy digest");
+        return tool_rc_general_error;
+    }
+
+    result = files_read_bytes(f, digest.buffer, digest.size);
+    if (!result) {
+        LOG_ERR("Could not read session policy digest");
+        return tool_rc_general_error;
+    }
+
+    tpm2_session_data *d = tpm2_session_data_new(type);
+    if (!d) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_session_set_authhash(d, auth_hash);
+
+    tool_rc rc = tpm2_session_open_offline(d, session);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    (*session)->offline.policy_digest = digest;
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_session_restore(ESYS_CONTEXT *ctx, const char *path, bool is_final,
         tpm2_session **session) {
 
@@ -246,6 +434,12 @@ tool_rc tpm2_session_restore(ESYS_CONTEXT *ctx, const char *path, bool is_final,
 
     uint32_t version;
     bool result = files_read_header(f, &version);
+    if (!result) {
+        LOG_ERR("Could not read session file header");
+        goto out;
+    }
+
+    bool is_offline = version == SESSION_VERSION_OFFLINE;
 
     TPM2_SE type;
     result = files_read_bytes(f, &type, sizeof(type));
@@ -261,6 +455,24 @@ tool_rc tpm2_session_restore(ESYS_CONTEXT *ctx, const char *path, bool is_final,
         goto out;
     }
 
+    if (is_offline) {
+        rc = restore_offline(f, type, auth_hash, &s);
+        if (rc != tool_rc_success) {
+            goto out;
+        }
+
+        s->internal.path = dup_path;
+        s->internal.ectx = ctx;
+        s->internal.is_final = is_final;
+        dup_path = NULL;
+
+        *session = s;
+
+        LOG_INFO("Restored offline session");
+
+        goto out;
+    }
+
     ESYS_TR handle;
     tool_rc tmp_rc = files_load_tpm_context_from_file(ctx, &handle, f);
     if (tmp_rc != tool_rc_success) {
@@ -349,10 +561,13 @@ tool_rc tpm2_session_close(tpm2_session **s) {
         goto out;
     }
 
+    bool is_offline = session->offline.is_offline;
     bool flush = path ? session->internal.is_final : true;
     if (flush) {
-        rc = tpm2_flush_context(session->internal.ectx,
-                session->output.session_handle);
+        if (!is_offline && !put_pooled_session(session)) {
+            rc = tpm2_flush_context(session->internal.ectx,
+                    session->output.session_handle);
+        }
         /* done, use rc to indicate status */
         goto out;
     }
@@ -360,7 +575,8 @@ tool_rc tpm2_session_close(tpm2_session **s) {
     /*
      * Now write the session_type, handle and auth hash data to disk
      */
-    bool result = files_write_header(session_file, SESSION_VERSION);
+    bool result = files_write_header(session_file,
+            is_offline ? SESSION_VERSION_OFFLINE : SESSION_VERSION);
     if (!result) {
         LOG_ERR("Could not write context file header");
         rc = tool_rc_general_error;
@@ -386,6 +602,18 @@ tool_rc tpm2_session_close(tpm2_session **s) {
         goto out;
     }
 
+    if (is_offline) {
+        TPM2B_DIGEST *digest = &session->offline.policy_digest;
+        result = files_write_16(session_file, digest->size)
+                && files_write_bytes(session_file, digest->buffer,
+                        digest->size);
+        if (!result) {
+            LOG_ERR("Could not write session policy digest");
+            rc = tool_rc_general_error;
+        }
+        goto out;
+    }
+
     /*
      * Save session context at end of tpm2_session. With tabrmd support it
      * can be reloaded under certain circumstances.
@@ -412,6 +640,12 @@ out2:
 
 tool_rc tpm2_session_restart(ESYS_CONTEXT *context, tpm2_session *s) {
 
+    if (s->offline.is_offline) {
+        bool result = tpm2_policy_offline_reset(tpm2_session_get_authhash(s),
+                &s->offline.policy_digest);
+        return result ? tool_rc_success : tool_rc_general_error;
+    }
+
     ESYS_TR handle = tpm2_session_get_handle(s);
 
     return tpm2_policy_restart(context, handle, ESYS_TR_NONE, ESYS_TR_NONE,
@@ -161,6 +161,40 @@ static inline bool tpm2_session_is_trial(tpm2_session *session) {
 tool_rc tpm2_session_open(ESYS_CONTEXT *context, tpm2_session_data *data,
         tpm2_session **session);
 
+/**
+ * Starts a trial session without a TPM. The policy digest of the session is
+ * computed on the host by the tpm2_policy_build_*() routines and saved with
+ * the session, so the policy tools can extend it without a TPM.
+ * @param data
+ *  A session data object of type TPM2_SE_TRIAL created with
+ *  tpm2_session_data_new(). This pointer is owned by the tpm2_session object
+ *  and the caller can forget about it at this point.
+ * @param session
+ *  The output session on success.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_session_open_offline(tpm2_session_data *data,
+        tpm2_session **session);
+
+/**
+ * True if a session was started with tpm2_session_open_offline().
+ * @param session
+ *  The session to check.
+ * @return
+ *  True if the policy digest of the session is computed on the host.
+ */
+bool tpm2_session_is_offline(tpm2_session *session);
+
+/**
+ * Retrieves the policy digest of an offline session.
+ * @param session
+ *  A session started with tpm2_session_open_offline().
+ * @return
+ *  The policy digest, which the caller may update in place.
+ */
+TPM2B_DIGEST *tpm2_session_get_offline_digest(tpm2_session *session);
+
 /**
  * Saves session data to disk allowing tpm2_session_from_file() to
  * restore the session if applicable and frees resources.
@@ -196,7 +230,7 @@ tool_rc tpm2_session_restore(ESYS_CONTEXT *ctx, const char *path, bool is_final,
 
 /**
  * restarts the session to it's initial state via a call to
- * PolicyRestart().
+ * PolicyRestart(), or by clearing the digest of an offline session.
  * @param context
  *  The Enhanced System API (ESAPI) context
  * @param s
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2.h"
+#include "tpm2_session_pool.h"
+#include "tpm2_util.h"
+
+#define SESSION_POOL_TEMPLATE "tpm2-tools-sessions.XXXXXX"
+
+/*
+ * Saved sessions count against the active sessions of the TPM, so keep a
+ * few per key for commands using more than one, and a few in total.
+ */
+#define SESSION_POOL_MAX_PER_KEY 3
+#define SESSION_POOL_MAX 8
+
+static char *pool_dir;
+
+bool tpm2_session_pool_init(void) {
+
+    const char *tmp = tpm2_util_getenv("TMPDIR");
+    if (!tmp || !tmp[0]) {
+        tmp = "/tmp";
+    }
+
+    char path[PATH_MAX];
+    int n = snprintf(path, sizeof(path), "%s/" SESSION_POOL_TEMPLATE, tmp);
+    if (n < 0 || (size_t) n >= sizeof(path)) {
+        LOG_WARN("Session pool path too long in \"%s\"", tmp);
+        return false;
+    }
+
+    if (!mkdtemp(path)) {
+        LOG_WARN("Could not create the session pool in \"%s\", error: %s", tmp,
+                strerror(errno));
+        return false;
+    }
+
+    pool_dir = strdup(path);
+    if (!pool_dir) {
+        LOG_ERR("oom");
+        rmdir(path);
+        return false;
+    }
+
+    return true;
+}
+
+bool tpm2_session_pool_is_enabled(void) {
+
+    return pool_dir != NULL;
+}
+
+static bool entry_path(const TPM2B_DIGEST *key, unsigned index, char *path,
+        size_t size) {
+
+    char hex[2 * sizeof(key->buffer) + 1];
+    UINT16 i;
+    for (i = 0; i < key->size; i++) {
+        sprintf(&hex[2 * i], "%02x", key->buffer[i]);
+    }
+    hex[2 * i] = '\0';
+
+    int n = snprintf(path, size, "%s/%s.%u", pool_dir, hex, index);
+
+    return n > 0 && (size_t) n < size;
+}
+
+/*
+ * Loads the session of an entry, which is removed first so it's never
+ * loaded twice, whether loading works or not.
+ */
+static bool entry_load(ESYS_CONTEXT *ectx, const char *path, ESYS_TR *handle) {
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    unlink(path);
+
+    tool_rc rc = files_load_tpm_context_from_file(ectx, handle, f);
+    fclose(f);
+    if (rc != tool_rc_success) {
+        LOG_WARN("Dropping the pooled session \"%s\"", path);
+        return false;
+    }
+
+    return true;
+}
+
+static void entry_flush(ESYS_CONTEXT *ectx, const char *path) {
+
+    ESYS_TR handle;
+    bool result = entry_load(ectx, path, &handle);
+    if (result) {
+        tool_rc rc = tpm2_flush_context(ectx, handle);
+        UNUSED(rc);
+    }
+}
+
+bool tpm2_session_pool_take(ESYS_CONTEXT *ectx, const TPM2B_DIGEST *key,
+        ESYS_TR *handle) {
+
+    if (!pool_dir) {
+        return false;
+    }
+
+    unsigned i;
+    for (i = 0; i < SESSION_POOL_MAX_PER_KEY; i++) {
+        char path[PATH_MAX];
+        if (entry_path(key, i, path, sizeof(path))
+                && entry_load(ectx, path, handle)) {
+            LOG_INFO("Reusing pooled session \"%s\"", path);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void for_each_entry(ESYS_CONTEXT *ectx, time_t older_than,
+        size_t *count) {
+
+    DIR *d = opendir(pool_dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", pool_dir, entry->d_name);
+        if (n < 0 || (size_t) n >= sizeof(path)) {
+            continue;
+        }
+
+        struct stat sb;
+        if (stat(path, &sb)) {
+            continue;
+        }
+
+        if (ectx && sb.st_mtime < older_than) {
+            entry_flush(ectx, path);
+        } else if (count) {
+            (*count)++;
+        }
+    }
+
+    closedir(d);
+}
+
+/*
+ * Saves the session into a free slot of the key. Sets is_tpm_error when the
+ * TPM refused to save the context, in which case the caller still owns the
+ * session.
+ */
+static bool entry_save(ESYS_CONTEXT *ectx, const TPM2B_DIGEST *key,
+        ESYS_TR handle, bool *is_tpm_error) {
+
+    *is_tpm_error = false;
+
+    unsigned i;
+    for (i = 0; i < SESSION_POOL_MAX_PER_KEY; i++) {
+        char path[PATH_MAX];
+        if (!entry_path(key, i, path, sizeof(path))) {
+            return false;
+        }
+
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            return false;
+        }
+
+        FILE *f = fdopen(fd, "wb");
+        if (!f) {
+            close(fd);
+            unlink(path);
+            return false;
+        }
+
+        tool_rc rc = files_save_tpm_context_to_file(ectx, handle, f);
+        bool result = fclose(f) == 0;
+        if (rc != tool_rc_success) {
+            unlink(path);
+            *is_tpm_error = true;
+            return false;
+        }
+
+        /*
+         * Once saved the ESYS_TR is gone, even if writing the context out
+         * failed, and there is nothing left for the caller to flush.
+         */
+        if (!result) {
+            LOG_WARN("Could not write the pooled session \"%s\"", path);
+            unlink(path);
+        }
+
+        return true;
+    }
+
+    /* all slots of the key are taken */
+    return false;
+}
+
+bool tpm2_session_pool_put(ESYS_CONTEXT *ectx, const TPM2B_DIGEST *key,
+        ESYS_TR handle) {
+
+    if (!pool_dir) {
+        return false;
+    }
+
+    size_t count = 0;
+    for_each_entry(NULL, 0, &count);
+    if (count >= SESSION_POOL_MAX) {
+        return false;
+    }
+
+    bool is_tpm_error;
+    bool result = entry_save(ectx, key, handle, &is_tpm_error);
+    if (result || !is_tpm_error) {
+        return result;
+    }
+
+    /*
+     * A context gap, the oldest saved session being too old for the TPM
+     * to save another one, is cleared by flushing the saved sessions.
+     */
+    LOG_INFO("Could not pool the session, flushing the pooled sessions");
+    tpm2_session_pool_expire(ectx, 0);
+
+    return entry_save(ectx, key, handle, &is_tpm_error);
+}
+
+void tpm2_session_pool_expire(ESYS_CONTEXT *ectx, unsigned idle) {
+
+    if (!pool_dir) {
+        return;
+    }
+
+    time_t now = time(NULL);
+    for_each_entry(ectx, idle ? now - idle : now + 1, NULL);
+}
+
+void tpm2_session_pool_destroy(ESYS_CONTEXT *ectx) {
+
+    if (!pool_dir) {
+        return;
+    }
+
+    tpm2_session_pool_expire(ectx, 0);
+
+    if (rmdir(pool_dir)) {
+        LOG_WARN("Could not remove the session pool \"%s\", error: %s",
+                pool_dir, strerror(errno));
+    }
+
+    free(pool_dir);
+    pool_dir = NULL;
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_SESSION_POOL_H_
+#define LIB_TPM2_SESSION_POOL_H_
+
+#include <stdbool.h>
+
+#include <tss2/tss2_esys.h>
+
+#include "tool_rc.h"
+
+/* seconds a pooled session is kept unused before it's flushed */
+#define TPM2_SESSION_POOL_IDLE 60
+
+/*
+ * A pool of idle HMAC sessions, so commands run one after another by a
+ * long lived process, like "tpm2 batch" and "tpm2 serve", don't pay for a
+ * StartAuthSession, and its salt exchange, each.
+ *
+ * Those commands run in forked children, so the pool is a private directory
+ * of saved session contexts created by the parent before forking. A child
+ * closing a poolable session saves it under a key derived from the session
+ * parameters, and the next child opening a session with the same key loads
+ * it instead of starting a new one. The ESAPI session metadata, including
+ * the nonces, is part of the saved context.
+ */
+
+/**
+ * Creates the pool directory, enabling the pool for this process and the
+ * children forked afterwards.
+ * @return
+ *  true on success, false if the pool could not be created and stays
+ *  disabled.
+ */
+bool tpm2_session_pool_init(void);
+
+/**
+ * True if tpm2_session_pool_init() enabled the pool.
+ */
+bool tpm2_session_pool_is_enabled(void);
+
+/**
+ * Takes an idle session out of the pool.
+ * @param ectx
+ *  The ESAPI context.
+ * @param key
+ *  The digest of the session parameters.
+ * @param handle
+ *  The loaded session on success.
+ * @return
+ *  true if a session was loaded, false if there was none to reuse.
+ */
+bool tpm2_session_pool_take(ESYS_CONTEXT *ectx, const TPM2B_DIGEST *key,
+        ESYS_TR *handle);
+
+/**
+ * Saves a session into the pool. When saving fails, as happens on a context
+ * gap, the pooled sessions are flushed and saving is retried once.
+ * @param ectx
+ *  The ESAPI context.
+ * @param key
+ *  The digest of the session parameters.
+ * @param handle
+ *  The session, which is no longer valid on success.
+ * @return
+ *  true if the session was pooled, false if the caller still owns it.
+ */
+bool tpm2_session_pool_put(ESYS_CONTEXT *ectx, const TPM2B_DIGEST *key,
+        ESYS_TR handle);
+
+/**
+ * Flushes the pooled sessions that have been idle for longer than idle
+ * seconds, all of them when idle is 0.
+ * @param ectx
+ *  The ESAPI context.
+ * @param idle
+ *  The idle timeout in seconds.
+ */
+void tpm2_session_pool_expire(ESYS_CONTEXT *ectx, unsigned idle);
+
+/**
+ * Flushes all pooled sessions and removes the pool directory.
+ * @param ectx
+ *  The ESAPI context.
+ */
+void tpm2_session_pool_destroy(ESYS_CONTEXT *ectx);
+
+#endif /* LIB_TPM2_SESSION_POOL_H_ */
@@ -12,6 +12,16 @@ extern bool output_enabled;
  */
 #define tpm2_tool_output_disable() (output_enabled = false)
 
+/**
+ * stdout is buffered by default, this flushes what is pending and
+ * makes every subsequent tpm2_tool_output() call write through.
+ */
+#define tpm2_tool_output_unbuffered()                \
+    do {                                        \
+        fflush(stdout);                         \
+        setvbuf(stdout, NULL, _IONBF, 0);       \
+    } while (0)
+
 /**
  * prints output to stdout respecting the quiet option.
  * Ie when quiet, don't print.
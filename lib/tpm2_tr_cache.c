@@ -0,0 +1,181 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "tpm2.h"
+#include "tpm2_tr_cache.h"
+#include "tpm2_util.h"
+
+#define TR_CACHE_SUFFIX ".tr"
+
+/* a serialized ESYS_TR of an object is its handle, name and public area */
+#define TR_CACHE_MAX_ENTRY 4096
+
+static const char *cache_dir(void) {
+
+    const char *dir = tpm2_util_getenv(TPM2TOOLS_ENV_TR_CACHE);
+
+    return dir && dir[0] ? dir : NULL;
+}
+
+static bool cache_path(const char *dir, TPM2_HANDLE handle, char *path,
+        size_t size) {
+
+    int n = snprintf(path, size, "%s/0x%08"PRIx32 TR_CACHE_SUFFIX, dir,
+            handle);
+    if (n < 0 || (size_t) n >= size) {
+        LOG_WARN("ESYS_TR cache path too long in \"%s\"", dir);
+        return false;
+    }
+
+    return true;
+}
+
+static bool cache_read(const char *path, uint8_t *buffer, size_t *size) {
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+
+    *size = fread(buffer, 1, TR_CACHE_MAX_ENTRY, f);
+    bool result = !ferror(f) && *size && *size < TR_CACHE_MAX_ENTRY;
+    fclose(f);
+
+    return result;
+}
+
+/*
+ * Writes to a temporary file renamed into place, so concurrent tools never
+ * see a partial entry.
+ */
+static void cache_write(const char *path, const uint8_t *buffer,
+        size_t size) {
+
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    if (n < 0 || (size_t) n >= sizeof(tmp)) {
+        return;
+    }
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        LOG_WARN("Could not add an ESYS_TR cache entry \"%s\", error: %s",
+                path, strerror(errno));
+        return;
+    }
+
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+
+    bool result = fwrite(buffer, 1, size, f) == size;
+    result &= fclose(f) == 0;
+    if (!result || rename(tmp, path)) {
+        LOG_WARN("Could not add an ESYS_TR cache entry \"%s\"", path);
+        unlink(tmp);
+    }
+}
+
+tool_rc tpm2_tr_cache_from_tpm_public(ESYS_CONTEXT *ectx, TPM2_HANDLE handle,
+        ESYS_TR *tr) {
+
+    char path[PATH_MAX];
+    const char *dir = cache_dir();
+    if (!dir || handle >> TPM2_HR_SHIFT != TPM2_HT_PERSISTENT
+            || !cache_path(dir, handle, path, sizeof(path))) {
+        return tpm2_from_tpm_public(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
+                ESYS_TR_NONE, tr);
+    }
+
+    uint8_t buffer[TR_CACHE_MAX_ENTRY];
+    size_t size = 0;
+    if (cache_read(path, buffer, &size)) {
+        tool_rc rc = tpm2_tr_deserialize(ectx, buffer, size, tr);
+        if (rc == tool_rc_success) {
+            /* an entry copied or renamed from another handle is bad too */
+            TPM2_HANDLE tpm_handle;
+            TSS2_RC rv = Esys_TR_GetTpmHandle(ectx, *tr, &tpm_handle);
+            if (rv == TSS2_RC_SUCCESS && tpm_handle == handle) {
+                return rc;
+            }
+            tpm2_close(ectx, tr);
+        }
+        LOG_WARN("Dropping the bad ESYS_TR cache entry \"%s\"", path);
+        unlink(path);
+    }
+
+    tool_rc rc = tpm2_from_tpm_public(ectx, handle, ESYS_TR_NONE, ESYS_TR_NONE,
+            ESYS_TR_NONE, tr);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    uint8_t *serialized = NULL;
+    rc = tpm2_tr_serialize(ectx, *tr, &serialized, &size);
+    if (rc == tool_rc_success && size < TR_CACHE_MAX_ENTRY) {
+        cache_write(path, serialized, size);
+    }
+    free(serialized);
+
+    /* the cache is an optimization, failing to fill it isn't an error */
+    return tool_rc_success;
+}
+
+void tpm2_tr_cache_invalidate(TPM2_HANDLE handle) {
+
+    char path[PATH_MAX];
+    const char *dir = cache_dir();
+    if (!dir || !cache_path(dir, handle, path, sizeof(path))) {
+        return;
+    }
+
+    if (unlink(path) && errno != ENOENT) {
+        LOG_WARN("Could not remove the ESYS_TR cache entry \"%s\", error: %s",
+                path, strerror(errno));
+    }
+}
+
+void tpm2_tr_cache_clear(void) {
+
+    const char *dir = cache_dir();
+    if (!dir) {
+        return;
+    }
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+        size_t len = strlen(entry->d_name);
+        size_t suffix_len = strlen(TR_CACHE_SUFFIX);
+        if (strncmp(entry->d_name, "0x", 2) || len <= suffix_len
+                || strcmp(&entry->d_name[len - suffix_len], TR_CACHE_SUFFIX)) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        int n = snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (n > 0 && (size_t) n < sizeof(path) && unlink(path)
+                && errno != ENOENT) {
+            LOG_WARN("Could not remove the ESYS_TR cache entry \"%s\", "
+                    "error: %s", path, strerror(errno));
+        }
+    }
+
+    closedir(d);
+}
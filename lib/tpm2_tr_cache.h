@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+#ifndef LIB_TPM2_TR_CACHE_H_
+#define LIB_TPM2_TR_CACHE_H_
+
+#include <tss2/tss2_esys.h>
+
+#include "tool_rc.h"
+
+#define TPM2TOOLS_ENV_TR_CACHE "TPM2TOOLS_TR_CACHE"
+
+/*
+ * An on-disk cache of the ESYS_TR metadata of persistent objects, so a
+ * persistent handle given on the command line doesn't cost a ReadPublic
+ * round trip on every run. It is enabled by pointing TPM2TOOLS_TR_CACHE at a
+ * directory, which holds one serialized ESYS_TR per handle, with the name and
+ * public area of the object it was read from.
+ *
+ * Entries are trusted as they are: checking the name against the TPM would
+ * take the very ReadPublic the cache saves, as every command runs in its own
+ * process, batch and server mode included. Tools changing what a persistent
+ * handle refers to invalidate the entries they affect, changes made by other
+ * means require removing the entries by hand. Until then the commands using
+ * a stale entry still act on the object the TPM has at the handle, but with
+ * the old name and public area, so HMAC sessions, cpHash and salted sessions
+ * computed from them fail.
+ */
+
+/**
+ * Gets an ESYS_TR for a persistent handle, from the cache when it has an
+ * entry for the handle and otherwise from the TPM, in which case the entry
+ * is added. The name of a cached entry is not checked against the TPM.
+ * Other handles, or a disabled cache, always go to the TPM.
+ * @param ectx
+ *  The ESAPI context.
+ * @param handle
+ *  The TPM handle.
+ * @param tr
+ *  The ESYS_TR output.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_tr_cache_from_tpm_public(ESYS_CONTEXT *ectx, TPM2_HANDLE handle,
+        ESYS_TR *tr);
+
+/**
+ * Removes the entry of a handle.
+ */
+void tpm2_tr_cache_invalidate(TPM2_HANDLE handle);
+
+/**
+ * Removes all entries, for commands that evict persistent objects
+ * wholesale.
+ */
+void tpm2_tr_cache_clear(void);
+
+#endif /* LIB_TPM2_TR_CACHE_H_ */
@@ -1,6 +1,5 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
-#include <ctype.h>
 #include <dlfcn.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -180,17 +179,68 @@ bool tpm2_util_string_to_int32(const char *str, int32_t *value) {
     return true;
 }
 
+static const char hex_digits[] = "0123456789abcdef";
+
+/*
+ * Maps a character to its hex digit value with HEX_VALID set, any
+ * character that isn't a hex digit maps to 0.
+ */
+#define HEX_VALID 0x10
+#define HEX_DIGIT(c, v) [c] = HEX_VALID | (v)
+static const UINT8 hex_values[256] = {
+    HEX_DIGIT('0', 0x0), HEX_DIGIT('1', 0x1), HEX_DIGIT('2', 0x2),
+    HEX_DIGIT('3', 0x3), HEX_DIGIT('4', 0x4), HEX_DIGIT('5', 0x5),
+    HEX_DIGIT('6', 0x6), HEX_DIGIT('7', 0x7), HEX_DIGIT('8', 0x8),
+    HEX_DIGIT('9', 0x9),
+    HEX_DIGIT('a', 0xa), HEX_DIGIT('b', 0xb), HEX_DIGIT('c', 0xc),
+    HEX_DIGIT('d', 0xd), HEX_DIGIT('e', 0xe), HEX_DIGIT('f', 0xf),
+    HEX_DIGIT('A', 0xa), HEX_DIGIT('B', 0xb), HEX_DIGIT('C', 0xc),
+    HEX_DIGIT('D', 0xd), HEX_DIGIT('E', 0xe), HEX_DIGIT('F', 0xf),
+};
+#undef HEX_DIGIT
+
+size_t tpm2_util_hex_encode(const BYTE *data, size_t len, char *dest) {
+
+    size_t i;
+    for (i = 0; i < len; i++) {
+        dest[2 * i] = hex_digits[data[i] >> 4];
+        dest[2 * i + 1] = hex_digits[data[i] & 0xf];
+    }
+    dest[2 * len] = '\0';
+
+    return 2 * len;
+}
+
+bool tpm2_util_hex_decode(const char *hex, size_t len, BYTE *dest) {
+
+    if (len % 2) {
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; i < len / 2; i++) {
+        UINT8 hi = hex_values[(unsigned char) hex[2 * i]];
+        UINT8 lo = hex_values[(unsigned char) hex[2 * i + 1]];
+        if (!(hi & lo & HEX_VALID)) {
+            return false;
+        }
+        dest[i] = (UINT8) ((hi & 0xf) << 4) | (lo & 0xf);
+    }
+
+    return true;
+}
+
 int tpm2_util_hex_to_byte_structure(const char *input_string, UINT16 *byte_length,
         BYTE *byte_buffer) {
-    int str_length; //if the input_string likes "1a2b...", no prefix "0x"
-    int i = 0;
+    size_t str_length; //if the input_string likes "1a2b...", no prefix "0x"
+    size_t i;
     if (input_string == NULL || byte_length == NULL || byte_buffer == NULL)
         return -1;
     str_length = strlen(input_string);
     if (str_length % 2)
         return -2;
     for (i = 0; i < str_length; i++) {
-        if (!isxdigit(input_string[i]))
+        if (!hex_values[(unsigned char) input_string[i]])
             return -3;
     }
 
@@ -199,12 +249,7 @@ int tpm2_util_hex_to_byte_structure(const char *input_string, UINT16 *byte_lengt
 
     *byte_length = str_length / 2;
 
-    for (i = 0; i < *byte_length; i++) {
-        char tmp_str[4] = { 0 };
-        tmp_str[0] = input_string[i * 2];
-        tmp_str[1] = input_string[i * 2 + 1];
-        byte_buffer[i] = strtol(tmp_str, NULL, 16);
-    }
+    tpm2_util_hex_decode(input_string, str_length, byte_buffer);
     return 0;
 }
 
@@ -231,9 +276,14 @@ out:
 
 void tpm2_util_hexdump2(FILE *f, const BYTE *data, size_t len) {
 
-    size_t i;
-    for (i = 0; i < len; i++) {
-        fprintf(f, "%02x", data[i]);
+    /* encode a chunk at a time, +1 for the NULL terminator */
+    char hex[2 * 256 + 1];
+    while (len) {
+        size_t chunk = len < 256 ? len : 256;
+        size_t hex_len = tpm2_util_hex_encode(data, chunk, hex);
+        fwrite(hex, 1, hex_len, f);
+        data += chunk;
+        len -= chunk;
     }
 }
 
@@ -325,6 +375,50 @@ UINT32 tpm2_util_pop_count(UINT32 data) {
     return count;
 }
 
+void tpm2_util_index_build(const void *table, size_t count, size_t size,
+        const void **index, tpm2_util_index_cmp cmp) {
+
+    /*
+     * The tables are small and built once, an insertion sort keeps entries
+     * comparing equal in table order.
+     */
+    size_t i;
+    for (i = 0; i < count; i++) {
+        const void *entry = (const char *) table + i * size;
+        size_t j = i;
+        while (j > 0 && cmp(index[j - 1], entry) > 0) {
+            index[j] = index[j - 1];
+            j--;
+        }
+        index[j] = entry;
+    }
+}
+
+size_t tpm2_util_index_lower_bound(const void *key, const void **index,
+        size_t count, tpm2_util_index_cmp cmp) {
+
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (cmp(key, index[mid]) > 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+const void *tpm2_util_index_find(const void *key, const void **index,
+        size_t count, tpm2_util_index_cmp cmp) {
+
+    size_t i = tpm2_util_index_lower_bound(key, index, count, cmp);
+
+    return i < count && !cmp(key, index[i]) ? index[i] : NULL;
+}
+
 #define TPM2_UTIL_KEYDATA_INIT { .len = 0 };
 
 typedef struct tpm2_util_keydata tpm2_util_keydata;
@@ -380,6 +474,32 @@ void print_yaml_indent(size_t indent_count) {
     }
 }
 
+void tpm2_util_print_yaml_string(const char *str) {
+
+    tpm2_tool_output("\"");
+
+    const char *run = str;
+    for (; str && *str; str++) {
+        unsigned char c = *str;
+        if (c >= 0x20 && c != 0x7f && c != '"' && c != '\\') {
+            continue;
+        }
+
+        tpm2_tool_output("%.*s", (int) (str - run), run);
+        if (c == '"' || c == '\\') {
+            tpm2_tool_output("\\%c", c);
+        } else {
+            tpm2_tool_output("\\x%02x", c);
+        }
+        run = str + 1;
+    }
+    if (run) {
+        tpm2_tool_output("%s", run);
+    }
+
+    tpm2_tool_output("\"");
+}
+
 void tpm2_util_tpma_object_to_yaml(TPMA_OBJECT obj, char *indent) {
 
     if (!indent) {
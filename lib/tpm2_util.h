@@ -192,6 +192,35 @@ void tpm2_util_hexdump(const BYTE *data, size_t len);
  */
 void tpm2_util_hexdump2(FILE *f, const BYTE *data, size_t len);
 
+/**
+ * Encodes a byte buffer as lower case hex. The conversion is table
+ * driven, it is used for every digest and buffer printed as YAML.
+ * @param data
+ *  The data to encode.
+ * @param len
+ *  The length of the data.
+ * @param dest
+ *  The output buffer, it must hold at least 2 * len + 1 characters.
+ *  The output is NULL terminated.
+ * @return
+ *  The number of hex characters written, ie 2 * len.
+ */
+size_t tpm2_util_hex_encode(const BYTE *data, size_t len, char *dest);
+
+/**
+ * Decodes a hex string, upper and lower case digits are accepted.
+ * @param hex
+ *  The hex string, it doesn't need to be NULL terminated.
+ * @param len
+ *  The number of characters to decode, it must be even.
+ * @param dest
+ *  The output buffer, it must hold at least len / 2 bytes.
+ * @return
+ *  true on success, false if len is odd or a character isn't a hex digit.
+ *  On failure, dest may have been partially written.
+ */
+bool tpm2_util_hex_decode(const char *hex, size_t len, BYTE *dest);
+
 /**
  * Read a hex string converting it to binary or a binary file and
  * store into a binary buffer.
@@ -316,6 +345,57 @@ UINT64 tpm2_util_ntoh_64(UINT64 data);
  */
 UINT32 tpm2_util_pop_count(UINT32 data);
 
+/**
+ * Compares a key, or an entry, to an entry of a table indexed with
+ * tpm2_util_index_build(), like strcmp().
+ */
+typedef int (*tpm2_util_index_cmp)(const void *key, const void *entry);
+
+/**
+ * Builds an index of a static table, sorted on a key of its entries, so
+ * lookups on the key are a binary search instead of a walk of the table.
+ * Entries comparing equal keep their table order.
+ * @param table
+ *  The table.
+ * @param count
+ *  The number of entries in the table.
+ * @param size
+ *  The size of an entry.
+ * @param index
+ *  Caller allocated, count entries, filled with the sorted entries.
+ * @param cmp
+ *  Compares two entries.
+ */
+void tpm2_util_index_build(const void *table, size_t count, size_t size,
+        const void **index, tpm2_util_index_cmp cmp);
+
+/**
+ * Finds the position of the first entry of an index not sorting before a
+ * key.
+ * @param key
+ *  The key to look up.
+ * @param index
+ *  The index built with tpm2_util_index_build().
+ * @param count
+ *  The number of entries in the index.
+ * @param cmp
+ *  Compares the key to an entry, consistent with the comparison the index
+ *  was sorted with.
+ * @return
+ *  The position, count when all entries sort before the key.
+ */
+size_t tpm2_util_index_lower_bound(const void *key, const void **index,
+        size_t count, tpm2_util_index_cmp cmp);
+
+/**
+ * Finds the first entry of an index comparing equal to a key.
+ * @return
+ *  The entry, NULL when there is none. See tpm2_util_index_lower_bound()
+ *  for the parameters.
+ */
+const void *tpm2_util_index_find(const void *key, const void **index,
+        size_t count, tpm2_util_index_cmp cmp);
+
 /**
  * Prints whitespace indention for yaml output.
  * @param indent_count
@@ -323,6 +403,14 @@ UINT32 tpm2_util_pop_count(UINT32 data);
  */
 void print_yaml_indent(size_t indent_count);
 
+/**
+ * Prints a string as a double quoted yaml scalar, escaping quotes,
+ * backslashes and control characters.
+ * @param str
+ *  The string to print, NULL prints an empty string.
+ */
+void tpm2_util_print_yaml_string(const char *str);
+
 /**
  * Convert a TPM2B_PUBLIC into a yaml format and output if not quiet.
  * @param public
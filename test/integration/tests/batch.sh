@@ -0,0 +1,119 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+batch_pid=""
+
+cleanup() {
+    if [ -n "$batch_pid" ]; then
+        kill $batch_pid &> /dev/null
+        wait $batch_pid &> /dev/null
+        batch_pid=""
+    fi
+
+    rm -f batch.txt batch.log batch.yaml random.out primary.ctx key.pub \
+    key.priv key.ctx batch.fifo
+    rm -rf batch-tmp
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+# commands share one TPM connection and state is fresh per command
+cat > batch.txt <<EOF
+# a comment and an empty line
+
+createprimary -Q -C o -c primary.ctx
+tpm2 create -Q -C primary.ctx -u key.pub -r key.priv
+tpm2_load -Q -C primary.ctx -u key.pub -r key.priv -c key.ctx
+getrandom -o random.out 16
+getrandom --hex 4
+EOF
+
+tpm2 batch batch.txt 2> batch.log
+test -f key.ctx
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 16
+test `grep -c ": 0$" batch.log` -eq 5
+
+# stdin works as well
+echo "getrandom -o random.out 8" | tpm2 batch -
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 8
+
+# authorized commands hand their HMAC session on to the next one, and the
+# pooled sessions are flushed when the batch is done
+cat > batch.txt <<EOF
+create -Q -C primary.ctx -u key.pub -r key.priv
+create -Q -C primary.ctx -u key.pub -r key.priv
+getcap handles-saved-session
+EOF
+tpm2 batch batch.txt > batch.yaml 2> batch.log
+test `grep -c "0x" batch.yaml` -eq 1
+test -z "`tpm2 getcap handles-saved-session`"
+
+# negative tests
+trap - ERR
+
+# stops at the first failure
+printf "getrandom 2000\ngetrandom -o random.out 4\n" > batch.txt
+tpm2 batch batch.txt 2> batch.log
+if [ $? -eq 0 ]; then
+    echo "tpm2 batch should fail when a command fails"
+    exit 1
+fi
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 8
+
+# keeps going when asked to, but still reports the failure
+tpm2 batch --keep-going batch.txt 2> batch.log
+if [ $? -eq 0 ]; then
+    echo "tpm2 batch --keep-going should fail when a command fails"
+    exit 1
+fi
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 4
+
+# the TCTI can't be changed per command
+echo "getrandom -T none 8" | tpm2 batch - &> /dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 batch should reject a per command tcti"
+    exit 1
+fi
+
+# a signal stops the batch waiting for input, flushing the pooled sessions
+# and removing the pool
+mkdir batch-tmp
+mkfifo batch.fifo
+TMPDIR=$PWD/batch-tmp tpm2 batch batch.fifo 2> batch.log &
+batch_pid=$!
+exec 3> batch.fifo
+echo "create -Q -C primary.ctx -u key.pub -r key.priv" >&3
+for i in $(seq 1 50); do
+    grep -q ": 0$" batch.log && break
+    sleep 0.1
+done
+kill -TERM $batch_pid
+wait $batch_pid
+if [ $? -eq 0 ]; then
+    echo "tpm2 batch should fail when stopped by a signal"
+    exit 1
+fi
+batch_pid=""
+exec 3>&-
+if ! rmdir batch-tmp; then
+    echo "tpm2 batch should remove the session pool on a signal"
+    exit 1
+fi
+if [ -n "`tpm2 getcap handles-saved-session`" ]; then
+    echo "tpm2 batch should flush the pooled sessions on a signal"
+    exit 1
+fi
+
+exit 0
@@ -17,11 +17,19 @@ output_ak_pub_name=ak.name
 output_quote=quote.out
 output_quotesig=quotesig.out
 output_quotepcr=quotepcr.out
+serve_pid=""
 
 cleanup() {
   rm -f $output_ek_pub_pem $output_ak_pub_pem $output_ak_pub_name \
   $output_quote $output_quotesig $output_quotepcr rand.out $ak_ctx \
-  pcr.bin
+  pcr.bin manifest.txt manifest.yaml checkquote.sock serve.yaml ecc.ak.name \
+  golden.txt ecc384.ak ecc384.ak.pem quote384.bin quote384.sig
+
+  if [ -n "$serve_pid" ]; then
+    kill $serve_pid &> /dev/null
+    wait $serve_pid &> /dev/null
+    serve_pid=""
+  fi
 
   tpm2 pcrreset 16
   tpm2 evictcontrol -C o -c $handle_ek 2>/dev/null || true
@@ -90,4 +98,144 @@ tpm2 pcrread sha256:15,16,22 -o pcr.bin
 tpm2 checkquote -u ecc.ak.tpmt -m quote.bin -s quote.sig -g sha256 -q nonce.bin \
 -f pcr.bin -l sha256:15,16,22
 
+# Verify the quoted PCRs against a list of allowed values
+pcr_values=`tpm2 pcrread sha256:15,16,22 | awk '/0x/ {printf "%s ", substr($2, 3)}'`
+cat > golden.txt <<EOF
+# a selection followed by its allowed values
+sha256:15,16,22
+ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff ffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff
+$pcr_values
+EOF
+
+tpm2 checkquote -u ecc.ak.pem -m quote.bin -s quote.sig -g sha256 -q nonce.bin \
+--golden golden.txt
+
+# The golden composite digests follow the hash of the quote signature
+tpm2 createak -C ecc.ek -c ecc384.ak -G ecc -g sha384 -s ecdsa
+tpm2 readpublic -c ecc384.ak -f pem -o ecc384.ak.pem
+tpm2 quote -c ecc384.ak -l sha256:15,16,22 -q nonce.bin -m quote384.bin \
+-s quote384.sig -g sha384
+tpm2 checkquote -u ecc384.ak.pem -m quote384.bin -s quote384.sig -q nonce.bin \
+--golden golden.txt
+
+# Verify a manifest of quotes, the results are in manifest order
+cat > manifest.txt <<EOF
+# public key, message, signature, pcrs, eventlog, qualification
+$output_ak_pub_pem $output_quote $output_quotesig $output_quotepcr - $loaded_randomness
+
+ecc.ak.pem quote.bin quote.sig quote.pcr - nonce.bin
+ecc.ak.tss quote.bin quote.sig - - nonce.bin
+EOF
+
+tpm2 checkquote -g $digestAlg --manifest manifest.txt > manifest.yaml
+test `grep -c "result: pass" manifest.yaml` -eq 3
+head -n 1 manifest.yaml | grep -q "line: 2,"
+tail -n 1 manifest.yaml | grep -q "line: 5,"
+
+cat manifest.txt | tpm2 checkquote -g $digestAlg --jobs 1 --manifest - \
+  > manifest.yaml
+test `grep -c "result: pass" manifest.yaml` -eq 3
+
+# Paths are quoted and escaped in the results
+cp $output_quote 'quote"\.bin'
+echo "$output_ak_pub_pem quote\"\\.bin $output_quotesig $output_quotepcr - $loaded_randomness" \
+  > manifest.txt
+tpm2 checkquote -g $digestAlg --manifest manifest.txt > manifest.yaml
+python << 'pyscript'
+import yaml
+with open("manifest.yaml") as f:
+    doc = yaml.safe_load(f)
+    assert doc[0]["message"] == r'quote"\.bin', doc
+pyscript
+rm -f 'quote"\.bin'
+
+# Verify quotes with the service, keys are looked up by their name
+tpm2 checkquote -g $digestAlg --serve checkquote.sock \
+  $output_ak_pub_name=$output_ak_pub_pem ecc.ak.tss &
+serve_pid=$!
+
+for i in $(seq 1 50); do
+  test -S checkquote.sock && break
+  sleep 0.1
+done
+test -S checkquote.sock
+
+tpm2 checkquote --connect checkquote.sock --key-name $output_ak_pub_name \
+  -m $output_quote -s $output_quotesig -f $output_quotepcr \
+  -q $loaded_randomness > serve.yaml
+grep -q "result: pass" serve.yaml
+
+tpm2 readpublic -c ecc.ak -n ecc.ak.name > /dev/null
+tpm2 checkquote --connect checkquote.sock --key-name ecc.ak.name \
+  -m quote.bin -s quote.sig -q nonce.bin > serve.yaml
+grep -q "result: pass" serve.yaml
+
+# a client that connects and never sends is dropped, the next one is served
+python -c 'import socket,time; s=socket.socket(socket.AF_UNIX); \
+  s.connect("checkquote.sock"); time.sleep(30)' &
+stall_pid=$!
+sleep 0.5
+timeout 20 tpm2 checkquote --connect checkquote.sock --key-name ecc.ak.name \
+  -m quote.bin -s quote.sig -q nonce.bin > serve.yaml
+kill $stall_pid
+wait $stall_pid || true
+grep -q "result: pass" serve.yaml
+
+# negative tests
+trap - ERR
+
+# a wrong nonce fails its record only
+echo "ecc.ak.pem quote.bin quote.sig quote.pcr - $loaded_randomness" \
+  >> manifest.txt
+tpm2 checkquote -g $digestAlg --manifest manifest.txt > manifest.yaml
+if [ $? -eq 0 ]; then
+  echo "tpm2 checkquote --manifest should fail when a quote fails"
+  exit 1
+fi
+if [ `grep -c "result: pass" manifest.yaml` -ne 3 ] ||
+   ! grep -q "reason: \"qualification mismatch\"" manifest.yaml; then
+  echo "tpm2 checkquote --manifest should only fail the bad quote"
+  exit 1
+fi
+
+# the service rejects a quote with a wrong nonce
+tpm2 checkquote --connect checkquote.sock --key-name ecc.ak.name \
+  -m quote.bin -s quote.sig -q $loaded_randomness > serve.yaml 2> /dev/null
+if [ $? -eq 0 ] || ! grep -q "qualification mismatch" serve.yaml; then
+  echo "tpm2 checkquote --connect should fail with a wrong nonce"
+  exit 1
+fi
+
+# and quotes of unknown keys
+tpm2 checkquote --connect checkquote.sock --key-name 000b0000 \
+  -m quote.bin -s quote.sig > serve.yaml 2> /dev/null
+if [ $? -eq 0 ] || ! grep -q "unknown key" serve.yaml; then
+  echo "tpm2 checkquote --connect should fail with an unknown key"
+  exit 1
+fi
+
+kill $serve_pid
+wait $serve_pid
+serve_pid=""
+if [ -e checkquote.sock ]; then
+  echo "tpm2 checkquote --serve should remove its socket"
+  exit 1
+fi
+
+# quotes of other PCR values aren't golden
+sed -i '$d' golden.txt
+tpm2 checkquote -u ecc.ak.pem -m quote.bin -s quote.sig -g sha256 -q nonce.bin \
+  --golden golden.txt 2> /dev/null
+if [ $? -eq 0 ]; then
+  echo "tpm2 checkquote --golden should fail with PCR values not listed"
+  exit 1
+fi
+
+# the single quote options can't be combined with a manifest
+tpm2 checkquote -u ecc.ak.pem --manifest manifest.txt 2> /dev/null
+if [ $? -eq 0 ]; then
+  echo "tpm2 checkquote --manifest should reject -u"
+  exit 1
+fi
+
 exit 0
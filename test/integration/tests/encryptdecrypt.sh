@@ -7,7 +7,7 @@ cleanup() {
   decrypt2.out encrypt.out encrypt2.out secret.dat secret2.dat \
   iv.dat iv2.dat key128.ctx plain.dec128.tpm plain.dec256.tpm plain.enc128.tpm \
   plain.enc256.tpm sym128.key key256.ctx plain.dec128.ssl plain.dec256.ssl \
-  plain.enc128.ssl plain.enc256.ssl plain.txt sym256.key
+  plain.enc128.ssl plain.enc256.ssl plain.txt sym256.key verbose.log
 
   if [ "$1" != "no-shut-down" ]; then
       shut_down
@@ -88,6 +88,18 @@ tpm2 encryptdecrypt -Q -c decrypt.ctx -d -o decrypt.out encrypt.out
 
 cmp secret2.dat decrypt.out
 
+# Test that inputs larger than 64KiB are streamed, from stdin and files
+dd if=/dev/urandom bs=1024 count=80 status=none of=secret2.dat
+head -c 100 /dev/urandom >> secret2.dat
+cat secret2.dat | tpm2 encryptdecrypt -Q -c decrypt.ctx -o encrypt.out -e
+tpm2 encryptdecrypt -Q -c decrypt.ctx -d -e encrypt.out > decrypt.out
+cmp secret2.dat decrypt.out
+test `stat -c %s encrypt.out` -eq $((80 * 1024 + 112))
+
+# Test that the throughput is reported when verbose
+tpm2 encryptdecrypt -V -c decrypt.ctx -o encrypt2.out secret2.dat 2> verbose.log
+grep -q "Processed $((80 * 1024 + 100)) bytes" verbose.log
+
 # Test that last block in input data shorter than block length has pkcs7 padding
 dd if=/dev/zero bs=1 count=2050 status=none of=secret2.dat
 cat secret2.dat | tpm2 encryptdecrypt -Q -c decrypt.ctx -o encrypt.out -e
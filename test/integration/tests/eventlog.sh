@@ -38,4 +38,86 @@ expect_pass tpm2 eventlog ${srcdir}/test/integration/fixtures/event-uefi-sha1-lo
 expect_pass tpm2 eventlog ${srcdir}/test/integration/fixtures/event-bootorder.bin
 expect_pass tpm2 eventlog ${srcdir}/test/integration/fixtures/event-postcode.bin
 
+# verifying on worker threads gives the same output
+expect_pass tpm2 eventlog --jobs 4 ${srcdir}/test/integration/fixtures/event-bootorder.bin
+tpm2 eventlog ${srcdir}/test/integration/fixtures/event-bootorder.bin > serial.yaml
+tpm2 eventlog --jobs 0 ${srcdir}/test/integration/fixtures/event-bootorder.bin > parallel.yaml
+if ! cmp -s serial.yaml parallel.yaml; then
+    echo "eventlog output differs with --jobs"
+    exit 1
+fi
+rm -f serial.yaml parallel.yaml
+expect_fail tpm2 eventlog --jobs foo ${srcdir}/test/integration/fixtures/event.bin
+
+# a separator event whose payload doesn't match its digest gives the same
+# warning and result inline and on worker threads
+cp ${srcdir}/test/integration/fixtures/event-bootorder.bin tampered.bin
+printf '\x01' | dd of=tampered.bin bs=1 seek=952 conv=notrunc 2>/dev/null
+if ! tpm2 eventlog tampered.bin > serial.yaml 2> serial.log \
+        || ! tpm2 eventlog --jobs 2 tampered.bin > parallel.yaml 2> parallel.log
+then
+    echo "eventlog should only warn about a payload mismatch"
+    exit 1
+fi
+for log in serial.log parallel.log; do
+    if ! grep -q "^WARN: Event .*digest does not match its payload" $log; then
+        echo "eventlog should warn about a payload mismatch in $log"
+        exit 1
+    fi
+done
+if ! cmp -s serial.log parallel.log || ! cmp -s serial.yaml parallel.yaml; then
+    echo "eventlog output differs with --jobs on a tampered log"
+    exit 1
+fi
+expect_pass tpm2 eventlog --jobs 2 --resume-state tampered.state tampered.bin
+rm -f tampered.bin tampered.state serial.yaml parallel.yaml serial.log \
+    parallel.log
+
+# resuming replays the PCRs from the saved state and only parses new events
+state=eventlog.state
+rm -f $state
+tpm2 eventlog ${srcdir}/test/integration/fixtures/event-bootorder.bin > full.yaml
+expect_pass tpm2 eventlog --resume-state $state ${srcdir}/test/integration/fixtures/event-bootorder.bin
+tpm2 eventlog --resume-state $state ${srcdir}/test/integration/fixtures/event-bootorder.bin > resumed.yaml
+if grep -q "EventNum" resumed.yaml; then
+    echo "resumed eventlog should not output already parsed events"
+    exit 1
+fi
+sed -n '/^pcrs:/,$p' full.yaml > full.pcrs
+sed -n '/^pcrs:/,$p' resumed.yaml > resumed.pcrs
+if ! cmp -s full.pcrs resumed.pcrs; then
+    echo "resumed eventlog PCRs differ from a full parse"
+    exit 1
+fi
+
+# a state from another log doesn't apply, the log is parsed from the start
+tpm2 eventlog ${srcdir}/test/integration/fixtures/event.bin > full.yaml
+tpm2 eventlog --resume-state $state ${srcdir}/test/integration/fixtures/event.bin > resumed.yaml
+if ! cmp -s full.yaml resumed.yaml; then
+    echo "eventlog resumed from a stale state differs from a full parse"
+    exit 1
+fi
+
+# the same goes for a log of the same size with a changed event
+rm -f $state
+cp ${srcdir}/test/integration/fixtures/event-bootorder.bin changed.bin
+tpm2 eventlog --resume-state $state changed.bin > /dev/null
+printf '\x01' | dd of=changed.bin bs=1 seek=10 conv=notrunc 2>/dev/null
+tpm2 eventlog changed.bin > full.yaml
+tpm2 eventlog --resume-state $state changed.bin > resumed.yaml
+if ! cmp -s full.yaml resumed.yaml; then
+    echo "eventlog resumed from a stale state differs from a full parse"
+    exit 1
+fi
+rm -f $state changed.bin full.yaml resumed.yaml full.pcrs resumed.pcrs
+
+# buffering doesn't change the output
+tpm2 eventlog ${srcdir}/test/integration/fixtures/event-bootorder.bin > buffered.yaml
+tpm2 eventlog --unbuffered ${srcdir}/test/integration/fixtures/event-bootorder.bin > unbuffered.yaml
+if ! cmp -s buffered.yaml unbuffered.yaml; then
+    echo "eventlog output differs with --unbuffered"
+    exit 1
+fi
+rm -f buffered.yaml unbuffered.yaml
+
 exit $?
@@ -4,7 +4,9 @@ source helpers.sh
 
 cleanup() {
   rm -f primary.ctx decrypt.ctx key.pub key.priv key.name decrypt.out \
-        encrypt.out secret.dat key.dat evict.log primary.ctx key.ctx
+        encrypt.out secret.dat key.dat evict.log primary.ctx key.ctx \
+        key2.pub key2.priv key2.dat key2.name msg.dat sig.bin session.ctx
+  rm -rf tr-cache
 
   if [ "$1" != "no-shut-down" ]; then
       shut_down
@@ -49,4 +51,61 @@ tpm2 evictcontrol -C p -c key.ctx > evict.log
 phandle=$(yaml_get_kv evict.log persistent-handle)
 tpm2 evictcontrol -C p -c $phandle
 
+# verify that the ESYS_TR cache fills and is invalidated by evictcontrol
+mkdir tr-cache
+export TPM2TOOLS_TR_CACHE=$PWD/tr-cache
+tpm2 createprimary -Q -C o -c primary.ctx
+tpm2 create -Q -C primary.ctx -u key.pub -r key.priv
+tpm2 create -Q -C primary.ctx -u key2.pub -r key2.priv
+tpm2 load -Q -C primary.ctx -u key.pub -r key.priv -c key.dat
+tpm2 load -Q -C primary.ctx -u key2.pub -r key2.priv -n key2.name \
+    -c key2.dat
+tpm2 evictcontrol -Q -C o -c key.dat 0x81010003
+tpm2 readpublic -Q -c 0x81010003
+test -f tr-cache/0x81010003.tr
+tpm2 readpublic -Q -c 0x81010003
+tpm2 evictcontrol -Q -C o -c 0x81010003
+test ! -f tr-cache/0x81010003.tr
+
+# another object at the same handle is seen as such
+tpm2 evictcontrol -Q -C o -c key2.dat 0x81010003
+tpm2 readpublic -Q -c 0x81010003 -n key.name
+cmp key.name key2.name
+
+# an entry left stale by changing the handle outside the cache is used as is,
+# commands act on the object at the handle but sessions fail on its old name
+tpm2 evictcontrol -Q -C o -c 0x81010003
+tpm2 evictcontrol -Q -C o -c key.dat 0x81010003
+tpm2 readpublic -Q -c 0x81010003
+TPM2TOOLS_TR_CACHE= tpm2 evictcontrol -Q -C o -c 0x81010003
+TPM2TOOLS_TR_CACHE= tpm2 evictcontrol -Q -C o -c key2.dat 0x81010003
+test -f tr-cache/0x81010003.tr
+
+echo "stale entry" > msg.dat
+tpm2 sign -Q -c 0x81010003 -g sha256 -o sig.bin msg.dat
+tpm2 verifysignature -Q -c key2.dat -g sha256 -m msg.dat -s sig.bin
+
+tpm2 startauthsession -S session.ctx --hmac-session
+trap - ERR
+tpm2 sign -Q -c 0x81010003 -p session:session.ctx -g sha256 -o sig.bin \
+    msg.dat 2> /dev/null
+if [ $? == 0 ]; then
+  echo "tpm2 sign didn't fail with the stale name in the HMAC session!"
+  exit 1
+fi
+trap onerror ERR
+tpm2 flushcontext -s
+
+# removing the entry by hand reads the object at the handle again
+rm tr-cache/0x81010003.tr
+tpm2 startauthsession -S session.ctx --hmac-session
+tpm2 sign -Q -c 0x81010003 -p session:session.ctx -g sha256 -o sig.bin \
+    msg.dat
+tpm2 flushcontext session.ctx
+tpm2 verifysignature -Q -c key2.dat -g sha256 -m msg.dat -s sig.bin
+test -f tr-cache/0x81010003.tr
+
+tpm2 evictcontrol -Q -C o -c 0x81010003
+unset TPM2TOOLS_TR_CACHE
+
 exit 0
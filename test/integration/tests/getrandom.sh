@@ -39,9 +39,54 @@ tpm2 startauthsession -S enc_session.ctx --hmac-session --tpmkey-context prim.ct
 tpm2 sessionconfig enc_session.ctx --enable-encrypt
 tpm2 getrandom 8 -S enc_session.ctx -S audit_session.ctx
 
+# test streaming more than the max size
+tpm2 getrandom --bytes 4096 -o random.out
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 4096
+
+# test an unbounded stream ends with its reader
+tpm2 getrandom --bytes 0 | head -c 1000 > random.out
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 1000
+
+# test streaming from a DRBG seeded from the TPM, with reseeds
+tpm2 getrandom --bytes 300000 --drbg --drbg-reseed 65536 -o random.out
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 300000
+
 # negative tests
 trap - ERR
 
+# a stream and a size are exclusive
+tpm2 getrandom --bytes 16 16 &> /dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 getrandom should fail with both --bytes and a size"
+    exit 1
+fi
+
+# an unbounded stream needs an output its reader can close
+timeout 10 tpm2 getrandom --bytes 0 -Q &> /dev/null
+rc=$?
+if [ $rc -eq 0 -o $rc -eq 124 ]; then
+    echo "tpm2 getrandom should reject --bytes 0 with -Q"
+    exit 1
+fi
+
+rm -f random.out
+timeout 10 tpm2 getrandom --bytes 0 -o random.out &> /dev/null
+rc=$?
+if [ $rc -eq 0 -o $rc -eq 124 -o -e random.out ]; then
+    echo "tpm2 getrandom should reject --bytes 0 to a regular file"
+    exit 1
+fi
+
+# the DRBG only streams
+tpm2 getrandom --drbg 16 &> /dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 getrandom should fail with --drbg and no --bytes"
+    exit 1
+fi
+
 # larger than any known hash size should fail
 tpm2 getrandom 2000 &> /dev/null
 if [ $? -eq 0 ]; then
@@ -72,4 +72,34 @@ if [ "$tpm_hash_val" != "$sha1sum_val" ]; then
   exit 1
 fi
 
+# Test streamed input of unknown size and exact multiples of the block size,
+# which are read ahead of the TPM by the hashing pipeline.
+for size in 4096 70001; do
+  dd if=/dev/urandom of=$hash_in_file bs=$size count=1 2>/dev/null
+  sha1sum_val=`shasum -a 1 $hash_in_file | cut -d\  -f 1-2 | tr -d '[:space:]'`
+  tpm_hash_val=`tpm2 hash --hex $hash_in_file`
+  test "$tpm_hash_val" == "$sha1sum_val"
+  tpm_hash_val=`cat $hash_in_file | tpm2 hash --hex`
+  test "$tpm_hash_val" == "$sha1sum_val"
+done
+
+# Throughput is reported when verbose
+tpm2 hash -V -o $hash_out_file $hash_in_file 2>&1 | grep -q "KiB/s"
+
+# Hashing on the host gives the same digest, also without a TPM
+host_hash_val=`tpm2 hash --host-digest --hex $hash_in_file 2> /dev/null`
+test "$host_hash_val" == "$sha1sum_val"
+host_hash_val=`cat $hash_in_file | tpm2 hash -T none --host-digest --hex 2> /dev/null`
+test "$host_hash_val" == "$sha1sum_val"
+
+# negative tests
+trap - ERR
+
+# no ticket can be produced on the host
+tpm2 hash --host-digest -t $ticket_file $hash_in_file 2> /dev/null
+if [ $? -eq 0 ]; then
+  echo "tpm2 hash --host-digest should fail when a ticket is requested"
+  exit 1
+fi
+
 exit 0
@@ -7,6 +7,7 @@ fi
 source helpers.sh
 
 nv_test_index=0x1500018
+nv_second_index=0x1500019
 
 large_file_name="nv.test_large_w"
 large_file_read_name="nv.test_large_r"
@@ -19,9 +20,11 @@ cleanup() {
   tpm2 nvundefine -Q   $nv_test_index -C o 2>/dev/null || true
   tpm2 nvundefine -Q   0x1500016 -C o 2>/dev/null || true
   tpm2 nvundefine -Q   0x1500015 -C o -P owner 2>/dev/null || true
+  tpm2 nvundefine -Q   $nv_second_index -C o 2>/dev/null || true
 
   rm -f policy.bin test.bin nv.test_w $large_file_name $large_file_read_name \
-  nv.readlock foo.dat cmp.dat $file_pcr_value $file_policy nv.out cap.out yaml.out
+  nv.readlock foo.dat cmp.dat $file_pcr_value $file_policy nv.out cap.out yaml.out \
+  nv.second nv.out.*
 
   if [ "$1" != "no-shut-down" ]; then
      shut_down
@@ -143,6 +146,30 @@ cmp -s $large_file_read_name $large_file_name
 tpm2 nvreadpublic "$nv_test_index" > nv.out
 yaml_get_kv nv.out "$nv_test_index" > /dev/null
 
+# read several indices at once, sharing the owner authorization
+tpm2 nvdefine -Q   $nv_second_index -C o -s 12 -a "ownerread|ownerwrite"
+printf "second index" > nv.second
+tpm2 nvwrite -Q   $nv_second_index -C o -i nv.second
+
+tpm2 nvread -C o $nv_test_index $nv_second_index > nv.out
+test "`yaml_get_kv nv.out "$nv_second_index"`" == "`xxd -p nv.second`"
+
+tpm2 nvread -C o -o nv.out $nv_test_index $nv_second_index
+cmp -s nv.out.$nv_test_index $large_file_name
+cmp -s nv.out.$nv_second_index nv.second
+
+tpm2 nvread -C o all > nv.out
+yaml_get_kv nv.out "$nv_test_index" > /dev/null
+yaml_get_kv nv.out "$nv_second_index" > /dev/null
+
+tpm2 nvreadpublic $nv_test_index $nv_second_index > nv.out
+test `grep -c "^0x" nv.out` -eq 2
+
+tpm2 nvreadpublic all > nv.out
+yaml_get_kv nv.out "$nv_second_index" "name" > /dev/null
+
+tpm2 nvundefine -Q   $nv_second_index -C o
+
 tpm2 nvundefine -Q   $nv_test_index -C o
 
 #
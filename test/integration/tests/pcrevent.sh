@@ -61,6 +61,27 @@ if [ "$new_pcr_value" == "$old_pcr_value" ]; then
   exit 1;
 fi
 
+# Hashing on the host extends the same digests as hashing with the TPM
+tpm2 pcrreset 16
+tpm2 pcrevent -Q 16 $hash_in_file
+tpm2 pcrread sha1:16 > $yaml_out_file
+tpm_pcr_value=`yaml_get_kv $yaml_out_file "sha1" "16"`
+
+tpm2 pcrreset 16
+tpm2 pcrevent -Q --host-digest 16 $hash_in_file
+tpm2 pcrread sha1:16 > $yaml_out_file
+host_pcr_value=`yaml_get_kv $yaml_out_file "sha1" "16"`
+
+if [ "$tpm_pcr_value" != "$host_pcr_value" ]; then
+  echo "Expected the same PCR value with --host-digest."
+  echo "Got \"$host_pcr_value\", expected \"$tpm_pcr_value\""
+  exit 1;
+fi
+
+tpm2 pcrevent --host-digest $hash_in_file > $hash_out_file
+check=`sha256sum $hash_in_file | cut -d' ' -f 1-1`
+grep -q "sha256: $check" $hash_out_file
+
 # verify that specifying -P without -i fails
 trap - ERR
 
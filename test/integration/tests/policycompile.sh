@@ -0,0 +1,92 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+cleanup() {
+    rm -f session.ctx policy.txt compile.yaml pcr.bin pcr.policy admin.policy \
+    unseal.policy step.policy
+
+    tpm2 flushcontext session.ctx 2>/dev/null || true
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+tpm2 pcrread -Q -o pcr.bin sha256:0,1,2
+
+cat > policy.txt <<EOF
+# unseal with the PCR state or the endorsement hierarchy auth
+pcr: pcr.policy
+    pcr sha256:0,1,2 pcr.bin
+    commandcode TPM2_CC_Unseal
+admin: admin.policy
+    secret e
+    commandcode TPM2_CC_Unseal
+
+unseal: unseal.policy
+    or pcr admin
+EOF
+
+# the same policies built one command at a time
+tpm2 startauthsession -S session.ctx
+tpm2 policypcr -S session.ctx -l sha256:0,1,2 -f pcr.bin
+tpm2 policycommandcode -S session.ctx -L step.policy TPM2_CC_Unseal
+tpm2 flushcontext session.ctx
+
+check_compile() {
+    tpm2 policycompile $1 policy.txt > compile.yaml
+    cmp step.policy pcr.policy
+    yaml_verify compile.yaml
+    test `grep -c "digest:" compile.yaml` -eq 3
+    test "`yaml_get_kv compile.yaml unseal digest`" == \
+        "`xxd -p -c 64 unseal.policy`"
+}
+
+# on the TPM and offline
+check_compile
+check_compile --offline
+
+tpm2 startauthsession -S session.ctx
+tpm2 policyor -S session.ctx -L step.policy sha256:pcr.policy,admin.policy
+tpm2 flushcontext session.ctx
+cmp step.policy unseal.policy
+
+# the description can come from stdin
+rm unseal.policy
+tpm2 policycompile -T none - < policy.txt > compile.yaml
+cmp step.policy unseal.policy
+
+# policy names are quoted in the output
+printf 'odd"#name\\:\n    authvalue\n' | tpm2 policycompile -T none - \
+    > compile.yaml
+python << 'pyscript'
+import yaml
+with open("compile.yaml") as f:
+    doc = yaml.safe_load(f)
+    assert list(doc) == ['odd"#name\\'], doc
+pyscript
+
+# negative tests
+trap - ERR
+
+# a branch must be defined before the OR
+printf "root:\n    or a b\na:\n    authvalue\nb:\n    password\n" \
+| tpm2 policycompile -T none - &> /dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 policycompile should reject undefined branches"
+    exit 1
+fi
+
+printf "root:\n    bogus\n" | tpm2 policycompile -T none - &> /dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 policycompile should reject unknown policy commands"
+    exit 1
+fi
+
+exit 0
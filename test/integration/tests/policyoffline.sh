@@ -0,0 +1,82 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+cleanup() {
+    rm -f session.ctx offline.ctx tpm.policy offline.policy \
+    branch1.policy branch2.policy pcr.bin
+
+    tpm2 flushcontext session.ctx 2>/dev/null || true
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+# builds the same policy with a trial session on the TPM ($1 empty) and
+# offline ($1 --offline) and writes it to $2
+build_policy() {
+    local opt=$1
+    local out=$2
+
+    tpm2 startauthsession $opt -S session.ctx
+    tpm2 policysecret $opt -S session.ctx -c e
+    tpm2 policycommandcode $opt -S session.ctx TPM2_CC_Unseal
+    tpm2 policyauthvalue $opt -S session.ctx -L $out
+    if [ -z "$opt" ]; then
+        tpm2 flushcontext session.ctx
+    fi
+    rm -f session.ctx
+}
+
+build_policy "" tpm.policy
+build_policy "--offline" offline.policy
+cmp tpm.policy offline.policy
+
+# -T none selects the offline engine as well
+tpm2 startauthsession -T none -S offline.ctx
+tpm2 policycommandcode -T none -S offline.ctx -L branch1.policy \
+TPM2_CC_Unseal
+tpm2 policyrestart -T none -S offline.ctx
+tpm2 policypassword -T none -S offline.ctx -L branch2.policy
+tpm2 policyor -T none -S offline.ctx -L offline.policy \
+sha256:branch1.policy,branch2.policy
+tpm2 getpolicydigest -T none -S offline.ctx -o offline.policy
+rm -f offline.ctx
+
+tpm2 startauthsession -S session.ctx
+tpm2 policyor -S session.ctx -L tpm.policy \
+sha256:branch1.policy,branch2.policy
+tpm2 flushcontext session.ctx
+cmp tpm.policy offline.policy
+
+# createpolicy computes PCR policies from a pcr values file
+tpm2 pcrread -Q -o pcr.bin sha256:0,1
+tpm2 createpolicy -Q --policy-pcr -l sha256:0,1 -f pcr.bin -L tpm.policy
+tpm2 createpolicy -Q --offline --policy-pcr -l sha256:0,1 -f pcr.bin \
+-L offline.policy
+cmp tpm.policy offline.policy
+
+# negative tests
+trap - ERR
+
+tpm2 startauthsession --offline -S offline.ctx
+tpm2 policysecret --offline -S offline.ctx -c 0x81000001 &>/dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 policysecret offline should reject objects without a name"
+    exit 1
+fi
+rm -f offline.ctx
+
+tpm2 startauthsession --offline --policy-session -S offline.ctx &>/dev/null
+if [ $? -eq 0 ]; then
+    echo "tpm2 startauthsession offline should only start trial sessions"
+    exit 1
+fi
+
+exit 0
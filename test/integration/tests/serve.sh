@@ -0,0 +1,109 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+serve_pid=""
+
+cleanup() {
+    if [ -n "$serve_pid" ]; then
+        kill $serve_pid &> /dev/null
+        wait $serve_pid &> /dev/null
+        serve_pid=""
+    fi
+
+    rm -f random.out stderr.out tpm2.sock primary.ctx key.pub key.priv
+    rm -rf serve-tmp
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+mkdir serve-tmp
+TMPDIR=$PWD/serve-tmp tpm2 serve tpm2.sock &
+serve_pid=$!
+
+for i in $(seq 1 50); do
+    test -S tpm2.sock && break
+    sleep 0.1
+done
+test -S tpm2.sock
+
+export TPM2TOOLS_SERVER="$PWD/tpm2.sock"
+
+# outputs are relative to the client's working directory
+tpm2 getrandom -o random.out 32
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 32
+
+# stdout is relayed
+tpm2 getrandom --hex 4 > random.out
+s=`ls -l random.out | awk {'print $5'}`
+test $s -eq 8
+
+# stdin is the client's
+local_hash=`echo 1234 | TPM2TOOLS_SERVER= tpm2 hash -C n --hex`
+served_hash=`echo 1234 | tpm2 hash -C n --hex`
+test "$local_hash" = "$served_hash"
+
+# requests from concurrent clients are serialized
+pids=""
+for i in $(seq 1 8); do
+    tpm2 getrandom 8 > /dev/null &
+    pids="$pids $!"
+done
+for pid in $pids; do
+    wait $pid
+done
+
+# authorized commands leave an HMAC session in the pool
+tpm2 createprimary -Q -C o -c primary.ctx
+tpm2 create -Q -C primary.ctx -u key.pub -r key.priv
+test -n "`tpm2 getcap handles-saved-session`"
+
+# negative tests
+trap - ERR
+
+# failures relay the return code and stderr
+tpm2 getrandom 2000 > /dev/null 2> stderr.out
+if [ $? -eq 0 ]; then
+    echo "tpm2 getrandom should fail with too big of request"
+    exit 1
+fi
+if [ ! -s stderr.out ]; then
+    echo "tpm2 serve should relay stderr"
+    exit 1
+fi
+
+# the server removes its socket on exit
+kill $serve_pid
+wait $serve_pid
+serve_pid=""
+if [ -e tpm2.sock ]; then
+    echo "tpm2 serve should remove its socket"
+    exit 1
+fi
+
+# and flushes the pooled sessions and removes the pool
+if ! rmdir serve-tmp; then
+    echo "tpm2 serve should remove the session pool on exit"
+    exit 1
+fi
+if [ -n "`tpm2 getcap handles-saved-session`" ]; then
+    echo "tpm2 serve should flush the pooled sessions on exit"
+    exit 1
+fi
+
+# and tools fall back to running locally
+tpm2 getrandom -o random.out 16
+if [ $? -ne 0 ]; then
+    echo "tpm2 getrandom should run locally without a server"
+    exit 1
+fi
+
+exit 0
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <setjmp.h>
 #include <cmocka.h>
@@ -238,6 +239,44 @@ static void test_file_exists_bad_args(void **state) {
     assert_false(res);
 }
 
+static void test_file_map_truncated(void **state) {
+
+    test_file *tf = test_file_from_state(state);
+
+    /* two pages, truncated below one so the first page stays backed */
+    long page_size = sysconf(_SC_PAGESIZE);
+    assert_true(page_size > 16);
+
+    size_t size = 2 * page_size;
+    UINT8 *data = malloc(size);
+    assert_non_null(data);
+    memset(data, 0xaa, size);
+
+    bool res = files_write_bytes(tf->file, data, size);
+    free(data);
+    assert_true(res);
+
+    int rc = fflush(tf->file);
+    assert_return_code(rc, errno);
+
+    files_mapping mapping = { 0 };
+    res = files_map_path(tf->path, &mapping);
+    assert_true(res);
+    assert_true(mapping.is_mmap);
+    assert_int_equal(mapping.size, size);
+    assert_false(files_mapping_is_truncated(&mapping));
+
+    rc = ftruncate(fileno(tf->file), 16);
+    assert_return_code(rc, errno);
+
+    /* the rest of the first page reads as zeros */
+    assert_int_equal(mapping.data[0], 0xaa);
+    assert_int_equal(mapping.data[page_size - 1], 0);
+    assert_true(files_mapping_is_truncated(&mapping));
+
+    files_unmap_path(&mapping);
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -279,6 +318,9 @@ int main(int argc, char* argv[]) {
                 test_setup, test_teardown),
         cmocka_unit_test_setup_teardown(test_file_exists_bad_args,
                 test_setup, test_teardown),
+
+        cmocka_unit_test_setup_teardown(test_file_map_truncated,
+                test_setup, test_teardown),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -3,6 +3,8 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <setjmp.h>
 #include <cmocka.h>
@@ -77,6 +79,136 @@ TEST_ENDIAN_NTOH(16, 0xFF00, 0x00FF)
 TEST_ENDIAN_NTOH(32, 0xAABBCCDD, 0xDDCCBBAA)
 TEST_ENDIAN_NTOH(64, 0x0011223344556677, 0x7766554433221100)
 
+static void test_hex_encode(void **state) {
+
+    (void) state;
+
+    const BYTE data[] = { 0x00, 0x01, 0x7f, 0x80, 0xab, 0xcd, 0xef, 0xff };
+    char hex[2 * sizeof(data) + 1];
+
+    size_t len = tpm2_util_hex_encode(data, sizeof(data), hex);
+    assert_int_equal(len, 2 * sizeof(data));
+    assert_string_equal(hex, "00017f80abcdefff");
+
+    len = tpm2_util_hex_encode(data, 0, hex);
+    assert_int_equal(len, 0);
+    assert_string_equal(hex, "");
+}
+
+static void test_hex_encode_all_bytes(void **state) {
+
+    (void) state;
+
+    BYTE data[256];
+    char hex[2 * sizeof(data) + 1];
+    char expected[3];
+    unsigned i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    tpm2_util_hex_encode(data, sizeof(data), hex);
+    for (i = 0; i < sizeof(data); i++) {
+        snprintf(expected, sizeof(expected), "%02x", i);
+        assert_memory_equal(&hex[2 * i], expected, 2);
+    }
+
+    BYTE decoded[sizeof(data)];
+    bool result = tpm2_util_hex_decode(hex, 2 * sizeof(data), decoded);
+    assert_true(result);
+    assert_memory_equal(decoded, data, sizeof(data));
+}
+
+static void test_hex_decode(void **state) {
+
+    (void) state;
+
+    const BYTE expected[] = { 0xde, 0xad, 0xbe, 0xef, 0x09 };
+    BYTE data[sizeof(expected)];
+
+    bool result = tpm2_util_hex_decode("deadBEEF09", 10, data);
+    assert_true(result);
+    assert_memory_equal(data, expected, sizeof(expected));
+
+    /* only len characters are consumed */
+    memset(data, 0, sizeof(data));
+    result = tpm2_util_hex_decode("dead??", 4, data);
+    assert_true(result);
+    assert_memory_equal(data, expected, 2);
+}
+
+static void test_hex_decode_bad(void **state) {
+
+    (void) state;
+
+    BYTE data[4];
+
+    assert_false(tpm2_util_hex_decode("abc", 3, data));
+    assert_false(tpm2_util_hex_decode("0g", 2, data));
+    assert_false(tpm2_util_hex_decode("g0", 2, data));
+    assert_false(tpm2_util_hex_decode("0x12", 4, data));
+    assert_false(tpm2_util_hex_decode("12 4", 4, data));
+    /* NULL in the middle of the requested length */
+    assert_false(tpm2_util_hex_decode("12\0\0", 4, data));
+}
+
+static void test_hex_to_byte_structure(void **state) {
+
+    (void) state;
+
+    const BYTE expected[] = { 0x01, 0x23, 0xab };
+    BYTE data[4];
+    UINT16 len = sizeof(data);
+
+    int rc = tpm2_util_hex_to_byte_structure("0123AB", &len, data);
+    assert_int_equal(rc, 0);
+    assert_int_equal(len, sizeof(expected));
+    assert_memory_equal(data, expected, sizeof(expected));
+
+    len = sizeof(data);
+    rc = tpm2_util_hex_to_byte_structure(NULL, &len, data);
+    assert_int_equal(rc, -1);
+
+    rc = tpm2_util_hex_to_byte_structure("012", &len, data);
+    assert_int_equal(rc, -2);
+
+    rc = tpm2_util_hex_to_byte_structure("01x3", &len, data);
+    assert_int_equal(rc, -3);
+
+    len = 1;
+    rc = tpm2_util_hex_to_byte_structure("0123", &len, data);
+    assert_int_equal(rc, -4);
+}
+
+static void test_hexdump2(void **state) {
+
+    (void) state;
+
+    /* larger than the internal encoding chunk */
+    BYTE data[1000];
+    char hex[2 * sizeof(data) + 1];
+    char out[sizeof(hex)];
+    unsigned i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i * 7;
+    }
+    tpm2_util_hex_encode(data, sizeof(data), hex);
+
+    FILE *f = tmpfile();
+    assert_non_null(f);
+
+    tpm2_util_hexdump2(f, data, sizeof(data));
+    assert_int_equal(ftell(f), 2 * sizeof(data));
+
+    rewind(f);
+    size_t read = fread(out, 1, 2 * sizeof(data), f);
+    fclose(f);
+    assert_int_equal(read, 2 * sizeof(data));
+    assert_memory_equal(out, hex, 2 * sizeof(data));
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -97,7 +229,13 @@ int main(int argc, char* argv[]) {
         cmocka_unit_test(test_ntoh_16),
         cmocka_unit_test(test_ntoh_32),
         cmocka_unit_test(test_ntoh_64),
-        cmocka_unit_test(test_popcount)
+        cmocka_unit_test(test_popcount),
+        cmocka_unit_test(test_hex_encode),
+        cmocka_unit_test(test_hex_encode_all_bytes),
+        cmocka_unit_test(test_hex_decode),
+        cmocka_unit_test(test_hex_decode_bad),
+        cmocka_unit_test(test_hex_to_byte_structure),
+        cmocka_unit_test(test_hexdump2)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tpm2_capability_cache.h"
+#include "tpm2_util.h"
+
+/* the number of GetCapability calls per capability */
+static unsigned queries[TPM2_CAP_LAST + 1];
+
+TSS2_RC __wrap_Esys_GetCapability(ESYS_CONTEXT *context, ESYS_TR session1,
+        ESYS_TR session2, ESYS_TR session3, TPM2_CAP capability,
+        UINT32 property, UINT32 propertyCount, TPMI_YES_NO *moreData,
+        TPMS_CAPABILITY_DATA **capabilityData) {
+
+    UNUSED(context);
+    UNUSED(session1);
+    UNUSED(session2);
+    UNUSED(session3);
+    UNUSED(property);
+    UNUSED(propertyCount);
+
+    queries[capability]++;
+
+    *moreData = TPM2_NO;
+    *capabilityData = calloc(1, sizeof(**capabilityData));
+    (*capabilityData)->capability = capability;
+
+    switch (capability) {
+    case TPM2_CAP_TPM_PROPERTIES: {
+        TPML_TAGGED_TPM_PROPERTY *p = &(*capabilityData)->data.tpmProperties;
+        p->tpmProperty[p->count].property = TPM2_PT_MANUFACTURER;
+        p->tpmProperty[p->count++].value = 0x49424d00;
+        p->tpmProperty[p->count].property = TPM2_PT_FIRMWARE_VERSION_1;
+        p->tpmProperty[p->count++].value = 0x20170619;
+        p->tpmProperty[p->count].property = TPM2_PT_NV_BUFFER_MAX;
+        p->tpmProperty[p->count++].value = 1024;
+        /* a variable property, which is never cached */
+        p->tpmProperty[p->count].property = TPM2_PT_PERMANENT;
+        p->tpmProperty[p->count++].value = 0x2;
+        break;
+    }
+    case TPM2_CAP_PCRS: {
+        TPML_PCR_SELECTION *p = &(*capabilityData)->data.assignedPCR;
+        p->count = 1;
+        p->pcrSelections[0].hash = TPM2_ALG_SHA256;
+        p->pcrSelections[0].sizeofSelect = 3;
+        memset(p->pcrSelections[0].pcrSelect, 0xff, 3);
+        break;
+    }
+    default:
+        fail();
+    }
+
+    return TSS2_RC_SUCCESS;
+}
+
+static int setup(void **state) {
+    UNUSED(state);
+
+    tpm2_capability_cache_clear();
+    memset(queries, 0, sizeof(queries));
+
+    return 0;
+}
+
+static void test_tpm2_capability_cache_properties(void **state) {
+    UNUSED(state);
+
+    ESYS_CONTEXT *ectx = (ESYS_CONTEXT *) 0xDEADBEEF;
+
+    UINT32 value = 0;
+    bool found = false;
+    tool_rc rc = tpm2_capability_cache_get_property(ectx,
+            TPM2_PT_NV_BUFFER_MAX, &value, &found);
+    assert_int_equal(rc, tool_rc_success);
+    assert_true(found);
+    assert_int_equal(value, 1024);
+
+    rc = tpm2_capability_cache_get_property(ectx, TPM2_PT_PERMANENT, &value,
+            &found);
+    assert_int_equal(rc, tool_rc_success);
+    assert_false(found);
+
+    const TPML_TAGGED_TPM_PROPERTY *properties = NULL;
+    rc = tpm2_capability_cache_get_properties(ectx, &properties);
+    assert_int_equal(rc, tool_rc_success);
+    assert_int_equal(properties->count, 3);
+
+    assert_int_equal(queries[TPM2_CAP_TPM_PROPERTIES], 1);
+
+    /* another ESAPI context may be another TPM */
+    rc = tpm2_capability_cache_get_properties((ESYS_CONTEXT *) 0xBADCAFE,
+            &properties);
+    assert_int_equal(rc, tool_rc_success);
+    assert_int_equal(queries[TPM2_CAP_TPM_PROPERTIES], 2);
+}
+
+static void test_tpm2_capability_cache_banks(void **state) {
+    UNUSED(state);
+
+    ESYS_CONTEXT *ectx = (ESYS_CONTEXT *) 0xDEADBEEF;
+
+    const TPML_PCR_SELECTION *pcrs = NULL;
+    tool_rc rc = tpm2_capability_cache_get_pcrs(ectx, &pcrs);
+    assert_int_equal(rc, tool_rc_success);
+    assert_int_equal(pcrs->count, 1);
+    assert_int_equal(pcrs->pcrSelections[0].hash, TPM2_ALG_SHA256);
+
+    rc = tpm2_capability_cache_get_pcrs(ectx, &pcrs);
+    assert_int_equal(rc, tool_rc_success);
+
+    /* the banks don't need the properties */
+    assert_int_equal(queries[TPM2_CAP_TPM_PROPERTIES], 0);
+    assert_int_equal(queries[TPM2_CAP_PCRS], 1);
+
+    rc = tpm2_capability_cache_get_pcrs((ESYS_CONTEXT *) 0xBADCAFE, &pcrs);
+    assert_int_equal(rc, tool_rc_success);
+    assert_int_equal(queries[TPM2_CAP_PCRS], 2);
+}
+
+/* link required symbol, but tpm2_tool.c declares it AND main, which
+ * we have a main below for cmocka tests.
+ */
+bool output_enabled = true;
+
+int main(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(test_tpm2_capability_cache_properties, setup),
+        cmocka_unit_test_setup(test_tpm2_capability_cache_banks, setup),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
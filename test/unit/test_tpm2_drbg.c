@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tpm2_drbg.h"
+#include "tpm2_util.h"
+
+/*
+ * The expected outputs were cross checked with the CTR-DRBG of the OpenSSL 3
+ * default provider, set up with AES-256-CTR, no derivation function and an
+ * empty personalization string.
+ */
+static void fill_seed(uint8_t *seed, size_t len) {
+
+    size_t i;
+    for (i = 0; i < len; i++) {
+        seed[i] = i * 7 + 3;
+    }
+}
+
+static void test_drbg_known_answer(void **state) {
+    (void) state;
+
+    uint8_t seed[2 * TPM2_DRBG_SEED_LEN];
+    fill_seed(seed, sizeof(seed));
+
+    static const uint8_t expected_instantiate[] = {
+        0x49, 0x53, 0x92, 0xe4, 0x7b, 0xee, 0xa4, 0x07,
+        0xed, 0xf8, 0xb3, 0x65, 0x04, 0xea, 0x23, 0x84,
+        0xd2, 0x0a, 0x8c, 0xe9, 0x3b, 0x3f, 0x48, 0xbb,
+        0x01, 0xcf, 0x24, 0xd1, 0xc6, 0xe4, 0xe8, 0x15,
+    };
+
+    static const uint8_t expected_reseed[] = {
+        0x04, 0x2a, 0xb4, 0x66, 0x44, 0x87, 0x1e, 0xe4,
+        0x9f, 0xd1, 0xd7, 0xd0, 0x24, 0xfc, 0x7d, 0x0c,
+    };
+
+    tpm2_drbg *drbg = tpm2_drbg_new(seed);
+    assert_non_null(drbg);
+
+    uint8_t out[sizeof(expected_instantiate)];
+    assert_true(tpm2_drbg_generate(drbg, out, sizeof(expected_instantiate)));
+    assert_memory_equal(out, expected_instantiate,
+            sizeof(expected_instantiate));
+
+    assert_true(tpm2_drbg_reseed(drbg, &seed[TPM2_DRBG_SEED_LEN]));
+
+    assert_true(tpm2_drbg_generate(drbg, out, sizeof(expected_reseed)));
+    assert_memory_equal(out, expected_reseed, sizeof(expected_reseed));
+
+    tpm2_drbg_free(drbg);
+}
+
+static void test_drbg_requests(void **state) {
+    (void) state;
+
+    uint8_t seed[TPM2_DRBG_SEED_LEN];
+    fill_seed(seed, sizeof(seed));
+
+    tpm2_drbg *drbg = tpm2_drbg_new(seed);
+    assert_non_null(drbg);
+
+    uint8_t *out = calloc(1, TPM2_DRBG_MAX_REQUEST + 1);
+    assert_non_null(out);
+
+    /* the output isn't left as zeros, and successive requests differ */
+    static const uint8_t zeros[TPM2_DRBG_MAX_REQUEST / 2];
+    assert_true(tpm2_drbg_generate(drbg, out, TPM2_DRBG_MAX_REQUEST));
+    assert_memory_not_equal(&out[TPM2_DRBG_MAX_REQUEST / 2], zeros,
+            sizeof(zeros));
+
+    uint8_t first[17];
+    memcpy(first, out, sizeof(first));
+    assert_true(tpm2_drbg_generate(drbg, out, sizeof(first)));
+    assert_memory_not_equal(out, first, sizeof(first));
+
+    assert_true(tpm2_drbg_generate(drbg, out, 0));
+
+    assert_false(tpm2_drbg_generate(drbg, out, TPM2_DRBG_MAX_REQUEST + 1));
+
+    free(out);
+    tpm2_drbg_free(drbg);
+}
+
+int main(int argc, char *argv[]) {
+
+    (void) argc;
+    (void) argv;
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_drbg_known_answer),
+        cmocka_unit_test(test_drbg_requests),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
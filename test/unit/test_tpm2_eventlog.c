@@ -74,7 +74,11 @@ static void test_sha1(void **state){
 
     tpm2_eventlog_context ctx = {0};
     assert_true(foreach_digest2(&ctx, pcr_index, digest, 1, TCG_DIGEST2_SHA1_SIZE));
-    assert_memory_equal(ctx.sha1_pcrs[pcr_index], sha1sum, sizeof(sha1sum));
+    tpm2_eventlog_bank *bank = eventlog_bank_get(&ctx, TPM2_ALG_SHA1);
+    assert_non_null(bank);
+    assert_int_equal(bank->used, 1 << pcr_index);
+    assert_memory_equal(bank->pcrs[pcr_index], sha1sum, sizeof(sha1sum));
+    eventlog_context_cleanup(&ctx);
 }
 static void test_sha256(void **state){
 
@@ -94,7 +98,10 @@ static void test_sha256(void **state){
 
     tpm2_eventlog_context ctx = {0};
     assert_true(foreach_digest2(&ctx, pcr_index, digest, 1, TCG_DIGEST2_SHA256_SIZE));
-    assert_memory_equal(ctx.sha256_pcrs[pcr_index], sha256sum, sizeof(sha256sum));
+    tpm2_eventlog_bank *bank = eventlog_bank_get(&ctx, TPM2_ALG_SHA256);
+    assert_non_null(bank);
+    assert_memory_equal(bank->pcrs[pcr_index], sha256sum, sizeof(sha256sum));
+    eventlog_context_cleanup(&ctx);
 }
 static void test_foreach_digest2_cbfail(void **state){
 
@@ -550,6 +557,128 @@ static void test_specid_event(void **state) {
 
     assert_true(specid_event(event, sizeof(buf), &next));
 }
+#define TEST_LOG_SPECID_SIZE (sizeof(TCG_EVENT) + sizeof(TCG_SPECID_EVENT) + \
+                              sizeof(TCG_SPECID_ALG) + sizeof(TCG_VENDOR_INFO))
+#define TEST_LOG_EVENT_SIZE (sizeof(TCG_EVENT_HEADER2) + TCG_DIGEST2_SHA1_SIZE + \
+                             sizeof(TCG_EVENT2) + 4)
+#define TEST_LOG_EVENTS 3
+#define TEST_LOG_SIZE (TEST_LOG_SPECID_SIZE + \
+                       TEST_LOG_EVENTS * TEST_LOG_EVENT_SIZE)
+static void test_log_init(uint8_t *buf) {
+
+    TCG_EVENT *event = (TCG_EVENT*)buf;
+    event->eventType = EV_NO_ACTION;
+    event->eventDataSize = TEST_LOG_SPECID_SIZE - sizeof(*event);
+    TCG_SPECID_EVENT *event_specid = (TCG_SPECID_EVENT*)event->event;
+    event_specid->numberOfAlgorithms = 1;
+    event_specid->digestSizes[0].algorithmId = TPM2_ALG_SHA1;
+    event_specid->digestSizes[0].digestSize = TPM2_SHA1_DIGEST_SIZE;
+
+    size_t i;
+    for (i = 0; i < TEST_LOG_EVENTS; i++) {
+        uint8_t *p = buf + TEST_LOG_SPECID_SIZE + i * TEST_LOG_EVENT_SIZE;
+        TCG_EVENT_HEADER2 *eventhdr = (TCG_EVENT_HEADER2*)p;
+        TCG_DIGEST2 *digest = eventhdr->Digests;
+        TCG_EVENT2 *event2 = (TCG_EVENT2*)(p + sizeof(*eventhdr) + TCG_DIGEST2_SHA1_SIZE);
+
+        eventhdr->PCRIndex = i;
+        eventhdr->EventType = EV_POST_CODE;
+        eventhdr->DigestCount = 1;
+        digest->AlgorithmId = TPM2_ALG_SHA1;
+        memset(digest->Digest, i + 1, TPM2_SHA1_DIGEST_SIZE);
+        event2->EventSize = 4;
+    }
+}
+static void test_parse_eventlog_specid_banks(void **state) {
+
+    (void)state;
+    uint8_t buf[TEST_LOG_SIZE] = { 0, };
+    test_log_init(buf);
+
+    /* declare a bank the events don't extend and one the host can't hash */
+    TCG_EVENT *event = (TCG_EVENT*)buf;
+    TCG_SPECID_EVENT *event_specid = (TCG_SPECID_EVENT*)event->event;
+    event_specid->digestSizes[0].algorithmId = 0x7fff;
+    event_specid->digestSizes[0].digestSize = 16;
+
+    tpm2_eventlog_context ctx = { 0 };
+    assert_true(parse_eventlog(&ctx, buf, sizeof(buf)));
+
+    /* sorted by algorithm, SHA1 added for the events */
+    assert_int_equal(ctx.bank_count, 2);
+    assert_int_equal(ctx.banks[0].alg, TPM2_ALG_SHA1);
+    assert_int_equal(ctx.banks[0].used, (1 << TEST_LOG_EVENTS) - 1);
+    assert_int_equal(ctx.banks[1].alg, 0x7fff);
+    assert_int_equal(ctx.banks[1].size, 16);
+    assert_null(ctx.banks[1].md);
+    assert_int_equal(ctx.banks[1].used, 0);
+    eventlog_context_cleanup(&ctx);
+}
+static void test_parse_eventlog_chunk(void **state) {
+
+    (void)state;
+    uint8_t buf[TEST_LOG_SIZE] = { 0, };
+    test_log_init(buf);
+
+    tpm2_eventlog_context whole = { 0 };
+    assert_true(parse_eventlog(&whole, buf, sizeof(buf)));
+
+    /* events split over every possible byte boundary */
+    tpm2_eventlog_context ctx = { 0 };
+    size_t i;
+    for (i = 0; i < sizeof(buf); i++) {
+        assert_true(parse_eventlog_chunk(&ctx, &buf[i], 1));
+    }
+    assert_true(parse_eventlog_finish(&ctx));
+
+    assert_int_equal(ctx.format, EVENTLOG_FORMAT_CRYPTO_AGILE);
+    assert_int_equal(ctx.offset, sizeof(buf));
+    assert_int_equal(ctx.events, TEST_LOG_EVENTS + 1);
+    assert_int_equal(ctx.bank_count, 1);
+    assert_int_equal(ctx.banks[0].used, whole.banks[0].used);
+    assert_memory_equal(ctx.banks[0].pcrs, whole.banks[0].pcrs,
+            sizeof(ctx.banks[0].pcrs));
+    eventlog_context_cleanup(&ctx);
+    eventlog_context_cleanup(&whole);
+}
+static void test_parse_eventlog_chunk_resume(void **state) {
+
+    (void)state;
+    uint8_t buf[TEST_LOG_SIZE] = { 0, };
+    test_log_init(buf);
+
+    tpm2_eventlog_context whole = { 0 };
+    assert_true(parse_eventlog(&whole, buf, sizeof(buf)));
+
+    /* the log grows by one event between the runs */
+    size_t first = TEST_LOG_SPECID_SIZE + TEST_LOG_EVENT_SIZE;
+    tpm2_eventlog_context ctx = { 0 };
+    assert_true(parse_eventlog_chunk(&ctx, buf, first));
+    assert_true(parse_eventlog_finish(&ctx));
+    assert_int_equal(ctx.offset, first);
+    assert_int_equal(ctx.events, 2);
+
+    assert_true(parse_eventlog_chunk(&ctx, &buf[ctx.offset],
+            sizeof(buf) - ctx.offset));
+    assert_true(parse_eventlog_finish(&ctx));
+    assert_int_equal(ctx.offset, sizeof(buf));
+    assert_memory_equal(ctx.banks[0].pcrs, whole.banks[0].pcrs,
+            sizeof(ctx.banks[0].pcrs));
+    eventlog_context_cleanup(&ctx);
+    eventlog_context_cleanup(&whole);
+}
+static void test_parse_eventlog_chunk_truncated(void **state) {
+
+    (void)state;
+    uint8_t buf[TEST_LOG_SIZE] = { 0, };
+    test_log_init(buf);
+
+    tpm2_eventlog_context ctx = { 0 };
+    assert_true(parse_eventlog_chunk(&ctx, buf, sizeof(buf) - 1));
+    assert_int_equal(ctx.events, TEST_LOG_EVENTS);
+    assert_false(parse_eventlog_finish(&ctx));
+    assert_null(ctx.pending);
+}
 int main(void) {
 
     const struct CMUnitTest tests[] = {
@@ -587,6 +716,10 @@ int main(void) {
         cmocka_unit_test(test_specid_event_nosizeforvendorstruct),
         cmocka_unit_test(test_specid_event_nosizeforvendordata),
         cmocka_unit_test(test_specid_event),
+        cmocka_unit_test(test_parse_eventlog_specid_banks),
+        cmocka_unit_test(test_parse_eventlog_chunk),
+        cmocka_unit_test(test_parse_eventlog_chunk_resume),
+        cmocka_unit_test(test_parse_eventlog_chunk_truncated),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
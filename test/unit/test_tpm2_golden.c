@@ -0,0 +1,240 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <openssl/evp.h>
+
+#include "pcr.h"
+#include "tpm2_golden.h"
+#include "tpm2_util.h"
+
+#define GOLDEN_TEST_PATH "xxx_test_golden_xxx.test"
+
+static void write_policy(const char *policy) {
+
+    FILE *f = fopen(GOLDEN_TEST_PATH, "w");
+    assert_non_null(f);
+    assert_true(fputs(policy, f) >= 0);
+    assert_int_equal(fclose(f), 0);
+}
+
+static void write_value(FILE *f, BYTE fill, size_t size) {
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        fprintf(f, "%02x", fill);
+    }
+    fputc(' ', f);
+}
+
+/*
+ * The pcrDigest of a quote of PCRs all filled with one byte per PCR.
+ */
+static void composite(const EVP_MD *md, const BYTE *fills, size_t count,
+        size_t size, TPM2B_DIGEST *digest) {
+
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_create();
+    assert_non_null(mdctx);
+    assert_int_equal(EVP_DigestInit_ex(mdctx, md, NULL), 1);
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        BYTE value[TPM2_MAX_DIGEST_BUFFER];
+        memset(value, fills[i], size);
+        assert_int_equal(EVP_DigestUpdate(mdctx, value, size), 1);
+    }
+
+    unsigned len = 0;
+    assert_int_equal(EVP_DigestFinal_ex(mdctx, digest->buffer, &len), 1);
+    digest->size = len;
+
+    EVP_MD_CTX_destroy(mdctx);
+}
+
+static int test_teardown(void **state) {
+
+    (void) state;
+
+    unlink(GOLDEN_TEST_PATH);
+
+    return 0;
+}
+
+static void test_golden_contains(void **state) {
+
+    (void) state;
+
+    FILE *f = fopen(GOLDEN_TEST_PATH, "w");
+    assert_non_null(f);
+    fputs("# comment\n\nsha256:0,7 # trailing comment\n", f);
+    write_value(f, 0x11, 32);
+    write_value(f, 0x22, 32);
+    fputs("\n", f);
+    write_value(f, 0x33, 32);
+    write_value(f, 0x44, 32);
+    fputs("\nsha1:1+sha256:2\n", f);
+    write_value(f, 0x55, 20);
+    write_value(f, 0x66, 32);
+    fputs("\n", f);
+    assert_int_equal(fclose(f), 0);
+
+    tpm2_golden *golden = tpm2_golden_load(GOLDEN_TEST_PATH);
+    assert_non_null(golden);
+    assert_int_equal(tpm2_golden_count(golden), 3);
+
+    TPML_PCR_SELECTION pcr_select;
+    assert_true(pcr_parse_selections("sha256:0,7", &pcr_select));
+
+    TPM2B_DIGEST digest;
+    composite(EVP_sha256(), (BYTE []) { 0x11, 0x22 }, 2, 32, &digest);
+    assert_true(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    composite(EVP_sha256(), (BYTE []) { 0x33, 0x44 }, 2, 32, &digest);
+    assert_true(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    /* values of another combination */
+    composite(EVP_sha256(), (BYTE []) { 0x11, 0x44 }, 2, 32, &digest);
+    assert_false(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    /* a quote hashed with another algorithm */
+    composite(EVP_sha256(), (BYTE []) { 0x11, 0x22 }, 2, 32, &digest);
+    assert_false(tpm2_golden_contains(golden, TPM2_ALG_SHA1, &pcr_select,
+            &digest));
+
+    /* which has golden digests of its own */
+    composite(EVP_sha1(), (BYTE []) { 0x11, 0x22 }, 2, 32, &digest);
+    assert_true(tpm2_golden_contains(golden, TPM2_ALG_SHA1, &pcr_select,
+            &digest));
+
+    composite(EVP_sha384(), (BYTE []) { 0x33, 0x44 }, 2, 32, &digest);
+    assert_true(tpm2_golden_contains(golden, TPM2_ALG_SHA384, &pcr_select,
+            &digest));
+    assert_false(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    /* or none, when it can't be hashed */
+    assert_false(tpm2_golden_contains(golden, TPM2_ALG_NULL, &pcr_select,
+            &digest));
+
+    composite(EVP_sha256(), (BYTE []) { 0x11, 0x22 }, 2, 32, &digest);
+
+    /* a selection that isn't listed */
+    assert_true(pcr_parse_selections("sha256:0,8", &pcr_select));
+    assert_false(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    /* values of several banks are hashed in bank order */
+    assert_true(pcr_parse_selections("sha1:1+sha256:2", &pcr_select));
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_create();
+    assert_non_null(mdctx);
+    BYTE sha1_value[20], sha256_value[32];
+    memset(sha1_value, 0x55, sizeof(sha1_value));
+    memset(sha256_value, 0x66, sizeof(sha256_value));
+    unsigned len = 0;
+    assert_int_equal(EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL), 1);
+    assert_int_equal(EVP_DigestUpdate(mdctx, sha1_value, sizeof(sha1_value)),
+            1);
+    assert_int_equal(EVP_DigestUpdate(mdctx, sha256_value,
+            sizeof(sha256_value)), 1);
+    assert_int_equal(EVP_DigestFinal_ex(mdctx, digest.buffer, &len), 1);
+    digest.size = len;
+    EVP_MD_CTX_destroy(mdctx);
+    assert_true(tpm2_golden_contains(golden, TPM2_ALG_SHA256, &pcr_select,
+            &digest));
+
+    tpm2_golden_free(golden);
+}
+
+static void test_golden_many(void **state) {
+
+    (void) state;
+
+    FILE *f = fopen(GOLDEN_TEST_PATH, "w");
+    assert_non_null(f);
+    fputs("sha256:0,1\n", f);
+
+    unsigned i;
+    for (i = 0; i < 1000; i++) {
+        write_value(f, i & 0xff, 32);
+        write_value(f, i >> 8, 32);
+        fputs("\n", f);
+    }
+    /* duplicates are counted once */
+    fputs("sha256:0,1\n", f);
+    write_value(f, 0, 32);
+    write_value(f, 0, 32);
+    fputs("\n", f);
+    assert_int_equal(fclose(f), 0);
+
+    tpm2_golden *golden = tpm2_golden_load(GOLDEN_TEST_PATH);
+    assert_non_null(golden);
+    assert_int_equal(tpm2_golden_count(golden), 1000);
+
+    TPML_PCR_SELECTION pcr_select;
+    assert_true(pcr_parse_selections("sha256:0,1", &pcr_select));
+
+    for (i = 0; i < 1024; i++) {
+        TPM2B_DIGEST digest;
+        composite(EVP_sha256(), (BYTE []) { i & 0xff, i >> 8 }, 2, 32,
+                &digest);
+        assert_int_equal(tpm2_golden_contains(golden, TPM2_ALG_SHA256,
+                &pcr_select, &digest), i < 1000);
+    }
+
+    tpm2_golden_free(golden);
+}
+
+static void test_golden_bad(void **state) {
+
+    (void) state;
+
+    static const char *policies[] = {
+        /* values before a selection */
+        "00\n",
+        /* a bad selection */
+        "foo:0\n",
+        /* a value of the wrong size */
+        "sha1:0\n00\n",
+        /* not hex */
+        "sha1:0\nzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz\n",
+        /* a missing value */
+        "sha1:0,1\n0000000000000000000000000000000000000000\n",
+        /* an extra value */
+        "sha1:0\n0000000000000000000000000000000000000000"
+                " 0000000000000000000000000000000000000000\n",
+    };
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(policies); i++) {
+        write_policy(policies[i]);
+        assert_null(tpm2_golden_load(GOLDEN_TEST_PATH));
+    }
+
+    assert_null(tpm2_golden_load("xxx_test_golden_missing_xxx.test"));
+}
+
+int main(int argc, char *argv[]) {
+
+    (void) argc;
+    (void) argv;
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_teardown(test_golden_contains, test_teardown),
+        cmocka_unit_test_teardown(test_golden_many, test_teardown),
+        cmocka_unit_test_teardown(test_golden_bad, test_teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tpm2_alg_util.h"
+#include "tpm2_attr_util.h"
+#include "tpm2_cc_util.h"
+#include "tpm2_util.h"
+
+/*
+ * Microbenchmarks of the name lookups done while parsing options, they
+ * check the results and report the time per lookup but never fail on it.
+ */
+#define BENCH_ROUNDS 10000
+
+static void bench_start(struct timespec *start) {
+
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+static void bench_report(const char *what, const struct timespec *start,
+        size_t ops) {
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (end.tv_sec - start->tv_sec) * 1e9
+            + (end.tv_nsec - start->tv_nsec);
+
+    printf("%s: %.1f ns/op\n", what, ns / ops);
+}
+
+static const TPM2_ALG_ID alg_ids[] = {
+    TPM2_ALG_RSA,
+    TPM2_ALG_KEYEDHASH,
+    TPM2_ALG_ECC,
+    TPM2_ALG_SYMCIPHER,
+    TPM2_ALG_AES,
+    TPM2_ALG_CAMELLIA,
+    TPM2_ALG_SHA1,
+    TPM2_ALG_SHA256,
+    TPM2_ALG_SHA384,
+    TPM2_ALG_SHA512,
+    TPM2_ALG_HMAC,
+    TPM2_ALG_RSASSA,
+    TPM2_ALG_RSAPSS,
+    TPM2_ALG_ECDSA,
+    TPM2_ALG_OAEP,
+    TPM2_ALG_CFB,
+    TPM2_ALG_CBC,
+    TPM2_ALG_NULL,
+};
+
+static void test_tpm2_lookup_bench_alg(void **state) {
+    UNUSED(state);
+
+    const char *names[ARRAY_LEN(alg_ids)];
+
+    struct timespec start;
+    bench_start(&start);
+
+    size_t round;
+    size_t i;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < ARRAY_LEN(alg_ids); i++) {
+            names[i] = tpm2_alg_util_algtostr(alg_ids[i],
+                    tpm2_alg_util_flags_any);
+            assert_non_null(names[i]);
+        }
+    }
+
+    bench_report("tpm2_alg_util_algtostr", &start,
+            BENCH_ROUNDS * ARRAY_LEN(alg_ids));
+
+    bench_start(&start);
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < ARRAY_LEN(alg_ids); i++) {
+            TPM2_ALG_ID id = tpm2_alg_util_strtoalg(names[i],
+                    tpm2_alg_util_flags_any);
+            assert_int_equal(id, alg_ids[i]);
+        }
+    }
+
+    bench_report("tpm2_alg_util_strtoalg", &start,
+            BENCH_ROUNDS * ARRAY_LEN(alg_ids));
+}
+
+static void test_tpm2_lookup_bench_ext_alg(void **state) {
+    UNUSED(state);
+
+    static const char *specs[] = {
+        "rsa2048:aes128cfb",
+        "rsa1024:rsaes",
+        "rsa:rsapss",
+        "ecc256:aes128cbc",
+        "ecc384:ecdaa4-sha256",
+        "hmac:sha384",
+        "aes256cbc",
+    };
+
+    struct timespec start;
+    bench_start(&start);
+
+    size_t round;
+    size_t i;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < ARRAY_LEN(specs); i++) {
+            TPM2B_PUBLIC pub = { 0 };
+            bool res = tpm2_alg_util_handle_ext_alg(specs[i], &pub);
+            assert_true(res);
+        }
+    }
+
+    bench_report("tpm2_alg_util_handle_ext_alg", &start,
+            BENCH_ROUNDS * ARRAY_LEN(specs));
+}
+
+static void test_tpm2_lookup_bench_cc(void **state) {
+    UNUSED(state);
+
+    static const char *names[] = {
+        "TPM2_CC_NV_UndefineSpaceSpecial",
+        "TPM2_CC_Create",
+        "TPM2_CC_Unseal",
+        "TPM2_CC_PolicyOR",
+        "TPM2_CC_PolicyAuthorizeNV",
+        "TPM2_CC_Vendor_TCG_Test",
+    };
+
+    TPM2_CC ccs[ARRAY_LEN(names)];
+
+    struct timespec start;
+    bench_start(&start);
+
+    size_t round;
+    size_t i;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < ARRAY_LEN(names); i++) {
+            bool res = tpm2_cc_util_from_str(names[i], &ccs[i]);
+            assert_true(res);
+        }
+    }
+
+    bench_report("tpm2_cc_util_from_str", &start,
+            BENCH_ROUNDS * ARRAY_LEN(names));
+
+    bench_start(&start);
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < ARRAY_LEN(names); i++) {
+            const char *name = tpm2_cc_util_to_str(ccs[i]);
+            assert_string_equal(name, names[i]);
+        }
+    }
+
+    bench_report("tpm2_cc_util_to_str", &start,
+            BENCH_ROUNDS * ARRAY_LEN(names));
+}
+
+static void test_tpm2_lookup_bench_attr(void **state) {
+    UNUSED(state);
+
+    static const char obj_attrs[] = "fixedtpm|fixedparent|sensitivedataorigin"
+            "|userwithauth|restricted|decrypt";
+    static const char nv_attrs[] = "ownerread|ownerwrite|authread|authwrite"
+            "|nt=extend";
+
+    struct timespec start;
+    bench_start(&start);
+
+    size_t round;
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        char buf[sizeof(obj_attrs)];
+        memcpy(buf, obj_attrs, sizeof(buf));
+
+        TPMA_OBJECT attrs = 0;
+        bool res = tpm2_attr_util_obj_strtoattr(buf, &attrs);
+        assert_true(res);
+        assert_int_equal(attrs,
+                TPMA_OBJECT_FIXEDTPM | TPMA_OBJECT_FIXEDPARENT
+                        | TPMA_OBJECT_SENSITIVEDATAORIGIN
+                        | TPMA_OBJECT_USERWITHAUTH | TPMA_OBJECT_RESTRICTED
+                        | TPMA_OBJECT_DECRYPT);
+    }
+
+    bench_report("tpm2_attr_util_obj_strtoattr", &start, BENCH_ROUNDS);
+
+    bench_start(&start);
+
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        char buf[sizeof(nv_attrs)];
+        memcpy(buf, nv_attrs, sizeof(buf));
+
+        TPMA_NV attrs = 0;
+        bool res = tpm2_attr_util_nv_strtoattr(buf, &attrs);
+        assert_true(res);
+        assert_int_equal(attrs,
+                TPMA_NV_OWNERREAD | TPMA_NV_OWNERWRITE | TPMA_NV_AUTHREAD
+                        | TPMA_NV_AUTHWRITE
+                        | (TPM2_NT_EXTEND << TPMA_NV_TPM2_NT_SHIFT));
+    }
+
+    bench_report("tpm2_attr_util_nv_strtoattr", &start, BENCH_ROUNDS);
+}
+
+/* link required symbol, but tpm2_tool.c declares it AND main, which
+ * we have a main below for cmocka tests.
+ */
+bool output_enabled = true;
+
+int main(int argc, char *argv[]) {
+    UNUSED(argc);
+    UNUSED(argv);
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_tpm2_lookup_bench_alg),
+        cmocka_unit_test(test_tpm2_lookup_bench_ext_alg),
+        cmocka_unit_test(test_tpm2_lookup_bench_cc),
+        cmocka_unit_test(test_tpm2_lookup_bench_attr),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
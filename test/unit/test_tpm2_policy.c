@@ -353,6 +353,169 @@ static void test_tpm2_policy_build_pcr_file_bad_size(void **state) {
     assert_int_equal(trc, tool_rc_general_error);
 }
 
+/* PolicySecret(TPM_RH_ENDORSEMENT), the policy of the default EK templates */
+static TPM2B_DIGEST ek_policy_digest = {
+        .size = 32,
+        .buffer = {
+            0x83, 0x71, 0x97, 0x67, 0x44, 0x84, 0xb3, 0xf8, 0x1a, 0x90,
+            0xcc, 0x8d, 0x46, 0xa5, 0xd7, 0x24, 0xfd, 0x52, 0xd7, 0x6e,
+            0x06, 0x52, 0x0b, 0x64, 0xf2, 0xa1, 0xda, 0x1b, 0x33, 0x14,
+            0x69, 0xaa
+        }
+};
+
+/* PolicyAuthValue */
+static TPM2B_DIGEST authvalue_policy_digest = {
+        .size = 32,
+        .buffer = {
+            0x8f, 0xcd, 0x21, 0x69, 0xab, 0x92, 0x69, 0x4e, 0x0c, 0x63,
+            0x3f, 0x1a, 0xb7, 0x72, 0x84, 0x2b, 0x82, 0x41, 0xbb, 0xc2,
+            0x02, 0x88, 0x98, 0x1f, 0xc7, 0xac, 0x1e, 0xdd, 0xc1, 0xfd,
+            0xdb, 0x0e
+        }
+};
+
+/* PolicyOR of the two above */
+static TPM2B_DIGEST or_policy_digest = {
+        .size = 32,
+        .buffer = {
+            0x64, 0xa3, 0xe7, 0xf8, 0x53, 0xc6, 0xc9, 0x4c, 0x9e, 0xe7,
+            0xd1, 0xf5, 0x8f, 0x37, 0x73, 0xb2, 0x90, 0xe7, 0x5c, 0xb6,
+            0xd9, 0xb1, 0x9e, 0xf3, 0x4f, 0xd1, 0x9a, 0x87, 0x2c, 0x83,
+            0xa4, 0x94
+        }
+};
+
+/* PolicyCommandCode(TPM2_CC_Unseal) */
+static TPM2B_DIGEST unseal_policy_digest = {
+        .size = 32,
+        .buffer = {
+            0xe6, 0x13, 0x13, 0x70, 0x76, 0x52, 0x4b, 0xde, 0x48, 0x75,
+            0x33, 0x86, 0x58, 0x84, 0xe9, 0x73, 0x2e, 0xbe, 0xe3, 0xaa,
+            0xcb, 0x09, 0x5d, 0x94, 0xa6, 0xde, 0x49, 0x2e, 0xc0, 0x6c,
+            0x46, 0xfa
+        }
+};
+
+static tpm2_session *test_offline_session_new(const char *path) {
+
+    tpm2_session_data *d = tpm2_session_data_new(TPM2_SE_TRIAL);
+    assert_non_null(d);
+
+    tpm2_session_set_path(d, path);
+
+    tpm2_session *s = NULL;
+    tool_rc rc = tpm2_session_open_offline(d, &s);
+    assert_int_equal(rc, tool_rc_success);
+    assert_non_null(s);
+    assert_true(tpm2_session_is_offline(s));
+
+    return s;
+}
+
+static void assert_policy_digest(tpm2_session *s, TPM2B_DIGEST *expected) {
+
+    TPM2B_DIGEST *policy_digest = NULL;
+    tool_rc rc = tpm2_policy_get_digest(NULL, s, &policy_digest);
+    assert_int_equal(rc, tool_rc_success);
+
+    assert_int_equal(policy_digest->size, expected->size);
+    assert_memory_equal(policy_digest->buffer, expected->buffer,
+            expected->size);
+
+    free(policy_digest);
+}
+
+static void test_tpm2_policy_offline_secret_good(void **state) {
+    UNUSED(state);
+
+    tpm2_session *s = test_offline_session_new(NULL);
+
+    tpm2_loaded_object endorsement = {
+        .handle = TPM2_RH_ENDORSEMENT,
+    };
+
+    tool_rc rc = tpm2_policy_build_policysecret(NULL, s, &endorsement, 0,
+            NULL, NULL, false, NULL, NULL);
+    assert_int_equal(rc, tool_rc_success);
+
+    assert_policy_digest(s, &ek_policy_digest);
+
+    tpm2_session_close(&s);
+    assert_null(s);
+}
+
+static void test_tpm2_policy_offline_secret_bad_entity(void **state) {
+    UNUSED(state);
+
+    tpm2_session *s = test_offline_session_new(NULL);
+
+    /* the name of a transient object can't be known without a TPM */
+    tpm2_loaded_object object = {
+        .handle = TPM2_TRANSIENT_FIRST,
+        .path = "key.ctx",
+    };
+
+    tool_rc rc = tpm2_policy_build_policysecret(NULL, s, &object, 0, NULL,
+            NULL, false, NULL, NULL);
+    assert_int_equal(rc, tool_rc_option_error);
+
+    tpm2_session_close(&s);
+}
+
+static void test_tpm2_policy_offline_or_good(void **state) {
+    UNUSED(state);
+
+    tpm2_session *s = test_offline_session_new(NULL);
+
+    tool_rc rc = tpm2_policy_build_policyauthvalue(NULL, s);
+    assert_int_equal(rc, tool_rc_success);
+
+    assert_policy_digest(s, &authvalue_policy_digest);
+
+    TPML_DIGEST policy_list = {
+        .count = 2,
+        .digests = { ek_policy_digest, authvalue_policy_digest },
+    };
+
+    rc = tpm2_policy_build_policyor(NULL, s, &policy_list);
+    assert_int_equal(rc, tool_rc_success);
+
+    assert_policy_digest(s, &or_policy_digest);
+
+    tpm2_session_close(&s);
+}
+
+static void test_tpm2_policy_offline_save_restore(void **state) {
+
+    test_file *tf = test_file_from_state(state);
+
+    tpm2_session *s = test_offline_session_new(tf->path);
+
+    tool_rc rc = tpm2_policy_build_policycommandcode(NULL, s, TPM2_CC_Unseal);
+    assert_int_equal(rc, tool_rc_success);
+
+    rc = tpm2_session_close(&s);
+    assert_int_equal(rc, tool_rc_success);
+
+    rc = tpm2_session_restore(NULL, tf->path, false, &s);
+    assert_int_equal(rc, tool_rc_success);
+    assert_true(tpm2_session_is_offline(s));
+    assert_int_equal(tpm2_session_get_type(s), TPM2_SE_TRIAL);
+
+    assert_policy_digest(s, &unseal_policy_digest);
+
+    /* a restart goes back to the all zero digest */
+    rc = tpm2_session_restart(NULL, s);
+    assert_int_equal(rc, tool_rc_success);
+
+    TPM2B_DIGEST zero = { .size = 32 };
+    assert_policy_digest(s, &zero);
+
+    rc = tpm2_session_close(&s);
+    assert_int_equal(rc, tool_rc_success);
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -367,6 +530,11 @@ int main(int argc, char *argv[]) {
         cmocka_unit_test_setup_teardown(test_tpm2_policy_build_pcr_file_good,
                 test_setup, test_teardown),
         cmocka_unit_test_setup_teardown(test_tpm2_policy_build_pcr_file_bad_size,
+                test_setup, test_teardown),
+        cmocka_unit_test(test_tpm2_policy_offline_secret_good),
+        cmocka_unit_test(test_tpm2_policy_offline_secret_bad_entity),
+        cmocka_unit_test(test_tpm2_policy_offline_or_good),
+        cmocka_unit_test_setup_teardown(test_tpm2_policy_offline_save_restore,
                 test_setup, test_teardown)
     };
 
@@ -13,6 +13,7 @@
 
 #include "test_session_common.h"
 #include "tpm2_session.h"
+#include "tpm2_session_pool.h"
 
 ESYS_TR _save_handle;
 
@@ -92,6 +93,30 @@ TSS2_RC __wrap_tpm2_flush_context(ESYS_CONTEXT *esysContext,
     return TSS2_RC_SUCCESS;
 }
 
+static TPMA_SESSION _session_attrs = TPMA_SESSION_CONTINUESESSION;
+
+TSS2_RC __wrap_Esys_TRSess_GetAttributes(ESYS_CONTEXT *esysContext,
+        ESYS_TR session, TPMA_SESSION *flags) {
+
+    UNUSED(esysContext);
+    UNUSED(session);
+
+    *flags = _session_attrs;
+
+    return TPM2_RC_SUCCESS;
+}
+
+TSS2_RC __wrap_Esys_TRSess_SetAttributes(ESYS_CONTEXT *esysContext,
+        ESYS_TR session, TPMA_SESSION flags, TPMA_SESSION mask) {
+
+    UNUSED(esysContext);
+    UNUSED(session);
+
+    _session_attrs = (_session_attrs & ~mask) | (flags & mask);
+
+    return TPM2_RC_SUCCESS;
+}
+
 static void test_tpm2_session_defaults_good(void **state) {
     UNUSED(state);
 
@@ -265,6 +290,57 @@ static void test_tpm2_session_is_trial_test(void **state) {
     tpm2_session_close(&s);
 }
 
+static void open_close_hmac_session(TPMA_SESSION attrs_on_close) {
+
+    tpm2_session_data *d = tpm2_session_data_new(TPM2_SE_HMAC);
+    assert_non_null(d);
+
+    tpm2_session *s = NULL;
+    tool_rc rc = tpm2_session_open(CONTEXT, d, &s);
+    assert_int_equal(rc, tool_rc_success);
+    assert_non_null(s);
+
+    assert_int_equal(tpm2_session_get_handle(s), SESSION_HANDLE);
+    assert_int_equal(_session_attrs, TPMA_SESSION_CONTINUESESSION);
+
+    _session_attrs = attrs_on_close;
+    rc = tpm2_session_close(&s);
+    assert_int_equal(rc, tool_rc_success);
+    assert_null(s);
+}
+
+static void test_tpm2_session_pool_reuse(void **state) {
+    UNUSED(state);
+
+    bool result = tpm2_session_pool_init();
+    assert_true(result);
+
+    /* only the first open starts a session, the others come from the pool */
+    set_expected_defaults(TPM2_SE_HMAC, SESSION_HANDLE, TPM2_RC_SUCCESS);
+    open_close_hmac_session(TPMA_SESSION_CONTINUESESSION);
+    open_close_hmac_session(TPMA_SESSION_CONTINUESESSION);
+
+    /* a session used without continueSession is gone and not pooled */
+    open_close_hmac_session(0);
+
+    /* ESAPI starts sessions with continueSession set */
+    _session_attrs = TPMA_SESSION_CONTINUESESSION;
+    set_expected_defaults(TPM2_SE_HMAC, SESSION_HANDLE, TPM2_RC_SUCCESS);
+    open_close_hmac_session(TPMA_SESSION_CONTINUESESSION);
+
+    /* policy sessions are never pooled */
+    set_expected_defaults(TPM2_SE_POLICY, SESSION_HANDLE, TPM2_RC_SUCCESS);
+    tpm2_session_data *d = tpm2_session_data_new(TPM2_SE_POLICY);
+    assert_non_null(d);
+    tpm2_session *s = NULL;
+    tool_rc rc = tpm2_session_open(CONTEXT, d, &s);
+    assert_int_equal(rc, tool_rc_success);
+    tpm2_session_close(&s);
+
+    tpm2_session_pool_destroy(CONTEXT);
+    assert_false(tpm2_session_pool_is_enabled());
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -287,7 +363,9 @@ int main(int argc, char *argv[]) {
     cmocka_unit_test_setup_teardown(test_tpm2_session_save,
             test_session_setup, test_session_teardown),
     cmocka_unit_test(test_tpm2_session_restart),
-    cmocka_unit_test(test_tpm2_session_is_trial_test)
+    cmocka_unit_test(test_tpm2_session_is_trial_test),
+    /* must be last, it leaves the session pool disabled */
+    cmocka_unit_test(test_tpm2_session_pool_reuse)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
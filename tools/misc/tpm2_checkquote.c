@@ -1,11 +1,21 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <openssl/evp.h>
 #include <openssl/pem.h>
 #include <openssl/err.h>
 
@@ -14,6 +24,8 @@
 #include "object.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_convert.h"
+#include "tpm2_golden.h"
+#include "tpm2_identity_util.h"
 #include "tpm2_openssl.h"
 #include "tpm2_options.h"
 #include "tpm2_systemdeps.h"
@@ -46,47 +58,132 @@ struct tpm2_verifysig_ctx {
     char *eventlog_path;
     tpm2_loaded_object key_context_object;
     const char *pcr_selection_string;
+    uint32_t jobs;
+    const char *manifest_path;
+    const char *serve_path;
+    const char *connect_path;
+    TPM2B_NAME key_name;
+    int key_count;
+    char **keys;
+    const char *golden_path;
+    tpm2_golden *golden;
 };
 
 static tpm2_verifysig_ctx ctx = {
         .halg = TPM2_ALG_SHA256,
         .msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer),
         .pcr_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer),
+        .key_name = TPM2B_EMPTY_INIT,
 };
 
-static bool verify(void) {
+/*
+ * Verifies a signature with a context that went through
+ * EVP_PKEY_verify_init(), it can be reused for further signatures.
+ */
+static bool verify_signature_ctx(EVP_PKEY_CTX *pkey_ctx, TPMI_ALG_HASH halg,
+        TPM2B_MAX_BUFFER *signature, TPM2B_DIGEST *msg_hash) {
 
-    bool result = false;
+    /* get the digest alg */
+    /* TODO SPlit loading on plain vs tss format to detect the hash alg */
+    /* If its a plain sig we need -g */
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(halg);
+    // TODO error handling
 
-    /* read the public key */
-    EVP_PKEY *pkey = NULL;
-    bool ret = tpm2_public_load_pkey(ctx.pubkey_file_path, &pkey);
-    if (!ret) {
+    int rc = EVP_PKEY_CTX_set_signature_md(pkey_ctx, md);
+    if (!rc) {
+        LOG_ERR("EVP_PKEY_CTX_set_signature_md failed: %s", ERR_error_string(ERR_get_error(), NULL));
+        return false;
+    }
+
+    // Verify the signature matches message digest
+
+    rc = EVP_PKEY_verify(pkey_ctx, signature->buffer, signature->size,
+            msg_hash->buffer, msg_hash->size);
+    if (rc != 1) {
+        if (rc == 0) {
+            LOG_ERR("Error validating signed message with public key provided");
+        } else {
+            LOG_ERR("Error %s", ERR_error_string(ERR_get_error(), NULL));
+        }
         return false;
     }
 
+    return true;
+}
+
+static EVP_PKEY_CTX *verify_ctx_new(EVP_PKEY *pkey) {
+
     EVP_PKEY_CTX *pkey_ctx = EVP_PKEY_CTX_new(pkey, NULL);
     if (!pkey_ctx) {
         LOG_ERR("EVP_PKEY_CTX_new failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
+        return NULL;
     }
 
-    /* get the digest alg */
-    /* TODO SPlit loading on plain vs tss format to detect the hash alg */
-    /* If its a plain sig we need -g */
-    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(ctx.halg);
-    // TODO error handling
-
     int rc = EVP_PKEY_verify_init(pkey_ctx);
     if (!rc) {
         LOG_ERR("EVP_PKEY_verify_init failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
+        EVP_PKEY_CTX_free(pkey_ctx);
+        return NULL;
     }
 
-    rc = EVP_PKEY_CTX_set_signature_md(pkey_ctx, md);
-    if (!rc) {
-        LOG_ERR("EVP_PKEY_CTX_set_signature_md failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
+    return pkey_ctx;
+}
+
+static bool verify_signature(EVP_PKEY *pkey, TPMI_ALG_HASH halg,
+        TPM2B_MAX_BUFFER *signature, TPM2B_DIGEST *msg_hash) {
+
+    EVP_PKEY_CTX *pkey_ctx = verify_ctx_new(pkey);
+    if (!pkey_ctx) {
+        return false;
+    }
+
+    bool result = verify_signature_ctx(pkey_ctx, halg, signature, msg_hash);
+
+    EVP_PKEY_CTX_free(pkey_ctx);
+
+    return result;
+}
+
+/*
+ * Checks the qualification and, when pcr_hash is given, the PCR composite
+ * of a quote whose signature was verified, then the PCR composite against
+ * the golden values when there are some. Returns NULL on success or the
+ * reason the quote was rejected.
+ */
+static const char *check_attest(const TPMS_ATTEST *attest,
+        const TPM2B_DATA *extra_data, TPMI_ALG_HASH halg,
+        const TPM2B_DIGEST *pcr_hash) {
+
+    if (attest->extraData.size != extra_data->size
+            || memcmp(attest->extraData.buffer, extra_data->buffer,
+                    extra_data->size)) {
+        return "qualification mismatch";
+    }
+
+    if (pcr_hash && (attest->attested.quote.pcrDigest.size != pcr_hash->size
+            || memcmp(attest->attested.quote.pcrDigest.buffer,
+                    pcr_hash->buffer, pcr_hash->size))) {
+        return "pcr digest mismatch";
+    }
+
+    if (ctx.golden && !tpm2_golden_contains(ctx.golden, halg,
+            &attest->attested.quote.pcrSelect,
+            &attest->attested.quote.pcrDigest)) {
+        return "pcr digest not golden";
+    }
+
+    return NULL;
+}
+
+static bool verify(void) {
+
+    bool result = false;
+
+    /* read the public key */
+    EVP_PKEY *pkey = NULL;
+    bool ret = tpm2_public_load_pkey(ctx.pubkey_file_path, &pkey);
+    if (!ret) {
+        return false;
     }
 
     /* TODO dump actual signature */
@@ -94,16 +191,8 @@ static bool verify(void) {
     tpm2_util_hexdump(ctx.signature.buffer, ctx.signature.size);
     tpm2_tool_output("\n");
 
-    // Verify the signature matches message digest
-
-    rc = EVP_PKEY_verify(pkey_ctx, ctx.signature.buffer, ctx.signature.size,
-            ctx.msg_hash.buffer, ctx.msg_hash.size);
-    if (rc != 1) {
-        if (rc == 0) {
-            LOG_ERR("Error validating signed message with public key provided");
-        } else {
-            LOG_ERR("Error %s", ERR_error_string(ERR_get_error(), NULL));
-        }
+    ret = verify_signature(pkey, ctx.halg, &ctx.signature, &ctx.msg_hash);
+    if (!ret) {
         goto err;
     }
 
@@ -124,12 +213,18 @@ static bool verify(void) {
         }
     }
 
+    if (ctx.golden && !tpm2_golden_contains(ctx.golden, ctx.halg,
+            &ctx.attest.attested.quote.pcrSelect,
+            &ctx.attest.attested.quote.pcrDigest)) {
+        LOG_ERR("The PCR composite isn't one of the golden PCR values");
+        goto err;
+    }
+
     result = true;
 
 err:
 
     EVP_PKEY_free(pkey);
-    EVP_PKEY_CTX_free(pkey_ctx);
 
     return result;
 }
@@ -164,9 +259,10 @@ static TPM2B_ATTEST *message_from_file(const char *msg_file_path) {
 }
 
 static bool parse_selection_data_from_selection_string(FILE *pcr_input,
-    TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs) {
+    const char *pcr_selection_string, TPML_PCR_SELECTION *pcr_select,
+    tpm2_pcrs *pcrs) {
 
-    bool result = pcr_parse_selections(ctx.pcr_selection_string, pcr_select);
+    bool result = pcr_parse_selections(pcr_selection_string, pcr_select);
     if (!result) {
         LOG_ERR("Could not parse PCR selections");
         return false;
@@ -285,9 +381,21 @@ static bool parse_selection_data_from_file(FILE *pcr_input,
     return true;
 }
 
-static bool pcrs_from_file(const char *pcr_file_path,
+static bool pcrs_from_stream(FILE *pcr_input, const char *pcr_selection_string,
         TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs) {
 
+    if (!pcr_selection_string) {
+        return parse_selection_data_from_file(pcr_input, pcr_select, pcrs);
+    }
+
+    return parse_selection_data_from_selection_string(pcr_input,
+            pcr_selection_string, pcr_select, pcrs);
+}
+
+static bool pcrs_from_file(const char *pcr_file_path,
+        const char *pcr_selection_string, TPML_PCR_SELECTION *pcr_select,
+        tpm2_pcrs *pcrs) {
+
     bool result = false;
     unsigned long size;
 
@@ -307,20 +415,9 @@ static bool pcrs_from_file(const char *pcr_file_path,
         goto out;
     }
 
-    if (!ctx.pcr_selection_string) {
-        result = parse_selection_data_from_file(pcr_input, pcr_select, pcrs);
-        if (!result) {
-            goto out;
-        }
-    } else {
-        result = parse_selection_data_from_selection_string(pcr_input,
-            pcr_select, pcrs);
-        if (!result) {
-            goto out;
-        }
-    }
+    result = pcrs_from_stream(pcr_input, pcr_selection_string, pcr_select,
+            pcrs);
 
-    result = true;
 out:
     if (pcr_input) {
         fclose(pcr_input);
@@ -331,33 +428,146 @@ out:
 
 static bool eventlog_from_file(tpm2_eventlog_context *evctx, const char *file_path) {
 
-    unsigned long size;
-
-    if (!files_get_file_size_path(file_path, &size)) {
+    files_mapping eventlog = { 0 };
+    if (!files_map_path(file_path, &eventlog)) {
         return false;
     }
 
-    if (!size) {
+    bool rc = false;
+    if (!eventlog.size) {
         LOG_ERR("The eventlog file \"%s\" is empty", file_path);
+        goto out;
+    }
+
+    rc = parse_eventlog(evctx, eventlog.data, eventlog.size);
+    if (files_mapping_is_truncated(&eventlog)) {
+        LOG_ERR("The eventlog file \"%s\" was truncated while being read",
+                file_path);
+        rc = false;
+    }
+
+out:
+    files_unmap_path(&eventlog);
+
+    return rc;
+}
+
+/*
+ * Computes the composite digest of the PCR values of a quote.
+ */
+static bool pcrs_digest(TPMI_ALG_HASH halg, TPML_PCR_SELECTION *pcr_select,
+        tpm2_pcrs *pcrs, TPM2B_DIGEST *digest) {
+
+    if (le32toh(pcr_select->count) > TPM2_NUM_PCR_BANKS)
+        return false;
+
+    UINT32 i;
+    for (i = 0; i < le32toh(pcr_select->count); i++)
+        if (le16toh(pcr_select->pcrSelections[i].hash) == TPM2_ALG_ERROR)
+            return false;
+
+    if (!tpm2_openssl_hash_pcr_banks_le(halg, pcr_select, pcrs, digest)) {
+        LOG_ERR("Failed to hash PCR values related to quote!");
         return false;
     }
 
-    uint8_t *eventlog = calloc(1, size);
-    if (!eventlog) {
-        LOG_ERR("OOM");
+    return true;
+}
+
+/*
+ * Loads the PCR values of a quote and computes their composite digest, the
+ * selection string is only needed for files without a TPML_PCR_SELECTION.
+ */
+static bool pcrs_digest_from_file(const char *pcr_file_path,
+        const char *pcr_selection_string, TPMI_ALG_HASH halg,
+        TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs, TPM2B_DIGEST *digest) {
+
+    if (!pcrs_from_file(pcr_file_path, pcr_selection_string, pcr_select,
+            pcrs)) {
         return false;
     }
 
-    uint16_t size_tmp = size;
-    if (!files_load_bytes_from_path(file_path, eventlog, &size_tmp)) {
-        free(eventlog);
+    return pcrs_digest(halg, pcr_select, pcrs, digest);
+}
+
+/*
+ * Replays the event log and compares the result with the quoted PCR values.
+ * The event payloads aren't checked against their digests, the replay is.
+ */
+static bool eventlog_matches_pcrs(const char *eventlog_path,
+        TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs) {
+
+    tpm2_eventlog_context eventlog_ctx = { 0 };
+
+    bool rc = eventlog_from_file(&eventlog_ctx, eventlog_path);
+    if (!rc) {
+        eventlog_context_cleanup(&eventlog_ctx);
+        LOG_ERR("Failed to process eventlog");
         return false;
     }
 
-    bool rc = parse_eventlog(evctx, eventlog, size);
-    free(eventlog);
+    static const uint8_t zero_pcr[sizeof(TPMU_HA)];
+    bool eventlog_fail = false;
+    unsigned vi = 0;
+    unsigned di = 0;
+    for (unsigned i = 0; i < pcr_select->count; i++) {
+        const TPMS_PCR_SELECTION *const sel = &pcr_select->pcrSelections[i];
+
+        // Loop through all PCRs in this bank
+        const unsigned bank_size = sel->sizeofSelect * 8;
+        for (unsigned pcr_id = 0; pcr_id < bank_size; pcr_id++) {
+            // skip non-selected banks
+            if (!tpm2_util_is_pcr_select_bit_set(sel, pcr_id)) {
+                continue;
+            }
+            if (vi >= pcrs->count || di >= pcrs->pcr_values[vi].count) {
+                LOG_ERR("Something wrong, trying to print but nothing more");
+                eventlog_fail = true;
+                break;
+            }
 
-    return rc;
+            // Compare this digest to the computed value from the eventlog
+            const TPM2B_DIGEST *pcr = &pcrs->pcr_values[vi].digests[di];
+            const uint8_t *pcr_q = pcr->buffer;
+            const uint8_t *pcr_e = NULL;
+
+            const tpm2_eventlog_bank *bank =
+                    eventlog_bank_get(&eventlog_ctx, sel->hash);
+            if (bank && bank->md && pcr->size == bank->size) {
+                pcr_e = bank->pcrs[pcr_id];
+            } else if (!bank && pcr->size ==
+                    tpm2_alg_util_get_hash_size(sel->hash)) {
+                /* the log never extends this bank */
+                pcr_e = zero_pcr;
+            } else {
+                LOG_WARN("PCR%u unsupported algorithm/size %u/%u", pcr_id, sel->hash, pcr->size);
+                eventlog_fail = 1;
+            }
+
+            if (pcr_e && memcmp(pcr_e, pcr_q, pcr->size) != 0) {
+                LOG_WARN("PCR%u mismatch", pcr_id);
+                eventlog_fail = 1;
+            }
+
+            if (++di < pcrs->pcr_values[vi].count) {
+                continue;
+            }
+
+            di = 0;
+            if (++vi < pcrs->count) {
+                continue;
+            }
+        }
+    }
+
+    eventlog_context_cleanup(&eventlog_ctx);
+
+    if (eventlog_fail) {
+        LOG_ERR("Eventlog and quote PCR mismatch");
+        return false;
+    }
+
+    return true;
 }
 
 static tool_rc init(void) {
@@ -426,26 +636,14 @@ static tool_rc init(void) {
     }
 
     if (ctx.flags.pcr) {
-        if (pcrs_from_file(ctx.pcr_file_path, &pcr_select, &temp_pcrs)) {
-            /* pcrs_from_file() logs specific error no need to here */
+        if (pcrs_digest_from_file(ctx.pcr_file_path, ctx.pcr_selection_string,
+                ctx.halg, &pcr_select, &temp_pcrs, &ctx.pcr_hash)) {
+            /* pcrs_digest_from_file() logs specific error no need to here */
             pcrs = &temp_pcrs;
         } else {
             goto err;
         }
 
-        if (le32toh(pcr_select.count) > TPM2_NUM_PCR_BANKS)
-            goto err;
-
-        UINT32 i;
-        for (i = 0; i < le32toh(pcr_select.count); i++)
-            if (le16toh(pcr_select.pcrSelections[i].hash) == TPM2_ALG_ERROR)
-            goto err;
-
-        if (!tpm2_openssl_hash_pcr_banks_le(ctx.halg, &pcr_select, pcrs,
-                &ctx.pcr_hash)) {
-            LOG_ERR("Failed to hash PCR values related to quote!");
-            goto err;
-        }
         if (!pcr_print_pcr_struct_le(&pcr_select, pcrs)) {
             LOG_ERR("Failed to print PCR values related to quote!");
             goto err;
@@ -453,7 +651,8 @@ static tool_rc init(void) {
     }
 
     if (ctx.flags.eventlog && ctx.flags.pcr) {
-        if (pcrs_from_file(ctx.pcr_file_path, &pcr_select, &temp_pcrs)) {
+        if (pcrs_from_file(ctx.pcr_file_path, ctx.pcr_selection_string,
+                &pcr_select, &temp_pcrs)) {
             /* pcrs_from_file() logs specific error no need to here */
             pcrs = &temp_pcrs;
         } else {
@@ -463,70 +662,9 @@ static tool_rc init(void) {
         if (pcr_select.count > TPM2_NUM_PCR_BANKS)
             goto err;
 
-        tpm2_eventlog_context eventlog_ctx = { 0 };
-        bool rc = eventlog_from_file(&eventlog_ctx, ctx.eventlog_path);
+        bool rc = eventlog_matches_pcrs(ctx.eventlog_path, &pcr_select,
+                pcrs);
         if (!rc) {
-            LOG_ERR("Failed to process eventlog");
-            goto err;
-        }
-
-        bool eventlog_fail = false;
-        unsigned vi = 0;
-        unsigned di = 0;
-        for (unsigned i = 0; i < pcr_select.count; i++) {
-            const TPMS_PCR_SELECTION *const sel = &pcr_select.pcrSelections[i];
-
-            // Loop through all PCRs in this bank
-            const unsigned bank_size = sel->sizeofSelect * 8;
-            for (unsigned pcr_id = 0; pcr_id < bank_size; pcr_id++) {
-                // skip non-selected banks
-                if (!tpm2_util_is_pcr_select_bit_set(sel, pcr_id)) {
-                    continue;
-                }
-                if (vi >= pcrs->count || di >= pcrs->pcr_values[vi].count) {
-                    LOG_ERR("Something wrong, trying to print but nothing more");
-                    eventlog_fail = true;
-                    break;
-                }
-
-                // Compare this digest to the computed value from the eventlog
-                const TPM2B_DIGEST *pcr = &pcrs->pcr_values[vi].digests[di];
-                const uint8_t *pcr_q = pcr->buffer;
-                const uint8_t *pcr_e = NULL;
-
-                if (sel->hash == TPM2_ALG_SHA1 && pcr->size == TPM2_SHA1_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha1_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA256 && pcr->size == TPM2_SHA256_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha256_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA384 && pcr->size == TPM2_SHA384_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha384_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA512 && pcr->size == TPM2_SHA512_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha512_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SM3_256 && pcr->size == TPM2_SM3_256_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sm3_256_pcrs[pcr_id];
-                } else {
-                    LOG_WARN("PCR%u unsupported algorithm/size %u/%u", pcr_id, sel->hash, pcr->size);
-                    eventlog_fail = 1;
-                }
-
-                if (pcr_e && memcmp(pcr_e, pcr_q, pcr->size) != 0) {
-                    LOG_WARN("PCR%u mismatch", pcr_id);
-                    eventlog_fail = 1;
-                }
-
-                if (++di < pcrs->pcr_values[vi].count) {
-                    continue;
-                }
-
-                di = 0;
-                if (++vi < pcrs->count) {
-                    continue;
-                }
-            }
-        }
-
-        if (eventlog_fail) {
-            LOG_ERR("Eventlog and quote PCR mismatch");
             goto err;
         }
     }
@@ -553,83 +691,1152 @@ err:
     return return_value;
 }
 
-static bool on_option(char key, char *value) {
+/*
+ * Manifest mode: every line of the manifest names the files of one quote,
+ * the quotes are verified on a pool of threads and one result line per
+ * record is output in manifest order.
+ */
+enum manifest_field {
+    manifest_field_pubkey,
+    manifest_field_msg,
+    manifest_field_sig,
+    manifest_field_pcr,
+    manifest_field_eventlog,
+    manifest_field_qualification,
+    manifest_field_count,
+};
 
-    switch (key) {
-    case 'u':
-        ctx.pubkey_file_path = value;
-        break;
-    case 'g': {
-        ctx.halg = tpm2_alg_util_from_optarg(value, tpm2_alg_util_flags_hash);
-        if (ctx.halg == TPM2_ALG_ERROR) {
-            LOG_ERR("Unable to convert algorithm, got: \"%s\"", value);
-            return false;
+#define MANIFEST_FIELDS_REQUIRED (manifest_field_sig + 1)
+#define MANIFEST_QUEUE 256
+
+typedef struct manifest_record manifest_record;
+struct manifest_record {
+    size_t line;
+    char *buf;
+    /* NULL for fields that are absent or given as "-" */
+    const char *fields[manifest_field_count];
+    const char *reason;
+    bool done;
+};
+
+/*
+ * Public keys parsed so far. In manifest mode they are keyed by the SHA256
+ * of the key file so records naming the same key through different paths
+ * share it, the service keys them by the SHA256 of their TPM name and keeps
+ * a context ready for verification with them.
+ */
+typedef struct pubkey_cache_entry pubkey_cache_entry;
+struct pubkey_cache_entry {
+    UINT8 fingerprint[TPM2_SHA256_DIGEST_SIZE];
+    EVP_PKEY *pkey;
+    EVP_PKEY_CTX *verify_ctx;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    size_t count;
+    size_t capacity;
+    pubkey_cache_entry *entries;
+} pubkey_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct {
+    pthread_t *threads;
+    unsigned count;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stop;
+    size_t failed;
+    /* same ring layout as the event log verifier */
+    size_t head;
+    size_t next;
+    size_t tail;
+    manifest_record records[MANIFEST_QUEUE];
+} manifest = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* called with the cache lock held */
+static pubkey_cache_entry *pubkey_cache_slot(const UINT8 *fingerprint) {
+
+    size_t mask = pubkey_cache.capacity - 1;
+    size_t i;
+    memcpy(&i, fingerprint, sizeof(i));
+
+    for (i &= mask; pubkey_cache.entries[i].pkey; i = (i + 1) & mask) {
+        if (!memcmp(pubkey_cache.entries[i].fingerprint, fingerprint,
+                TPM2_SHA256_DIGEST_SIZE)) {
+            break;
         }
-        ctx.flags.hlg = 1;
-    }
-        break;
-    case 'm': {
-        ctx.msg_file_path = value;
-        ctx.flags.msg = 1;
-    }
-        break;
-    case 'F':
-        LOG_WARN("DEPRECATED: Format ignored");
-        break;
-    case 'q':
-        ctx.extra_data.size = sizeof(ctx.extra_data.buffer);
-        return tpm2_util_bin_from_hex_or_file(value, &ctx.extra_data.size,
-                ctx.extra_data.buffer);
-        break;
-    case 's':
-        ctx.sig_file_path = value;
-        ctx.flags.sig = 1;
-        break;
-    case 'f':
-        ctx.pcr_file_path = value;
-        ctx.flags.pcr = 1;
-        break;
-    case 'e':
-        ctx.eventlog_path = value;
-        ctx.flags.eventlog = 1;
-        break;
-    case 'l':
-        ctx.pcr_selection_string = value;
-        break;
-        /* no default */
     }
 
-    return true;
+    return &pubkey_cache.entries[i];
 }
 
-static bool tpm2_tool_onstart(tpm2_options **opts) {
+/* called with the cache lock held, keeps the load factor under 1/2 */
+static bool pubkey_cache_reserve(void) {
 
-    const struct option topts[] = {
-            { "hash-algorithm",     required_argument, NULL, 'g' },
-            { "message",            required_argument, NULL, 'm' },
-            { "format",             required_argument, NULL, 'F' },
-            { "signature",          required_argument, NULL, 's' },
-            { "eventlog",           required_argument, NULL, 'e' },
-            { "pcr",                required_argument, NULL, 'f' },
-            { "pcr-list",           required_argument, NULL, 'l' },
-            { "public",             required_argument, NULL, 'u' },
-            { "qualification",      required_argument, NULL, 'q' },
-    };
+    if ((pubkey_cache.count + 1) * 2 <= pubkey_cache.capacity) {
+        return true;
+    }
 
+    size_t old_capacity = pubkey_cache.capacity;
+    pubkey_cache_entry *old = pubkey_cache.entries;
 
-    *opts = tpm2_options_new("g:m:F:s:u:f:q:e:l:", ARRAY_LEN(topts), topts,
-            on_option, NULL, TPM2_OPTIONS_NO_SAPI);
+    size_t capacity = old_capacity ? old_capacity * 2 : 64;
+    pubkey_cache_entry *entries = calloc(capacity, sizeof(*entries));
+    if (!entries) {
+        LOG_ERR("oom");
+        return false;
+    }
 
-    return *opts != NULL;
+    pubkey_cache.entries = entries;
+    pubkey_cache.capacity = capacity;
+
+    size_t i;
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].pkey) {
+            *pubkey_cache_slot(old[i].fingerprint) = old[i];
+        }
+    }
+    free(old);
+
+    return true;
 }
 
-static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+static EVP_PKEY *pubkey_cache_get(const char *path) {
 
-    UNUSED(ectx);
-    UNUSED(flags);
+    files_mapping key = { 0 };
+    if (!files_map_path(path, &key)) {
+        return NULL;
+    }
 
-    /* initialize and process */
-    tool_rc rc = init();
+    UINT8 fingerprint[TPM2_SHA256_DIGEST_SIZE];
+    int rc = EVP_Digest(key.data, key.size, fingerprint, NULL, EVP_sha256(),
+            NULL);
+    if (files_mapping_is_truncated(&key)) {
+        LOG_ERR("The public key \"%s\" was truncated while being read", path);
+        rc = 0;
+    }
+    files_unmap_path(&key);
+    if (!rc) {
+        LOG_ERR("Could not fingerprint public key \"%s\"", path);
+        return NULL;
+    }
+
+    EVP_PKEY *pkey = NULL;
+
+    /*
+     * Misses are parsed with the lock held, so every key is only parsed
+     * once even if several threads ask for it at the same time.
+     */
+    pthread_mutex_lock(&pubkey_cache.lock);
+
+    if (!pubkey_cache_reserve()) {
+        goto out;
+    }
+
+    pubkey_cache_entry *entry = pubkey_cache_slot(fingerprint);
+    if (!entry->pkey) {
+        if (!tpm2_public_load_pkey(path, &entry->pkey)) {
+            entry->pkey = NULL;
+            goto out;
+        }
+        memcpy(entry->fingerprint, fingerprint, sizeof(fingerprint));
+        pubkey_cache.count++;
+    }
+
+    pkey = entry->pkey;
+
+out:
+    pthread_mutex_unlock(&pubkey_cache.lock);
+
+    return pkey;
+}
+
+static void pubkey_cache_free(void) {
+
+    size_t i;
+    for (i = 0; i < pubkey_cache.capacity; i++) {
+        EVP_PKEY_CTX_free(pubkey_cache.entries[i].verify_ctx);
+        EVP_PKEY_free(pubkey_cache.entries[i].pkey);
+    }
+    free(pubkey_cache.entries);
+
+    pubkey_cache.entries = NULL;
+    pubkey_cache.capacity = pubkey_cache.count = 0;
+}
+
+/*
+ * Verifies one record, the checks are the ones of a single quote.
+ * Returns NULL on success or the reason the quote was rejected.
+ */
+static const char *manifest_record_check(const manifest_record *record) {
+
+    const char *reason = NULL;
+
+    EVP_PKEY *pkey = pubkey_cache_get(record->fields[manifest_field_pubkey]);
+    if (!pkey) {
+        return "cannot load public key";
+    }
+
+    TPM2B_ATTEST *msg = message_from_file(record->fields[manifest_field_msg]);
+    if (!msg) {
+        return "cannot load message";
+    }
+
+    TPMS_ATTEST attest;
+    tool_rc rc = files_tpm2b_attest_to_tpms_attest(msg, &attest);
+    if (rc != tool_rc_success) {
+        reason = "malformed message";
+        goto out;
+    }
+
+    /* a TSS signature carries its hash algorithm, a plain one needs -g */
+    TPM2B_MAX_BUFFER signature;
+    TPMI_ALG_HASH halg = TPM2_ALG_ERROR;
+    bool result = tpm2_convert_sig_load_plain(
+            record->fields[manifest_field_sig], &signature, &halg);
+    if (!result) {
+        reason = "cannot load signature";
+        goto out;
+    }
+
+    if (halg == TPM2_ALG_NULL) {
+        halg = ctx.halg;
+    }
+
+    TPM2B_DIGEST msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    result = tpm2_openssl_hash_compute_data(halg, msg->attestationData,
+            msg->size, &msg_hash);
+    if (!result) {
+        reason = "cannot hash message";
+        goto out;
+    }
+
+    result = verify_signature(pkey, halg, &signature, &msg_hash);
+    if (!result) {
+        reason = "signature mismatch";
+        goto out;
+    }
+
+    TPM2B_DATA extra_data = { 0 };
+    const char *qualification = record->fields[manifest_field_qualification];
+    if (qualification) {
+        extra_data.size = sizeof(extra_data.buffer);
+        result = tpm2_util_bin_from_hex_or_file(qualification,
+                &extra_data.size, extra_data.buffer);
+        if (!result) {
+            reason = "cannot load qualification";
+            goto out;
+        }
+    }
+
+    const char *pcr_path = record->fields[manifest_field_pcr];
+    const char *eventlog_path = record->fields[manifest_field_eventlog];
+    if (!pcr_path) {
+        reason = eventlog_path ? "eventlog without pcrs" :
+                check_attest(&attest, &extra_data, halg, NULL);
+        goto out;
+    }
+
+    TPML_PCR_SELECTION pcr_select;
+    tpm2_pcrs pcrs;
+    TPM2B_DIGEST pcr_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    result = pcrs_digest_from_file(pcr_path, ctx.pcr_selection_string, halg,
+            &pcr_select, &pcrs, &pcr_hash);
+    if (!result) {
+        reason = "cannot load pcrs";
+        goto out;
+    }
+
+    reason = check_attest(&attest, &extra_data, halg, &pcr_hash);
+    if (reason) {
+        goto out;
+    }
+
+    if (eventlog_path) {
+        result = eventlog_matches_pcrs(eventlog_path, &pcr_select, &pcrs);
+        if (!result) {
+            reason = "eventlog mismatch";
+        }
+    }
+
+out:
+    free(msg);
+
+    return reason;
+}
+
+static void *manifest_thread(void *arg) {
+
+    UNUSED(arg);
+
+    pthread_mutex_lock(&manifest.lock);
+    for (;;) {
+        while (!manifest.stop && manifest.next == manifest.tail) {
+            pthread_cond_wait(&manifest.cond, &manifest.lock);
+        }
+        if (manifest.next == manifest.tail) {
+            break;
+        }
+
+        manifest_record *record =
+                &manifest.records[manifest.next++ % MANIFEST_QUEUE];
+        pthread_mutex_unlock(&manifest.lock);
+
+        const char *reason = record->reason ?
+                record->reason : manifest_record_check(record);
+
+        pthread_mutex_lock(&manifest.lock);
+        record->reason = reason;
+        record->done = true;
+        pthread_cond_broadcast(&manifest.cond);
+    }
+    pthread_mutex_unlock(&manifest.lock);
+
+    return NULL;
+}
+
+/* called with the lock held */
+static void manifest_report(void) {
+
+    manifest_record *record = &manifest.records[manifest.head % MANIFEST_QUEUE];
+    while (!record->done) {
+        pthread_cond_wait(&manifest.cond, &manifest.lock);
+    }
+
+    tpm2_tool_output("- {line: %zu, message: ", record->line);
+    tpm2_util_print_yaml_string(record->fields[manifest_field_msg]);
+    if (record->reason) {
+        tpm2_tool_output(", result: fail, reason: ");
+        tpm2_util_print_yaml_string(record->reason);
+        tpm2_tool_output("}\n");
+        manifest.failed++;
+    } else {
+        tpm2_tool_output(", result: pass}\n");
+    }
+
+    free(record->buf);
+    manifest.head++;
+}
+
+static bool manifest_submit(size_t line, char *buf) {
+
+    manifest_record record = {
+        .line = line,
+        .buf = buf,
+    };
+
+    /* fields are separated by white space, "-" skips an optional field */
+    size_t count = 0;
+    char *saveptr = NULL;
+    char *field;
+    for (field = strtok_r(buf, " \t\r\n", &saveptr); field;
+            field = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        if (field[0] == '#') {
+            break;
+        }
+        if (count == manifest_field_count) {
+            record.reason = "too many fields";
+            break;
+        }
+        record.fields[count++] = strcmp(field, "-") ? field : NULL;
+    }
+
+    /* empty lines and comments */
+    if (!count) {
+        free(buf);
+        return false;
+    }
+
+    size_t i;
+    for (i = 0; !record.reason && i < MANIFEST_FIELDS_REQUIRED; i++) {
+        if (!record.fields[i]) {
+            record.reason = "missing public key, message or signature";
+        }
+    }
+
+    pthread_mutex_lock(&manifest.lock);
+
+    while (manifest.tail - manifest.head == MANIFEST_QUEUE) {
+        manifest_report();
+    }
+
+    manifest.records[manifest.tail++ % MANIFEST_QUEUE] = record;
+
+    pthread_cond_broadcast(&manifest.cond);
+    pthread_mutex_unlock(&manifest.lock);
+
+    return true;
+}
+
+static void manifest_stop(void) {
+
+    pthread_mutex_lock(&manifest.lock);
+    manifest.stop = true;
+    pthread_cond_broadcast(&manifest.cond);
+    pthread_mutex_unlock(&manifest.lock);
+
+    unsigned i;
+    for (i = 0; i < manifest.count; i++) {
+        pthread_join(manifest.threads[i], NULL);
+    }
+    manifest.count = 0;
+
+    free(manifest.threads);
+    manifest.threads = NULL;
+}
+
+static bool manifest_start(void) {
+
+    unsigned jobs = ctx.jobs;
+    if (!jobs) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? cpus : 1;
+    }
+
+    manifest.threads = calloc(jobs, sizeof(*manifest.threads));
+    if (!manifest.threads) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    for (manifest.count = 0; manifest.count < jobs; manifest.count++) {
+        int rc = pthread_create(&manifest.threads[manifest.count], NULL,
+                manifest_thread, NULL);
+        if (rc) {
+            LOG_ERR("Could not start verifier thread: %s", strerror(rc));
+            manifest_stop();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static tool_rc verify_manifest(void) {
+
+    if (ctx.pubkey_file_path || ctx.flags.msg || ctx.flags.sig
+            || ctx.flags.pcr || ctx.flags.eventlog || ctx.extra_data.size) {
+        LOG_ERR("--manifest can't be combined with -u, -m, -s, -f, -e or -q");
+        return tool_rc_option_error;
+    }
+
+    bool is_stdin = !strcmp(ctx.manifest_path, "-");
+    FILE *f = is_stdin ? stdin : fopen(ctx.manifest_path, "r");
+    if (!f) {
+        LOG_ERR("Could not open manifest \"%s\", error: %s",
+                ctx.manifest_path, strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = tool_rc_general_error;
+    if (!manifest_start()) {
+        goto out;
+    }
+
+    size_t line = 0;
+    size_t records = 0;
+    char *buf = NULL;
+    size_t len = 0;
+    while (getline(&buf, &len, f) != -1) {
+        line++;
+        /* the record owns the line buffer from here on */
+        records += manifest_submit(line, buf);
+        buf = NULL;
+        len = 0;
+    }
+    free(buf);
+
+    bool read_error = ferror(f);
+    if (read_error) {
+        LOG_ERR("Could not read manifest \"%s\"", ctx.manifest_path);
+    }
+
+    pthread_mutex_lock(&manifest.lock);
+    while (manifest.head != manifest.tail) {
+        manifest_report();
+    }
+    pthread_mutex_unlock(&manifest.lock);
+
+    manifest_stop();
+
+    LOG_INFO("Verified %zu quotes, %zu failed", records, manifest.failed);
+
+    if (!read_error && !manifest.failed) {
+        rc = tool_rc_success;
+    }
+
+out:
+    pubkey_cache_free();
+    if (!is_stdin) {
+        fclose(f);
+    }
+
+    return rc;
+}
+
+/*
+ * Service mode: "tpm2_checkquote --serve=SOCKET KEY..." parses the
+ * attestation keys once and verifies the quotes received over a Unix socket,
+ * so requests don't pay for process start up, OpenSSL initialization and
+ * key parsing. Keys are looked up by their TPM name. Requests are handled one
+ * at a time, one per connection, so a connection going quiet for longer than
+ * CHECKQUOTE_IO_TIMEOUT seconds is dropped rather than stalling the others.
+ * Only clients running as the uid of the service are served.
+ *
+ * All integers are 32 bit big endian and every blob is length prefixed, see
+ * files_write_blob(). A request is:
+ *   version, name, message, signature, pcrs, qualification
+ * where pcrs and qualification may be empty. The response is:
+ *   result (0 pass, 1 fail), reason
+ * where the reason is empty when the quote passed.
+ */
+#define CHECKQUOTE_PROTOCOL_VERSION 1
+#define CHECKQUOTE_MAX_BLOB (64 * 1024)
+#define CHECKQUOTE_IO_TIMEOUT 5
+
+enum serve_blob {
+    serve_blob_name,
+    serve_blob_msg,
+    serve_blob_sig,
+    serve_blob_pcr,
+    serve_blob_qualification,
+    serve_blob_count,
+};
+
+static struct {
+    int listen_fd;
+    volatile sig_atomic_t stop;
+} serve = {
+    .listen_fd = -1,
+};
+
+static void serve_on_signal(int sig) {
+
+    UNUSED(sig);
+
+    serve.stop = 1;
+}
+
+static bool serve_set_timeout(int fd) {
+
+    struct timeval tv = { .tv_sec = CHECKQUOTE_IO_TIMEOUT };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv))
+            || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv))) {
+        LOG_ERR("Could not set the connection timeout, error: %s",
+                strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static bool name_fingerprint(const TPM2B_NAME *name, UINT8 *fingerprint) {
+
+    int rc = EVP_Digest(name->name, name->size, fingerprint, NULL,
+            EVP_sha256(), NULL);
+    if (!rc) {
+        LOG_ERR("Could not fingerprint key name");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Loads a [NAME=]FILE key argument, the name is computed for keys in a TSS
+ * format and must be given for PEM and DER keys.
+ */
+static bool serve_load_key(char *arg) {
+
+    TPM2B_NAME name = TPM2B_TYPE_INIT(TPM2B_NAME, name);
+    bool has_name = false;
+
+    char *path = arg;
+    char *sep = strchr(arg, '=');
+    if (sep) {
+        *sep = '\0';
+        path = sep + 1;
+        has_name = tpm2_util_bin_from_hex_or_file(arg, &name.size, name.name);
+        if (!has_name) {
+            return false;
+        }
+    }
+
+    TPM2B_PUBLIC public = { 0 };
+    bool is_tss = files_load_template_silent(path, &public.publicArea)
+            || files_load_public_silent(path, &public);
+    if (is_tss) {
+        TPM2B_NAME tss_name = TPM2B_TYPE_INIT(TPM2B_NAME, name);
+        if (!tpm2_identity_create_name(&public, &tss_name)) {
+            return false;
+        }
+        if (has_name && (name.size != tss_name.size
+                || memcmp(name.name, tss_name.name, name.size))) {
+            LOG_ERR("The name given for key \"%s\" doesn't match its public"
+                    " area", path);
+            return false;
+        }
+        name = tss_name;
+    } else if (!has_name) {
+        LOG_ERR("Key \"%s\" isn't in a TSS format, give its name as"
+                " NAME=%s", path, path);
+        return false;
+    }
+
+    UINT8 fingerprint[TPM2_SHA256_DIGEST_SIZE];
+    if (!name_fingerprint(&name, fingerprint)) {
+        return false;
+    }
+
+    bool result = false;
+
+    pthread_mutex_lock(&pubkey_cache.lock);
+
+    if (!pubkey_cache_reserve()) {
+        goto out;
+    }
+
+    pubkey_cache_entry *entry = pubkey_cache_slot(fingerprint);
+    if (entry->pkey) {
+        LOG_WARN("Key \"%s\" has the name of a key loaded before, skipping it",
+                path);
+        result = true;
+        goto out;
+    }
+
+    EVP_PKEY *pkey = NULL;
+    if (!tpm2_public_load_pkey(path, &pkey)) {
+        goto out;
+    }
+
+    entry->verify_ctx = verify_ctx_new(pkey);
+    if (!entry->verify_ctx) {
+        EVP_PKEY_free(pkey);
+        goto out;
+    }
+
+    memcpy(entry->fingerprint, fingerprint, sizeof(fingerprint));
+    entry->pkey = pkey;
+    pubkey_cache.count++;
+
+    result = true;
+
+out:
+    pthread_mutex_unlock(&pubkey_cache.lock);
+
+    return result;
+}
+
+static pubkey_cache_entry *serve_find_key(const UINT8 *name, UINT32 len) {
+
+    TPM2B_NAME key_name = { .size = len };
+    if (len > sizeof(key_name.name)) {
+        return NULL;
+    }
+    memcpy(key_name.name, name, len);
+
+    UINT8 fingerprint[TPM2_SHA256_DIGEST_SIZE];
+    if (!name_fingerprint(&key_name, fingerprint)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pubkey_cache.lock);
+    pubkey_cache_entry *entry = pubkey_cache_slot(fingerprint);
+    pthread_mutex_unlock(&pubkey_cache.lock);
+
+    return entry->pkey ? entry : NULL;
+}
+
+/*
+ * Verifies one request, the checks are the ones of a single quote.
+ * Returns NULL on success or the reason the quote was rejected.
+ */
+static const char *serve_check(UINT8 *blobs[], UINT32 lens[]) {
+
+    pubkey_cache_entry *key = serve_find_key(blobs[serve_blob_name],
+            lens[serve_blob_name]);
+    if (!key) {
+        return "unknown key";
+    }
+
+    TPM2B_ATTEST msg = { .size = lens[serve_blob_msg] };
+    if (!msg.size || lens[serve_blob_msg] > sizeof(msg.attestationData)) {
+        return "malformed message";
+    }
+    memcpy(msg.attestationData, blobs[serve_blob_msg], msg.size);
+
+    TPMS_ATTEST attest;
+    tool_rc rc = files_tpm2b_attest_to_tpms_attest(&msg, &attest);
+    if (rc != tool_rc_success) {
+        return "malformed message";
+    }
+
+    TPM2B_MAX_BUFFER signature;
+    TPMI_ALG_HASH halg = TPM2_ALG_ERROR;
+    bool result = tpm2_convert_sig_plain_from_buffer(blobs[serve_blob_sig],
+            lens[serve_blob_sig], &signature, &halg);
+    if (!result) {
+        return "malformed signature";
+    }
+
+    if (halg == TPM2_ALG_NULL) {
+        halg = ctx.halg;
+    }
+
+    TPM2B_DIGEST msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    result = tpm2_openssl_hash_compute_data(halg, msg.attestationData,
+            msg.size, &msg_hash);
+    if (!result) {
+        return "cannot hash message";
+    }
+
+    result = verify_signature_ctx(key->verify_ctx, halg, &signature,
+            &msg_hash);
+    if (!result) {
+        return "signature mismatch";
+    }
+
+    TPM2B_DATA extra_data = { .size = lens[serve_blob_qualification] };
+    if (lens[serve_blob_qualification] > sizeof(extra_data.buffer)) {
+        return "malformed qualification";
+    }
+    memcpy(extra_data.buffer, blobs[serve_blob_qualification],
+            extra_data.size);
+
+    if (!lens[serve_blob_pcr]) {
+        return check_attest(&attest, &extra_data, halg, NULL);
+    }
+
+    FILE *pcr_input = fmemopen(blobs[serve_blob_pcr], lens[serve_blob_pcr],
+            "rb");
+    if (!pcr_input) {
+        LOG_ERR("Could not open PCRs, error: %s", strerror(errno));
+        return "cannot load pcrs";
+    }
+
+    TPML_PCR_SELECTION pcr_select;
+    tpm2_pcrs pcrs;
+    TPM2B_DIGEST pcr_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    result = pcrs_from_stream(pcr_input, ctx.pcr_selection_string,
+            &pcr_select, &pcrs)
+            && pcrs_digest(halg, &pcr_select, &pcrs, &pcr_hash);
+    fclose(pcr_input);
+    if (!result) {
+        return "malformed pcrs";
+    }
+
+    return check_attest(&attest, &extra_data, halg, &pcr_hash);
+}
+
+static void serve_one(int fd) {
+
+    UINT8 *blobs[serve_blob_count] = { 0 };
+    UINT32 lens[serve_blob_count] = { 0 };
+    unsigned i;
+
+    FILE *in = fdopen(fd, "r");
+    int out_fd = dup(fd);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+        LOG_ERR("Could not open connection streams, error: %s",
+                strerror(errno));
+        if (in) {
+            fclose(in);
+        } else {
+            close(fd);
+        }
+        if (out_fd >= 0 && !out) {
+            close(out_fd);
+        }
+        return;
+    }
+
+    UINT32 version = 0;
+    bool result = files_read_32(in, &version);
+    for (i = 0; result && i < serve_blob_count; i++) {
+        result = files_read_blob(in, CHECKQUOTE_MAX_BLOB, &blobs[i], &lens[i]);
+    }
+
+    if (!result) {
+        LOG_ERR("Malformed request");
+        goto out;
+    }
+
+    const char *reason = version == CHECKQUOTE_PROTOCOL_VERSION ?
+            serve_check(blobs, lens) : "unsupported protocol version";
+    LOG_INFO("Quote %s%s", reason ? "failed: " : "passed",
+            reason ? reason : "");
+
+    result = files_write_32(out, reason ? 1 : 0)
+            && files_write_blob(out, reason, reason ? strlen(reason) : 0);
+    if (!result || fflush(out)) {
+        LOG_ERR("Could not send response");
+    }
+
+out:
+    for (i = 0; i < serve_blob_count; i++) {
+        free(blobs[i]);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+static tool_rc serve_run(void) {
+
+    if (ctx.manifest_path || ctx.connect_path || ctx.pubkey_file_path
+            || ctx.flags.msg || ctx.flags.sig || ctx.flags.pcr
+            || ctx.flags.eventlog || ctx.extra_data.size) {
+        LOG_ERR("--serve can't be combined with --manifest, --connect, -u, -m,"
+                " -s, -f, -e or -q");
+        return tool_rc_option_error;
+    }
+
+    if (!ctx.key_count) {
+        LOG_ERR("--serve expects the keys to serve as arguments");
+        return tool_rc_option_error;
+    }
+
+    struct sockaddr_un addr;
+    if (!files_unix_addr(ctx.serve_path, &addr)) {
+        return tool_rc_general_error;
+    }
+
+    tool_rc ret = tool_rc_general_error;
+
+    int i;
+    for (i = 0; i < ctx.key_count; i++) {
+        if (!serve_load_key(ctx.keys[i])) {
+            LOG_ERR("Could not load key \"%s\"", ctx.keys[i]);
+            goto out;
+        }
+    }
+
+    LOG_INFO("Serving %zu keys", pubkey_cache.count);
+
+    /* only ever replace a stale socket, never some other file */
+    struct stat sb;
+    if (!stat(ctx.serve_path, &sb) && S_ISSOCK(sb.st_mode)) {
+        unlink(ctx.serve_path);
+    }
+
+    serve.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (serve.listen_fd < 0) {
+        LOG_ERR("Could not create socket, error: %s", strerror(errno));
+        goto out;
+    }
+
+    if (bind(serve.listen_fd, (struct sockaddr *) &addr, sizeof(addr))
+            || listen(serve.listen_fd, SOMAXCONN)) {
+        LOG_ERR("Could not listen on \"%s\", error: %s", ctx.serve_path,
+                strerror(errno));
+        close(serve.listen_fd);
+        goto out;
+    }
+
+    /* no SA_RESTART, so a signal breaks out of accept() */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serve_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = tool_rc_success;
+    while (!serve.stop) {
+        int fd = accept(serve.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            LOG_ERR("Could not accept connection, error: %s", strerror(errno));
+            ret = tool_rc_general_error;
+            break;
+        }
+
+        if (!files_unix_peer_is_self(fd) || !serve_set_timeout(fd)) {
+            close(fd);
+            continue;
+        }
+
+        serve_one(fd);
+    }
+
+    close(serve.listen_fd);
+    unlink(ctx.serve_path);
+
+out:
+    pubkey_cache_free();
+
+    return ret;
+}
+
+/*
+ * Client of the service, sends the quote given with -m, -s, -f and -q for
+ * the key named with --key-name.
+ */
+static tool_rc connect_run(void) {
+
+    if (ctx.manifest_path || ctx.pubkey_file_path || ctx.flags.eventlog) {
+        LOG_ERR("--connect can't be combined with --manifest, -u or -e");
+        return tool_rc_option_error;
+    }
+
+    if (!ctx.key_name.size || !ctx.flags.msg || !ctx.flags.sig) {
+        LOG_ERR("--key-name, --message (-m) and --signature (-s) are required");
+        return tool_rc_option_error;
+    }
+
+    struct sockaddr_un addr;
+    if (!files_unix_addr(ctx.connect_path, &addr)) {
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = tool_rc_general_error;
+    files_mapping files[3] = { 0 };
+    const char *paths[3] = { ctx.msg_file_path, ctx.sig_file_path,
+            ctx.flags.pcr ? ctx.pcr_file_path : NULL };
+    FILE *in = NULL;
+    FILE *out = NULL;
+    UINT8 *reason = NULL;
+    unsigned i;
+
+    for (i = 0; i < ARRAY_LEN(paths); i++) {
+        if (paths[i] && !files_map_path(paths[i], &files[i])) {
+            goto out;
+        }
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOG_ERR("Could not create socket, error: %s", strerror(errno));
+        goto out;
+    }
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        LOG_ERR("Could not connect to \"%s\", error: %s", ctx.connect_path,
+                strerror(errno));
+        close(fd);
+        goto out;
+    }
+
+    in = fdopen(fd, "r");
+    int out_fd = dup(fd);
+    out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+        LOG_ERR("Could not open connection streams, error: %s",
+                strerror(errno));
+        if (!in) {
+            close(fd);
+        }
+        if (out_fd >= 0 && !out) {
+            close(out_fd);
+        }
+        goto out;
+    }
+
+    bool result = files_write_32(out, CHECKQUOTE_PROTOCOL_VERSION)
+            && files_write_blob(out, ctx.key_name.name, ctx.key_name.size);
+    for (i = 0; result && i < ARRAY_LEN(files); i++) {
+        result = files_write_blob(out, files[i].data, files[i].size);
+        if (files_mapping_is_truncated(&files[i])) {
+            LOG_ERR("The file \"%s\" was truncated while being read",
+                    paths[i]);
+            goto out;
+        }
+    }
+    result = result
+            && files_write_blob(out, ctx.extra_data.buffer, ctx.extra_data.size);
+    if (!result || fflush(out)) {
+        LOG_ERR("Could not send request to \"%s\"", ctx.connect_path);
+        goto out;
+    }
+
+    UINT32 failed;
+    UINT32 len;
+    result = files_read_32(in, &failed)
+            && files_read_blob(in, CHECKQUOTE_MAX_BLOB, &reason, &len);
+    if (!result) {
+        LOG_ERR("Could not receive response from \"%s\"", ctx.connect_path);
+        goto out;
+    }
+
+    if (failed) {
+        tpm2_tool_output("result: fail\nreason: ");
+        tpm2_util_print_yaml_string((const char *) reason);
+        tpm2_tool_output("\n");
+        LOG_ERR("Verify signature failed!");
+    } else {
+        tpm2_tool_output("result: pass\n");
+        rc = tool_rc_success;
+    }
+
+out:
+    free(reason);
+    if (in) {
+        fclose(in);
+    }
+    if (out) {
+        fclose(out);
+    }
+    for (i = 0; i < ARRAY_LEN(files); i++) {
+        if (paths[i]) {
+            files_unmap_path(&files[i]);
+        }
+    }
+
+    return rc;
+}
+
+static bool on_option(char key, char *value) {
+
+    switch (key) {
+    case 'u':
+        ctx.pubkey_file_path = value;
+        break;
+    case 'g': {
+        ctx.halg = tpm2_alg_util_from_optarg(value, tpm2_alg_util_flags_hash);
+        if (ctx.halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Unable to convert algorithm, got: \"%s\"", value);
+            return false;
+        }
+        ctx.flags.hlg = 1;
+    }
+        break;
+    case 'm': {
+        ctx.msg_file_path = value;
+        ctx.flags.msg = 1;
+    }
+        break;
+    case 'F':
+        LOG_WARN("DEPRECATED: Format ignored");
+        break;
+    case 'q':
+        ctx.extra_data.size = sizeof(ctx.extra_data.buffer);
+        return tpm2_util_bin_from_hex_or_file(value, &ctx.extra_data.size,
+                ctx.extra_data.buffer);
+        break;
+    case 's':
+        ctx.sig_file_path = value;
+        ctx.flags.sig = 1;
+        break;
+    case 'f':
+        ctx.pcr_file_path = value;
+        ctx.flags.pcr = 1;
+        break;
+    case 'e':
+        ctx.eventlog_path = value;
+        ctx.flags.eventlog = 1;
+        break;
+    case 'l':
+        ctx.pcr_selection_string = value;
+        break;
+    case 0:
+        if (!tpm2_util_string_to_uint32(value, &ctx.jobs)) {
+            LOG_ERR("Cannot parse the number of jobs: %s", value);
+            return false;
+        }
+        break;
+    case 1:
+        ctx.manifest_path = value;
+        break;
+    case 2:
+        ctx.serve_path = value;
+        break;
+    case 3:
+        ctx.connect_path = value;
+        break;
+    case 4:
+        ctx.key_name.size = sizeof(ctx.key_name.name);
+        return tpm2_util_bin_from_hex_or_file(value, &ctx.key_name.size,
+                ctx.key_name.name);
+    case 5:
+        ctx.golden_path = value;
+        break;
+        /* no default */
+    }
+
+    return true;
+}
+
+static bool on_args(int argc, char **argv) {
+
+    ctx.key_count = argc;
+    ctx.keys = argv;
+
+    return true;
+}
+
+static bool tpm2_tool_onstart(tpm2_options **opts) {
+
+    const struct option topts[] = {
+            { "hash-algorithm",     required_argument, NULL, 'g' },
+            { "message",            required_argument, NULL, 'm' },
+            { "format",             required_argument, NULL, 'F' },
+            { "signature",          required_argument, NULL, 's' },
+            { "eventlog",           required_argument, NULL, 'e' },
+            { "pcr",                required_argument, NULL, 'f' },
+            { "pcr-list",           required_argument, NULL, 'l' },
+            { "public",             required_argument, NULL, 'u' },
+            { "qualification",      required_argument, NULL, 'q' },
+            { "jobs",               required_argument, NULL,  0  },
+            { "manifest",           required_argument, NULL,  1  },
+            { "serve",              required_argument, NULL,  2  },
+            { "connect",            required_argument, NULL,  3  },
+            { "key-name",           required_argument, NULL,  4  },
+            { "golden",             required_argument, NULL,  5  },
+    };
+
+
+    *opts = tpm2_options_new("g:m:F:s:u:f:q:e:l:", ARRAY_LEN(topts), topts,
+            on_option, on_args, TPM2_OPTIONS_NO_SAPI);
+
+    return *opts != NULL;
+}
+
+static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    UNUSED(ectx);
+    UNUSED(flags);
+
+    if (ctx.key_count && !ctx.serve_path) {
+        LOG_ERR("Only --serve takes arguments");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.connect_path && ctx.golden_path) {
+        LOG_ERR("--golden is applied by the service, not by --connect");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.golden_path) {
+        ctx.golden = tpm2_golden_load(ctx.golden_path);
+        if (!ctx.golden) {
+            return tool_rc_general_error;
+        }
+        LOG_INFO("Loaded %zu golden PCR combinations",
+                tpm2_golden_count(ctx.golden));
+    }
+
+    if (ctx.serve_path) {
+        return serve_run();
+    }
+
+    if (ctx.connect_path) {
+        return connect_run();
+    }
+
+    if (ctx.manifest_path) {
+        return verify_manifest();
+    }
+
+    /* initialize and process */
+    tool_rc rc = init();
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -643,5 +1850,14 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     return tool_rc_success;
 }
 
+static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
+
+    UNUSED(ectx);
+
+    tpm2_golden_free(ctx.golden);
+
+    return tool_rc_success;
+}
+
 // Register this tool with tpm2_tool.c
-TPM2_TOOL_REGISTER("checkquote", tpm2_tool_onstart, tpm2_tool_onrun, NULL, NULL)
+TPM2_TOOL_REGISTER("checkquote", tpm2_tool_onstart, tpm2_tool_onrun, tpm2_tool_onstop, NULL)
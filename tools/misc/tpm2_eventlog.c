@@ -1,5 +1,4 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
-#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -13,6 +12,9 @@
 #include "tpm2_tool.h"
 
 static char *filename = NULL;
+static char *resume_state = NULL;
+static bool jobs_set = false;
+static uint32_t jobs = 0;
 
 /* Set the default YAML version */
 static uint32_t eventlog_version = 1;
@@ -46,6 +48,16 @@ static bool on_option(char key, char *value) {
         }
         eventlog_version = version;
         break;
+    case 1:
+        resume_state = value;
+        break;
+    case 2:
+        if (!tpm2_util_string_to_uint32(value, &jobs)) {
+            LOG_ERR("Cannot parse the number of jobs: %s", value);
+            return false;
+        }
+        jobs_set = true;
+        break;
     }
     return true;
 }
@@ -54,6 +66,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
 
     static struct option topts[] = {
          { "eventlog-version",         required_argument, NULL, 0 },
+         { "resume-state",             required_argument, NULL, 1 },
+         { "jobs",                     required_argument, NULL, 2 },
     };
 
     *opts = tpm2_options_new("y:", ARRAY_LEN(topts), topts, on_option,
@@ -72,46 +86,45 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return tool_rc_option_error;
     }
 
-    /* Get file size */
-    unsigned long size = 0;
-    bool ret = files_get_file_size_path(filename, &size);
-    if (!ret || !size) {
-        return tool_rc_general_error;
-    }
-
-    /* Allocate buffer to read file data */
-    UINT8 *eventlog = calloc(1, size);
-    if (eventlog == NULL){
-        LOG_ERR("failed to allocate %lu bytes: %s", size, strerror(errno));
+    /* Map the file, or read it if it can't be mapped */
+    files_mapping eventlog = { 0 };
+    bool ret = files_map_path(filename, &eventlog);
+    if (!ret) {
         return tool_rc_general_error;
     }
 
-    /* Load buffer with file data */
     tool_rc rc = tool_rc_success;
-    FILE *fileptr = fopen(filename, "rb");
-    if (!fileptr) {
+    tpm2_eventlog_verifier *verifier = NULL;
+    if (!eventlog.size) {
+        LOG_ERR("The eventlog file \"%s\" is empty", filename);
         rc = tool_rc_general_error;
         goto out;
     }
 
-    ret = files_read_bytes(fileptr, eventlog, size);
-    fclose(fileptr);
-    if (!ret) {
-        rc = tool_rc_general_error;
-        goto out;
+    /* Verify the event payloads on worker threads */
+    if (jobs_set) {
+        verifier = eventlog_verifier_new(jobs);
+        if (!verifier) {
+            rc = tool_rc_general_error;
+            goto out;
+        }
     }
 
     /* Parse eventlog data */
-    ret = yaml_eventlog(eventlog, size, eventlog_version);
+    ret = yaml_eventlog_resume(eventlog.data, eventlog.size, eventlog_version,
+            resume_state, verifier);
     if (!ret) {
         LOG_ERR("failed to parse tpm2 eventlog");
         rc = tool_rc_general_error;
+    } else if (files_mapping_is_truncated(&eventlog)) {
+        LOG_ERR("The eventlog file \"%s\" was truncated while being read",
+                filename);
+        rc = tool_rc_general_error;
     }
 
 out:
-    if (eventlog) {
-        free(eventlog);
-    }
+    eventlog_verifier_free(verifier);
+    files_unmap_path(&eventlog);
 
     return rc;
 }
@@ -6,6 +6,7 @@
 #include "tpm2_auth_util.h"
 #include "tpm2_options.h"
 #include "tpm2_tool.h"
+#include "tpm2_tr_cache.h"
 
 typedef struct changeeps_ctx changeeps_ctx;
 #define MAX_SESSIONS 3
@@ -221,6 +222,9 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
+    /* the new seed evicts the endorsement persistent objects */
+    tpm2_tr_cache_clear();
+
     /*
      * 4. Process outputs
      */
@@ -4,6 +4,7 @@
 #include "log.h"
 #include "tpm2.h"
 #include "tpm2_tool.h"
+#include "tpm2_tr_cache.h"
 
 typedef struct clear_ctx clear_ctx;
 struct clear_ctx {
@@ -91,7 +92,13 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
-    return tpm2_clear(ectx, &ctx.auth_hierarchy.object, NULL);
+    rc = tpm2_clear(ectx, &ctx.auth_hierarchy.object, NULL);
+    if (rc == tool_rc_success) {
+        /* clear evicts the owner and endorsement persistent objects */
+        tpm2_tr_cache_clear();
+    }
+
+    return rc;
 }
 
 static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
@@ -71,7 +71,8 @@ static tool_rc parse_policy_type_specific_command(ESYS_CONTEXT *ectx) {
 
     tpm2_session **s = &pctx.common_policy_options.policy_session;
 
-    tool_rc rc = tpm2_session_open(ectx, session_data, s);
+    tool_rc rc = ectx ? tpm2_session_open(ectx, session_data, s) :
+            tpm2_session_open_offline(session_data, s);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -144,7 +145,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     };
 
     *opts = tpm2_options_new("L:g:l:f:", ARRAY_LEN(topts), topts, on_option,
-    NULL, 0);
+    NULL, TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "files.h"
 #include "log.h"
@@ -15,7 +16,11 @@
 #include "tpm2_auth_util.h"
 #include "tpm2_options.h"
 
-#define MAX_INPUT_DATA_SIZE UINT16_MAX
+/*
+ * The input is processed in chunks of the largest buffer a TPM command takes,
+ * only three of them are held in memory whatever the size of the input.
+ */
+#define CHUNK_SIZE TPM2_MAX_DIGEST_BUFFER
 
 typedef struct tpm_encrypt_decrypt_ctx tpm_encrypt_decrypt_ctx;
 struct tpm_encrypt_decrypt_ctx {
@@ -27,9 +32,6 @@ struct tpm_encrypt_decrypt_ctx {
 
     TPMI_YES_NO is_decrypt;
 
-    uint8_t input_data[MAX_INPUT_DATA_SIZE];
-    uint16_t input_data_size;
-
     const char *input_path;
     char *out_file_path;
 
@@ -44,11 +46,12 @@ struct tpm_encrypt_decrypt_ctx {
 
     TPM2B_IV iv_start;
     char *cp_hash_path;
+
+    bool is_sync;
 };
 
 static tpm_encrypt_decrypt_ctx ctx = {
     .mode = TPM2_ALG_NULL,
-    .input_data_size = MAX_INPUT_DATA_SIZE,
     .padded_block_len = TPM2_MAX_SYM_BLOCK_SIZE,
     .is_padding_option_enabled = false,
     .iv_start = { .size = sizeof(ctx.iv_start.buffer), .buffer = { 0 } },
@@ -60,181 +63,313 @@ static tool_rc readpub(ESYS_CONTEXT *ectx, TPM2B_PUBLIC **public) {
             public, NULL, NULL);
 }
 
-static bool evaluate_pkcs7_padding_requirements(uint16_t remaining_bytes,
-bool expected) {
+static bool is_pkcs7_padding_applicable(void) {
 
     if (!ctx.is_padding_option_enabled) {
         return false;
     }
 
-    if (ctx.is_decrypt != expected) {
-        return false;
-    }
-
     /*
      * If no ctx.mode was specified, the default cfb was set.
      */
-    if (ctx.mode != TPM2_ALG_CBC && ctx.mode != TPM2_ALG_ECB) {
-        return false;
+    return ctx.mode == TPM2_ALG_CBC || ctx.mode == TPM2_ALG_ECB;
+}
+
+/*
+ * Pads the last chunk of the input. When the chunk is full, the padding goes
+ * to the extra chunk given.
+ */
+static void append_pkcs7_padding_data_to_input(TPM2B_MAX_BUFFER *last,
+        TPM2B_MAX_BUFFER *extra) {
+
+    LOG_WARN("Processing pkcs7 padding.");
+
+    uint8_t pad_data = ctx.padded_block_len
+            - (last->size % ctx.padded_block_len);
+
+    TPM2B_MAX_BUFFER *dest = last->size + pad_data <= CHUNK_SIZE ?
+            last : extra;
+
+    memset(&dest->buffer[dest->size], pad_data, pad_data);
+    dest->size += pad_data;
+}
+
+static bool strip_pkcs7_padding_data_from_output(TPM2B_MAX_BUFFER *out_data) {
+
+    LOG_WARN("Processing pkcs7 padding.");
+
+    if (out_data->size % ctx.padded_block_len) {
+        LOG_WARN("Encrypted input is not block length aligned.");
     }
 
-    /*
-     * Is last block?
-     */
-    if (!(remaining_bytes <= TPM2_MAX_DIGEST_BUFFER && remaining_bytes > 0)) {
+    uint8_t pad_data = out_data->size ?
+            out_data->buffer[out_data->size - 1] : 0;
+    if (!pad_data || pad_data > ctx.padded_block_len
+            || pad_data > out_data->size) {
+        LOG_ERR("Invalid pkcs7 padding");
         return false;
     }
 
-    LOG_WARN("Processing pkcs7 padding.");
+    out_data->size -= pad_data;
 
     return true;
 }
 
-static void append_pkcs7_padding_data_to_input(uint8_t *pad_data,
-        uint16_t *in_data_size, uint16_t *remaining_bytes) {
+/*
+ * Fills a chunk from the input, it is only short at the end of the input.
+ */
+static bool read_chunk(FILE *input, TPM2B_MAX_BUFFER *chunk) {
 
-    bool test_pad_reqs = evaluate_pkcs7_padding_requirements(*remaining_bytes,
-    false);
-    if (!test_pad_reqs) {
-        return;
+    chunk->size = fread(chunk->buffer, 1, CHUNK_SIZE, input);
+    if (chunk->size < CHUNK_SIZE && ferror(input)) {
+        LOG_ERR("Failed to read in the input, error: %s", strerror(errno));
+        return false;
     }
 
-    *pad_data = ctx.padded_block_len - (*in_data_size % ctx.padded_block_len);
+    return true;
+}
 
-    memset(&ctx.input_data[ctx.input_data_size], *pad_data, *pad_data);
+static tool_rc encrypt_decrypt_cp_hash(ESYS_CONTEXT *ectx, FILE *input,
+        TPM2B_IV *iv_in) {
 
-    if (*pad_data == ctx.padded_block_len) {
-        *remaining_bytes += *pad_data;
+    TPM2B_MAX_BUFFER in_data;
+    TPM2B_MAX_BUFFER extra = { .size = 0 };
+    if (!read_chunk(input, &in_data) || !read_chunk(input, &extra)) {
+        return tool_rc_general_error;
     }
 
-    if (*pad_data < ctx.padded_block_len) {
-        *remaining_bytes = *in_data_size += *pad_data;
+    if (!extra.size && !ctx.is_decrypt && is_pkcs7_padding_applicable()) {
+        append_pkcs7_padding_data_to_input(&in_data, &extra);
+    }
+
+    if (extra.size) {
+        LOG_ERR("Cannot calculate cpHash for buffer larger than max digest buffer.");
+        return tool_rc_general_error;
     }
+
+    LOG_WARN("Calculating cpHash. Exiting without performing encryptdecrypt.");
+    TPM2B_MAX_BUFFER *out_data = NULL;
+    TPM2B_IV *iv_out = NULL;
+    TPM2B_DIGEST cp_hash = { .size = 0 };
+    tool_rc rc = tpm2_encryptdecrypt(ectx, &ctx.encryption_key.object,
+            ctx.is_decrypt, ctx.mode, iv_in, &in_data, &out_data, &iv_out,
+            &cp_hash);
+    if (rc != tool_rc_success) {
+        LOG_ERR("CpHash calculation failed!");
+        return rc;
+    }
+
+    bool result = files_save_digest(&cp_hash, ctx.cp_hash_path);
+    if (!result) {
+        rc = tool_rc_general_error;
+    }
+
+    return rc;
 }
 
-static void strip_pkcs7_padding_data_from_output(uint8_t *pad_data,
-        TPM2B_MAX_BUFFER *out_data, uint16_t *remaining_bytes) {
+/*
+ * Submits a chunk to the TPM without waiting for the result. Once the TPM is
+ * known not to implement EncryptDecrypt2, chunks are processed synchronously
+ * by finish_chunk() instead.
+ */
+static tool_rc submit_chunk(ESYS_CONTEXT *ectx, TPM2B_IV *iv_in,
+        TPM2B_MAX_BUFFER *in_data) {
 
-    bool test_pad_reqs = evaluate_pkcs7_padding_requirements(*remaining_bytes,
-    true);
-    if (!test_pad_reqs) {
-        return;
+    if (ctx.is_sync) {
+        return tool_rc_success;
     }
 
-    uint8_t last_block_length = ctx.padded_block_len
-            - (out_data->size % ctx.padded_block_len);
+    return tpm2_encryptdecrypt_async(ectx, &ctx.encryption_key.object,
+            ctx.is_decrypt, ctx.mode, iv_in, in_data);
+}
 
-    if (last_block_length != ctx.padded_block_len) {
-        LOG_WARN("Encrypted input is not block length aligned.");
+/*
+ * Collects the result of a submitted chunk. The IV output by the TPM becomes
+ * the IV of the next chunk.
+ */
+static tool_rc finish_chunk(ESYS_CONTEXT *ectx, TPM2B_IV *iv_in,
+        TPM2B_MAX_BUFFER *in_data, TPM2B_MAX_BUFFER **out_data) {
+
+    TPM2B_IV *iv_out = NULL;
+    tool_rc rc = ctx.is_sync ? tool_rc_unsupported :
+            tpm2_encryptdecrypt_finish(ectx, out_data, &iv_out);
+    if (rc == tool_rc_unsupported) {
+        ctx.is_sync = true;
+        rc = tpm2_encryptdecrypt(ectx, &ctx.encryption_key.object,
+                ctx.is_decrypt, ctx.mode, iv_in, in_data, out_data, &iv_out,
+                NULL);
+    }
+    if (rc != tool_rc_success) {
+        return rc;
     }
 
-    *pad_data = out_data->buffer[last_block_length - 1];
+    /*
+     * Copy iv_out iv_in to use it in next loop iteration.
+     * This copy is also output from the tool for further chaining.
+     */
+    if (ctx.mode != TPM2_ALG_ECB) {
+        assert(iv_in);
+        assert(iv_out);
+        *iv_in = *iv_out;
+    }
+    free(iv_out);
 
-    out_data->size -= *pad_data;
+    return tool_rc_success;
 }
 
-static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
+static bool write_chunk(FILE *output, TPM2B_MAX_BUFFER *out_data) {
 
-    tool_rc rc = tool_rc_general_error;
+    if (out_data
+            && !files_write_bytes(output, out_data->buffer, out_data->size)) {
+        LOG_ERR("Failed to save output data to file");
+        return false;
+    }
+
+    return true;
+}
+
+static double elapsed(const struct timespec *start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec)
+            + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
 
     /*
      * try EncryptDecrypt2 first, and if the command is not supported by the TPM
      * fall back to EncryptDecrypt.
      */
 
-    UINT16 data_offset = 0;
-    bool result = true;
+    TPM2B_IV *iv_in = ctx.mode == TPM2_ALG_ECB ? NULL : &ctx.iv_start;
+
+    FILE *input = ctx.input_path ? fopen(ctx.input_path, "rb") : stdin;
+    if (!input) {
+        LOG_ERR("Could not open file \"%s\", error: %s", ctx.input_path,
+                strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    if (ctx.cp_hash_path) {
+        tool_rc rc = encrypt_decrypt_cp_hash(ectx, input, iv_in);
+        if (input != stdin) {
+            fclose(input);
+        }
+        return rc;
+    }
+
+    tool_rc rc = tool_rc_general_error;
+    TPM2B_MAX_BUFFER *out_data = NULL;
     FILE *out_file_ptr =
             ctx.out_file_path ? fopen(ctx.out_file_path, "wb+") : stdout;
     if (!out_file_ptr) {
         LOG_ERR("Could not open file \"%s\", error: %s", ctx.out_file_path,
                 strerror(errno));
-        return tool_rc_general_error;
+        goto out;
     }
 
-    TPM2B_MAX_BUFFER *out_data = NULL;
-    TPM2B_MAX_BUFFER in_data;
-    TPM2B_IV *iv_out = NULL;
-    TPM2B_IV *iv_in = &ctx.iv_start;
-    uint8_t pad_data = 0;
+    bool padding = is_pkcs7_padding_applicable();
+    bool pad_input = padding && !ctx.is_decrypt;
+    bool strip_output = padding && ctx.is_decrypt;
 
-    uint16_t remaining_bytes = ctx.input_data_size;
-    if (ctx.mode == TPM2_ALG_ECB) {
-        iv_in = NULL;
-    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long long total = 0;
 
-    if (ctx.cp_hash_path) {
-        in_data.size = remaining_bytes;
-        append_pkcs7_padding_data_to_input(&pad_data, &in_data.size,
-                    &remaining_bytes);
-        memcpy(in_data.buffer, ctx.input_data, in_data.size);
-        LOG_WARN("Calculating cpHash. Exiting without performing encryptdecrypt.");
-        TPM2B_DIGEST cp_hash = { .size = 0 };
-        tool_rc rc = tpm2_encryptdecrypt(ectx, &ctx.encryption_key.object,
-        ctx.is_decrypt, ctx.mode, iv_in, &in_data, &out_data, &iv_out,
-        &cp_hash);
-        if (rc != tool_rc_success) {
-            LOG_ERR("CpHash calculation failed!");
-            fclose(out_file_ptr);
-            return rc;
-        }
+    /*
+     * While the TPM works on a chunk, the output of the previous chunk is
+     * written out and the chunk after the next one is read in. The next
+     * chunk is always read ahead, so the last chunk is known when it is
+     * submitted and only it is padded or has its padding stripped.
+     */
+    TPM2B_MAX_BUFFER chunks[3];
+    TPM2B_MAX_BUFFER *chunk = &chunks[0];
+    TPM2B_MAX_BUFFER *next = &chunks[1];
+    TPM2B_MAX_BUFFER *spare = &chunks[2];
+    if (!read_chunk(input, chunk)) {
+        goto out;
+    }
 
-        bool result = files_save_digest(&cp_hash, ctx.cp_hash_path);
-        if (!result) {
-            rc = tool_rc_general_error;
+    bool eof = chunk->size < CHUNK_SIZE;
+    next->size = 0;
+    if (!eof) {
+        if (!read_chunk(input, next)) {
+            goto out;
         }
-        return rc;
+        eof = next->size < CHUNK_SIZE;
     }
 
-    while (remaining_bytes > 0) {
-        in_data.size =
-                remaining_bytes > TPM2_MAX_DIGEST_BUFFER ?
-                        TPM2_MAX_DIGEST_BUFFER : remaining_bytes;
-
-        if (!pad_data) {
-            append_pkcs7_padding_data_to_input(&pad_data, &in_data.size,
-                    &remaining_bytes);
+    for (;;) {
+        if (!next->size && pad_input) {
+            append_pkcs7_padding_data_to_input(chunk, next);
+            pad_input = false;
         }
 
-        memcpy(in_data.buffer, &ctx.input_data[data_offset], in_data.size);
+        if (!chunk->size) {
+            break;
+        }
 
-        rc = tpm2_encryptdecrypt(ectx, &ctx.encryption_key.object,
-                ctx.is_decrypt, ctx.mode, iv_in, &in_data, &out_data, &iv_out,
-                NULL);
-        if (rc != tool_rc_success) {
+        tool_rc tmp_rc = submit_chunk(ectx, iv_in, chunk);
+        if (tmp_rc != tool_rc_success) {
+            rc = tmp_rc;
             goto out;
         }
 
         /*
-         * Copy iv_out iv_in to use it in next loop iteration.
-         * This copy is also output from the tool for further chaining.
+         * The command is outstanding, it is collected before bailing out on
+         * an I/O error so the ESYS context stays usable.
          */
-        if (ctx.mode != TPM2_ALG_ECB) {
-            assert(iv_in);
-            assert(iv_out);
-            *iv_in = *iv_out;
-            free(iv_out);
+        bool io_ok = write_chunk(out_file_ptr, out_data);
+        free(out_data);
+        out_data = NULL;
+
+        spare->size = 0;
+        if (io_ok && !eof) {
+            io_ok = read_chunk(input, spare);
+            eof = spare->size < CHUNK_SIZE;
         }
 
-        strip_pkcs7_padding_data_from_output(&pad_data, out_data,
-                &remaining_bytes);
+        tmp_rc = finish_chunk(ectx, iv_in, chunk, &out_data);
+        if (tmp_rc != tool_rc_success) {
+            rc = tmp_rc;
+            goto out;
+        }
 
-        result = files_write_bytes(out_file_ptr, out_data->buffer,
-                out_data->size);
-        free(out_data);
-        if (!result) {
-            LOG_ERR("Failed to save output data to file");
+        if (!io_ok) {
             goto out;
         }
 
-        remaining_bytes -= in_data.size;
-        data_offset += in_data.size;
+        total += chunk->size;
+
+        if (!next->size) {
+            if (strip_output
+                    && !strip_pkcs7_padding_data_from_output(out_data)) {
+                goto out;
+            }
+            break;
+        }
+
+        TPM2B_MAX_BUFFER *tmp = chunk;
+        chunk = next;
+        next = spare;
+        spare = tmp;
+    }
+
+    if (!write_chunk(out_file_ptr, out_data)) {
+        goto out;
     }
 
+    double secs = elapsed(&start);
+    LOG_INFO("Processed %llu bytes in %.3f seconds, %.2f MiB/s", total, secs,
+            secs > 0 ? total / (1024.0 * 1024.0) / secs : 0.0);
+
     /*
      * iv_in here is the copy of final iv_out from the loop above.
      */
-    result =
+    bool result =
             (ctx.iv.out && iv_in) ?
                     files_save_bytes_to_file(ctx.iv.out, iv_in->buffer,
                             iv_in->size) :
@@ -246,10 +381,16 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
     rc = tool_rc_success;
 
 out:
-    if (out_file_ptr != stdout) {
+    free(out_data);
+
+    if (out_file_ptr && out_file_ptr != stdout) {
         fclose(out_file_ptr);
     }
 
+    if (input != stdin) {
+        fclose(input);
+    }
+
     return rc;
 }
 
@@ -370,13 +511,7 @@ static bool is_input_options_args_valid(void) {
         return false;
     }
 
-    bool result = files_load_bytes_from_buffer_or_file_or_stdin(NULL,
-            ctx.input_path, &ctx.input_data_size, ctx.input_data);
-    if (!result) {
-        LOG_ERR("Failed to read in the input.");
-        return result;
-    }
-
+    bool result;
     if (!ctx.iv.in) {
         LOG_WARN("Using a weak IV, try specifying an IV");
     }
@@ -402,11 +537,6 @@ static bool is_input_options_args_valid(void) {
         }
     }
 
-    if (ctx.cp_hash_path && ctx.input_data_size > TPM2_MAX_DIGEST_BUFFER) {
-        LOG_ERR("Cannot calculate cpHash for buffer larger than max digest buffer.");
-        return false;
-    }
-
     return true;
 }
 
@@ -7,6 +7,7 @@
 #include "tpm2.h"
 #include "tpm2_capability.h"
 #include "tpm2_tool.h"
+#include "tpm2_tr_cache.h"
 
 typedef struct tpm_evictcontrol_ctx tpm_evictcontrol_ctx;
 struct tpm_evictcontrol_ctx {
@@ -189,6 +190,19 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
      * See bug: https://github.com/tpm2-software/tpm2-tools/issues/1816
      */
     evicted = out_tr == ESYS_TR_NONE;
+
+    /*
+     * The handle now refers to another object, or none. An object evicted
+     * through a context file may not be at the handle given, so forget all
+     * handles then.
+     */
+    if (evicted && ctx.to_persist_key.object.handle >> TPM2_HR_SHIFT
+            != TPM2_HT_PERSISTENT) {
+        tpm2_tr_cache_clear();
+    } else {
+        tpm2_tr_cache_invalidate(ctx.persist_handle);
+    }
+
     tpm2_tool_output("persistent-handle: 0x%x\n", ctx.persist_handle);
     tpm2_tool_output("action: %s\n", evicted ? "evicted" : "persisted");
 
@@ -7,6 +7,7 @@
 #include "files.h"
 #include "log.h"
 #include "tpm2.h"
+#include "tpm2_policy.h"
 #include "tpm2_tool.h"
 
 typedef struct tpm_getpolicydigest_ctx tpm_getpolicydigest_ctx;
@@ -41,8 +42,10 @@ static tool_rc get_policydigest(ESYS_CONTEXT *ectx) {
     /*
      * 1. TPM2_CC_<command> OR Retrieve cpHash
      */
-    tool_rc rc = tpm2_policy_getdigest(ectx, ctx.session_handle,
-        ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, &ctx.policy_digest);
+    tool_rc rc = ctx.session ?
+        tpm2_policy_get_digest(ectx, ctx.session, &ctx.policy_digest) :
+        tpm2_policy_getdigest(ectx, ctx.session_handle, ESYS_TR_NONE,
+            ESYS_TR_NONE, ESYS_TR_NONE, &ctx.policy_digest);
     if (rc != tool_rc_success) {
         LOG_ERR("Failed getrandom");
     }
@@ -190,7 +193,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "session",      required_argument, NULL, 'S' },
     };
 
-    *opts = tpm2_options_new("S:o:", ARRAY_LEN(topts), topts, on_option, 0, 0);
+    *opts = tpm2_options_new("S:o:", ARRAY_LEN(topts), topts, on_option, 0,
+        TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
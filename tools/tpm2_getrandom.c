@@ -1,21 +1,30 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
 
 #include "files.h"
 #include "log.h"
 #include "tpm2.h"
-#include "tpm2_capability.h"
+#include "tpm2_capability_cache.h"
+#include "tpm2_drbg.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_util.h"
 
 typedef struct tpm_random_ctx tpm_random_ctx;
+#define DRBG_RESEED_DEFAULT (1024 * 1024)
 #define MAX_AUX_SESSIONS 3
 #define MAX_SESSIONS 3
 struct tpm_random_ctx {
@@ -26,6 +35,18 @@ struct tpm_random_ctx {
     bool force;
     bool hex;
 
+    /*
+     * Streaming, a count of 0 streams until the reader goes away
+     */
+    bool stream;
+    uint64_t stream_bytes;
+
+    /*
+     * Host DRBG seeded from the TPM and reseeded every drbg_reseed bytes
+     */
+    bool drbg;
+    uint64_t drbg_reseed;
+
     /*
      * Outputs
      */
@@ -56,6 +77,7 @@ static tpm_random_ctx ctx = {
     .aux_session_handle[1] = ESYS_TR_NONE,
     .aux_session_handle[2] = ESYS_TR_NONE,
     .parameter_hash_algorithm = TPM2_ALG_ERROR,
+    .drbg_reseed = DRBG_RESEED_DEFAULT,
 };
 
 static tool_rc get_random(ESYS_CONTEXT *ectx) {
@@ -159,27 +181,247 @@ out_skip_output_file:
 
 static tool_rc get_max_random(ESYS_CONTEXT *ectx, UINT32 *value) {
 
-    TPMS_CAPABILITY_DATA *cap_data = NULL;
-    tool_rc rc = tpm2_capability_get(ectx, TPM2_CAP_TPM_PROPERTIES,
-            TPM2_PT_FIXED, TPM2_MAX_TPM_PROPERTIES, &cap_data);
+    bool found = false;
+    tool_rc rc = tpm2_capability_cache_get_property(ectx, TPM2_PT_MAX_DIGEST,
+            value, &found);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    UINT32 i;
-    for (i = 0; i < cap_data->data.tpmProperties.count; i++) {
-        TPMS_TAGGED_PROPERTY *p = &cap_data->data.tpmProperties.tpmProperty[i];
-        if (p->property == TPM2_PT_MAX_DIGEST) {
-            *value = p->value;
-            free(cap_data);
-            return tool_rc_success;
+    if (!found) {
+        LOG_ERR("TPM does not have property TPM2_PT_MAX_DIGEST");
+        return tool_rc_general_error;
+    }
+
+    return tool_rc_success;
+}
+
+static bool write_all(int fd, const BYTE *data, size_t size) {
+
+    while (size) {
+        ssize_t done = write(fd, data, size);
+        if (done < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += done;
+        size -= done;
+    }
+
+    return true;
+}
+
+static double elapsed(const struct timespec *start) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec)
+            + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Fills a buffer from the TPM, in requests of at most max bytes.
+ */
+static tool_rc tpm_random(ESYS_CONTEXT *ectx, UINT32 max, BYTE *buffer,
+        size_t size) {
+
+    size_t done = 0;
+    while (done < size) {
+        UINT16 count = size - done < max ? size - done : max;
+
+        TPM2B_DIGEST *random_bytes = NULL;
+        tool_rc rc = tpm2_getrandom(ectx, count, &random_bytes, &ctx.cp_hash,
+            &ctx.rp_hash, ctx.aux_session_handle[0],
+            ctx.aux_session_handle[1], ctx.aux_session_handle[2],
+            ctx.parameter_hash_algorithm);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Failed getrandom");
+            return rc;
+        }
+
+        if (!random_bytes->size) {
+            LOG_ERR("TPM returned no random bytes");
+            free(random_bytes);
+            return tool_rc_general_error;
         }
+
+        count = random_bytes->size < size - done ?
+                random_bytes->size : size - done;
+        memcpy(&buffer[done], random_bytes->buffer, count);
+        OPENSSL_cleanse(random_bytes, sizeof(*random_bytes));
+        free(random_bytes);
+        done += count;
+    }
+
+    return tool_rc_success;
+}
+
+/*
+ * Instantiates the DRBG, or reseeds it, with entropy from the TPM.
+ */
+static tool_rc seed_drbg(ESYS_CONTEXT *ectx, UINT32 max, tpm2_drbg **drbg) {
+
+    uint8_t seed[TPM2_DRBG_SEED_LEN];
+    tool_rc rc = tpm_random(ectx, max, seed, sizeof(seed));
+    if (rc != tool_rc_success) {
+        goto out;
+    }
+
+    if (!*drbg) {
+        *drbg = tpm2_drbg_new(seed);
+    } else if (!tpm2_drbg_reseed(*drbg, seed)) {
+        tpm2_drbg_free(*drbg);
+        *drbg = NULL;
+    }
+
+    if (!*drbg) {
+        LOG_ERR("Could not seed the DRBG");
+        rc = tool_rc_general_error;
+    }
+
+out:
+    OPENSSL_cleanse(seed, sizeof(seed));
+
+    return rc;
+}
+
+/*
+ * An unbounded stream only ends when the reader closes the output, which
+ * only a pipe, FIFO or socket can do. Anything else, including a disabled
+ * output, would draw from the TPM forever or fill up the disk.
+ */
+static bool stream_output_can_close(void) {
+
+    if (!ctx.output_file && !output_enabled) {
+        LOG_ERR("--bytes 0 needs an output that can be closed, not -Q");
+        return false;
     }
 
-    LOG_ERR("TPM does not have property TPM2_PT_MAX_DIGEST");
-    free(cap_data);
+    struct stat sb;
+    int r = ctx.output_file ? stat(ctx.output_file, &sb) :
+            fstat(STDOUT_FILENO, &sb);
+    if (r || !(S_ISFIFO(sb.st_mode) || S_ISSOCK(sb.st_mode))) {
+        LOG_ERR("--bytes 0 streams until the output is closed, the output "
+                "must be a pipe, FIFO or socket");
+        return false;
+    }
 
-    return tool_rc_general_error;
+    return true;
+}
+
+/*
+ * Loops over requests of the largest size the TPM serves, or of a DRBG
+ * seeded from the TPM, and writes each result straight to the output
+ * descriptor, so any amount of random bytes can be drawn with a bounded
+ * amount of memory.
+ */
+static tool_rc stream_random(ESYS_CONTEXT *ectx) {
+
+    if (!ctx.stream_bytes && !stream_output_can_close()) {
+        return tool_rc_option_error;
+    }
+
+    UINT32 max = 0;
+    tool_rc rc = get_max_random(ectx, &max);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    if (!max || max > sizeof(((TPM2B_DIGEST *)0)->buffer)) {
+        max = sizeof(((TPM2B_DIGEST *)0)->buffer);
+    }
+
+    size_t chunk = ctx.drbg ? TPM2_DRBG_MAX_REQUEST : max;
+    BYTE *buffer = malloc(chunk);
+    if (!buffer) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_drbg *drbg = NULL;
+    uint64_t since_seed = 0;
+
+    int fd = STDOUT_FILENO;
+    if (ctx.output_file) {
+        fd = open(ctx.output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            LOG_ERR("Could not open output file \"%s\", error: %s",
+                    ctx.output_file, strerror(errno));
+            rc = tool_rc_general_error;
+            goto out;
+        }
+    } else if (!output_enabled) {
+        fd = -1;
+    }
+
+    /* a closed pipe ends an unbounded stream, report it as EPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint64_t total = 0;
+    while (!ctx.stream_bytes || total < ctx.stream_bytes) {
+        size_t count = chunk;
+        if (ctx.stream_bytes && ctx.stream_bytes - total < count) {
+            count = ctx.stream_bytes - total;
+        }
+
+        if (ctx.drbg) {
+            if (!drbg || since_seed >= ctx.drbg_reseed) {
+                rc = seed_drbg(ectx, max, &drbg);
+                if (rc != tool_rc_success) {
+                    goto out;
+                }
+                since_seed = 0;
+            }
+
+            if (ctx.drbg_reseed - since_seed < count) {
+                count = ctx.drbg_reseed - since_seed;
+            }
+
+            if (!tpm2_drbg_generate(drbg, buffer, count)) {
+                rc = tool_rc_general_error;
+                goto out;
+            }
+            since_seed += count;
+        } else {
+            rc = tpm_random(ectx, max, buffer, count);
+            if (rc != tool_rc_success) {
+                goto out;
+            }
+        }
+
+        if (fd >= 0 && !write_all(fd, buffer, count)) {
+            if (errno == EPIPE && !ctx.stream_bytes) {
+                break;
+            }
+            LOG_ERR("Could not write random bytes, error: %s",
+                    strerror(errno));
+            rc = tool_rc_general_error;
+            goto out;
+        }
+
+        total += count;
+    }
+
+    double secs = elapsed(&start);
+    LOG_INFO("Streamed %"PRIu64" bytes in %.3f seconds, %.1f bytes/s", total,
+            secs, secs > 0 ? total / secs : 0.0);
+
+out:
+    if (fd >= 0 && fd != STDOUT_FILENO) {
+        close(fd);
+    }
+
+    tpm2_drbg_free(drbg);
+    OPENSSL_cleanse(buffer, chunk);
+    free(buffer);
+
+    return rc;
 }
 
 static tool_rc process_inputs(ESYS_CONTEXT *ectx) {
@@ -217,9 +459,10 @@ static tool_rc process_inputs(ESYS_CONTEXT *ectx) {
      * Per 16.1 of:
      *  - https://trustedcomputinggroup.org/wp-content/uploads/TPM-Rev-2.0-Part-3-Commands-01.38.pdf
      *
-     *  Allow the force flag to override this behavior.
+     *  Allow the force flag to override this behavior. Streaming always
+     *  requests the max hash size.
      */
-    if (!ctx.force) {
+    if (!ctx.force && !ctx.stream) {
         UINT32 max = 0;
         rc = get_max_random(ectx, &max);
         if (rc != tool_rc_success) {
@@ -288,6 +531,25 @@ static bool on_option(char key, char *value) {
     case 2:
         ctx.rp_hash_path = value;
         break;
+    case 3:
+        ctx.stream = tpm2_util_string_to_uint64(value, &ctx.stream_bytes);
+        if (!ctx.stream) {
+            LOG_ERR("Error converting size to a number, got: \"%s\".",
+                    value);
+            return false;
+        }
+        break;
+    case 4:
+        ctx.drbg = true;
+        break;
+    case 5:
+        if (!tpm2_util_string_to_uint64(value, &ctx.drbg_reseed)
+                || !ctx.drbg_reseed) {
+            LOG_ERR("Expected a non zero reseed interval, got: \"%s\".",
+                    value);
+            return false;
+        }
+        break;
     case 'S':
         ctx.aux_session_path[ctx.aux_session_cnt] = value;
         if (ctx.aux_session_cnt < MAX_AUX_SESSIONS) {
@@ -310,6 +572,11 @@ static bool on_args(int argc, char **argv) {
         return false;
     }
 
+    if (ctx.stream) {
+        LOG_ERR("Specify either SIZE or --bytes, not both");
+        return false;
+    }
+
     bool result = tpm2_util_string_to_uint16(argv[0], &ctx.num_of_bytes);
     if (!result) {
         LOG_ERR("Error converting size to a number, got: \"%s\".", argv[0]);
@@ -327,7 +594,10 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "hex",          no_argument,       NULL,  0  },
         { "session",      required_argument, NULL, 'S' },
         { "cphash",       required_argument, NULL,  1  },
-        { "rphash",       required_argument, NULL,  2  }
+        { "rphash",       required_argument, NULL,  2  },
+        { "bytes",        required_argument, NULL,  3  },
+        { "drbg",         no_argument,       NULL,  4  },
+        { "drbg-reseed",  required_argument, NULL,  5  },
     };
 
     *opts = tpm2_options_new("S:o:f", ARRAY_LEN(topts), topts, on_option, on_args,
@@ -347,11 +617,25 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     /*
      * 2. Process inputs
      */
+    if (ctx.stream && (ctx.hex || ctx.cp_hash_path || ctx.rp_hash_path)) {
+        LOG_ERR("--bytes cannot be combined with --hex, --cphash or --rphash");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.drbg && !ctx.stream) {
+        LOG_ERR("--drbg requires --bytes");
+        return tool_rc_option_error;
+    }
+
     tool_rc rc = process_inputs(ectx);
     if (rc != tool_rc_success) {
         return rc;
     }
 
+    if (ctx.stream) {
+        return stream_random(ectx);
+    }
+
     /*
      * 3. TPM2_CC_<command> call
      */
@@ -11,6 +11,7 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_hash.h"
 #include "tpm2_hierarchy.h"
+#include "tpm2_openssl.h"
 #include "tpm2_tool.h"
 
 typedef struct tpm_hash_ctx tpm_hash_ctx;
@@ -21,6 +22,7 @@ struct tpm_hash_ctx {
     char *output_hash_path;
     char *output_ticket_path;
     bool hex;
+    bool host_digest;
 };
 
 static tpm_hash_ctx ctx = {
@@ -28,15 +30,43 @@ static tpm_hash_ctx ctx = {
     .halg = TPM2_ALG_SHA1,
 };
 
+static tool_rc hash_on_host(TPM2B_DIGEST **out_hash) {
+
+    LOG_WARN("Hashing on the host, no hashcheck ticket is produced");
+
+    TPML_DIGEST_VALUES digests = {
+        .count = 1,
+        .digests[0].hashAlg = ctx.halg,
+    };
+
+    bool res = tpm2_openssl_hash_file(ctx.input_file, &digests);
+    if (!res) {
+        return tool_rc_general_error;
+    }
+
+    *out_hash = calloc(1, sizeof(**out_hash));
+    if (!*out_hash) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    (*out_hash)->size = tpm2_alg_util_get_hash_size(ctx.halg);
+    memcpy((*out_hash)->buffer, &digests.digests[0].digest,
+            (*out_hash)->size);
+
+    return tool_rc_success;
+}
+
 static tool_rc hash_and_save(ESYS_CONTEXT *context) {
 
     TPM2B_DIGEST *out_hash;
-    TPMT_TK_HASHCHECK *validation;
+    TPMT_TK_HASHCHECK *validation = NULL;
 
     FILE *out = stdout;
 
-    tool_rc rc = tpm2_hash_file(context, ctx.halg, ctx.hierarchy_value,
-            ctx.input_file, &out_hash, &validation);
+    tool_rc rc = ctx.host_digest ? hash_on_host(&out_hash) :
+            tpm2_hash_file(context, ctx.halg, ctx.hierarchy_value,
+                ctx.input_file, &out_hash, &validation);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -128,6 +158,9 @@ static bool on_option(char key, char *value) {
     case 0:
         ctx.hex = true;
         break;
+    case 1:
+        ctx.host_digest = true;
+        break;
     }
 
     return true;
@@ -141,13 +174,14 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         {"output",         required_argument, NULL, 'o'},
         {"ticket",         required_argument, NULL, 't'},
         {"hex",            no_argument,       NULL,  0 },
+        {"host-digest",    no_argument,       NULL,  1 },
     };
 
     /* set up non-static defaults here */
     ctx.input_file = stdin;
 
     *opts = tpm2_options_new("C:g:o:t:", ARRAY_LEN(topts), topts, on_option,
-            on_args, 0);
+            on_args, TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
@@ -156,6 +190,17 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *context, tpm2_option_flags flags) {
 
     UNUSED(flags);
 
+    if (ctx.host_digest && ctx.output_ticket_path) {
+        LOG_ERR("No ticket can be produced with --host-digest");
+        return tool_rc_option_error;
+    }
+
+    if (!context && !ctx.host_digest) {
+        LOG_ERR("Hashing with the TPM requires a TCTI, use --host-digest"
+                " to hash without one");
+        return tool_rc_option_error;
+    }
+
     return hash_and_save(context);
 }
 
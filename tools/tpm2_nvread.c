@@ -1,6 +1,9 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "files.h"
 #include "tpm2_tool.h"
@@ -16,6 +19,8 @@ struct tpm_nvread_ctx {
     } auth_hierarchy;
 
     TPM2_HANDLE nv_index;
+    TPML_HANDLE indices;
+    bool all;
 
     UINT32 size_to_read;
     UINT32 offset;
@@ -61,10 +66,121 @@ out:
     return rc;
 }
 
+/*
+ * Reads several indices with one TPM connection. Indices sharing the
+ * hierarchy given with -C share its authorization, otherwise each index
+ * authorizes its own read. The data of each index is printed as a YAML
+ * map entry, or saved to the output path suffixed with the index.
+ */
+static tool_rc nv_read_one_of_many(ESYS_CONTEXT *ectx,
+        tpm2_option_flags flags, TPM2_HANDLE nv_index,
+        tpm2_loaded_object *object) {
+
+    UINT8 *data_buffer = NULL;
+    UINT16 bytes_written = 0;
+    tool_rc rc = tpm2_util_nv_read(ectx, nv_index, 0, 0, object, &data_buffer,
+            &bytes_written, NULL);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    if (ctx.output_file) {
+        char path[PATH_MAX];
+        int len = snprintf(path, sizeof(path), "%s.0x%x", ctx.output_file,
+                nv_index);
+        if (len < 0 || (size_t) len >= sizeof(path)) {
+            LOG_ERR("Output path for NV index 0x%x is too long", nv_index);
+            rc = tool_rc_general_error;
+        } else if (!files_save_bytes_to_file(path, data_buffer,
+                bytes_written)) {
+            rc = tool_rc_general_error;
+        }
+    } else if (!flags.quiet) {
+        tpm2_tool_output("0x%x: ", nv_index);
+        tpm2_util_hexdump(data_buffer, bytes_written);
+        tpm2_tool_output("\n");
+    }
+
+    free(data_buffer);
+
+    return rc;
+}
+
+static tool_rc nv_read_many(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    if (ctx.size_to_read || ctx.offset || ctx.cp_hash_path) {
+        LOG_ERR("--size, --offset and --cphash only apply to a single index");
+        return tool_rc_option_error;
+    }
+
+    tool_rc rc;
+    if (ctx.all) {
+        rc = tpm2_util_nv_list(ectx, &ctx.indices);
+        if (rc != tool_rc_success) {
+            return rc;
+        }
+    }
+
+    bool shared_auth = ctx.auth_hierarchy.ctx_path != NULL;
+    if (shared_auth) {
+        rc = tpm2_util_object_load_auth(ectx, ctx.auth_hierarchy.ctx_path,
+                ctx.auth_hierarchy.auth_str, &ctx.auth_hierarchy.object, false,
+                TPM2_HANDLE_FLAGS_NV | TPM2_HANDLE_FLAGS_O
+                        | TPM2_HANDLE_FLAGS_P);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Invalid handle authorization");
+            return rc;
+        }
+    }
+
+    UINT32 i;
+    for (i = 0; i < ctx.indices.count; i++) {
+        TPM2_HANDLE nv_index = ctx.indices.handle[i];
+
+        tpm2_loaded_object index_object = { 0 };
+        tpm2_loaded_object *object = &ctx.auth_hierarchy.object;
+        if (!shared_auth) {
+            char index_str[sizeof("0x") + 2 * sizeof(nv_index)];
+            snprintf(index_str, sizeof(index_str), "0x%x", nv_index);
+            rc = tpm2_util_object_load_auth(ectx, index_str,
+                    ctx.auth_hierarchy.auth_str, &index_object, false,
+                    TPM2_HANDLE_FLAGS_NV);
+            if (rc != tool_rc_success) {
+                LOG_ERR("Invalid handle authorization for NV index 0x%x",
+                        nv_index);
+                return rc;
+            }
+            object = &index_object;
+        }
+
+        rc = nv_read_one_of_many(ectx, flags, nv_index, object);
+
+        if (!shared_auth) {
+            tool_rc tmp_rc = tpm2_session_close(&index_object.session);
+            if (rc == tool_rc_success) {
+                rc = tmp_rc;
+            }
+        }
+
+        if (rc != tool_rc_success) {
+            if (!ctx.all) {
+                return rc;
+            }
+            LOG_WARN("Skipping unreadable NV index 0x%x", nv_index);
+        }
+    }
+
+    return tool_rc_success;
+}
+
 static bool on_arg(int argc, char **argv) {
     /* If the user doesn't specify an authorization hierarchy use the index
      * passed to -x/--index for the authorization index.
      */
+    if (argc > 1 || !strcmp(argv[0], "all")) {
+        return on_arg_nv_indices(argc, argv, &ctx.indices, &ctx.all);
+    }
+
     if (!ctx.auth_hierarchy.ctx_path) {
         ctx.auth_hierarchy.ctx_path = argv[0];
     }
@@ -127,7 +243,9 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
 
 static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
 
-    UNUSED(flags);
+    if (ctx.indices.count || ctx.all) {
+        return nv_read_many(ectx, flags);
+    }
 
     tool_rc rc = tpm2_util_object_load_auth(ectx, ctx.auth_hierarchy.ctx_path,
             ctx.auth_hierarchy.auth_str, &ctx.auth_hierarchy.object, false,
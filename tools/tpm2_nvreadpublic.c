@@ -9,19 +9,13 @@
 
 typedef struct tpm2_nvreadpublic_ctx tpm2_nvreadpublic_ctx;
 struct tpm2_nvreadpublic_ctx {
-    TPMI_RH_NV_INDEX nv_index;
+    TPML_HANDLE indices;
 };
 
 static tpm2_nvreadpublic_ctx ctx;
 
-static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TPM2B_NV_PUBLIC *nv_public) {
-
-    ESYS_TR tr_handle = ESYS_TR_NONE;
-    tool_rc rc = tpm2_tr_from_tpm_public(context, index,
-            &tr_handle);
-    if (rc != tool_rc_success) {
-        return rc;
-    }
+static tool_rc print_nv_public(TPMI_RH_NV_INDEX index,
+        TPM2B_NV_PUBLIC *nv_public, TPM2B_NAME *name) {
 
     tpm2_tool_output("0x%x:\n", index);
 
@@ -37,14 +31,6 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
         LOG_ERR("Could not convert algorithm to string form");
     }
 
-    TPM2B_NAME *name = NULL;
-    rc = tpm2_tr_get_name(context, tr_handle,
-            &name);
-    if (rc != tool_rc_success) {
-        free(attrs);
-        return rc;
-    }
-
     tpm2_tool_output("  name: ");
     UINT16 i;
     for (i = 0; i < name->size; i++) {
@@ -52,8 +38,6 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
     }
     tpm2_tool_output("\n");
 
-    Esys_Free(name);
-
     tpm2_tool_output("  hash algorithm:\n");
     tpm2_tool_output("    friendly: %s\n", alg);
     tpm2_tool_output("    value: 0x%X\n", nv_public->nvPublic.nameAlg);
@@ -80,53 +64,66 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
     return tool_rc_success;
 }
 
-static tool_rc nv_readpublic(ESYS_CONTEXT *context) {
+/*
+ * Each index is looked up once, its public area and name then come from a
+ * single NV_ReadPublic.
+ */
+static tool_rc nv_readpublic_one(ESYS_CONTEXT *context,
+        TPMI_RH_NV_INDEX index) {
 
+    ESYS_TR tr_handle = ESYS_TR_NONE;
+    tool_rc rc = tpm2_tr_from_tpm_public(context, index, &tr_handle);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
 
-    TPMS_CAPABILITY_DATA *capability_data = NULL;
-    if (ctx.nv_index == 0) {
-        tool_rc rc = tpm2_getcap(context, TPM2_CAP_HANDLES, TPM2_HT_NV_INDEX << 24,
-                TPM2_PT_NV_INDEX_MAX, NULL, &capability_data);
-        if (rc != tool_rc_success) {
-            return rc;
-        }
-    } else {
-        capability_data = calloc(1, sizeof(*capability_data));
-        if (!capability_data) {
-            LOG_ERR("oom");
-            return tool_rc_general_error;
-        }
-        capability_data->data.handles.count = 1;
-        capability_data->data.handles.handle[0] = ctx.nv_index;
+    TPM2B_NV_PUBLIC *nv_public = NULL;
+    TPM2B_NAME *name = NULL;
+    rc = tpm2_nv_readpublic(context, tr_handle, &nv_public, &name);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to read the public part of NV index 0x%X", index);
+        goto out;
     }
-    UINT32 i;
-    for (i = 0; i < capability_data->data.handles.count; i++) {
-        TPMI_RH_NV_INDEX index = capability_data->data.handles.handle[i];
 
-        TPM2B_NV_PUBLIC *nv_public;
-        tool_rc rc = tpm2_util_nv_read_public(context, index, &nv_public);
+    rc = print_nv_public(index, nv_public, name);
+    tpm2_tool_output("\n");
+
+out:
+    Esys_Free(nv_public);
+    Esys_Free(name);
+
+    tool_rc tmp_rc = tpm2_close(context, &tr_handle);
+    if (rc == tool_rc_success) {
+        rc = tmp_rc;
+    }
+
+    return rc;
+}
+
+static tool_rc nv_readpublic(ESYS_CONTEXT *context) {
+
+    if (!ctx.indices.count) {
+        tool_rc rc = tpm2_util_nv_list(context, &ctx.indices);
         if (rc != tool_rc_success) {
-            LOG_ERR("Failed to read the public part of NV index 0x%X", index);
-            free(capability_data);
             return rc;
         }
+    }
 
-        rc = print_nv_public(context, index, nv_public);
-        free(nv_public);
-        tpm2_tool_output("\n");
+    UINT32 i;
+    for (i = 0; i < ctx.indices.count; i++) {
+        tool_rc rc = nv_readpublic_one(context, ctx.indices.handle[i]);
         if (rc != tool_rc_success) {
-            free(capability_data);
             return rc;
         }
     }
 
-    free(capability_data);
     return tool_rc_success;
 }
 
 static bool on_arg(int argc, char **argv) {
 
-    return on_arg_nv_index(argc, argv, &ctx.nv_index);
+    bool all;
+    return on_arg_nv_indices(argc, argv, &ctx.indices, &all);
 }
 
 static bool tpm2_tool_onstart(tpm2_options **opts) {
@@ -9,10 +9,12 @@
 
 #include "files.h"
 #include "log.h"
+#include "pcr.h"
 #include "tpm2.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_hierarchy.h"
 #include "tpm2_auth_util.h"
+#include "tpm2_openssl.h"
 #include "tpm2_tool.h"
 
 typedef struct tpm_pcrevent_ctx tpm_pcrevent_ctx;
@@ -23,6 +25,7 @@ struct tpm_pcrevent_ctx {
     } auth;
     ESYS_TR pcr;
     FILE *input;
+    bool host_digest;
 };
 
 static tpm_pcrevent_ctx ctx = {
@@ -118,10 +121,67 @@ static tool_rc tpm_pcrevent_file(ESYS_CONTEXT *ectx,
             ctx.auth.session, &data, result);
 }
 
+/*
+ * Hashes the input on the host for every PCR bank and extends the digests,
+ * instead of streaming the data through a TPM event sequence.
+ */
+static tool_rc tpm_pcrevent_host(ESYS_CONTEXT *ectx,
+        TPML_DIGEST_VALUES **result) {
+
+    TPMS_CAPABILITY_DATA cap_data;
+    tpm2_algorithm algs;
+    tool_rc rc = pcr_get_banks(ectx, &cap_data, &algs);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    TPML_DIGEST_VALUES *digests = calloc(1, sizeof(*digests));
+    if (!digests) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    bool is_extend = ctx.pcr != ESYS_TR_RH_NULL;
+    UINT32 i;
+    for (i = 0; i < cap_data.data.assignedPCR.count; i++) {
+        TPMS_PCR_SELECTION *bank = &cap_data.data.assignedPCR.pcrSelections[i];
+        if (is_extend) {
+            /* only banks with the PCR allocated get extended */
+            if (ctx.pcr / 8 >= bank->sizeofSelect
+                    || !(bank->pcrSelect[ctx.pcr / 8] & (1 << (ctx.pcr % 8)))) {
+                continue;
+            }
+        } else if (!tpm2_openssl_halg_from_tpmhalg(bank->hash)) {
+            continue;
+        }
+
+        digests->digests[digests->count++].hashAlg = bank->hash;
+    }
+
+    bool res = tpm2_openssl_hash_file(ctx.input, digests);
+    if (!res) {
+        free(digests);
+        return tool_rc_general_error;
+    }
+
+    if (is_extend) {
+        rc = tpm2_pcr_extend(ectx, ctx.pcr, ctx.auth.session, digests);
+        if (rc != tool_rc_success) {
+            free(digests);
+            return rc;
+        }
+    }
+
+    *result = digests;
+
+    return tool_rc_success;
+}
+
 static tool_rc do_pcrevent_and_output(ESYS_CONTEXT *ectx) {
 
     TPML_DIGEST_VALUES *digests = NULL;
-    tool_rc rc = tpm_pcrevent_file(ectx, &digests);
+    tool_rc rc = ctx.host_digest ? tpm_pcrevent_host(ectx, &digests) :
+            tpm_pcrevent_file(ectx, &digests);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -237,6 +297,9 @@ static bool on_option(char key, char *value) {
     case 'P':
         ctx.auth.auth_str = value;
         break;
+    case 0:
+        ctx.host_digest = true;
+        break;
         /* no default */
     }
 
@@ -246,7 +309,8 @@ static bool on_option(char key, char *value) {
 static bool tpm2_tool_onstart(tpm2_options **opts) {
 
     static const struct option topts[] = {
-        { "auth",      required_argument, NULL, 'P' },
+        { "auth",        required_argument, NULL, 'P' },
+        { "host-digest", no_argument,       NULL,  0  },
     };
 
     *opts = tpm2_options_new("P:", ARRAY_LEN(topts), topts, on_option, on_arg,
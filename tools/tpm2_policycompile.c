@@ -0,0 +1,547 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "log.h"
+#include "pcr.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_cc_util.h"
+#include "tpm2_policy.h"
+#include "tpm2_tool.h"
+
+/*
+ * A policy description is a list of named policies, each a header line
+ * "<name>: [<output-file>]" followed by one policy command per line:
+ *
+ *   unseal-pcr:
+ *       pcr sha256:0,1,2 pcr.bin
+ *       commandcode TPM2_CC_Unseal
+ *   unseal-admin:
+ *       secret e
+ *       commandcode TPM2_CC_Unseal
+ *   unseal: unseal.policy
+ *       or unseal-pcr unseal-admin
+ *
+ * Every policy is built in turn in a single trial session, on the TPM or
+ * offline, which is restarted between policies. Later policies can refer
+ * to the digests of earlier ones by name.
+ */
+
+#define POLICY_MAX_ARGS 8
+
+typedef struct compiled_policy compiled_policy;
+struct compiled_policy {
+    char *name;
+    TPM2B_DIGEST digest;
+};
+
+typedef struct tpm_policycompile_ctx tpm_policycompile_ctx;
+struct tpm_policycompile_ctx {
+    const char *path;
+    TPMI_ALG_HASH halg;
+    tpm2_session *session;
+
+    /* the policy being built */
+    char *name;
+    char *output_path;
+    unsigned line_no;
+
+    /* the policies built so far */
+    compiled_policy *policies;
+    size_t count;
+    size_t max;
+};
+
+static tpm_policycompile_ctx ctx = {
+    .halg = TPM2_ALG_SHA256,
+};
+
+typedef tool_rc (*policy_cmd_fn)(ESYS_CONTEXT *ectx, int argc, char **argv);
+
+static tool_rc cmd_pcr(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    TPML_PCR_SELECTION pcr_selections = { .count = 0 };
+    bool result = pcr_parse_selections(argv[0], &pcr_selections);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    return tpm2_policy_build_pcr(ectx, ctx.session, argc > 1 ? argv[1] : NULL,
+            &pcr_selections, NULL);
+}
+
+static tool_rc cmd_secret(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    tpm2_loaded_object auth_entity = { 0 };
+    tool_rc rc = tpm2_util_object_load_auth(ectx, argv[0],
+            argc > 1 ? argv[1] : NULL, &auth_entity, false,
+            TPM2_HANDLE_ALL_W_NV);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    rc = tpm2_policy_build_policysecret(ectx, ctx.session, &auth_entity, 0,
+            NULL, NULL, false, NULL, NULL);
+
+    tool_rc tmp_rc = tpm2_session_close(&auth_entity.session);
+    return rc != tool_rc_success ? rc : tmp_rc;
+}
+
+static tool_rc cmd_commandcode(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    UNUSED(argc);
+
+    TPM2_CC command_code;
+    bool result = tpm2_cc_util_from_str(argv[0], &command_code);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    return tpm2_policy_build_policycommandcode(ectx, ctx.session,
+            command_code);
+}
+
+static tool_rc cmd_authorize(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    return tpm2_policy_build_policyauthorize(ectx, ctx.session, NULL,
+            argc > 1 ? argv[1] : NULL, argv[0], NULL);
+}
+
+static tool_rc cmd_authvalue(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    UNUSED(argc);
+    UNUSED(argv);
+
+    return tpm2_policy_build_policyauthvalue(ectx, ctx.session);
+}
+
+static tool_rc cmd_password(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    UNUSED(argc);
+    UNUSED(argv);
+
+    return tpm2_policy_build_policypassword(ectx, ctx.session);
+}
+
+static tool_rc cmd_locality(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    UNUSED(argc);
+
+    static const char *names[] = { "zero", "one", "two", "three", "four" };
+
+    TPMA_LOCALITY locality = 0;
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(names); i++) {
+        if (!strcmp(argv[0], names[i])) {
+            locality = 1 << i;
+            break;
+        }
+    }
+
+    if (i == ARRAY_LEN(names)
+            && !tpm2_util_string_to_uint8(argv[0], &locality)) {
+        LOG_ERR("Could not convert locality to number, got: \"%s\"", argv[0]);
+        return tool_rc_general_error;
+    }
+
+    return tpm2_policy_build_policylocality(ectx, ctx.session, locality);
+}
+
+static tool_rc cmd_nvwritten(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    UNUSED(argc);
+
+    TPMI_YES_NO written_set;
+    if (!strcmp(argv[0], "s") || !strcmp(argv[0], "1")) {
+        written_set = TPM2_YES;
+    } else if (!strcmp(argv[0], "c") || !strcmp(argv[0], "0")) {
+        written_set = TPM2_NO;
+    } else {
+        LOG_ERR("Please use 0|1|s|c as the NV written state, got: \"%s\"",
+                argv[0]);
+        return tool_rc_general_error;
+    }
+
+    return tpm2_policy_build_policynvwritten(ectx, ctx.session, written_set);
+}
+
+static const compiled_policy *find_policy(const char *name) {
+
+    size_t i;
+    for (i = 0; i < ctx.count; i++) {
+        if (!strcmp(ctx.policies[i].name, name)) {
+            return &ctx.policies[i];
+        }
+    }
+
+    return NULL;
+}
+
+static tool_rc cmd_or(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    TPML_DIGEST policy_list = { .count = 0 };
+
+    int i;
+    for (i = 0; i < argc; i++) {
+        TPM2B_DIGEST *d = &policy_list.digests[policy_list.count++];
+
+        /* a policy built earlier, or else a file with a policy digest */
+        const compiled_policy *p = find_policy(argv[i]);
+        if (p) {
+            *d = p->digest;
+            continue;
+        }
+
+        d->size = sizeof(d->buffer);
+        bool result = files_load_bytes_from_path(argv[i], d->buffer, &d->size);
+        if (!result) {
+            LOG_ERR("\"%s\" is neither a policy defined before nor a policy "
+                    "digest file", argv[i]);
+            return tool_rc_general_error;
+        }
+    }
+
+    return tpm2_policy_build_policyor(ectx, ctx.session, &policy_list);
+}
+
+typedef struct policy_cmd policy_cmd;
+struct policy_cmd {
+    const char *name;
+    int min_args;
+    int max_args;
+    policy_cmd_fn fn;
+};
+
+static const policy_cmd policy_cmds[] = {
+    { "pcr",         1, 2, cmd_pcr         },
+    { "secret",      1, 2, cmd_secret      },
+    { "commandcode", 1, 1, cmd_commandcode },
+    { "authorize",   1, 2, cmd_authorize   },
+    { "authvalue",   0, 0, cmd_authvalue   },
+    { "password",    0, 0, cmd_password    },
+    { "locality",    1, 1, cmd_locality    },
+    { "nvwritten",   1, 1, cmd_nvwritten   },
+    { "or",          2, 8, cmd_or          },
+};
+
+static const policy_cmd *find_cmd(const char *name) {
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(policy_cmds); i++) {
+        if (!strcmp(policy_cmds[i].name, name)) {
+            return &policy_cmds[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void print_digest(const char *indent, const char *key,
+        const TPM2B_DIGEST *digest) {
+
+    tpm2_tool_output("%s%s: ", indent, key);
+    tpm2_util_hexdump(digest->buffer, digest->size);
+    tpm2_tool_output("\n");
+}
+
+static tool_rc policy_begin(ESYS_CONTEXT *ectx, const char *name,
+        const char *output_path) {
+
+    if (find_policy(name)) {
+        LOG_ERR("Policy \"%s\" is defined twice", name);
+        return tool_rc_general_error;
+    }
+
+    if (ctx.count == ctx.max) {
+        size_t max = ctx.max ? ctx.max * 2 : 8;
+        compiled_policy *tmp = realloc(ctx.policies, sizeof(*tmp) * max);
+        if (!tmp) {
+            LOG_ERR("oom");
+            return tool_rc_general_error;
+        }
+        ctx.policies = tmp;
+        ctx.max = max;
+    }
+
+    ctx.name = strdup(name);
+    ctx.output_path = output_path ? strdup(output_path) : NULL;
+    if (!ctx.name || (output_path && !ctx.output_path)) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_util_print_yaml_string(name);
+    tpm2_tool_output(":\n");
+    tpm2_tool_output("  steps:\n");
+
+    /* the first policy starts out with the fresh session */
+    return ctx.count ? tpm2_session_restart(ectx, ctx.session) :
+            tool_rc_success;
+}
+
+static tool_rc policy_end(ESYS_CONTEXT *ectx) {
+
+    if (!ctx.name) {
+        return tool_rc_success;
+    }
+
+    TPM2B_DIGEST *digest = NULL;
+    tool_rc rc = tpm2_policy_get_digest(ectx, ctx.session, &digest);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    print_digest("  ", "digest", digest);
+
+    compiled_policy *p = &ctx.policies[ctx.count++];
+    p->name = ctx.name;
+    p->digest = *digest;
+    free(digest);
+
+    ctx.name = NULL;
+
+    if (ctx.output_path) {
+        bool result = files_save_bytes_to_file(ctx.output_path,
+                p->digest.buffer, p->digest.size);
+        free(ctx.output_path);
+        ctx.output_path = NULL;
+        if (!result) {
+            return tool_rc_general_error;
+        }
+    }
+
+    return tool_rc_success;
+}
+
+static tool_rc policy_step(ESYS_CONTEXT *ectx, int argc, char **argv) {
+
+    if (!ctx.name) {
+        LOG_ERR("Policy command \"%s\" is outside of a policy", argv[0]);
+        return tool_rc_general_error;
+    }
+
+    const policy_cmd *cmd = find_cmd(argv[0]);
+    if (!cmd) {
+        LOG_ERR("Unknown policy command \"%s\"", argv[0]);
+        return tool_rc_general_error;
+    }
+
+    argc--;
+    if (argc < cmd->min_args || argc > cmd->max_args) {
+        LOG_ERR("Policy command \"%s\" takes %d to %d arguments, got: %d",
+                cmd->name, cmd->min_args, cmd->max_args, argc);
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = cmd->fn(ectx, argc, &argv[1]);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    TPM2B_DIGEST *digest = NULL;
+    rc = tpm2_policy_get_digest(ectx, ctx.session, &digest);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    print_digest("    - ", cmd->name, digest);
+    free(digest);
+
+    return tool_rc_success;
+}
+
+/*
+ * Splits a line in place on white space, a '#' starting a word comments
+ * out the rest of the line.
+ */
+static bool split_line(char *line, int *argc, char **argv) {
+
+    int count = 0;
+    char *saveptr = NULL;
+    char *word = strtok_r(line, " \t\r\n", &saveptr);
+    while (word && word[0] != '#') {
+        if (count == POLICY_MAX_ARGS + 1) {
+            LOG_ERR("Too many arguments");
+            return false;
+        }
+        argv[count++] = word;
+        word = strtok_r(NULL, " \t\r\n", &saveptr);
+    }
+
+    *argc = count;
+
+    return true;
+}
+
+static tool_rc compile_line(ESYS_CONTEXT *ectx, char *line) {
+
+    int argc;
+    char *argv[POLICY_MAX_ARGS + 1];
+    bool result = split_line(line, &argc, argv);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    if (!argc) {
+        return tool_rc_success;
+    }
+
+    size_t len = strlen(argv[0]);
+    if (argv[0][len - 1] != ':') {
+        return policy_step(ectx, argc, argv);
+    }
+
+    argv[0][len - 1] = '\0';
+    if (!argv[0][0] || argc > 2) {
+        LOG_ERR("Expected a policy header of \"<name>: [<output-file>]\"");
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = policy_end(ectx);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    return policy_begin(ectx, argv[0], argc > 1 ? argv[1] : NULL);
+}
+
+static tool_rc compile(ESYS_CONTEXT *ectx, FILE *f) {
+
+    char *line = NULL;
+    size_t len = 0;
+    tool_rc rc = tool_rc_success;
+    while (getline(&line, &len, f) >= 0) {
+        ctx.line_no++;
+        rc = compile_line(ectx, line);
+        if (rc != tool_rc_success) {
+            LOG_ERR("%s:%u: could not compile the policy",
+                    ctx.path, ctx.line_no);
+            goto out;
+        }
+    }
+
+    if (ferror(f)) {
+        LOG_ERR("Could not read \"%s\", error: %s", ctx.path, strerror(errno));
+        rc = tool_rc_general_error;
+        goto out;
+    }
+
+    if (!ctx.name && !ctx.count) {
+        LOG_ERR("No policy found in \"%s\"", ctx.path);
+        rc = tool_rc_general_error;
+        goto out;
+    }
+
+    rc = policy_end(ectx);
+
+out:
+    free(line);
+    return rc;
+}
+
+static bool on_option(char key, char *value) {
+
+    switch (key) {
+    case 'g':
+        ctx.halg = tpm2_alg_util_from_optarg(value, tpm2_alg_util_flags_hash);
+        if (ctx.halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Invalid choice for policy digest hash algorithm");
+            return false;
+        }
+        break;
+    }
+
+    return true;
+}
+
+static bool on_arg(int argc, char **argv) {
+
+    if (argc != 1) {
+        LOG_ERR("Expected a single policy description file, got: %d", argc);
+        return false;
+    }
+
+    ctx.path = argv[0];
+
+    return true;
+}
+
+static bool tpm2_tool_onstart(tpm2_options **opts) {
+
+    const struct option topts[] = {
+        { "policy-algorithm", required_argument, NULL, 'g' },
+    };
+
+    *opts = tpm2_options_new("g:", ARRAY_LEN(topts), topts, on_option, on_arg,
+            TPM2_OPTIONS_OPTIONAL_SAPI);
+
+    return *opts != NULL;
+}
+
+static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    UNUSED(flags);
+
+    if (!ctx.path) {
+        LOG_ERR("Expected a policy description file or \"-\" for stdin");
+        return tool_rc_option_error;
+    }
+
+    bool is_stdin = !strcmp(ctx.path, "-");
+    FILE *f = is_stdin ? stdin : fopen(ctx.path, "r");
+    if (!f) {
+        LOG_ERR("Could not open policy description \"%s\", error: %s",
+                ctx.path, strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = tool_rc_general_error;
+    tpm2_session_data *session_data = tpm2_session_data_new(TPM2_SE_TRIAL);
+    if (!session_data) {
+        LOG_ERR("oom");
+        goto out;
+    }
+
+    tpm2_session_set_authhash(session_data, ctx.halg);
+
+    rc = ectx ? tpm2_session_open(ectx, session_data, &ctx.session) :
+            tpm2_session_open_offline(session_data, &ctx.session);
+    if (rc != tool_rc_success) {
+        goto out;
+    }
+
+    rc = compile(ectx, f);
+
+out:
+    if (!is_stdin) {
+        fclose(f);
+    }
+
+    return rc;
+}
+
+static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
+
+    UNUSED(ectx);
+
+    return tpm2_session_close(&ctx.session);
+}
+
+static void tpm2_tool_onexit(void) {
+
+    size_t i;
+    for (i = 0; i < ctx.count; i++) {
+        free(ctx.policies[i].name);
+    }
+    free(ctx.policies);
+    free(ctx.name);
+    free(ctx.output_path);
+}
+
+// Register this tool with tpm2_tool.c
+TPM2_TOOL_REGISTER("policycompile", tpm2_tool_onstart, tpm2_tool_onrun,
+        tpm2_tool_onstop, tpm2_tool_onexit)
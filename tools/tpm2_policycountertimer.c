@@ -204,7 +204,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     };
 
     *opts = tpm2_options_new("L:S:", ARRAY_LEN(topts), topts, on_option,
-            on_arg, 0);
+            on_arg, TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
@@ -240,11 +240,9 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
-    ESYS_TR policy_session = tpm2_session_get_handle(ctx.session);
-
     //ESAPI call
-    rc = tpm2_policy_countertimer(ectx, policy_session, &ctx.operand_b,
-        ctx.offset, ctx.operation);
+    rc = tpm2_policy_build_policycountertimer(ectx, ctx.session,
+        &ctx.operand_b, ctx.offset, ctx.operation);
     if (rc != tool_rc_success) {
         return rc;
     }
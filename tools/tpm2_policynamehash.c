@@ -62,7 +62,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     };
 
     *opts = tpm2_options_new("L:S:n:", ARRAY_LEN(topts), topts, on_option, NULL,
-        0);
+        TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
@@ -217,6 +217,12 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
+    /* the NV index name is only known to the TPM */
+    if (tpm2_session_is_offline(ctx.session)) {
+        LOG_ERR("PolicyNV needs a session started on the TPM");
+        return tool_rc_option_error;
+    }
+
     ESYS_TR policy_session_handle = tpm2_session_get_handle(ctx.session);
 
     if (!ctx.cp_hash_path) {
@@ -79,7 +79,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     };
 
     *opts = tpm2_options_new("L:f:l:S:", ARRAY_LEN(topts), topts, on_option,
-    on_arg, 0);
+    on_arg, TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
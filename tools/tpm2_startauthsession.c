@@ -125,7 +125,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     };
 
     *opts = tpm2_options_new("g:S:c:", ARRAY_LEN(topts), topts, on_option,
-    NULL, 0);
+    NULL, TPM2_OPTIONS_OPTIONAL_SAPI);
 
     return *opts != NULL;
 }
@@ -306,6 +306,29 @@ static tool_rc process_input_data(ESYS_CONTEXT *ectx) {
     return setup_session_data();
 }
 
+static tool_rc start_offline_session(void) {
+
+    if (ctx.is_real_policy_session || ctx.is_hmac_session
+            || ctx.session.tpmkey.key_context_arg_str
+            || ctx.session.bind.bind_context_arg_str) {
+        LOG_ERR("Only trial sessions can be started without a TPM");
+        return tool_rc_option_error;
+    }
+
+    tool_rc rc = setup_session_data();
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    tpm2_session *s = NULL;
+    rc = tpm2_session_open_offline(ctx.session_data, &s);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    return tpm2_session_close(&s);
+}
+
 static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
 
     UNUSED(flags);
@@ -316,6 +339,14 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
+    /*
+     * Without a TPM, trial sessions are computed on the host by the policy
+     * tools.
+     */
+    if (!ectx) {
+        return start_offline_session();
+    }
+
     //Process inputs
     rc = process_input_data(ectx);
     if (rc != tool_rc_success) {
@@ -1,20 +1,33 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <openssl/err.h>
 #include <openssl/evp.h>
 
 #include <tss2/tss2_tctildr.h>
 
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
+#include "files.h"
 #include "log.h"
 #include "tpm2_errata.h"
 #include "tpm2_options.h"
+#include "tpm2_session_pool.h"
 #include "tpm2_tool.h"
 #include "tpm2_tool_output.h"
 
@@ -132,6 +145,7 @@ static const tpm2_tool *tpm2_tool_lookup(int *argc, char ***argv)
 static struct tool_context {
     ESYS_CONTEXT *ectx;
     tpm2_options *tool_opts;
+    bool errata_applied;
 } ctx;
 
 static void main_onexit(void) {
@@ -140,53 +154,21 @@ static void main_onexit(void) {
     tpm2_options_free(ctx.tool_opts);
 }
 
-int main(int argc, char **argv) {
-
-    /* get rid of:
-     *   owner execute (1)
-     *   group execute (1)
-     *   other write + read + execute (7)
-     */
-    umask(0117);
-
-    if (!strcmp(argv[0], "tpm2")) {
-        if (argc == 1 || (argc == 2 && (!strcmp(argv[1],"--help") ||
-            !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help=man")))) {
-            char *options[2] = {"tpm2","--help=man"};
-            tpm2_handle_options(2, options, 0, 0, 0);
-            exit(tool_rc_success);
-        }
-
-        if ((argc == 2 && (!strcmp(argv[1],"--version") ||
-        !strcmp(argv[1], "-v") ))) {
-            tpm2_handle_options(argc, argv, 0, 0, 0);
-            exit(tool_rc_success);
-        }
-
-    }
-
-    /* don't buffer stdin/stdout/stderr so pipes work */
-    setvbuf (stdin, NULL, _IONBF, 0);
-    setvbuf (stdout, NULL, _IONBF, 0);
-    setvbuf (stderr, NULL, _IONBF, 0);
-
-    const tpm2_tool * const tool = tpm2_tool_lookup(&argc, &argv);
-    if (!tool) {
-        LOG_ERR("%s: unknown tool. Available tpm2 commands:", argv[0]);
-        for(unsigned i = 0 ; i < tool_count ; i++) {
-            fprintf(stderr, "%s\n", tools[i]->name);
-        }
-        exit(tool_rc_general_error);
-    }
-
-    atexit(main_onexit);
+/*
+ * Drives a tool through its onstart, onrun and onstop life-cycle.
+ *
+ * When is_batch is set, the ESAPI context in ctx.ectx was set up once by
+ * the batch runner and is shared, so no TCTI is loaded here.
+ */
+static tool_rc tool_exec(const tpm2_tool *tool, int argc, char **argv,
+        bool is_batch) {
 
     tool_rc ret = tool_rc_general_error;
     if (tool->onstart) {
         bool res = tool->onstart(&ctx.tool_opts);
         if (!res) {
             LOG_ERR("retrieving tool options");
-            exit(tool_rc_general_error);
+            return tool_rc_general_error;
         }
     }
 
@@ -197,17 +179,21 @@ int main(int argc, char **argv) {
     tpm2_option_flags flags = { .all = 0 };
     TSS2_TCTI_CONTEXT *tcti = NULL;
     tpm2_option_code rc = tpm2_handle_options(argc, argv, ctx.tool_opts, &flags,
-            &tcti);
+            is_batch ? NULL : &tcti);
     if (rc != tpm2_option_code_continue) {
         ret = rc == tpm2_option_code_err ?
                 tool_rc_general_error : tool_rc_success;
-        exit(ret);
+        return ret;
     }
 
     if (flags.verbose) {
         log_set_level(log_level_verbose);
     }
 
+    if (flags.unbuffered) {
+        tpm2_tool_output_unbuffered();
+    }
+
     /*
      * We don't want a cyclic dependency between tools/options. Resolving those
      * works well on linux/elf based systems, but darwin and windows tend to
@@ -222,29 +208,44 @@ int main(int argc, char **argv) {
     if (tcti) {
         ctx.ectx = ctx_init(tcti);
         if (!ctx.ectx) {
-            exit(tool_rc_tcti_error);
+            return tool_rc_tcti_error;
         }
     }
 
-    if (flags.enable_errata) {
-        tpm2_errata_init(ctx.ectx);
+    ESYS_CONTEXT *ectx = ctx.ectx;
+    if (is_batch && ctx.tool_opts
+            && (ctx.tool_opts->flags & TPM2_OPTIONS_NO_SAPI)) {
+        ectx = NULL;
+    }
+
+    /* the shared context of batch mode isn't used by offline commands */
+    if (flags.offline) {
+        ectx = NULL;
+    }
+
+    if (flags.enable_errata && ectx && !ctx.errata_applied) {
+        tpm2_errata_init(ectx);
+        ctx.errata_applied = true;
     }
 
     /*
      * Load the openssl error strings and algorithms
-     * so library routines work as expected.
+     * so library routines work as expected. In batch mode
+     * this was done once before any command was started.
      */
-    OpenSSL_add_all_algorithms();
-    OpenSSL_add_all_ciphers();
-    ERR_load_crypto_strings();
+    if (!is_batch) {
+        OpenSSL_add_all_algorithms();
+        OpenSSL_add_all_ciphers();
+        ERR_load_crypto_strings();
+    }
 
     /*
      * Call the specific tool, all tools implement this function instead of
      * 'main'.
      */
-    ret = tool->onrun(ctx.ectx, flags);
+    ret = tool->onrun(ectx, flags);
     if (tool->onstop) {
-        tool_rc tmp_rc = tool->onstop(ctx.ectx);
+        tool_rc tmp_rc = tool->onstop(ectx);
         /* if onrun() passed, the error code should come from onstop() */
         ret = ret == tool_rc_success ? tmp_rc : ret;
     }
@@ -259,5 +260,1005 @@ int main(int argc, char **argv) {
         LOG_ERR("Unable to run %s", argv[0]);
     }
 
-    exit(ret);
+    return ret;
+}
+
+/*
+ * Batch mode: "tpm2 batch <file|->" runs one tool command line per line of
+ * the input against a single TCTI and ESAPI context, so the TCTI load,
+ * Esys_Initialize(), errata probing and OpenSSL set up are paid once.
+ *
+ * Every command runs in a forked child of the initialized process. Tools
+ * keep their state in file scope statics and rely on atexit() handlers,
+ * the child gets a pristine copy of those for free, while the TCTI
+ * connection and ESAPI context are inherited. Commands are run one at a
+ * time, so the TPM never sees interleaved traffic.
+ */
+static struct {
+    const char *path;
+    bool keep_going;
+    tpm2_options *opts;
+} batch;
+
+static bool batch_on_option(char key, char *value) {
+
+    UNUSED(value);
+
+    switch (key) {
+    case 'k':
+        batch.keep_going = true;
+        break;
+        /* no default */
+    }
+
+    return true;
+}
+
+static bool batch_on_arg(int argc, char **argv) {
+
+    if (argc != 1) {
+        LOG_ERR("Expected a single batch file argument, got: %d", argc);
+        return false;
+    }
+
+    batch.path = argv[0];
+
+    return true;
+}
+
+static void batch_onexit(void) {
+
+    tpm2_options_free(batch.opts);
+}
+
+/*
+ * Splits a line in place into an argv, honoring single and double quotes
+ * and backslash escapes. A '#' starting a word comments out the rest of
+ * the line.
+ */
+static bool batch_split_line(char *line, int *argc, char ***argv) {
+
+    size_t max = 8;
+    char **args = malloc(sizeof(*args) * (max + 1));
+    if (!args) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    int count = 0;
+    char *src = line;
+    char *dst = line;
+    while (true) {
+
+        while (isspace((unsigned char )*src)) {
+            src++;
+        }
+
+        if (*src == '\0' || *src == '#') {
+            break;
+        }
+
+        if ((size_t) count == max) {
+            max *= 2;
+            char **tmp = realloc(args, sizeof(*args) * (max + 1));
+            if (!tmp) {
+                LOG_ERR("oom");
+                free(args);
+                return false;
+            }
+            args = tmp;
+        }
+
+        args[count++] = dst;
+
+        char quote = '\0';
+        while (*src) {
+            if (quote) {
+                if (*src == quote) {
+                    quote = '\0';
+                    src++;
+                    continue;
+                }
+                if (quote == '"' && *src == '\\' && src[1]) {
+                    src++;
+                }
+            } else if (isspace((unsigned char )*src)) {
+                break;
+            } else if (*src == '\'' || *src == '"') {
+                quote = *src++;
+                continue;
+            } else if (*src == '\\' && src[1]) {
+                src++;
+            }
+            *dst++ = *src++;
+        }
+
+        if (quote) {
+            LOG_ERR("Unterminated quote");
+            free(args);
+            return false;
+        }
+
+        /* the terminator may overwrite the separator, so step past it first */
+        if (*src) {
+            src++;
+        }
+        *dst++ = '\0';
+    }
+
+    args[count] = NULL;
+    *argc = count;
+    *argv = args;
+
+    return true;
+}
+
+/*
+ * Batch and server mode stop on SIGINT and SIGTERM once the running command
+ * is done, so the session pool is flushed and removed on the way out. The
+ * handlers are installed without SA_RESTART, so a signal breaks out of the
+ * wait for more input.
+ */
+static volatile sig_atomic_t stop_requested;
+
+/* pooled sessions are expired this often while waiting for input */
+#define WAIT_INPUT_INTERVAL (TPM2_SESSION_POOL_IDLE / 4)
+
+static void on_stop_signal(int sig) {
+
+    UNUSED(sig);
+
+    stop_requested = 1;
+}
+
+static void catch_stop_signals(void) {
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+/*
+ * Waits for fd to become readable, flushing the pooled sessions that went
+ * idle meanwhile. Returns false when a stop was requested or on an error.
+ */
+static bool wait_input(int fd) {
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+    while (!stop_requested) {
+        int n = poll(&pfd, 1, WAIT_INPUT_INTERVAL * 1000);
+        if (n > 0) {
+            return true;
+        }
+
+        if (n < 0 && errno != EINTR) {
+            LOG_ERR("Could not wait for input, error: %s", strerror(errno));
+            return false;
+        }
+
+        tpm2_session_pool_expire(ctx.ectx, TPM2_SESSION_POOL_IDLE);
+    }
+
+    return false;
+}
+
+static tool_rc child_wait(pid_t pid, const char *name) {
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            LOG_ERR("Waiting for \"%s\" failed, error: %s", name,
+                    strerror(errno));
+            return tool_rc_general_error;
+        }
+    }
+
+    if (WIFSIGNALED(status)) {
+        LOG_ERR("%s: terminated by signal %d", name, WTERMSIG(status));
+        return tool_rc_general_error;
+    }
+
+    return WEXITSTATUS(status);
+}
+
+static tool_rc batch_exec_line(int argc, char **argv, bool stdin_is_batch,
+        const char **name) {
+
+    *name = argv[0];
+
+    const tpm2_tool * const tool = tpm2_tool_lookup(&argc, &argv);
+    if (!tool) {
+        LOG_ERR("%s: unknown tool", argv[0]);
+        return tool_rc_general_error;
+    }
+
+    *name = tool->name;
+
+    /* don't hand pending output to the child, it would be written twice */
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERR("Could not fork process for \"%s\", error: %s", tool->name,
+                strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+
+        /* tools reading stdin must not consume the batch input */
+        if (stdin_is_batch && !freopen("/dev/null", "r", stdin)) {
+            _exit(tool_rc_general_error);
+        }
+
+        tool_rc rc = tool_exec(tool, argc, argv, true);
+
+        /*
+         * The TCTI and ESAPI context belong to the batch process, so don't
+         * let main_onexit() finalize them, that would tear down the
+         * connection for the remaining commands.
+         */
+        ctx.ectx = NULL;
+        exit(rc);
+    }
+
+    return child_wait(pid, tool->name);
+}
+
+static tool_rc batch_run(int argc, char **argv) {
+
+    const struct option topts[] = {
+        { "keep-going", no_argument, NULL, 'k' },
+    };
+
+    batch.opts = tpm2_options_new("k", ARRAY_LEN(topts), topts,
+            batch_on_option, batch_on_arg, 0);
+    if (!batch.opts) {
+        return tool_rc_general_error;
+    }
+
+    atexit(batch_onexit);
+
+    tpm2_option_flags flags = { .all = 0 };
+    TSS2_TCTI_CONTEXT *tcti = NULL;
+    tpm2_option_code rc = tpm2_handle_options(argc, argv, batch.opts, &flags,
+            &tcti);
+    if (rc != tpm2_option_code_continue) {
+        return rc == tpm2_option_code_err ?
+                tool_rc_general_error : tool_rc_success;
+    }
+
+    if (!batch.path) {
+        LOG_ERR("Expected a batch file or \"-\" for stdin");
+        return tool_rc_option_error;
+    }
+
+    if (flags.verbose) {
+        log_set_level(log_level_verbose);
+    }
+
+    /* the commands inherit the stdout buffering mode */
+    if (flags.unbuffered) {
+        tpm2_tool_output_unbuffered();
+    }
+
+    bool is_stdin = !strcmp(batch.path, "-");
+    FILE *f = is_stdin ? stdin : fopen(batch.path, "r");
+    if (!f) {
+        LOG_ERR("Could not open batch file \"%s\", error: %s", batch.path,
+                strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    /*
+     * The children share the file offset with us, keep the stream
+     * unbuffered so the position only ever moves line by line here.
+     */
+    setvbuf(f, NULL, _IONBF, 0);
+
+    ctx.ectx = ctx_init(tcti);
+    if (!ctx.ectx) {
+        if (!is_stdin) {
+            fclose(f);
+        }
+        return tool_rc_tcti_error;
+    }
+
+    if (flags.enable_errata) {
+        tpm2_errata_init(ctx.ectx);
+        ctx.errata_applied = true;
+    }
+
+    OpenSSL_add_all_algorithms();
+    OpenSSL_add_all_ciphers();
+    ERR_load_crypto_strings();
+
+    /* the commands hand their HMAC sessions on to the next one */
+    tpm2_session_pool_init();
+
+    catch_stop_signals();
+
+    tool_rc ret = tool_rc_success;
+    char *line = NULL;
+    size_t len = 0;
+    size_t lineno = 0;
+    while (true) {
+        if (!wait_input(fileno(f))) {
+            if (!stop_requested) {
+                ret = tool_rc_general_error;
+            }
+            break;
+        }
+
+        if (getline(&line, &len, f) < 0) {
+            break;
+        }
+
+        lineno++;
+
+        int line_argc = 0;
+        char **line_argv = NULL;
+        bool result = batch_split_line(line, &line_argc, &line_argv);
+        if (!result) {
+            LOG_ERR("%s:%zu: could not parse line", batch.path, lineno);
+            ret = tool_rc_general_error;
+            break;
+        }
+
+        if (!line_argc) {
+            free(line_argv);
+            continue;
+        }
+
+        tpm2_session_pool_expire(ctx.ectx, TPM2_SESSION_POOL_IDLE);
+
+        /* report every command as "<file>:<line>: <tool>: <tool_rc>" */
+        const char *name = NULL;
+        tool_rc tmp_rc = batch_exec_line(line_argc, line_argv, is_stdin,
+                &name);
+        fprintf(stderr, "%s:%zu: %s: %d\n", batch.path, lineno, name, tmp_rc);
+        free(line_argv);
+
+        if (tmp_rc != tool_rc_success) {
+            if (ret == tool_rc_success) {
+                ret = tmp_rc;
+            }
+            if (!batch.keep_going) {
+                break;
+            }
+        }
+    }
+
+    if (stop_requested) {
+        LOG_ERR("%s:%zu: stopped by a signal", batch.path, lineno);
+        if (ret == tool_rc_success) {
+            ret = tool_rc_general_error;
+        }
+    }
+
+    tpm2_session_pool_destroy(ctx.ectx);
+
+    free(line);
+    if (!is_stdin) {
+        fclose(f);
+    }
+
+    return ret;
+}
+
+/*
+ * Server mode: "tpm2 serve <socket>" keeps a single TCTI and ESAPI context
+ * alive and runs tool requests received over a Unix socket. Like batch mode,
+ * each request runs in a forked child, and requests are handled one at a
+ * time in the order they are accepted, so they are serialized onto the TPM.
+ *
+ * When TPM2TOOLS_SERVER names the socket of a running server, the tools
+ * forward their command line to it instead of running locally. Only clients
+ * running as the uid of the server are served.
+ *
+ * A connection starts with a single byte carrying the client's stdin as
+ * SCM_RIGHTS ancillary data, none when the client's stdin is closed. After
+ * that all integers are 32 bit big endian and every string or blob is length
+ * prefixed. A request is:
+ *   version, count, count x (length, bytes)
+ * where the strings are the client's working directory followed by argv. The
+ * response is:
+ *   tool_rc, stdout length, stdout bytes, stderr length, stderr bytes
+ */
+#define TPM2TOOLS_ENV_SERVER "TPM2TOOLS_SERVER"
+
+#define SERVE_PROTOCOL_VERSION 2
+#define SERVE_MAX_STRINGS 1024
+#define SERVE_MAX_STRING_LEN (64 * 1024)
+
+static struct {
+    const char *path;
+    int listen_fd;
+    tpm2_options *opts;
+} serve = {
+    .listen_fd = -1,
+};
+
+static bool serve_on_arg(int argc, char **argv) {
+
+    if (argc != 1) {
+        LOG_ERR("Expected a single socket path argument, got: %d", argc);
+        return false;
+    }
+
+    serve.path = argv[0];
+
+    return true;
+}
+
+static void serve_onexit(void) {
+
+    tpm2_options_free(serve.opts);
+}
+
+static bool serve_read_fd(int fd, UINT8 **data, UINT32 *len) {
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < 0 || size > UINT32_MAX || lseek(fd, 0, SEEK_SET) < 0) {
+        LOG_ERR("Could not size captured output, error: %s", strerror(errno));
+        return false;
+    }
+
+    *data = malloc(size ? size : 1);
+    if (!*data) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    FILE *f = fdopen(dup(fd), "r");
+    if (!f) {
+        LOG_ERR("Could not read captured output, error: %s", strerror(errno));
+        free(*data);
+        return false;
+    }
+
+    bool result = size ? files_read_bytes(f, *data, size) : true;
+    fclose(f);
+    if (!result) {
+        free(*data);
+        return false;
+    }
+
+    *len = size;
+
+    return true;
+}
+
+static bool serve_send_stdin(int fd) {
+
+    char byte = 0;
+    struct iovec iov = { .iov_base = &byte, .iov_len = sizeof(byte) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    if (fcntl(STDIN_FILENO, F_GETFD) >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+        int in_fd = STDIN_FILENO;
+        memcpy(CMSG_DATA(cmsg), &in_fd, sizeof(in_fd));
+    }
+
+    return sendmsg(fd, &msg, 0) == sizeof(byte);
+}
+
+/*
+ * Receives the client's stdin, -1 in stdin_fd when the client sent none.
+ */
+static bool serve_recv_stdin(int fd, int *stdin_fd) {
+
+    char byte;
+    struct iovec iov = { .iov_base = &byte, .iov_len = sizeof(byte) };
+
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    *stdin_fd = -1;
+
+    ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg;
+            cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS
+                && cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(stdin_fd, CMSG_DATA(cmsg), sizeof(*stdin_fd));
+        }
+    }
+
+    if (n != sizeof(byte) || (msg.msg_flags & MSG_CTRUNC)) {
+        if (*stdin_fd >= 0) {
+            close(*stdin_fd);
+            *stdin_fd = -1;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static void serve_child(char **strings, UINT32 count, int in_fd, int out_fd,
+        int err_fd) {
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+
+    close(serve.listen_fd);
+
+    if (dup2(out_fd, STDOUT_FILENO) < 0 || dup2(err_fd, STDERR_FILENO) < 0) {
+        _exit(tool_rc_general_error);
+    }
+
+    if (in_fd >= 0 ? dup2(in_fd, STDIN_FILENO) < 0
+            : !freopen("/dev/null", "r", stdin)) {
+        LOG_ERR("Could not redirect stdin, error: %s", strerror(errno));
+        _exit(tool_rc_general_error);
+    }
+
+    if (chdir(strings[0])) {
+        LOG_ERR("Could not change to directory \"%s\", error: %s",
+                strings[0], strerror(errno));
+        _exit(tool_rc_general_error);
+    }
+
+    int argc = count - 1;
+    char **argv = &strings[1];
+    const tpm2_tool * const tool = tpm2_tool_lookup(&argc, &argv);
+    if (!tool) {
+        LOG_ERR("%s: unknown tool", argv[0]);
+        _exit(tool_rc_general_error);
+    }
+
+    tool_rc rc = tool_exec(tool, argc, argv, true);
+
+    /* see batch_exec_line(), the context is owned by the server */
+    ctx.ectx = NULL;
+    exit(rc);
+}
+
+static void serve_one(int fd) {
+
+    UINT8 *blobs[2] = { NULL, NULL };
+    UINT32 blob_lens[2] = { 0, 0 };
+    char **strings = NULL;
+    UINT32 count = 0;
+    UINT32 i;
+
+    int in_fd;
+    if (!serve_recv_stdin(fd, &in_fd)) {
+        LOG_ERR("Malformed request");
+        close(fd);
+        return;
+    }
+
+    FILE *in = fdopen(fd, "r");
+    int out_fd = dup(fd);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+        LOG_ERR("Could not open connection streams, error: %s",
+                strerror(errno));
+        if (in) {
+            fclose(in);
+        } else {
+            close(fd);
+        }
+        if (out_fd >= 0 && !out) {
+            close(out_fd);
+        }
+        if (in_fd >= 0) {
+            close(in_fd);
+        }
+        return;
+    }
+
+    UINT32 version = 0;
+    bool result = files_read_32(in, &version) && files_read_32(in, &count);
+    if (!result || version != SERVE_PROTOCOL_VERSION || count < 2
+            || count > SERVE_MAX_STRINGS) {
+        LOG_ERR("Malformed request");
+        goto out;
+    }
+
+    /* +1 for the NULL terminator of argv */
+    strings = calloc(count + 1, sizeof(*strings));
+    if (!strings) {
+        LOG_ERR("oom");
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        UINT32 len;
+        result = files_read_blob(in, SERVE_MAX_STRING_LEN,
+                (UINT8 **) &strings[i], &len);
+        if (!result) {
+            LOG_ERR("Malformed request");
+            goto out;
+        }
+    }
+
+    FILE *captured[2] = { tmpfile(), tmpfile() };
+    if (!captured[0] || !captured[1]) {
+        LOG_ERR("Could not create output capture files, error: %s",
+                strerror(errno));
+        goto out_captured;
+    }
+
+    /* see batch_exec_line() */
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERR("Could not fork process for \"%s\", error: %s", strings[1],
+                strerror(errno));
+        goto out_captured;
+    }
+
+    if (pid == 0) {
+        fclose(in);
+        fclose(out);
+        serve_child(strings, count, in_fd, fileno(captured[0]),
+                fileno(captured[1]));
+    }
+
+    tool_rc rc = child_wait(pid, strings[1]);
+    LOG_INFO("%s: %d", strings[1], rc);
+
+    for (i = 0; i < ARRAY_LEN(captured); i++) {
+        result = serve_read_fd(fileno(captured[i]), &blobs[i], &blob_lens[i]);
+        if (!result) {
+            goto out_captured;
+        }
+    }
+
+    result = files_write_32(out, rc)
+            && files_write_blob(out, blobs[0], blob_lens[0])
+            && files_write_blob(out, blobs[1], blob_lens[1]);
+    if (!result || fflush(out)) {
+        LOG_ERR("Could not send response for \"%s\"", strings[1]);
+    }
+
+out_captured:
+    for (i = 0; i < ARRAY_LEN(captured); i++) {
+        if (captured[i]) {
+            fclose(captured[i]);
+        }
+        free(blobs[i]);
+    }
+
+out:
+    if (strings) {
+        for (i = 0; i < count; i++) {
+            free(strings[i]);
+        }
+        free(strings);
+    }
+    if (in_fd >= 0) {
+        close(in_fd);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+static tool_rc serve_run(int argc, char **argv) {
+
+    serve.opts = tpm2_options_new(NULL, 0, NULL, NULL, serve_on_arg, 0);
+    if (!serve.opts) {
+        return tool_rc_general_error;
+    }
+
+    atexit(serve_onexit);
+
+    tpm2_option_flags flags = { .all = 0 };
+    TSS2_TCTI_CONTEXT *tcti = NULL;
+    tpm2_option_code rc = tpm2_handle_options(argc, argv, serve.opts, &flags,
+            &tcti);
+    if (rc != tpm2_option_code_continue) {
+        return rc == tpm2_option_code_err ?
+                tool_rc_general_error : tool_rc_success;
+    }
+
+    if (!serve.path) {
+        LOG_ERR("Expected a socket path");
+        return tool_rc_option_error;
+    }
+
+    if (flags.verbose) {
+        log_set_level(log_level_verbose);
+    }
+
+    struct sockaddr_un addr;
+    bool result = files_unix_addr(serve.path, &addr);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    ctx.ectx = ctx_init(tcti);
+    if (!ctx.ectx) {
+        return tool_rc_tcti_error;
+    }
+
+    if (flags.enable_errata) {
+        tpm2_errata_init(ctx.ectx);
+        ctx.errata_applied = true;
+    }
+
+    OpenSSL_add_all_algorithms();
+    OpenSSL_add_all_ciphers();
+    ERR_load_crypto_strings();
+
+    /* see batch_run() */
+    tpm2_session_pool_init();
+
+    /* only ever replace a stale socket, never some other file */
+    struct stat sb;
+    if (!stat(serve.path, &sb) && S_ISSOCK(sb.st_mode)) {
+        unlink(serve.path);
+    }
+
+    /* non blocking, a connection gone by the time it's accepted is skipped */
+    serve.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (serve.listen_fd < 0) {
+        LOG_ERR("Could not create socket, error: %s", strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    if (bind(serve.listen_fd, (struct sockaddr *) &addr, sizeof(addr))
+            || listen(serve.listen_fd, SOMAXCONN)) {
+        LOG_ERR("Could not listen on \"%s\", error: %s", serve.path,
+                strerror(errno));
+        close(serve.listen_fd);
+        return tool_rc_general_error;
+    }
+
+    catch_stop_signals();
+    signal(SIGPIPE, SIG_IGN);
+
+    tool_rc ret = tool_rc_success;
+    while (wait_input(serve.listen_fd)) {
+        int fd = accept(serve.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN
+                    || errno == EWOULDBLOCK) {
+                continue;
+            }
+            LOG_ERR("Could not accept connection, error: %s", strerror(errno));
+            ret = tool_rc_general_error;
+            break;
+        }
+
+        if (!files_unix_peer_is_self(fd)) {
+            close(fd);
+            continue;
+        }
+
+        tpm2_session_pool_expire(ctx.ectx, TPM2_SESSION_POOL_IDLE);
+        serve_one(fd);
+    }
+
+    if (!stop_requested) {
+        ret = tool_rc_general_error;
+    }
+
+    tpm2_session_pool_destroy(ctx.ectx);
+    close(serve.listen_fd);
+    unlink(serve.path);
+
+    return ret;
+}
+
+/*
+ * Forwards the command line to a running server. Returns false when no
+ * server could be reached, so the caller can run the tool locally instead.
+ */
+static bool client_forward(const char *path, int argc, char **argv,
+        tool_rc *rc) {
+
+    /*
+     * a tcti for this invocation only can't be honored by the server and
+     * offline commands don't need it
+     */
+    int i;
+    for (i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "-T", 2) || !strncmp(argv[i], "--tcti", 6)
+                || !strcmp(argv[i], "--offline")) {
+            return false;
+        }
+    }
+
+    struct sockaddr_un addr;
+    bool result = files_unix_addr(path, &addr);
+    if (!result) {
+        return false;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+        LOG_INFO("Server \"%s\" not reachable, running locally", path);
+        close(fd);
+        return false;
+    }
+
+    *rc = tool_rc_general_error;
+
+    if (!serve_send_stdin(fd)) {
+        LOG_ERR("Could not send request to server \"%s\"", path);
+        close(fd);
+        return true;
+    }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        LOG_ERR("Could not get the working directory, error: %s",
+                strerror(errno));
+        close(fd);
+        return true;
+    }
+
+    FILE *in = fdopen(fd, "r");
+    int out_fd = dup(fd);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (!in || !out) {
+        LOG_ERR("Could not open connection streams, error: %s",
+                strerror(errno));
+        if (in) {
+            fclose(in);
+        } else {
+            close(fd);
+        }
+        if (out) {
+            fclose(out);
+        } else if (out_fd >= 0) {
+            close(out_fd);
+        }
+        return true;
+    }
+
+    result = files_write_32(out, SERVE_PROTOCOL_VERSION)
+            && files_write_32(out, argc + 1)
+            && files_write_blob(out, cwd, strlen(cwd));
+    for (i = 0; result && i < argc; i++) {
+        result = files_write_blob(out, argv[i], strlen(argv[i]));
+    }
+
+    if (!result || fflush(out)) {
+        LOG_ERR("Could not send request to server \"%s\"", path);
+        goto out;
+    }
+
+    UINT32 server_rc;
+    UINT8 *blob = NULL;
+    UINT32 len = 0;
+    result = files_read_32(in, &server_rc);
+    FILE *dest[2] = { stdout, stderr };
+    unsigned j;
+    for (j = 0; result && j < ARRAY_LEN(dest); j++) {
+        result = files_read_blob(in, UINT32_MAX - 1, &blob, &len);
+        if (result && len) {
+            result = files_write_bytes(dest[j], blob, len);
+        }
+        free(blob);
+        blob = NULL;
+    }
+
+    if (!result) {
+        LOG_ERR("Could not receive response from server \"%s\"", path);
+        goto out;
+    }
+
+    *rc = server_rc;
+
+out:
+    fclose(in);
+    fclose(out);
+
+    return true;
+}
+
+int main(int argc, char **argv) {
+
+    /* get rid of:
+     *   owner execute (1)
+     *   group execute (1)
+     *   other write + read + execute (7)
+     */
+    umask(0117);
+
+    if (!strcmp(argv[0], "tpm2")) {
+        if (argc == 1 || (argc == 2 && (!strcmp(argv[1],"--help") ||
+            !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help=man")))) {
+            char *options[2] = {"tpm2","--help=man"};
+            tpm2_handle_options(2, options, 0, 0, 0);
+            exit(tool_rc_success);
+        }
+
+        if ((argc == 2 && (!strcmp(argv[1],"--version") ||
+        !strcmp(argv[1], "-v") ))) {
+            tpm2_handle_options(argc, argv, 0, 0, 0);
+            exit(tool_rc_success);
+        }
+
+    }
+
+    /*
+     * Don't buffer stdin/stderr so pipes work. Tools like eventlog and getcap
+     * emit their YAML in many small writes, so stdout is buffered: by line
+     * when a user is watching a terminal, in large blocks otherwise. The
+     * buffer is flushed at exit and before any error or warning is logged,
+     * --unbuffered restores the old behavior.
+     */
+    static char stdout_buf[64 * 1024];
+    setvbuf (stdin, NULL, _IONBF, 0);
+    if (isatty(STDOUT_FILENO)) {
+        setvbuf (stdout, NULL, _IOLBF, 0);
+    } else {
+        setvbuf (stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+    }
+    setvbuf (stderr, NULL, _IONBF, 0);
+
+    atexit(main_onexit);
+
+    if (argc > 1 && !strcmp(tpm2_tool_name(argv[0]), "tpm2")) {
+        if (!strcmp(argv[1], "batch")) {
+            exit(batch_run(argc - 1, &argv[1]));
+        }
+        if (!strcmp(argv[1], "serve")) {
+            exit(serve_run(argc - 1, &argv[1]));
+        }
+    }
+
+    const char *server = tpm2_util_getenv(TPM2TOOLS_ENV_SERVER);
+    if (server && *server) {
+        tool_rc rc;
+        bool forwarded = client_forward(server, argc, argv, &rc);
+        if (forwarded) {
+            exit(rc);
+        }
+    }
+
+    const tpm2_tool * const tool = tpm2_tool_lookup(&argc, &argv);
+    if (!tool) {
+        LOG_ERR("%s: unknown tool. Available tpm2 commands:", argv[0]);
+        for(unsigned i = 0 ; i < tool_count ; i++) {
+            fprintf(stderr, "%s\n", tools[i]->name);
+        }
+        exit(tool_rc_general_error);
+    }
+
+    exit(tool_exec(tool, argc, argv, false));
 }